@@ -55,6 +55,22 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_convertTo
 JNIEXPORT jobjectArray JNICALL Java_com_litongjava_media_NativeMedia_split
   (JNIEnv *, jclass, jstring, jlong);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    splitByDuration
+ * Signature: (Ljava/lang/String;D)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_litongjava_media_NativeMedia_splitByDuration
+  (JNIEnv *, jclass, jstring, jdouble);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    splitParallel
+ * Signature: (Ljava/lang/String;JDI)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_litongjava_media_NativeMedia_splitParallel
+  (JNIEnv *, jclass, jstring, jlong, jdouble, jint);
+
 /*
  * Class:     com_litongjava_media_NativeMedia
  * Method:    supportFormats
@@ -71,6 +87,30 @@ JNIEXPORT jobjectArray JNICALL Java_com_litongjava_media_NativeMedia_supportForm
 JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_splitVideoToHLS
   (JNIEnv *, jclass, jstring, jstring, jstring, jint);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    splitVideoToHLSWithOptions
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ILjava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_splitVideoToHLSWithOptions
+  (JNIEnv *, jclass, jstring, jstring, jstring, jint, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    buildHlsLadder
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ILjava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_buildHlsLadder
+  (JNIEnv *, jclass, jstring, jstring, jstring, jint, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    hlsToMp4
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_hlsToMp4
+  (JNIEnv *, jclass, jstring, jstring);
+
 /*
  * Class:     com_litongjava_media_NativeMedia
  * Method:    initPersistentHls
@@ -79,6 +119,22 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_splitVideoToHLS
 JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHls
   (JNIEnv *, jclass, jstring, jstring, jint, jint);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    initPersistentHlsWithOptions
+ * Signature: (Ljava/lang/String;Ljava/lang/String;IILjava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHlsWithOptions
+  (JNIEnv *, jclass, jstring, jstring, jint, jint, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    resumePersistentHls
+ * Signature: (Ljava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_resumePersistentHls
+  (JNIEnv *, jclass, jstring);
+
 /*
  * Class:     com_litongjava_media_NativeMedia
  * Method:    appendVideoSegmentToHls
@@ -87,6 +143,38 @@ JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHls
 JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_appendVideoSegmentToHls
   (JNIEnv *, jclass, jlong, jstring);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    appendVideoSegmentToHlsAsync
+ * Signature: (JLjava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_appendVideoSegmentToHlsAsync
+  (JNIEnv *, jclass, jlong, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    getCompletedHlsTicket
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_getCompletedHlsTicket
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    getFailedHlsTicket
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_getFailedHlsTicket
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    awaitHlsPlaylistUpdate
+ * Signature: (JJII)I
+ */
+JNIEXPORT jint JNICALL Java_com_litongjava_media_NativeMedia_awaitHlsPlaylistUpdate
+  (JNIEnv *, jclass, jlong, jlong, jint, jint);
+
 /*
  * Class:     com_litongjava_media_NativeMedia
  * Method:    insertSilentSegment
@@ -111,6 +199,14 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_finishPersistent
 JNIEXPORT jboolean JNICALL Java_com_litongjava_media_NativeMedia_merge
   (JNIEnv *, jclass, jobjectArray, jstring);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    mergeWithOptions
+ * Signature: ([Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_litongjava_media_NativeMedia_mergeWithOptions
+  (JNIEnv *, jclass, jobjectArray, jstring, jstring);
+
 /*
  * Class:     com_litongjava_media_NativeMedia
  * Method:    getVideoLength
@@ -135,6 +231,14 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_listHlsSession
 JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_freeHlsSession
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    setHlsSessionIdleTimeout
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_com_litongjava_media_NativeMedia_setHlsSessionIdleTimeout
+  (JNIEnv *, jclass, jint);
+
 /*
  * Class:     com_litongjava_media_NativeMedia
  * Method:    addWatermarkToVideo
@@ -143,6 +247,38 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_freeHlsSession
 JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkToVideo
   (JNIEnv *, jclass, jstring, jstring, jstring, jstring);
 
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    addWatermarkToVideoWithOptions
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkToVideoWithOptions
+  (JNIEnv *, jclass, jstring, jstring, jstring, jstring, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    addWatermarks
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarks
+  (JNIEnv *, jclass, jstring, jobjectArray, jobjectArray, jstring, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    addWatermarkInWindows
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;[DLjava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkInWindows
+  (JNIEnv *, jclass, jstring, jstring, jstring, jstring, jdoubleArray, jstring);
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    extractClip
+ * Signature: (Ljava/lang/String;Ljava/lang/String;DD)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_extractClip
+  (JNIEnv *, jclass, jstring, jstring, jdouble, jdouble);
+
 #ifdef __cplusplus
 }
 #endif
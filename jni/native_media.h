@@ -28,6 +28,41 @@ const char *split_video_to_hls(const char *playlistUrl,
                                const char *tsPattern,
                                int segmentDuration);
 
+/**
+ * 与 split_video_to_hls 相同，但可以通过 options 指定分段格式等选项（"key=value:key=value"），例如：
+ *   "hls_segment_type=fmp4:hls_fmp4_init_filename=init.mp4"
+ *   "hls_flags=single_file"   所有分段写入同一个文件（tsPattern 可不含 %d），播放列表使用 #EXT-X-BYTERANGE
+ * options 为 NULL 时等价于 split_video_to_hls。
+ */
+const char *split_video_to_hls_with_options(const char *playlistUrl,
+                                            const char *inputVideoPath,
+                                            const char *tsPattern,
+                                            int segmentDuration,
+                                            const char *options);
+
+/**
+ * 自适应码率阶梯打包：源视频只解码一次，按档位并行缩放编码，输出对齐的分段与主播放列表
+ * @param inputPath 输入视频路径
+ * @param outputDir 输出目录，每档写入 <outputDir>/<name>/index.m3u8，主播放列表为 <outputDir>/master.m3u8
+ * @param renditions 档位列表 "name:height:kbps,..."，height 为 0 表示纯音频档（kbps 为 AAC 码率）；
+ *                   NULL 或空串使用 "1080p:1080:5000,720p:720:2800,480p:480:1400,audio:0:128"。
+ *                   高于源分辨率的档位会被跳过
+ * @param segmentDuration 分段时长（秒），所有档位在相同时间点强制 IDR
+ * @param options 分段选项，与 split_video_to_hls_with_options 相同，可为 NULL
+ * @return 结果描述字符串
+ */
+const char *build_hls_ladder(const char *inputPath, const char *outputDir, const char *renditions,
+                             int segmentDuration, const char *options);
+
+/**
+ * 把 HLS 媒体播放列表的全部分段重封装为一个 faststart MP4（不解码）
+ * 支持 MPEG-TS 与 fMP4 分段、EXT-X-BYTERANGE 单文件模式；ADTS 封装的 AAC 转换为 MP4 所需的 ASC
+ * @param playlistPath m3u8 文件路径，分段 URI 相对于播放列表所在目录
+ * @param outputPath 输出 MP4 文件路径
+ * @return 结果描述字符串
+ */
+const char *hls_to_mp4(const char *playlistPath, const char *outputPath);
+
 /**
  * 初始化 HLS 持久化会话
  * @param playlistUrl 输出播放列表文件路径（例如 "./data/hls/test/master.m3u8"）
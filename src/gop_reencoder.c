@@ -0,0 +1,234 @@
+// gop_reencoder.c
+#include "gop_reencoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/opt.h>
+#include "h264_bitstream.h"
+
+struct GopReencoder {
+  AVCodecParameters *par;       // 源流编码参数副本
+  AVRational time_base;
+  AVRational frame_rate;
+  int global_header;
+  int splice;                   // 1 表示可与流拷贝的 GOP 拼接
+  int nal_length_size;          // 源码流为长度前缀封装时的长度字节数，0 表示 Annex B
+  int sps_id;                   // 重编码片段使用的 SPS/PPS id（与源不同，避免覆盖源参数集）
+  const AVCodec *enc_codec;
+  AVCodecContext *dec;
+  AVCodecContext *enc;          // 每个重编码片段打开一次，flush 后释放
+  AVFrame *frame;
+  AVPacket *pkt;
+  int64_t dts_shift;            // 当前片段输出数据包的 pts - dts
+  GopFrameCallback frame_cb;    // 编码前处理解码帧，可为 NULL
+  void *frame_opaque;
+};
+
+// 按源流参数打开编码器
+static int open_encoder(GopReencoder *r) {
+  const AVCodecParameters *par = r->par;
+  r->enc = avcodec_alloc_context3(r->enc_codec);
+  if (!r->enc)
+    return AVERROR(ENOMEM);
+  AVCodecContext *enc = r->enc;
+  enc->width = par->width;
+  enc->height = par->height;
+  enc->pix_fmt = par->format >= 0 ? (enum AVPixelFormat) par->format
+                                  : r->enc_codec->pix_fmts ? r->enc_codec->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+  enc->sample_aspect_ratio = par->sample_aspect_ratio;
+  enc->color_range = par->color_range;
+  enc->color_primaries = par->color_primaries;
+  enc->color_trc = par->color_trc;
+  enc->colorspace = par->color_space;
+  enc->chroma_sample_location = par->chroma_location;
+  enc->time_base = r->time_base;
+  if (r->frame_rate.num > 0 && r->frame_rate.den > 0)
+    enc->framerate = r->frame_rate;
+  if (par->profile != FF_PROFILE_UNKNOWN)
+    enc->profile = par->profile;
+  if (par->level != FF_LEVEL_UNKNOWN)
+    enc->level = par->level;
+
+  AVDictionary *opts = NULL;
+  if (r->splice) {
+    // 片段最长一个 GOP：不用 B 帧，dts 只需整体平移即可与流拷贝部分衔接
+    enc->max_b_frames = 0;
+    char params[64] = {0};
+    snprintf(params, sizeof(params), "sps-id=%d:bframes=0", r->sps_id);
+    av_dict_set(&opts, "x264-params", params, 0);
+  } else if (r->global_header) {
+    enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  if (!strcmp(r->enc_codec->name, "libx264")) {
+    av_dict_set(&opts, "preset", "fast", 0);
+    av_dict_set(&opts, "crf", "18", 0);
+    // 源码率已知时限制峰值码率，避免重编码片段明显大于相邻的流拷贝 GOP
+    if (par->bit_rate > 0) {
+      enc->rc_max_rate = par->bit_rate * 3 / 2;
+      enc->rc_buffer_size = (int) FFMIN(par->bit_rate * 2, INT32_MAX);
+    }
+  } else if (par->bit_rate > 0) {
+    enc->bit_rate = par->bit_rate;
+  }
+  int ret = avcodec_open2(enc, r->enc_codec, &opts);
+  av_dict_free(&opts);
+  if (ret < 0)
+    avcodec_free_context(&r->enc);
+  return ret;
+}
+
+int gop_reencoder_open(GopReencoder **out, const AVCodecParameters *par, AVRational time_base,
+                       AVRational frame_rate, int global_header) {
+  *out = NULL;
+  if (par->codec_type != AVMEDIA_TYPE_VIDEO)
+    return AVERROR(EINVAL);
+  GopReencoder *r = (GopReencoder *) calloc(1, sizeof(GopReencoder));
+  if (!r)
+    return AVERROR(ENOMEM);
+  r->time_base = time_base;
+  r->frame_rate = frame_rate;
+  r->global_header = global_header;
+
+  int ret;
+  const AVCodec *dec_codec = avcodec_find_decoder(par->codec_id);
+  if (!dec_codec) {
+    ret = AVERROR_DECODER_NOT_FOUND;
+    goto fail;
+  }
+  if (par->codec_id == AV_CODEC_ID_H264 && (r->enc_codec = avcodec_find_encoder_by_name("libx264"))) {
+    r->splice = 1;
+    r->sps_id = h264_probe_extradata(par, &r->nal_length_size);
+  } else {
+    r->enc_codec = avcodec_find_encoder(par->codec_id);
+  }
+  if (!r->enc_codec) {
+    ret = AVERROR_ENCODER_NOT_FOUND;
+    goto fail;
+  }
+
+  r->par = avcodec_parameters_alloc();
+  r->dec = avcodec_alloc_context3(dec_codec);
+  r->frame = av_frame_alloc();
+  r->pkt = av_packet_alloc();
+  if (!r->par || !r->dec || !r->frame || !r->pkt) {
+    ret = AVERROR(ENOMEM);
+    goto fail;
+  }
+  if ((ret = avcodec_parameters_copy(r->par, par)) < 0 ||
+      (ret = avcodec_parameters_to_context(r->dec, par)) < 0)
+    goto fail;
+  r->dec->pkt_timebase = time_base;
+  r->dec->thread_count = 0;
+  if ((ret = avcodec_open2(r->dec, dec_codec, NULL)) < 0)
+    goto fail;
+
+  *out = r;
+  return 0;
+
+  fail:
+  gop_reencoder_free(&r);
+  return ret;
+}
+
+int gop_reencoder_splice_compatible(const GopReencoder *r) {
+  return r->splice;
+}
+
+void gop_reencoder_set_frame_callback(GopReencoder *r, GopFrameCallback cb, void *opaque) {
+  r->frame_cb = cb;
+  r->frame_opaque = opaque;
+}
+
+int gop_reencoder_parameters(GopReencoder *r, AVCodecParameters *par) {
+  int ret = r->enc ? 0 : open_encoder(r);
+  return ret < 0 ? ret : avcodec_parameters_from_context(par, r->enc);
+}
+
+// 取出编码器输出的数据包并回调（frame 为 NULL 时刷出编码器）
+static int encode_frame(GopReencoder *r, AVFrame *frame, GopPacketCallback cb, void *opaque) {
+  int ret = avcodec_send_frame(r->enc, frame);
+  if (ret < 0)
+    return ret;
+  while ((ret = avcodec_receive_packet(r->enc, r->pkt)) >= 0) {
+    if (r->splice) {
+      if (r->pkt->pts != AV_NOPTS_VALUE)
+        r->pkt->dts = r->pkt->pts - r->dts_shift;
+      if (r->nal_length_size && (ret = h264_annexb_to_length_prefixed(r->pkt, r->nal_length_size)) < 0) {
+        av_packet_unref(r->pkt);
+        return ret;
+      }
+    }
+    ret = cb(opaque, r->pkt);
+    av_packet_unref(r->pkt);
+    if (ret < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 取出解码器输出的帧，落在范围内的送入编码器
+static int drain_decoder(GopReencoder *r, int64_t keep_from, int64_t keep_to, GopPacketCallback cb, void *opaque) {
+  int ret;
+  while ((ret = avcodec_receive_frame(r->dec, r->frame)) >= 0) {
+    int64_t pts = r->frame->best_effort_timestamp;
+    if (pts != AV_NOPTS_VALUE && pts >= keep_from && pts < keep_to) {
+      r->frame->pts = pts;
+      r->frame->pict_type = AV_PICTURE_TYPE_NONE;
+      ret = r->frame_cb ? r->frame_cb(r->frame_opaque, r->frame) : 0;
+      if (ret >= 0 && !r->enc)
+        ret = open_encoder(r);
+      if (ret >= 0)
+        ret = encode_frame(r, r->frame, cb, opaque);
+    }
+    av_frame_unref(r->frame);
+    if (ret < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+int gop_reencoder_encode(GopReencoder *r, AVPacket *const *pkts, int nb_pkts, int64_t keep_from, int64_t keep_to,
+                         GopPacketCallback cb, void *opaque) {
+  if (nb_pkts <= 0)
+    return 0;
+  // 新片段开始时按源关键帧的解码延迟确定 dts 平移量，片段内保持不变
+  if (!r->enc) {
+    const AVPacket *key = pkts[0];
+    r->dts_shift = key->pts != AV_NOPTS_VALUE && key->dts != AV_NOPTS_VALUE && key->pts > key->dts
+                   ? key->pts - key->dts : 0;
+  }
+  int ret = 0;
+  for (int i = 0; i < nb_pkts && ret >= 0; i++) {
+    if (avcodec_send_packet(r->dec, pkts[i]) < 0)
+      continue; // 损坏的数据包跳过
+    ret = drain_decoder(r, keep_from, keep_to, cb, opaque);
+  }
+  // 每个 GOP 独立解码：取出剩余帧后重置解码器
+  if (ret >= 0 && avcodec_send_packet(r->dec, NULL) >= 0)
+    ret = drain_decoder(r, keep_from, keep_to, cb, opaque);
+  avcodec_flush_buffers(r->dec);
+  return ret;
+}
+
+int gop_reencoder_flush(GopReencoder *r, GopPacketCallback cb, void *opaque) {
+  if (!r->enc)
+    return 0;
+  int ret = encode_frame(r, NULL, cb, opaque);
+  avcodec_free_context(&r->enc);
+  return ret;
+}
+
+void gop_reencoder_free(GopReencoder **pr) {
+  GopReencoder *r = *pr;
+  if (!r)
+    return;
+  avcodec_parameters_free(&r->par);
+  avcodec_free_context(&r->dec);
+  avcodec_free_context(&r->enc);
+  av_frame_free(&r->frame);
+  av_packet_free(&r->pkt);
+  free(r);
+  *pr = NULL;
+}
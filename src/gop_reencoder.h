@@ -0,0 +1,64 @@
+#ifndef GOP_REENCODER_H
+#define GOP_REENCODER_H
+
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+/*
+ * 按 GOP 重新编码视频：一次送入一个完整 GOP（从关键帧开始）的数据包，只重新编码落在指定时间范围内的帧
+ *
+ * 用于"智能剪切"：与范围部分相交的 GOP 重新编码，完整落在范围内的 GOP 直接流拷贝。
+ * H.264 使用 libx264 按源流的分辨率、像素格式、profile、level 与色彩参数编码，不使用 B 帧，
+ * 参数集（使用与源不同的 SPS/PPS id）随关键帧写在码流中，并转换为与源相同的 NAL 封装（Annex B 或长度前缀），
+ * 因此重编码的片段可以与流拷贝的 GOP 写入同一路输出流；其他编码只能整路重新编码。
+ */
+
+typedef struct GopReencoder GopReencoder;
+
+// 输出数据包回调：时间戳使用 gop_reencoder_open 时的 time_base，回调结束后数据包会被释放引用
+typedef int (*GopPacketCallback)(void *opaque, AVPacket *pkt);
+
+// 解码帧回调：在帧送入编码器之前调用，可修改帧的像素（先调用 av_frame_make_writable），返回负值时中止编码
+typedef int (*GopFrameCallback)(void *opaque, AVFrame *frame);
+
+/**
+ * @param par 源视频流编码参数
+ * @param time_base 送入数据包与输出数据包所用时间基
+ * @param frame_rate 源视频帧率，未知时填 {0, 1}
+ * @param global_header 输出格式需要全局头（仅在无法与流拷贝拼接、需整路重编码时使用）
+ */
+int gop_reencoder_open(GopReencoder **r, const AVCodecParameters *par, AVRational time_base,
+                       AVRational frame_rate, int global_header);
+
+/**
+ * 重新编码的 GOP 能否与流拷贝的 GOP 在同一路输出流中拼接
+ * 不能拼接时调用方应重新编码整路流，并用 gop_reencoder_parameters 的参数创建输出流
+ */
+int gop_reencoder_splice_compatible(const GopReencoder *r);
+
+/**
+ * 设置解码帧回调（例如在重编码的帧上叠加水印），cb 为 NULL 表示不处理
+ */
+void gop_reencoder_set_frame_callback(GopReencoder *r, GopFrameCallback cb, void *opaque);
+
+/**
+ * 取得编码器输出参数（会打开编码器）
+ */
+int gop_reencoder_parameters(GopReencoder *r, AVCodecParameters *par);
+
+/**
+ * 解码一个 GOP，将显示时间在 [keep_from, keep_to) 内的帧送入编码器，产生的数据包通过 cb 输出
+ * 可拼接模式下输出数据包的 dts 按源关键帧的 pts-dts 差值平移，保证与前后流拷贝的数据包单调衔接
+ */
+int gop_reencoder_encode(GopReencoder *r, AVPacket *const *pkts, int nb_pkts, int64_t keep_from, int64_t keep_to,
+                         GopPacketCallback cb, void *opaque);
+
+/**
+ * 刷出编码器中剩余的数据包；之后再编码时重新打开编码器，从新的 IDR 帧开始
+ * 在重编码片段之后写入流拷贝的 GOP 之前必须调用
+ */
+int gop_reencoder_flush(GopReencoder *r, GopPacketCallback cb, void *opaque);
+
+void gop_reencoder_free(GopReencoder **r);
+
+#endif // GOP_REENCODER_H
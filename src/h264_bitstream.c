@@ -0,0 +1,153 @@
+// h264_bitstream.c
+#include "h264_bitstream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/intreadwrite.h>
+
+// 读取无符号指数哥伦布码（SPS 开头的字段中不会出现防竞争字节）
+static int read_ue(const uint8_t *buf, int size, int *bit) {
+  int zeros = 0;
+  while (*bit < size * 8 && !((buf[*bit >> 3] >> (7 - (*bit & 7))) & 1)) {
+    zeros++;
+    (*bit)++;
+  }
+  if (*bit >= size * 8 || zeros > 16)
+    return -1;
+  (*bit)++;
+  int value = 0;
+  for (int i = 0; i < zeros; i++, (*bit)++) {
+    if (*bit >= size * 8)
+      return -1;
+    value = (value << 1) | ((buf[*bit >> 3] >> (7 - (*bit & 7))) & 1);
+  }
+  return (1 << zeros) - 1 + value;
+}
+
+// 从 SPS 或 PPS NAL（含 NAL 头）中读取参数集 id，记入已使用的 id 集合（只关心 0-31）
+static void mark_ps_id(const uint8_t *nal, int size, uint32_t *used) {
+  int type = size > 0 ? nal[0] & 0x1f : 0;
+  // SPS：NAL 头 + profile_idc + constraint_flags + level_idc 之后是 seq_parameter_set_id；
+  // PPS：NAL 头之后是 pic_parameter_set_id
+  int bit = type == 7 ? 32 : 8;
+  if ((type != 7 && type != 8) || size * 8 <= bit)
+    return;
+  int id = read_ue(nal, size, &bit);
+  if (id >= 0 && id < 32)
+    *used |= 1u << id;
+}
+
+// avcC：numOfSequenceParameterSets 之后依次是各 SPS，随后是 numOfPictureParameterSets 与各 PPS
+static void mark_avcc_ps_ids(const uint8_t *data, int size, uint32_t *used) {
+  int pos = 5;
+  for (int list = 0; list < 2 && pos < size; list++) {
+    int count = list == 0 ? data[pos] & 0x1f : data[pos];
+    pos++;
+    for (int i = 0; i < count && pos + 2 <= size; i++) {
+      int nal_size = AV_RB16(data + pos);
+      pos += 2;
+      if (nal_size > size - pos)
+        return;
+      mark_ps_id(data + pos, nal_size, used);
+      pos += nal_size;
+    }
+  }
+}
+
+int h264_probe_extradata(const AVCodecParameters *par, int *nal_length_size) {
+  const uint8_t *data = par->extradata;
+  int size = par->extradata_size;
+  uint32_t used = 0;
+  *nal_length_size = 0;
+  if (data && size >= 7 && data[0] == 1) {
+    *nal_length_size = (data[4] & 3) + 1;
+    mark_avcc_ps_ids(data, size, &used);
+  } else {
+    for (int i = 0; data && i + 3 < size; i++) {
+      if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+        mark_ps_id(data + i + 3, size - i - 3, &used);
+    }
+  }
+  // 没有 extradata 时源的参数集只在码流内，通常使用 id 0，因此从 1 开始选
+  for (int i = 1; i <= 32; i++) {
+    int id = i % 32;
+    if (!(used & (1u << id)))
+      return id;
+  }
+  return 1;
+}
+
+int h264_codec_string(const uint8_t *data, int size, char *buf, size_t buf_size) {
+  const uint8_t *sps = NULL;
+  if (data && size >= 4 && data[0] == 1) {
+    sps = data + 1; // avcC 头部依次保存 profile_idc、约束标志与 level_idc
+  } else {
+    for (int i = 0; data && i + 6 < size; i++) {
+      if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1 && (data[i + 3] & 0x1f) == 7) {
+        sps = data + i + 4;
+        break;
+      }
+    }
+  }
+  if (!sps)
+    return AVERROR_INVALIDDATA;
+  snprintf(buf, buf_size, "avc1.%02x%02x%02x", sps[0], sps[1], sps[2]);
+  return 0;
+}
+
+// 查找下一个起始码 00 00 01，返回其位置，没有时返回 end
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+  for (; p + 2 < end; p++) {
+    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+      return p;
+  }
+  return end;
+}
+
+int h264_annexb_to_length_prefixed(AVPacket *pkt, int nal_length_size) {
+  const uint8_t *end = pkt->data + pkt->size;
+  const uint8_t *p = find_start_code(pkt->data, end);
+  if (p == end)
+    return 0; // 已经是长度前缀封装
+  int64_t total = 0;
+  for (const uint8_t *nal = p + 3; nal < end;) {
+    const uint8_t *next = find_start_code(nal, end);
+    const uint8_t *nal_end = next;
+    while (nal_end > nal && nal_end[-1] == 0)
+      nal_end--;
+    int64_t nal_size = nal_end - nal;
+    if (nal_length_size < 4 && nal_size >= (1LL << (8 * nal_length_size)))
+      return AVERROR(ERANGE);
+    total += nal_length_size + nal_size;
+    nal = next == end ? end : next + 3;
+  }
+
+  AVPacket *out = av_packet_alloc();
+  if (!out)
+    return AVERROR(ENOMEM);
+  int ret = av_new_packet(out, (int) total);
+  if (ret >= 0)
+    ret = av_packet_copy_props(out, pkt);
+  if (ret < 0) {
+    av_packet_free(&out);
+    return ret;
+  }
+  uint8_t *dst = out->data;
+  for (const uint8_t *nal = p + 3; nal < end;) {
+    const uint8_t *next = find_start_code(nal, end);
+    const uint8_t *nal_end = next;
+    while (nal_end > nal && nal_end[-1] == 0)
+      nal_end--;
+    int nal_size = (int) (nal_end - nal);
+    for (int i = nal_length_size - 1; i >= 0; i--)
+      *dst++ = (uint8_t) (nal_size >> (8 * i));
+    memcpy(dst, nal, nal_size);
+    dst += nal_size;
+    nal = next == end ? end : next + 3;
+  }
+  av_packet_unref(pkt);
+  av_packet_move_ref(pkt, out);
+  av_packet_free(&out);
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef H264_BITSTREAM_H
+#define H264_BITSTREAM_H
+
+#include <libavcodec/avcodec.h>
+
+/*
+ * H.264 码流辅助函数
+ *
+ * 重新编码的片段要与流拷贝的数据写入同一路输出流时，需要知道源参数集的 id（重编码时使用不同的 id，
+ * 避免覆盖源参数集）以及源的 NAL 封装方式（Annex B 或 avcC 长度前缀）。
+ */
+
+/**
+ * 选出源 extradata 中所有 SPS 与 PPS 都没有使用的参数集 id，同时识别 avcC 封装
+ * （x264 的 sps-id 同时用作 PPS id，所以两类 id 都要避开）
+ * @param nal_length_size 输出：avcC 的长度字节数，Annex B 或无 extradata 时为 0
+ * @return 未使用的 id（1-31 优先，其次 0），32 个 id 都被占用时返回 1
+ */
+int h264_probe_extradata(const AVCodecParameters *par, int *nal_length_size);
+
+/**
+ * 将 Annex B 数据包原地转换为长度前缀封装，已是长度前缀封装的数据包保持不变
+ * @return 成功返回 0，NAL 超出长度字段范围时返回 AVERROR(ERANGE)
+ */
+int h264_annexb_to_length_prefixed(AVPacket *pkt, int nal_length_size);
+
+/**
+ * 从第一个 SPS 取得 RFC 6381 编码字符串（avc1.PPCCLL：profile_idc、约束标志、level_idc）
+ * @param data avcC extradata，或包含 SPS 的 Annex B 数据（Annex B extradata 或关键帧数据包）
+ * @return 成功返回 0，没有找到 SPS 时返回 AVERROR_INVALIDDATA
+ */
+int h264_codec_string(const uint8_t *data, int size, char *buf, size_t buf_size);
+
+#endif // H264_BITSTREAM_H
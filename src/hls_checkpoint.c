@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/avstring.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "hls_checkpoint.h"
+
+#define HLS_CHECKPOINT_VERSION 1
+
+static void write_hex(FILE *file, const uint8_t *data, int size) {
+  for (int i = 0; i < size; i++)
+    fprintf(file, "%02x", data[i]);
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static int read_hex(AVCodecParameters *par, const char *hex) {
+  size_t len = strlen(hex);
+  if (len % 2)
+    return AVERROR_INVALIDDATA;
+  av_freep(&par->extradata);
+  par->extradata_size = 0;
+  if (len == 0)
+    return 0;
+  par->extradata = av_mallocz(len / 2 + AV_INPUT_BUFFER_PADDING_SIZE);
+  if (!par->extradata)
+    return AVERROR(ENOMEM);
+  for (size_t i = 0; i < len / 2; i++) {
+    int hi = hex_value(hex[2 * i]), lo = hex_value(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0)
+      return AVERROR_INVALIDDATA;
+    par->extradata[i] = (uint8_t) ((hi << 4) | lo);
+  }
+  par->extradata_size = (int) (len / 2);
+  return 0;
+}
+
+static void write_stream(FILE *file, int i, const AVCodecParameters *par, AVRational tb) {
+  fprintf(file, "stream.%d.time_base=%d/%d\n", i, tb.num, tb.den);
+  fprintf(file, "stream.%d.codec_type=%d\n", i, (int) par->codec_type);
+  fprintf(file, "stream.%d.codec_id=%d\n", i, (int) par->codec_id);
+  fprintf(file, "stream.%d.format=%d\n", i, par->format);
+  fprintf(file, "stream.%d.bit_rate=%lld\n", i, (long long) par->bit_rate);
+  fprintf(file, "stream.%d.profile=%d\n", i, par->profile);
+  fprintf(file, "stream.%d.level=%d\n", i, par->level);
+  if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+    fprintf(file, "stream.%d.width=%d\n", i, par->width);
+    fprintf(file, "stream.%d.height=%d\n", i, par->height);
+    fprintf(file, "stream.%d.sample_aspect_ratio=%d/%d\n", i,
+            par->sample_aspect_ratio.num, par->sample_aspect_ratio.den);
+    fprintf(file, "stream.%d.video_delay=%d\n", i, par->video_delay);
+  } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+    fprintf(file, "stream.%d.sample_rate=%d\n", i, par->sample_rate);
+    fprintf(file, "stream.%d.channels=%d\n", i, par->ch_layout.nb_channels);
+    fprintf(file, "stream.%d.channel_mask=%llu\n", i,
+            par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? (unsigned long long) par->ch_layout.u.mask : 0ULL);
+    fprintf(file, "stream.%d.frame_size=%d\n", i, par->frame_size);
+    fprintf(file, "stream.%d.initial_padding=%d\n", i, par->initial_padding);
+  }
+  fprintf(file, "stream.%d.extradata=", i);
+  write_hex(file, par->extradata, par->extradata_size);
+  fprintf(file, "\n");
+}
+
+int hls_checkpoint_write(const char *path, const HlsCheckpoint *ck) {
+  char tmp_path[1100] = {0};
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+  FILE *file = hls_fopen(tmp_path, "wb");
+  if (!file)
+    return AVERROR(errno ? errno : EIO);
+
+  fprintf(file, "version=%d\n", HLS_CHECKPOINT_VERSION);
+  fprintf(file, "playlist=%s\n", ck->playlist);
+  fprintf(file, "segment_pattern=%s\n", ck->segment_pattern);
+  fprintf(file, "options=%s\n", ck->options);
+  fprintf(file, "segment_duration=%.6f\n", ck->segment_duration);
+  fprintf(file, "next_number=%lld\n", (long long) ck->next_number);
+  fprintf(file, "timeline_end=%lld\n", (long long) ck->timeline_end);
+  fprintf(file, "committed_ticket=%lld\n", (long long) ck->committed_ticket);
+  fprintf(file, "committed_offset=%lld\n", (long long) ck->committed_offset);
+  fprintf(file, "last_segment_uri=%s\n", ck->last_segment_uri);
+  fprintf(file, "last_segment_duration=%.6f\n", ck->last_segment_duration);
+  fprintf(file, "last_segment_offset=%lld\n", (long long) ck->last_segment_offset);
+  fprintf(file, "last_segment_length=%lld\n", (long long) ck->last_segment_length);
+  fprintf(file, "video_frame_rate=%d/%d\n", ck->video_frame_rate.num, ck->video_frame_rate.den);
+  fprintf(file, "nb_streams=%d\n", ck->nb_streams);
+  for (int i = 0; i < ck->nb_streams; i++)
+    write_stream(file, i, ck->par[i], ck->time_base[i]);
+
+  int failed = fflush(file) != 0 || ferror(file);
+  failed |= fclose(file) != 0;
+  if (failed) {
+    remove(tmp_path);
+    return AVERROR(EIO);
+  }
+  return hls_replace_file(tmp_path, path);
+}
+
+static AVRational parse_rational(const char *value) {
+  AVRational r = {0, 1};
+  if (sscanf(value, "%d/%d", &r.num, &r.den) != 2 || r.den == 0)
+    r = (AVRational) {0, 1};
+  return r;
+}
+
+static int parse_stream_field(HlsCheckpoint *ck, const char *key, const char *value) {
+  char *field = NULL;
+  long i = strtol(key, &field, 10);
+  if (field == key || *field != '.' || i < 0 || i >= HLS_WRITER_MAX_STREAMS)
+    return AVERROR_INVALIDDATA;
+  field++;
+  if (!ck->par[i]) {
+    ck->par[i] = avcodec_parameters_alloc();
+    if (!ck->par[i])
+      return AVERROR(ENOMEM);
+  }
+  AVCodecParameters *par = ck->par[i];
+
+  if (!strcmp(field, "time_base")) {
+    ck->time_base[i] = parse_rational(value);
+  } else if (!strcmp(field, "codec_type")) {
+    par->codec_type = (enum AVMediaType) atoi(value);
+  } else if (!strcmp(field, "codec_id")) {
+    par->codec_id = (enum AVCodecID) atoi(value);
+  } else if (!strcmp(field, "format")) {
+    par->format = atoi(value);
+  } else if (!strcmp(field, "bit_rate")) {
+    par->bit_rate = strtoll(value, NULL, 10);
+  } else if (!strcmp(field, "profile")) {
+    par->profile = atoi(value);
+  } else if (!strcmp(field, "level")) {
+    par->level = atoi(value);
+  } else if (!strcmp(field, "width")) {
+    par->width = atoi(value);
+  } else if (!strcmp(field, "height")) {
+    par->height = atoi(value);
+  } else if (!strcmp(field, "sample_aspect_ratio")) {
+    par->sample_aspect_ratio = parse_rational(value);
+  } else if (!strcmp(field, "video_delay")) {
+    par->video_delay = atoi(value);
+  } else if (!strcmp(field, "sample_rate")) {
+    par->sample_rate = atoi(value);
+  } else if (!strcmp(field, "channels")) {
+    int channels = atoi(value);
+    if (par->ch_layout.nb_channels != channels) {
+      av_channel_layout_uninit(&par->ch_layout);
+      av_channel_layout_default(&par->ch_layout, channels);
+    }
+  } else if (!strcmp(field, "channel_mask")) {
+    uint64_t mask = strtoull(value, NULL, 10);
+    if (mask) {
+      av_channel_layout_uninit(&par->ch_layout);
+      av_channel_layout_from_mask(&par->ch_layout, mask);
+    }
+  } else if (!strcmp(field, "frame_size")) {
+    par->frame_size = atoi(value);
+  } else if (!strcmp(field, "initial_padding")) {
+    par->initial_padding = atoi(value);
+  } else if (!strcmp(field, "extradata")) {
+    return read_hex(par, value);
+  }
+  return 0;
+}
+
+int hls_checkpoint_read(const char *path, HlsCheckpoint *ck) {
+  memset(ck, 0, sizeof(HlsCheckpoint));
+  ck->last_segment_offset = -1;
+  ck->video_frame_rate = (AVRational) {0, 1};
+  FILE *file = hls_fopen(path, "rb");
+  if (!file)
+    return AVERROR(ENOENT);
+
+  // extradata 以十六进制保存在一行内，行长度按需增长
+  size_t cap = 4096;
+  char *line = av_malloc(cap);
+  int ret = line ? 0 : AVERROR(ENOMEM);
+  int version = 0;
+  while (ret >= 0 && fgets(line, (int) cap, file)) {
+    size_t len = strlen(line);
+    while (len == cap - 1 && line[len - 1] != '\n') {
+      char *grown = av_realloc(line, cap * 2);
+      if (!grown) {
+        ret = AVERROR(ENOMEM);
+        break;
+      }
+      line = grown;
+      if (!fgets(line + len, (int) (cap * 2 - len), file))
+        break;
+      cap *= 2;
+      len = strlen(line);
+    }
+    if (ret < 0)
+      break;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      line[--len] = '\0';
+
+    char *eq = strchr(line, '=');
+    if (!eq)
+      continue;
+    *eq = '\0';
+    const char *key = line, *value = eq + 1, *rest = NULL;
+
+    if (!strcmp(key, "version")) {
+      version = atoi(value);
+    } else if (!strcmp(key, "playlist")) {
+      av_strlcpy(ck->playlist, value, sizeof(ck->playlist));
+    } else if (!strcmp(key, "segment_pattern")) {
+      av_strlcpy(ck->segment_pattern, value, sizeof(ck->segment_pattern));
+    } else if (!strcmp(key, "options")) {
+      av_strlcpy(ck->options, value, sizeof(ck->options));
+    } else if (!strcmp(key, "segment_duration")) {
+      ck->segment_duration = atof(value);
+    } else if (!strcmp(key, "next_number")) {
+      ck->next_number = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "timeline_end")) {
+      ck->timeline_end = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "committed_ticket")) {
+      ck->committed_ticket = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "committed_offset")) {
+      ck->committed_offset = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "last_segment_uri")) {
+      av_strlcpy(ck->last_segment_uri, value, sizeof(ck->last_segment_uri));
+    } else if (!strcmp(key, "last_segment_duration")) {
+      ck->last_segment_duration = atof(value);
+    } else if (!strcmp(key, "last_segment_offset")) {
+      ck->last_segment_offset = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "last_segment_length")) {
+      ck->last_segment_length = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "video_frame_rate")) {
+      ck->video_frame_rate = parse_rational(value);
+    } else if (!strcmp(key, "nb_streams")) {
+      ck->nb_streams = atoi(value);
+    } else if (av_strstart(key, "stream.", &rest)) {
+      ret = parse_stream_field(ck, rest, value);
+    }
+  }
+  av_free(line);
+  fclose(file);
+
+  if (ret >= 0 && (version != HLS_CHECKPOINT_VERSION || !ck->playlist[0] || !ck->segment_pattern[0] ||
+                   ck->nb_streams <= 0 || ck->nb_streams > HLS_WRITER_MAX_STREAMS))
+    ret = AVERROR_INVALIDDATA;
+  for (int i = 0; ret >= 0 && i < ck->nb_streams; i++) {
+    if (!ck->par[i] || ck->time_base[i].num <= 0)
+      ret = AVERROR_INVALIDDATA;
+  }
+  if (ret < 0)
+    hls_checkpoint_uninit(ck);
+  return ret;
+}
+
+void hls_checkpoint_uninit(HlsCheckpoint *ck) {
+  for (int i = 0; i < HLS_WRITER_MAX_STREAMS; i++)
+    avcodec_parameters_free(&ck->par[i]);
+  ck->nb_streams = 0;
+}
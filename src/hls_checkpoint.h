@@ -0,0 +1,47 @@
+#ifndef HLS_CHECKPOINT_H
+#define HLS_CHECKPOINT_H
+
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include "hls_writer.h"
+
+/*
+ * 持久 HLS 会话的检查点
+ *
+ * 每完成一个分段写一次（key=value 文本，临时文件 + 原子替换），记录恢复会话所需的最小状态：
+ * 下一个分段编号、已落盘内容的结束时间、已完整落盘的追加任务数及其对应的时间偏移，
+ * 视频帧率，以及重建复用器所需的各路流编码参数。
+ */
+
+typedef struct HlsCheckpoint {
+  char playlist[1024];            // 播放列表路径
+  char segment_pattern[1024];     // 分段文件命名模板
+  char options[512];              // 写入器选项字符串（见 HlsWriterOptions），为空表示默认
+  double segment_duration;        // 目标分段时长（秒）
+  int64_t next_number;            // 下一个（尚未完成的）分段编号
+  int64_t timeline_end;           // 已完成分段的结束时间（AV_TIME_BASE）
+  int64_t committed_ticket;       // 内容已全部落在已完成分段中的最大任务票据
+  int64_t committed_offset;       // 上述任务完成后的全局时间偏移（AV_TIME_BASE）
+  char last_segment_uri[1024];    // 最后完成的分段 URI（用于补齐播放列表）
+  double last_segment_duration;   // 最后完成的分段时长
+  int64_t last_segment_offset;    // 单文件模式下最后分段的字节偏移，-1 表示独立文件
+  int64_t last_segment_length;    // 单文件模式下最后分段的字节长度
+  AVRational video_frame_rate;    // 会话视频帧率（用于编码静音片段），未知时为 {0, 1}
+  int nb_streams;
+  AVCodecParameters *par[HLS_WRITER_MAX_STREAMS];
+  AVRational time_base[HLS_WRITER_MAX_STREAMS];
+} HlsCheckpoint;
+
+/**
+ * 原子写入检查点文件
+ */
+int hls_checkpoint_write(const char *path, const HlsCheckpoint *ck);
+
+/**
+ * 读取检查点文件，成功后需调用 hls_checkpoint_uninit 释放编码参数
+ */
+int hls_checkpoint_read(const char *path, HlsCheckpoint *ck);
+
+void hls_checkpoint_uninit(HlsCheckpoint *ck);
+
+#endif // HLS_CHECKPOINT_H
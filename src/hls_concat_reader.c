@@ -0,0 +1,203 @@
+// hls_concat_reader.c
+#include "hls_concat_reader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "hls_playlist.h"
+#include "native_queue.h"
+#include "native_thread.h"
+
+#define HLS_CONCAT_IO_BUFFER_SIZE (64 * 1024)
+
+#ifdef _WIN32
+#define hls_fseek64 _fseeki64
+#else
+#define hls_fseek64 fseeko
+#endif
+
+typedef struct HlsConcatChunk {
+  int size;
+  uint8_t data[];
+} HlsConcatChunk;
+
+struct HlsConcatReader {
+  HlsConcatPiece *pieces;       // 路径已复制
+  int nb_pieces;
+  int chunk_size;
+  NativeQueue *chunks;          // 已读入、等待解复用的块
+  native_thread_t thread;
+  int thread_started;
+  volatile uint32_t error;      // 读取失败时的错误码（取负值），0 表示正常
+  volatile uint32_t skipped;    // 无法打开而跳过的分段数
+  HlsConcatChunk *current;      // 正在被消费的块
+  int pos;
+  AVIOContext *avio;
+};
+
+/*
+ * 读取一个分段并按块放入队列，队列关闭（调用方提前结束）时返回 AVERROR_EXIT
+ * 无法打开或定位时还没有放入任何数据，返回 AVERROR(EAGAIN) 表示跳过该分段
+ */
+static int read_piece(HlsConcatReader *r, const HlsConcatPiece *piece) {
+  FILE *file = hls_fopen(piece->path, "rb");
+  if (!file)
+    return AVERROR(EAGAIN);
+  if (piece->offset > 0 && hls_fseek64(file, piece->offset, SEEK_SET) != 0) {
+    fclose(file);
+    return AVERROR(EAGAIN);
+  }
+  int ret = 0;
+  int64_t remaining = piece->length;
+  while (remaining != 0) {
+    int want = remaining > 0 && remaining < r->chunk_size ? (int) remaining : r->chunk_size;
+    HlsConcatChunk *chunk = (HlsConcatChunk *) malloc(sizeof(HlsConcatChunk) + want);
+    if (!chunk) {
+      ret = AVERROR(ENOMEM);
+      break;
+    }
+    chunk->size = (int) fread(chunk->data, 1, want, file);
+    if (chunk->size <= 0) {
+      free(chunk);
+      // 读取出错，或指定了长度却提前到达文件末尾
+      if (ferror(file))
+        ret = AVERROR(EIO);
+      else if (remaining > 0)
+        ret = AVERROR_INVALIDDATA;
+      break;
+    }
+    if (remaining > 0)
+      remaining -= chunk->size;
+    if (native_queue_push(r->chunks, chunk) < 0) {
+      free(chunk);
+      ret = AVERROR_EXIT;
+      break;
+    }
+  }
+  fclose(file);
+  return ret;
+}
+
+static void *reader_thread(void *arg) {
+  HlsConcatReader *r = (HlsConcatReader *) arg;
+  for (int i = 0; i < r->nb_pieces; i++) {
+    int ret = read_piece(r, &r->pieces[i]);
+    if (ret == AVERROR_EXIT)
+      break;
+    if (ret == AVERROR(EAGAIN)) {
+      native_atomic_add_u32(&r->skipped, 1);
+      continue;
+    }
+    if (ret < 0) {
+      native_atomic_store_u32(&r->error, (uint32_t) -ret);
+      break;
+    }
+  }
+  native_queue_close(r->chunks);
+  return NULL;
+}
+
+static int read_concat_data(void *opaque, uint8_t *buf, int buf_size) {
+  HlsConcatReader *r = (HlsConcatReader *) opaque;
+  int copied = 0;
+  while (copied < buf_size) {
+    if (!r->current || r->pos == r->current->size) {
+      free(r->current);
+      r->current = NULL;
+      r->pos = 0;
+      // 已有数据时先返回，不为凑满缓冲区等待下一块
+      if (copied > 0 && native_queue_size(r->chunks) == 0)
+        break;
+      void *item = NULL;
+      if (!native_queue_pop(r->chunks, &item))
+        break;
+      r->current = (HlsConcatChunk *) item;
+    }
+    int n = FFMIN(buf_size - copied, r->current->size - r->pos);
+    memcpy(buf + copied, r->current->data + r->pos, n);
+    r->pos += n;
+    copied += n;
+  }
+  if (copied > 0)
+    return copied;
+  uint32_t error = native_atomic_load_u32(&r->error);
+  return error ? -(int) error : AVERROR_EOF;
+}
+
+int hls_concat_reader_open(HlsConcatReader **out, const HlsConcatPiece *pieces, int nb_pieces, int chunk_size,
+                           int depth) {
+  *out = NULL;
+  HlsConcatReader *r = (HlsConcatReader *) calloc(1, sizeof(HlsConcatReader));
+  if (!r)
+    return AVERROR(ENOMEM);
+  r->chunk_size = chunk_size > 0 ? chunk_size : HLS_CONCAT_IO_BUFFER_SIZE;
+  r->pieces = (HlsConcatPiece *) calloc(nb_pieces > 0 ? nb_pieces : 1, sizeof(HlsConcatPiece));
+  r->chunks = native_queue_alloc(depth > 0 ? depth : 1);
+  if (!r->pieces || !r->chunks)
+    goto fail;
+  for (int i = 0; i < nb_pieces; i++) {
+    r->pieces[i] = pieces[i];
+    r->pieces[i].path = strdup(pieces[i].path);
+    r->nb_pieces++;
+    if (!r->pieces[i].path)
+      goto fail;
+  }
+
+  unsigned char *buffer = av_malloc(HLS_CONCAT_IO_BUFFER_SIZE);
+  if (!buffer)
+    goto fail;
+  r->avio = avio_alloc_context(buffer, HLS_CONCAT_IO_BUFFER_SIZE, 0, r, read_concat_data, NULL, NULL);
+  if (!r->avio) {
+    av_free(buffer);
+    goto fail;
+  }
+  r->avio->seekable = 0;
+
+  if (native_thread_create(&r->thread, reader_thread, r) < 0) {
+    hls_concat_reader_free(&r);
+    return AVERROR(EAGAIN);
+  }
+  r->thread_started = 1;
+  *out = r;
+  return 0;
+
+  fail:
+  hls_concat_reader_free(&r);
+  return AVERROR(ENOMEM);
+}
+
+AVIOContext *hls_concat_reader_avio(HlsConcatReader *r) {
+  return r->avio;
+}
+
+int hls_concat_reader_skipped(HlsConcatReader *r) {
+  return (int) native_atomic_load_u32(&r->skipped);
+}
+
+void hls_concat_reader_free(HlsConcatReader **pr) {
+  HlsConcatReader *r = *pr;
+  if (!r)
+    return;
+  if (r->chunks) {
+    native_queue_close(r->chunks);
+    if (r->thread_started)
+      native_thread_join(r->thread);
+    void *item = NULL;
+    while (native_queue_pop(r->chunks, &item))
+      free(item);
+    native_queue_free(&r->chunks);
+  }
+  free(r->current);
+  if (r->avio) {
+    av_freep(&r->avio->buffer);
+    avio_context_free(&r->avio);
+  }
+  for (int i = 0; i < r->nb_pieces; i++)
+    free((char *) r->pieces[i].path);
+  free(r->pieces);
+  free(r);
+  *pr = NULL;
+}
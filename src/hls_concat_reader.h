@@ -0,0 +1,44 @@
+#ifndef HLS_CONCAT_READER_H
+#define HLS_CONCAT_READER_H
+
+#include <stdint.h>
+#include <libavformat/avio.h>
+
+/*
+ * 分段顺序读取器
+ *
+ * 把若干文件（或文件中的字节范围）首尾相接成一个只读、不可定位的 AVIOContext，
+ * 由后台线程按顺序以大块读取并放入有界队列，解复用线程处理当前数据时后续分段已在读入内存。
+ * 无法打开的分段整段跳过并计数，其余分段照常读取。
+ */
+
+typedef struct HlsConcatPiece {
+  const char *path;             // 文件路径（UTF-8）
+  int64_t offset;               // 起始字节偏移
+  int64_t length;               // 字节数，-1 表示读到文件末尾
+} HlsConcatPiece;
+
+typedef struct HlsConcatReader HlsConcatReader;
+
+/**
+ * @param chunk_size 每次读取的块大小（字节）
+ * @param depth 最多预读的块数
+ * @return 成功返回 0，失败返回负错误码
+ */
+int hls_concat_reader_open(HlsConcatReader **r, const HlsConcatPiece *pieces, int nb_pieces, int chunk_size,
+                           int depth);
+
+/**
+ * 取得读取用的 AVIOContext（由读取器持有，随 hls_concat_reader_free 释放）
+ */
+AVIOContext *hls_concat_reader_avio(HlsConcatReader *r);
+
+/**
+ * 无法打开（或定位到起始偏移）而被跳过的分段数，读取到结尾后有效
+ * 已读入部分数据后出错的分段不会被跳过，错误由 AVIOContext 的读取返回
+ */
+int hls_concat_reader_skipped(HlsConcatReader *r);
+
+void hls_concat_reader_free(HlsConcatReader **r);
+
+#endif // HLS_CONCAT_READER_H
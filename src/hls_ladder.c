@@ -0,0 +1,857 @@
+// hls_ladder.c
+//
+// 自适应码率（ABR）阶梯打包：源视频只解码一次，解码后的帧以引用计数的方式分发给每一档的编码线程，
+// 每一档在自己的线程中缩放、编码并通过 HlsWriter 分段；音频只处理一次（AAC 直接复制，其他编码转码一次），
+// 数据包同样分发给每一档。所有档位在相同的时间点强制 IDR，因此分段边界对齐，最后生成主播放列表。
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+#include "native_media.h"
+#include "h264_bitstream.h"
+#include "hls_writer.h"
+#include "native_queue.h"
+#include "native_thread.h"
+
+#define LADDER_MAX_RENDITIONS 8
+#define LADDER_QUEUE_CAPACITY 8  // 每一档最多缓存的待编码帧/包数量，超过后解码线程等待
+#define LADDER_DEFAULT_RENDITIONS "1080p:1080:5000,720p:720:2800,480p:480:1400,audio:0:128"
+#define LADDER_DEFAULT_AUDIO_KBPS 128
+
+// 分发给编码线程的数据：视频帧或音频数据包（二者只有一个非 NULL）
+typedef struct LadderItem {
+  AVFrame *frame;
+  AVPacket *pkt;
+} LadderItem;
+
+typedef struct LadderRendition {
+  char name[64];                // 档位名称，同时作为子目录名
+  int height;                   // 输出高度，0 表示纯音频档
+  int width;
+  int64_t bit_rate;             // 视频码率（bps）
+  char level[8];                // H.264 level，例如 "3.1"
+  int level_idc;
+  char video_codecs[16];        // 主播放列表 CODECS 中的视频部分，取自编码器实际输出的 SPS
+  char playlist[1100];          // <outputDir>/<name>/index.m3u8
+  HlsWriter writer;
+  int writer_opened;
+  int video_index;              // 写入器中的视频流序号，-1 表示无
+  int audio_index;              // 写入器中的音频流序号，-1 表示无
+
+  AVFilterGraph *graph;         // buffer -> scale -> format -> buffersink
+  AVFilterContext *src_ctx;
+  AVFilterContext *sink_ctx;
+  AVCodecContext *enc;
+  AVFrame *filt_frame;
+  AVPacket *enc_pkt;
+  int64_t next_key;             // 下一个强制 IDR 的时间（源视频流时间基），AV_NOPTS_VALUE 表示尚未开始
+  int64_t key_interval;         // 强制 IDR 的间隔（源视频流时间基）
+
+  NativeQueue *queue;
+  native_thread_t thread;
+  int thread_started;
+  int result;                   // 编码线程的结果，失败后继续取出并丢弃剩余数据，避免解码线程阻塞
+
+  // 实测码率：由分段完成回调统计，用于主播放列表的 BANDWIDTH / AVERAGE-BANDWIDTH
+  int64_t segment_bytes_start;
+  int64_t peak_bandwidth;
+  int64_t total_bytes;
+  double total_duration;
+} LadderRendition;
+
+typedef struct LadderContext {
+  AVFormatContext *ifmt_ctx;
+  int video_stream;
+  int audio_stream;
+  AVCodecContext *video_dec;
+  AVRational frame_rate;
+  double segment_duration;
+
+  // 音频：AAC 直接复制，其他编码统一转码为 AAC 一次
+  AVCodecParameters *audio_par; // 写入各档的音频编码参数
+  AVRational audio_time_base;   // 分发的音频数据包所用时间基
+  int64_t audio_bit_rate;
+  AVCodecContext *audio_dec;
+  AVCodecContext *audio_enc;
+  SwrContext *swr;
+  AVAudioFifo *fifo;
+  int64_t audio_next_pts;       // 下一个编码帧的时间戳（编码器时间基）
+  char audio_codecs[16];        // 主播放列表 CODECS 中的音频部分
+  int playlist_version;         // 各档播放列表的最高 #EXT-X-VERSION，主播放列表沿用
+
+  LadderRendition renditions[LADDER_MAX_RENDITIONS];
+  int nb_renditions;
+} LadderContext;
+
+static void print_error(const char *msg, int errnum) {
+  char errbuf[128] = {0};
+  av_strerror(errnum, errbuf, sizeof(errbuf));
+  fprintf(stderr, "%s: %s\n", msg, errbuf);
+}
+
+static void free_ladder_item(LadderItem *item) {
+  av_frame_free(&item->frame);
+  av_packet_free(&item->pkt);
+  free(item);
+}
+
+/*
+ * 解析档位描述 "name:height:kbps,name:height:kbps"，height 为 0 表示纯音频档（kbps 为音频码率）
+ */
+static int parse_renditions(LadderContext *ctx, const char *spec) {
+  char buf[1024] = {0};
+  snprintf(buf, sizeof(buf), "%s", spec && spec[0] ? spec : LADDER_DEFAULT_RENDITIONS);
+  char *save = NULL;
+  for (char *item = av_strtok(buf, ",", &save); item; item = av_strtok(NULL, ",", &save)) {
+    char name[64] = {0};
+    int height = 0, kbps = 0;
+    if (sscanf(item, " %63[^:]:%d:%d", name, &height, &kbps) != 3 || height < 0 || kbps <= 0 ||
+        strchr(name, '/') || strchr(name, '\\') || !strcmp(name, ".") || !strcmp(name, ".."))
+      return AVERROR(EINVAL);
+    if (ctx->nb_renditions >= LADDER_MAX_RENDITIONS)
+      return AVERROR(EINVAL);
+    LadderRendition *r = &ctx->renditions[ctx->nb_renditions++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->height = height;
+    r->bit_rate = (int64_t) kbps * 1000;
+  }
+  return ctx->nb_renditions > 0 ? 0 : AVERROR(EINVAL);
+}
+
+/*
+ * 按源视频裁剪档位：不放大（高于源分辨率的档位被跳过，全部跳过时保留一档源分辨率），
+ * 没有视频时只保留纯音频档，没有音频时去掉纯音频档
+ */
+static void select_renditions(LadderContext *ctx) {
+  int src_height = ctx->video_dec ? ctx->video_dec->height : 0;
+  int kept = 0, video_kept = 0;
+  int64_t fallback_rate = 0;
+  for (int i = 0; i < ctx->nb_renditions; i++) {
+    LadderRendition r = ctx->renditions[i];
+    if (r.height == 0) {
+      if (ctx->audio_stream < 0)
+        continue;
+      ctx->audio_bit_rate = r.bit_rate;
+    } else {
+      if (!ctx->video_dec)
+        continue;
+      if (!fallback_rate || r.bit_rate < fallback_rate)
+        fallback_rate = r.bit_rate;
+      if (r.height > src_height)
+        continue;
+      video_kept++;
+    }
+    ctx->renditions[kept++] = r;
+  }
+  if (ctx->video_dec && !video_kept && fallback_rate && kept < LADDER_MAX_RENDITIONS) {
+    memmove(&ctx->renditions[1], &ctx->renditions[0], kept * sizeof(LadderRendition));
+    memset(&ctx->renditions[0], 0, sizeof(LadderRendition));
+    snprintf(ctx->renditions[0].name, sizeof(ctx->renditions[0].name), "%dp", src_height);
+    ctx->renditions[0].height = src_height;
+    ctx->renditions[0].bit_rate = fallback_rate;
+    kept++;
+  }
+  ctx->nb_renditions = kept;
+}
+
+// 按宏块吞吐量与帧大小选取能容纳该分辨率/帧率的最低 H.264 level
+static void choose_h264_level(LadderRendition *r, AVRational frame_rate) {
+  static const struct {
+    const char *name;
+    int idc;
+    int64_t max_fs;
+    int64_t max_mbps;
+  } levels[] = {
+    {"3.0", 30, 1620, 40500}, {"3.1", 31, 3600, 108000}, {"3.2", 32, 5120, 216000},
+    {"4.0", 40, 8192, 245760}, {"4.2", 42, 8704, 522240}, {"5.1", 51, 36864, 983040},
+    {"5.2", 52, 36864, 2073600},
+  };
+  int64_t frame_mbs = (int64_t) ((r->width + 15) / 16) * ((r->height + 15) / 16);
+  double fps = frame_rate.num > 0 && frame_rate.den > 0 ? av_q2d(frame_rate) : 30;
+  int i = 0;
+  while (i < (int) FF_ARRAY_ELEMS(levels) - 1 &&
+         (frame_mbs > levels[i].max_fs || frame_mbs * fps > levels[i].max_mbps))
+    i++;
+  snprintf(r->level, sizeof(r->level), "%s", levels[i].name);
+  r->level_idc = levels[i].idc;
+}
+
+// 分段完成回调：统计该档每个分段的码率
+static int on_ladder_segment(HlsWriter *writer, int64_t segment_end, void *opaque) {
+  LadderRendition *r = (LadderRendition *) opaque;
+  const HlsPlaylistEntry *last = &writer->playlist.entries[writer->playlist.nb_entries - 1];
+  int64_t bytes = writer->bytes_written - r->segment_bytes_start;
+  r->segment_bytes_start = writer->bytes_written;
+  r->total_bytes += bytes;
+  r->total_duration += last->duration;
+  if (last->duration > 0) {
+    int64_t bandwidth = (int64_t) (bytes * 8 / last->duration);
+    if (bandwidth > r->peak_bandwidth)
+      r->peak_bandwidth = bandwidth;
+  }
+  return 0;
+}
+
+// 为视频档创建缩放滤镜图：buffer -> scale -> format=yuv420p -> buffersink
+static int open_scaler(LadderContext *ctx, LadderRendition *r) {
+  AVStream *in_stream = ctx->ifmt_ctx->streams[ctx->video_stream];
+  AVCodecContext *dec = ctx->video_dec;
+  AVFilterInOut *outputs = NULL, *inputs = NULL;
+  int ret;
+
+  r->graph = avfilter_graph_alloc();
+  if (!r->graph)
+    return AVERROR(ENOMEM);
+  // 各档已经在独立线程中并行，滤镜内部不再开线程
+  r->graph->nb_threads = 1;
+
+  char args[512] = {0};
+  snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+           dec->width, dec->height, dec->pix_fmt, in_stream->time_base.num, in_stream->time_base.den,
+           dec->sample_aspect_ratio.num, dec->sample_aspect_ratio.den ? dec->sample_aspect_ratio.den : 1);
+  ret = avfilter_graph_create_filter(&r->src_ctx, avfilter_get_by_name("buffer"), "in", args, NULL, r->graph);
+  if (ret < 0)
+    return ret;
+  ret = avfilter_graph_create_filter(&r->sink_ctx, avfilter_get_by_name("buffersink"), "out", NULL, NULL, r->graph);
+  if (ret < 0)
+    return ret;
+
+  outputs = avfilter_inout_alloc();
+  inputs = avfilter_inout_alloc();
+  if (!outputs || !inputs) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  outputs->name = av_strdup("in");
+  outputs->filter_ctx = r->src_ctx;
+  outputs->pad_idx = 0;
+  outputs->next = NULL;
+  inputs->name = av_strdup("out");
+  inputs->filter_ctx = r->sink_ctx;
+  inputs->pad_idx = 0;
+  inputs->next = NULL;
+
+  char filter_descr[128] = {0};
+  snprintf(filter_descr, sizeof(filter_descr), "scale=%d:%d:flags=bicubic,format=yuv420p", r->width, r->height);
+  ret = avfilter_graph_parse_ptr(r->graph, filter_descr, &inputs, &outputs, NULL);
+  if (ret >= 0)
+    ret = avfilter_graph_config(r->graph, NULL);
+
+  end:
+  avfilter_inout_free(&inputs);
+  avfilter_inout_free(&outputs);
+  return ret;
+}
+
+/*
+ * 打开视频档的 H.264 编码器
+ * IDR 只在对齐的时间点强制插入（关闭场景切换检测与开放 GOP），使各档分段边界一致
+ */
+static int open_video_encoder(LadderContext *ctx, LadderRendition *r) {
+  AVStream *in_stream = ctx->ifmt_ctx->streams[ctx->video_stream];
+  const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+  int is_x264 = codec != NULL;
+  if (!codec)
+    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+  if (!codec)
+    return AVERROR_ENCODER_NOT_FOUND;
+  r->enc = avcodec_alloc_context3(codec);
+  if (!r->enc)
+    return AVERROR(ENOMEM);
+
+  AVCodecContext *enc = r->enc;
+  enc->width = r->width;
+  enc->height = r->height;
+  enc->sample_aspect_ratio = ctx->video_dec->sample_aspect_ratio;
+  enc->pix_fmt = AV_PIX_FMT_YUV420P;
+  enc->time_base = in_stream->time_base;
+  enc->framerate = ctx->frame_rate;
+  enc->bit_rate = r->bit_rate;
+  enc->rc_max_rate = r->bit_rate * 107 / 100;
+  enc->rc_buffer_size = (int) (r->bit_rate * 3 / 2);
+  enc->gop_size = (int) (ctx->segment_duration * av_q2d(ctx->frame_rate) + 0.5);
+  enc->keyint_min = enc->gop_size;
+  enc->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+  if (r->writer.mux->oformat->flags & AVFMT_GLOBALHEADER)
+    enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+  AVDictionary *opts = NULL;
+  if (is_x264) {
+    av_dict_set(&opts, "preset", "veryfast", 0);
+    av_dict_set(&opts, "profile", "high", 0);
+    av_dict_set(&opts, "level", r->level, 0);
+    av_dict_set(&opts, "forced-idr", "1", 0);
+    av_dict_set(&opts, "x264-params", "scenecut=0:open-gop=0", 0);
+  }
+  int ret = avcodec_open2(enc, codec, &opts);
+  av_dict_free(&opts);
+  return ret;
+}
+
+/*
+ * 打开音频处理：AAC 直接复制，其他编码解码后重采样并转码为 AAC
+ * global_header 表示分段格式需要全局头（fMP4）
+ */
+static int open_audio(LadderContext *ctx, int global_header) {
+  AVStream *in_stream = ctx->ifmt_ctx->streams[ctx->audio_stream];
+  AVCodecParameters *in_par = in_stream->codecpar;
+  ctx->audio_par = avcodec_parameters_alloc();
+  if (!ctx->audio_par)
+    return AVERROR(ENOMEM);
+
+  if (in_par->codec_id == AV_CODEC_ID_AAC) {
+    ctx->audio_time_base = in_stream->time_base;
+    snprintf(ctx->audio_codecs, sizeof(ctx->audio_codecs), "mp4a.40.%d",
+             in_par->profile == FF_PROFILE_AAC_HE ? 5 : in_par->profile == FF_PROFILE_AAC_HE_V2 ? 29 : 2);
+    return avcodec_parameters_copy(ctx->audio_par, in_par);
+  }
+
+  const AVCodec *dec_codec = avcodec_find_decoder(in_par->codec_id);
+  const AVCodec *enc_codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+  if (!dec_codec)
+    return AVERROR_DECODER_NOT_FOUND;
+  if (!enc_codec)
+    return AVERROR_ENCODER_NOT_FOUND;
+  ctx->audio_dec = avcodec_alloc_context3(dec_codec);
+  ctx->audio_enc = avcodec_alloc_context3(enc_codec);
+  if (!ctx->audio_dec || !ctx->audio_enc)
+    return AVERROR(ENOMEM);
+  int ret = avcodec_parameters_to_context(ctx->audio_dec, in_par);
+  if (ret < 0 || (ret = avcodec_open2(ctx->audio_dec, dec_codec, NULL)) < 0)
+    return ret;
+
+  AVCodecContext *enc = ctx->audio_enc;
+  enc->sample_rate = ctx->audio_dec->sample_rate;
+  enc->sample_fmt = enc_codec->sample_fmts ? enc_codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+  if ((ret = av_channel_layout_copy(&enc->ch_layout, &ctx->audio_dec->ch_layout)) < 0)
+    return ret;
+  enc->bit_rate = ctx->audio_bit_rate > 0 ? ctx->audio_bit_rate : LADDER_DEFAULT_AUDIO_KBPS * 1000;
+  enc->time_base = (AVRational) {1, enc->sample_rate};
+  if (global_header)
+    enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  if ((ret = avcodec_open2(enc, enc_codec, NULL)) < 0)
+    return ret;
+
+  ret = swr_alloc_set_opts2(&ctx->swr, &enc->ch_layout, enc->sample_fmt, enc->sample_rate,
+                            &ctx->audio_dec->ch_layout, ctx->audio_dec->sample_fmt, ctx->audio_dec->sample_rate,
+                            0, NULL);
+  if (ret < 0 || (ret = swr_init(ctx->swr)) < 0)
+    return ret;
+  ctx->fifo = av_audio_fifo_alloc(enc->sample_fmt, enc->ch_layout.nb_channels, enc->frame_size > 0 ? enc->frame_size : 1024);
+  if (!ctx->fifo)
+    return AVERROR(ENOMEM);
+
+  ctx->audio_time_base = enc->time_base;
+  ctx->audio_next_pts = AV_NOPTS_VALUE;
+  snprintf(ctx->audio_codecs, sizeof(ctx->audio_codecs), "mp4a.40.2");
+  return avcodec_parameters_from_context(ctx->audio_par, enc);
+}
+
+// 为一档打开写入器、滤镜与编码器并写头（在启动编码线程之前调用）
+static int open_rendition(LadderContext *ctx, LadderRendition *r, const char *outputDir, const char *options) {
+  char dir[1024] = {0}, pattern[1100] = {0};
+  snprintf(dir, sizeof(dir), "%s/%s", outputDir, r->name);
+  int ret = hls_mkdir(dir);
+  if (ret < 0)
+    return ret;
+  snprintf(r->playlist, sizeof(r->playlist), "%s/index.m3u8", dir);
+  snprintf(pattern, sizeof(pattern), "%s/segment_%%05d.%s", dir,
+           options && strstr(options, "hls_segment_type=fmp4") ? "m4s" : "ts");
+
+  // 每次打包都从新的播放列表开始：hls_writer_open 会续写已有的播放列表，已结束的播放列表则无法再写
+  if (remove(r->playlist) != 0 && errno != ENOENT)
+    return AVERROR(errno);
+  if ((ret = hls_writer_open(&r->writer, r->playlist, pattern, 0, ctx->segment_duration, options)) < 0)
+    return ret;
+  r->writer_opened = 1;
+  r->writer.on_segment = on_ladder_segment;
+  r->writer.opaque = r;
+  r->video_index = -1;
+  r->audio_index = -1;
+  r->next_key = AV_NOPTS_VALUE;
+
+  if (r->height > 0) {
+    AVCodecContext *dec = ctx->video_dec;
+    AVRational sar = dec->sample_aspect_ratio.num > 0 ? dec->sample_aspect_ratio : (AVRational) {1, 1};
+    // 保持显示宽高比，宽度取偶数
+    r->width = (int) ((int64_t) dec->width * sar.num * r->height / ((int64_t) dec->height * sar.den));
+    r->width = FFMAX(2, r->width & ~1);
+    r->height &= ~1;
+    choose_h264_level(r, ctx->frame_rate);
+    if ((ret = open_scaler(ctx, r)) < 0 || (ret = open_video_encoder(ctx, r)) < 0)
+      return ret;
+    h264_codec_string(r->enc->extradata, r->enc->extradata_size, r->video_codecs, sizeof(r->video_codecs));
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par)
+      return AVERROR(ENOMEM);
+    ret = avcodec_parameters_from_context(par, r->enc);
+    if (ret >= 0)
+      ret = hls_writer_add_stream(&r->writer, par, r->enc->time_base);
+    avcodec_parameters_free(&par);
+    if (ret < 0)
+      return ret;
+    r->video_index = ret;
+    r->key_interval = av_rescale_q((int64_t) (ctx->segment_duration * AV_TIME_BASE), AV_TIME_BASE_Q, r->enc->time_base);
+    r->filt_frame = av_frame_alloc();
+    r->enc_pkt = av_packet_alloc();
+    if (!r->filt_frame || !r->enc_pkt)
+      return AVERROR(ENOMEM);
+  }
+  if (ctx->audio_par) {
+    if ((ret = hls_writer_add_stream(&r->writer, ctx->audio_par, ctx->audio_time_base)) < 0)
+      return ret;
+    r->audio_index = ret;
+  }
+
+  if ((ret = hls_writer_write_header(&r->writer)) < 0)
+    return ret;
+  r->segment_bytes_start = r->writer.bytes_written;
+  r->queue = native_queue_alloc(LADDER_QUEUE_CAPACITY);
+  return r->queue ? 0 : AVERROR(ENOMEM);
+}
+
+// 取出编码器输出的数据包写入该档（frame 为 NULL 时刷出编码器）
+static int encode_rendition_frame(LadderRendition *r, AVFrame *frame) {
+  int ret = avcodec_send_frame(r->enc, frame);
+  if (ret < 0)
+    return ret;
+  while ((ret = avcodec_receive_packet(r->enc, r->enc_pkt)) >= 0) {
+    // 没有全局头时参数集在关键帧中
+    if (!r->video_codecs[0] && (r->enc_pkt->flags & AV_PKT_FLAG_KEY))
+      h264_codec_string(r->enc_pkt->data, r->enc_pkt->size, r->video_codecs, sizeof(r->video_codecs));
+    r->enc_pkt->stream_index = r->video_index;
+    if ((ret = hls_writer_write_packet(&r->writer, r->enc_pkt)) < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/*
+ * 缩放并编码一帧（frame 为 NULL 表示输入结束，刷出滤镜与编码器）
+ * 按源时间戳在 next_key 处强制 IDR，所有档位收到的帧相同，因此 IDR 位置一致
+ */
+static int process_rendition_frame(LadderRendition *r, AVFrame *frame) {
+  int ret = av_buffersrc_add_frame(r->src_ctx, frame);
+  if (ret < 0)
+    return ret;
+  while ((ret = av_buffersink_get_frame(r->sink_ctx, r->filt_frame)) >= 0) {
+    AVFrame *f = r->filt_frame;
+    f->pict_type = AV_PICTURE_TYPE_NONE;
+    if (f->pts != AV_NOPTS_VALUE) {
+      if (r->next_key == AV_NOPTS_VALUE)
+        r->next_key = f->pts;
+      if (f->pts >= r->next_key) {
+        f->pict_type = AV_PICTURE_TYPE_I;
+        while (r->next_key <= f->pts)
+          r->next_key += r->key_interval;
+      }
+    }
+    ret = encode_rendition_frame(r, f);
+    av_frame_unref(f);
+    if (ret < 0)
+      return ret;
+  }
+  if (ret == AVERROR_EOF)
+    return encode_rendition_frame(r, NULL);
+  return ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
+// 每一档一个编码线程：按顺序取出帧/包，缩放编码后写入分段
+static void *ladder_worker(void *arg) {
+  LadderRendition *r = (LadderRendition *) arg;
+  void *item = NULL;
+  while (native_queue_pop(r->queue, &item)) {
+    LadderItem *it = (LadderItem *) item;
+    if (r->result >= 0) {
+      if (it->frame) {
+        r->result = process_rendition_frame(r, it->frame);
+      } else {
+        it->pkt->stream_index = r->audio_index;
+        r->result = hls_writer_write_packet(&r->writer, it->pkt);
+      }
+    }
+    free_ladder_item(it);
+  }
+  if (r->result >= 0 && r->enc)
+    r->result = process_rendition_frame(r, NULL);
+  return NULL;
+}
+
+// 把解码后的视频帧分发给所有视频档（只增加引用计数，不拷贝像素）
+static int dispatch_video_frame(LadderContext *ctx, AVFrame *frame) {
+  for (int i = 0; i < ctx->nb_renditions; i++) {
+    LadderRendition *r = &ctx->renditions[i];
+    if (r->video_index < 0)
+      continue;
+    LadderItem *item = (LadderItem *) calloc(1, sizeof(LadderItem));
+    if (!item || !(item->frame = av_frame_clone(frame))) {
+      free(item);
+      return AVERROR(ENOMEM);
+    }
+    if (native_queue_push(r->queue, item) < 0) {
+      free_ladder_item(item);
+      return AVERROR(EIO);
+    }
+  }
+  return 0;
+}
+
+// 把音频数据包（时间基为 audio_time_base）分发给所有带音频的档位
+static int dispatch_audio_packet(LadderContext *ctx, const AVPacket *pkt) {
+  for (int i = 0; i < ctx->nb_renditions; i++) {
+    LadderRendition *r = &ctx->renditions[i];
+    if (r->audio_index < 0)
+      continue;
+    LadderItem *item = (LadderItem *) calloc(1, sizeof(LadderItem));
+    if (!item || !(item->pkt = av_packet_clone(pkt))) {
+      free(item);
+      return AVERROR(ENOMEM);
+    }
+    if (native_queue_push(r->queue, item) < 0) {
+      free_ladder_item(item);
+      return AVERROR(EIO);
+    }
+  }
+  return 0;
+}
+
+// 从 FIFO 中取出整帧编码并分发（flush 为 1 时连同不足一帧的剩余样本一起编码并刷出编码器）
+static int encode_audio_fifo(LadderContext *ctx, int flush) {
+  AVCodecContext *enc = ctx->audio_enc;
+  int frame_size = enc->frame_size > 0 ? enc->frame_size : 1024;
+  AVFrame *frame = av_frame_alloc();
+  AVPacket *pkt = av_packet_alloc();
+  int ret = frame && pkt ? 0 : AVERROR(ENOMEM);
+
+  while (ret >= 0 && (av_audio_fifo_size(ctx->fifo) >= frame_size || (flush && av_audio_fifo_size(ctx->fifo) > 0))) {
+    frame->nb_samples = FFMIN(frame_size, av_audio_fifo_size(ctx->fifo));
+    frame->format = enc->sample_fmt;
+    frame->sample_rate = enc->sample_rate;
+    if ((ret = av_channel_layout_copy(&frame->ch_layout, &enc->ch_layout)) < 0 ||
+        (ret = av_frame_get_buffer(frame, 0)) < 0)
+      break;
+    av_audio_fifo_read(ctx->fifo, (void **) frame->data, frame->nb_samples);
+    frame->pts = ctx->audio_next_pts;
+    ctx->audio_next_pts += frame->nb_samples;
+    ret = avcodec_send_frame(enc, frame);
+    av_frame_unref(frame);
+    while (ret >= 0 && (ret = avcodec_receive_packet(enc, pkt)) >= 0) {
+      ret = dispatch_audio_packet(ctx, pkt);
+      av_packet_unref(pkt);
+    }
+    if (ret == AVERROR(EAGAIN))
+      ret = 0;
+  }
+  if (ret >= 0 && flush) {
+    ret = avcodec_send_frame(enc, NULL);
+    while (ret >= 0 && (ret = avcodec_receive_packet(enc, pkt)) >= 0) {
+      ret = dispatch_audio_packet(ctx, pkt);
+      av_packet_unref(pkt);
+    }
+    if (ret == AVERROR_EOF)
+      ret = 0;
+  }
+  av_frame_free(&frame);
+  av_packet_free(&pkt);
+  return ret;
+}
+
+// 重采样一帧解码后的音频写入 FIFO（frame 为 NULL 时取出重采样器中的剩余样本）
+static int resample_audio_frame(LadderContext *ctx, AVFrame *frame) {
+  AVCodecContext *enc = ctx->audio_enc;
+  if (frame && ctx->audio_next_pts == AV_NOPTS_VALUE) {
+    int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : 0;
+    ctx->audio_next_pts = av_rescale_q(ts, ctx->ifmt_ctx->streams[ctx->audio_stream]->time_base, enc->time_base);
+  }
+  if (ctx->audio_next_pts == AV_NOPTS_VALUE)
+    return 0;
+  AVFrame *out = av_frame_alloc();
+  if (!out)
+    return AVERROR(ENOMEM);
+  out->nb_samples = swr_get_out_samples(ctx->swr, frame ? frame->nb_samples : 0);
+  out->format = enc->sample_fmt;
+  out->sample_rate = enc->sample_rate;
+  int ret = 0;
+  if (out->nb_samples > 0 &&
+      (ret = av_channel_layout_copy(&out->ch_layout, &enc->ch_layout)) >= 0 &&
+      (ret = av_frame_get_buffer(out, 0)) >= 0) {
+    ret = swr_convert(ctx->swr, out->data, out->nb_samples,
+                      frame ? (const uint8_t **) frame->extended_data : NULL, frame ? frame->nb_samples : 0);
+    if (ret > 0)
+      ret = av_audio_fifo_write(ctx->fifo, (void **) out->data, ret);
+  }
+  av_frame_free(&out);
+  return ret < 0 ? ret : 0;
+}
+
+// 解码一个源音频包并转码（pkt 为 NULL 时刷出解码器、重采样器与编码器）
+static int transcode_audio_packet(LadderContext *ctx, const AVPacket *pkt, AVFrame *frame) {
+  int ret = avcodec_send_packet(ctx->audio_dec, pkt);
+  if (ret < 0 && pkt)
+    return 0; // 损坏的数据包跳过
+  while ((ret = avcodec_receive_frame(ctx->audio_dec, frame)) >= 0) {
+    ret = resample_audio_frame(ctx, frame);
+    av_frame_unref(frame);
+    if (ret < 0 || (ret = encode_audio_fifo(ctx, 0)) < 0)
+      return ret;
+  }
+  if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+    return ret;
+  if (!pkt) {
+    if ((ret = resample_audio_frame(ctx, NULL)) < 0)
+      return ret;
+    return encode_audio_fifo(ctx, 1);
+  }
+  return 0;
+}
+
+// 解码一个源视频包并分发解码出的帧（pkt 为 NULL 时刷出解码器）
+static int decode_video_packet(LadderContext *ctx, const AVPacket *pkt, AVFrame *frame) {
+  int ret = avcodec_send_packet(ctx->video_dec, pkt);
+  if (ret < 0 && pkt)
+    return 0; // 损坏的数据包跳过
+  while ((ret = avcodec_receive_frame(ctx->video_dec, frame)) >= 0) {
+    frame->pts = frame->best_effort_timestamp;
+    ret = dispatch_video_frame(ctx, frame);
+    av_frame_unref(frame);
+    if (ret < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 写主播放列表（临时文件 + 原子替换）
+static int write_master_playlist(LadderContext *ctx, const char *path) {
+  char tmp_path[1100] = {0};
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  FILE *file = hls_fopen(tmp_path, "wb");
+  if (!file)
+    return AVERROR(errno ? errno : EIO);
+
+  fprintf(file, "#EXTM3U\n#EXT-X-VERSION:%d\n#EXT-X-INDEPENDENT-SEGMENTS\n",
+          ctx->playlist_version);
+  for (int i = 0; i < ctx->nb_renditions; i++) {
+    LadderRendition *r = &ctx->renditions[i];
+    // 实测值缺失（例如没有完成任何分段）时退回到标称码率
+    int64_t average = r->total_duration > 0 ? (int64_t) (r->total_bytes * 8 / r->total_duration) : 0;
+    int64_t nominal = (r->height > 0 ? r->bit_rate : 0) + (ctx->audio_par ? ctx->audio_par->bit_rate : 0);
+    int64_t peak = r->peak_bandwidth > 0 ? r->peak_bandwidth : nominal;
+    if (average <= 0)
+      average = nominal;
+    fprintf(file, "#EXT-X-STREAM-INF:BANDWIDTH=%lld,AVERAGE-BANDWIDTH=%lld", (long long) peak, (long long) average);
+    if (r->height > 0) {
+      fprintf(file, ",RESOLUTION=%dx%d", r->width, r->height);
+      if (ctx->frame_rate.num > 0 && ctx->frame_rate.den > 0)
+        fprintf(file, ",FRAME-RATE=%.3f", av_q2d(ctx->frame_rate));
+      // 编码器没有输出 SPS 时按请求的 High profile 与 level 填写
+      char video_codecs[16] = {0};
+      if (r->video_codecs[0])
+        snprintf(video_codecs, sizeof(video_codecs), "%s", r->video_codecs);
+      else
+        snprintf(video_codecs, sizeof(video_codecs), "avc1.6400%02x", r->level_idc);
+      fprintf(file, ",CODECS=\"%s%s%s\"", video_codecs,
+              ctx->audio_par ? "," : "", ctx->audio_par ? ctx->audio_codecs : "");
+    } else {
+      fprintf(file, ",CODECS=\"%s\"", ctx->audio_codecs);
+    }
+    fprintf(file, "\n%s/index.m3u8\n", r->name);
+  }
+
+  int failed = fflush(file) != 0 || ferror(file);
+  failed |= fclose(file) != 0;
+  if (failed) {
+    remove(tmp_path);
+    return AVERROR(EIO);
+  }
+  return hls_replace_file(tmp_path, path);
+}
+
+static void free_ladder_context(LadderContext *ctx) {
+  for (int i = 0; i < ctx->nb_renditions; i++) {
+    LadderRendition *r = &ctx->renditions[i];
+    if (r->queue) {
+      native_queue_close(r->queue);
+      if (r->thread_started)
+        native_thread_join(r->thread);
+      void *item = NULL;
+      while (native_queue_pop(r->queue, &item))
+        free_ladder_item((LadderItem *) item);
+      native_queue_free(&r->queue);
+    }
+    if (r->writer_opened)
+      hls_writer_free(&r->writer);
+    avfilter_graph_free(&r->graph);
+    avcodec_free_context(&r->enc);
+    av_frame_free(&r->filt_frame);
+    av_packet_free(&r->enc_pkt);
+  }
+  avcodec_free_context(&ctx->video_dec);
+  avcodec_free_context(&ctx->audio_dec);
+  avcodec_free_context(&ctx->audio_enc);
+  swr_free(&ctx->swr);
+  if (ctx->fifo)
+    av_audio_fifo_free(ctx->fifo);
+  avcodec_parameters_free(&ctx->audio_par);
+  if (ctx->ifmt_ctx)
+    avformat_close_input(&ctx->ifmt_ctx);
+}
+
+const char *build_hls_ladder(const char *inputPath, const char *outputDir, const char *renditions,
+                             int segmentDuration, const char *options) {
+  LadderContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.video_stream = -1;
+  ctx.audio_stream = -1;
+  ctx.segment_duration = segmentDuration > 0 ? segmentDuration : 6;
+  ctx.playlist_version = 3;
+  AVPacket *pkt = NULL;
+  AVFrame *frame = NULL;
+  const char *error = "HLS ladder generation failed";
+  int ret;
+
+  if ((ret = parse_renditions(&ctx, renditions)) < 0) {
+    return "Invalid rendition list, expected name:height:kbps[,name:height:kbps...]";
+  }
+  if ((ret = hls_mkdir(outputDir)) < 0) {
+    print_error("Unable to create output directory", ret);
+    return "Unable to create output directory";
+  }
+
+  if ((ret = avformat_open_input(&ctx.ifmt_ctx, inputPath, NULL, NULL)) < 0 ||
+      (ret = avformat_find_stream_info(ctx.ifmt_ctx, NULL)) < 0) {
+    print_error("Unable to open input file", ret);
+    error = "Unable to open input file";
+    goto end;
+  }
+  ctx.video_stream = av_find_best_stream(ctx.ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  ctx.audio_stream = av_find_best_stream(ctx.ifmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+
+  // 源视频只打开一个解码器，解码使用多线程
+  if (ctx.video_stream >= 0) {
+    AVStream *st = ctx.ifmt_ctx->streams[ctx.video_stream];
+    const AVCodec *dec = avcodec_find_decoder(st->codecpar->codec_id);
+    if (!dec || !(ctx.video_dec = avcodec_alloc_context3(dec))) {
+      ret = AVERROR_DECODER_NOT_FOUND;
+      goto end;
+    }
+    ctx.video_dec->thread_count = 0;
+    if ((ret = avcodec_parameters_to_context(ctx.video_dec, st->codecpar)) < 0 ||
+        (ret = avcodec_open2(ctx.video_dec, dec, NULL)) < 0) {
+      print_error("Failed to open video decoder", ret);
+      goto end;
+    }
+    ctx.frame_rate = av_guess_frame_rate(ctx.ifmt_ctx, st, NULL);
+    if (ctx.frame_rate.num <= 0 || ctx.frame_rate.den <= 0)
+      ctx.frame_rate = (AVRational) {25, 1};
+  }
+
+  select_renditions(&ctx);
+  if (ctx.nb_renditions == 0) {
+    error = "No rendition applicable to the input";
+    goto end;
+  }
+
+  if (ctx.audio_stream >= 0) {
+    int global_header = options && strstr(options, "hls_segment_type=fmp4") != NULL;
+    if ((ret = open_audio(&ctx, global_header)) < 0) {
+      print_error("Failed to open audio", ret);
+      goto end;
+    }
+  }
+  for (int i = 0; i < ctx.nb_renditions; i++) {
+    if ((ret = open_rendition(&ctx, &ctx.renditions[i], outputDir, options)) < 0) {
+      print_error("Failed to open rendition", ret);
+      goto end;
+    }
+  }
+  for (int i = 0; i < ctx.nb_renditions; i++) {
+    LadderRendition *r = &ctx.renditions[i];
+    if (native_thread_create(&r->thread, ladder_worker, r) < 0) {
+      ret = AVERROR(ENOMEM);
+      goto end;
+    }
+    r->thread_started = 1;
+  }
+
+  pkt = av_packet_alloc();
+  frame = av_frame_alloc();
+  if (!pkt || !frame) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  // 主线程只负责读包、解码一次并分发，缩放与编码在各档线程中并行进行
+  while ((ret = av_read_frame(ctx.ifmt_ctx, pkt)) >= 0) {
+    if (pkt->stream_index == ctx.video_stream) {
+      ret = decode_video_packet(&ctx, pkt, frame);
+    } else if (pkt->stream_index == ctx.audio_stream) {
+      if (ctx.audio_enc) {
+        ret = transcode_audio_packet(&ctx, pkt, frame);
+      } else {
+        av_packet_rescale_ts(pkt, ctx.ifmt_ctx->streams[ctx.audio_stream]->time_base, ctx.audio_time_base);
+        ret = dispatch_audio_packet(&ctx, pkt);
+      }
+    }
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
+  }
+  if (ret == AVERROR_EOF)
+    ret = 0;
+  if (ret >= 0 && ctx.video_dec)
+    ret = decode_video_packet(&ctx, NULL, frame);
+  if (ret >= 0 && ctx.audio_enc)
+    ret = transcode_audio_packet(&ctx, NULL, frame);
+
+  // 关闭队列让各档刷出编码器，等待全部完成后结束分段
+  for (int i = 0; i < ctx.nb_renditions; i++) {
+    LadderRendition *r = &ctx.renditions[i];
+    native_queue_close(r->queue);
+    native_thread_join(r->thread);
+    r->thread_started = 0;
+    if (ret >= 0 && r->result < 0)
+      ret = r->result;
+  }
+  for (int i = 0; ret >= 0 && i < ctx.nb_renditions; i++) {
+    LadderRendition *r = &ctx.renditions[i];
+    if (r->writer.playlist.version > ctx.playlist_version)
+      ctx.playlist_version = r->writer.playlist.version;
+    ret = hls_writer_close(&r->writer, 1);
+    r->writer_opened = 0;
+  }
+  if (ret >= 0) {
+    char master[1100] = {0};
+    snprintf(master, sizeof(master), "%s/master.m3u8", outputDir);
+    ret = write_master_playlist(&ctx, master);
+  }
+  if (ret < 0)
+    print_error("Failed to build HLS ladder", ret);
+
+  end:
+  av_packet_free(&pkt);
+  av_frame_free(&frame);
+  int nb_renditions = ctx.nb_renditions;
+  free_ladder_context(&ctx);
+  if (ret < 0)
+    return error;
+
+  static char resultMsg[256];
+  snprintf(resultMsg, sizeof(resultMsg), "HLS ladder generated successfully: %d renditions, master playlist %s/master.m3u8",
+           nb_renditions, outputDir);
+  return resultMsg;
+}
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <libavutil/avutil.h>
+#include <libavutil/avstring.h>
+#include <libavutil/bprint.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "hls_playlist.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static wchar_t *utf8_to_wide(const char *str) {
+  int size_needed = MultiByteToWideChar(CP_UTF8, 0, str, -1, NULL, 0);
+  wchar_t *wstr = (wchar_t *) malloc(size_needed * sizeof(wchar_t));
+  if (wstr)
+    MultiByteToWideChar(CP_UTF8, 0, str, -1, wstr, size_needed);
+  return wstr;
+}
+
+#else
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#endif
+
+FILE *hls_fopen(const char *path, const char *mode) {
+#ifdef _WIN32
+  wchar_t *wpath = utf8_to_wide(path);
+  wchar_t *wmode = utf8_to_wide(mode);
+  FILE *file = NULL;
+  if (wpath && wmode)
+    file = _wfopen(wpath, wmode);
+  free(wpath);
+  free(wmode);
+  return file;
+#else
+  return fopen(path, mode);
+#endif
+}
+
+int hls_replace_file(const char *src, const char *dst) {
+#ifdef _WIN32
+  wchar_t *wsrc = utf8_to_wide(src);
+  wchar_t *wdst = utf8_to_wide(dst);
+  int ok = wsrc && wdst && MoveFileExW(wsrc, wdst, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  free(wsrc);
+  free(wdst);
+  return ok ? 0 : AVERROR(EIO);
+#else
+  return rename(src, dst) == 0 ? 0 : AVERROR(errno);
+#endif
+}
+
+int hls_truncate_file(const char *path, int64_t size) {
+#ifdef _WIN32
+  wchar_t *wpath = utf8_to_wide(path);
+  int fd = -1;
+  if (wpath)
+    _wsopen_s(&fd, wpath, _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+  free(wpath);
+  if (fd < 0)
+    return AVERROR(EIO);
+  int ret = _chsize_s(fd, size) == 0 ? 0 : AVERROR(EIO);
+  _close(fd);
+  return ret;
+#else
+  return truncate(path, (off_t) size) == 0 ? 0 : AVERROR(errno);
+#endif
+}
+
+int hls_mkdir(const char *path) {
+#ifdef _WIN32
+  wchar_t *wpath = utf8_to_wide(path);
+  int ok = wpath && (CreateDirectoryW(wpath, NULL) || GetLastError() == ERROR_ALREADY_EXISTS);
+  free(wpath);
+  return ok ? 0 : AVERROR(EIO);
+#else
+  return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : AVERROR(errno);
+#endif
+}
+
+static void render_part(AVBPrint *bp, const char *uri, const HlsPlaylistPart *part) {
+  av_bprintf(bp, "#EXT-X-PART:DURATION=%.5f,URI=\"%s\",BYTERANGE=\"%lld@%lld\"%s\n", part->duration, uri,
+             (long long) part->length, (long long) part->offset, part->independent ? ",INDEPENDENT=YES" : "");
+}
+
+// with_parts 为 1 时在 EXTINF 之前输出组成该分段的 #EXT-X-PART
+static void render_entry(AVBPrint *bp, const HlsPlaylistEntry *entry, int with_parts) {
+  if (entry->discontinuity)
+    av_bprintf(bp, "#EXT-X-DISCONTINUITY\n");
+  if (entry->map_uri)
+    av_bprintf(bp, "#EXT-X-MAP:URI=\"%s\"\n", entry->map_uri);
+  for (int i = 0; with_parts && i < entry->nb_parts; i++)
+    render_part(bp, entry->uri, &entry->parts[i]);
+  av_bprintf(bp, "#EXTINF:%.6f,\n", entry->duration);
+  if (entry->offset >= 0)
+    av_bprintf(bp, "#EXT-X-BYTERANGE:%lld@%lld\n", (long long) entry->length, (long long) entry->offset);
+  av_bprintf(bp, "%s\n", entry->uri);
+}
+
+int hls_playlist_init(HlsPlaylist *pl, const char *path, int64_t media_sequence) {
+  memset(pl, 0, sizeof(HlsPlaylist));
+  pl->path = av_strdup(path);
+  if (!pl->path)
+    return AVERROR(ENOMEM);
+  pl->version = 3;
+  pl->media_sequence = media_sequence;
+  av_bprint_init(&pl->body, 0, AV_BPRINT_SIZE_UNLIMITED);
+  return 0;
+}
+
+void hls_playlist_uninit(HlsPlaylist *pl) {
+  for (int i = 0; i < pl->nb_entries; i++) {
+    av_freep(&pl->entries[i].uri);
+    av_freep(&pl->entries[i].map_uri);
+    av_freep(&pl->entries[i].parts);
+  }
+  av_freep(&pl->pending_map);
+  av_freep(&pl->parts);
+  av_freep(&pl->parts_uri);
+  av_freep(&pl->preload_uri);
+  pl->nb_parts = pl->parts_capacity = 0;
+  av_freep(&pl->entries);
+  av_freep(&pl->path);
+  av_bprint_finalize(&pl->body, NULL);
+  pl->nb_entries = pl->capacity = pl->nb_rendered = 0;
+}
+
+/*
+ * 把不再需要部分分段信息的条目并入正文缓存：没有部分分段的条目立即并入，
+ * 有部分分段的条目在其结束时间距列表末尾超过三个目标时长后并入
+ */
+static int merge_aged_entries(HlsPlaylist *pl) {
+  double after = 0; // entries[nb_rendered] 之后的内容时长
+  for (int i = pl->nb_rendered + 1; i < pl->nb_entries; i++)
+    after += pl->entries[i].duration;
+  for (int i = 0; i < pl->nb_parts; i++)
+    after += pl->parts[i].duration;
+  while (pl->nb_rendered < pl->nb_entries) {
+    HlsPlaylistEntry *entry = &pl->entries[pl->nb_rendered];
+    if (entry->nb_parts > 0 && after <= 3.0 * pl->target_duration)
+      break;
+    render_entry(&pl->body, entry, 0);
+    av_freep(&entry->parts);
+    entry->nb_parts = 0;
+    pl->nb_rendered++;
+    if (pl->nb_rendered < pl->nb_entries)
+      after -= pl->entries[pl->nb_rendered].duration;
+  }
+  return av_bprint_is_complete(&pl->body) ? 0 : AVERROR(ENOMEM);
+}
+
+int64_t hls_playlist_next_sequence(const HlsPlaylist *pl) {
+  return pl->media_sequence + pl->nb_entries;
+}
+
+int hls_playlist_add_segment(HlsPlaylist *pl, const char *uri, double duration, int discontinuity) {
+  return hls_playlist_add_segment_range(pl, uri, duration, discontinuity, -1, 0);
+}
+
+int hls_playlist_add_segment_range(HlsPlaylist *pl, const char *uri, double duration, int discontinuity,
+                                   int64_t offset, int64_t length) {
+  if (pl->nb_entries >= pl->capacity) {
+    int capacity = pl->capacity ? pl->capacity * 2 : 64;
+    HlsPlaylistEntry *entries = av_realloc_array(pl->entries, capacity, sizeof(HlsPlaylistEntry));
+    if (!entries)
+      return AVERROR(ENOMEM);
+    pl->entries = entries;
+    pl->capacity = capacity;
+  }
+  HlsPlaylistEntry *entry = &pl->entries[pl->nb_entries];
+  memset(entry, 0, sizeof(HlsPlaylistEntry));
+  entry->uri = av_strdup(uri);
+  if (!entry->uri)
+    return AVERROR(ENOMEM);
+  entry->duration = duration;
+  entry->discontinuity = discontinuity;
+  entry->map_uri = pl->pending_map;
+  pl->pending_map = NULL;
+  entry->offset = offset;
+  entry->length = length;
+  // 进行中分段的部分分段转入该条目
+  entry->parts = pl->parts;
+  entry->nb_parts = pl->nb_parts;
+  pl->parts = NULL;
+  pl->nb_parts = pl->parts_capacity = 0;
+  pl->parts_discontinuity = 0;
+  av_freep(&pl->parts_uri);
+  // EXT-X-BYTERANGE 需要版本 4 以上
+  if (offset >= 0 && pl->version < 4)
+    pl->version = 4;
+  pl->nb_entries++;
+
+  // EXTINF 四舍五入后不得超过 TARGETDURATION
+  int rounded = (int) (duration + 0.5);
+  if (rounded > pl->target_duration)
+    pl->target_duration = rounded;
+
+  return merge_aged_entries(pl);
+}
+
+int hls_playlist_add_part(HlsPlaylist *pl, const char *uri, int discontinuity, double duration,
+                          int64_t offset, int64_t length, int independent) {
+  if (pl->nb_parts >= pl->parts_capacity) {
+    int capacity = pl->parts_capacity ? pl->parts_capacity * 2 : 16;
+    HlsPlaylistPart *parts = av_realloc_array(pl->parts, capacity, sizeof(HlsPlaylistPart));
+    if (!parts)
+      return AVERROR(ENOMEM);
+    pl->parts = parts;
+    pl->parts_capacity = capacity;
+  }
+  if (pl->nb_parts == 0) {
+    char *parts_uri = av_strdup(uri);
+    if (!parts_uri)
+      return AVERROR(ENOMEM);
+    av_free(pl->parts_uri);
+    pl->parts_uri = parts_uri;
+    pl->parts_discontinuity = discontinuity;
+  }
+  HlsPlaylistPart *part = &pl->parts[pl->nb_parts++];
+  part->duration = duration;
+  part->offset = offset;
+  part->length = length;
+  part->independent = independent;
+  return merge_aged_entries(pl);
+}
+
+int hls_playlist_set_preload_hint(HlsPlaylist *pl, const char *uri, int64_t offset) {
+  char *preload_uri = NULL;
+  if (uri && !(preload_uri = av_strdup(uri)))
+    return AVERROR(ENOMEM);
+  av_free(pl->preload_uri);
+  pl->preload_uri = preload_uri;
+  pl->preload_offset = offset;
+  return 0;
+}
+
+// 渲染尚未并入正文缓存的条目、进行中分段的部分分段以及预加载提示
+static void render_tail(AVBPrint *bp, const HlsPlaylist *pl) {
+  for (int i = pl->nb_rendered; i < pl->nb_entries; i++)
+    render_entry(bp, &pl->entries[i], 1);
+  if (pl->nb_parts > 0) {
+    if (pl->parts_discontinuity)
+      av_bprintf(bp, "#EXT-X-DISCONTINUITY\n");
+    if (pl->pending_map)
+      av_bprintf(bp, "#EXT-X-MAP:URI=\"%s\"\n", pl->pending_map);
+    for (int i = 0; i < pl->nb_parts; i++)
+      render_part(bp, pl->parts_uri, &pl->parts[i]);
+  }
+  if (pl->preload_uri && !pl->ended) {
+    av_bprintf(bp, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\"", pl->preload_uri);
+    if (pl->preload_offset > 0)
+      av_bprintf(bp, ",BYTERANGE-START=%lld", (long long) pl->preload_offset);
+    av_bprintf(bp, "\n");
+  }
+}
+
+int hls_playlist_set_map(HlsPlaylist *pl, const char *uri) {
+  char *map = av_strdup(uri);
+  if (!map)
+    return AVERROR(ENOMEM);
+  av_free(pl->pending_map);
+  pl->pending_map = map;
+  return 0;
+}
+
+int hls_playlist_write(HlsPlaylist *pl) {
+  char tmp_path[1100] = {0};
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", pl->path);
+
+  AVBPrint tail;
+  av_bprint_init(&tail, 0, AV_BPRINT_SIZE_UNLIMITED);
+  render_tail(&tail, pl);
+  if (!av_bprint_is_complete(&tail)) {
+    av_bprint_finalize(&tail, NULL);
+    return AVERROR(ENOMEM);
+  }
+
+  FILE *file = hls_fopen(tmp_path, "wb");
+  if (!file) {
+    av_bprint_finalize(&tail, NULL);
+    return AVERROR(errno ? errno : EIO);
+  }
+
+  fprintf(file, "#EXTM3U\n#EXT-X-VERSION:%d\n", pl->version);
+  fprintf(file, "#EXT-X-TARGETDURATION:%d\n", pl->target_duration > 0 ? pl->target_duration : 1);
+  fprintf(file, "#EXT-X-MEDIA-SEQUENCE:%lld\n", (long long) pl->media_sequence);
+  if (pl->playlist_type[0])
+    fprintf(file, "#EXT-X-PLAYLIST-TYPE:%s\n", pl->playlist_type);
+  if (pl->part_target > 0) {
+    // PART-HOLD-BACK 至少为 PART-TARGET 的两倍，这里取三倍
+    fprintf(file, "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n", pl->part_target * 3);
+    fprintf(file, "#EXT-X-PART-INF:PART-TARGET=%.3f\n", pl->part_target);
+  }
+  fwrite(pl->body.str, 1, pl->body.len, file);
+  fwrite(tail.str, 1, tail.len, file);
+  av_bprint_finalize(&tail, NULL);
+  if (pl->ended)
+    fprintf(file, "#EXT-X-ENDLIST\n");
+
+  int failed = fflush(file) != 0 || ferror(file);
+  failed |= fclose(file) != 0;
+  if (failed) {
+    remove(tmp_path);
+    return AVERROR(EIO);
+  }
+  return hls_replace_file(tmp_path, pl->path);
+}
+
+// 去掉行尾的换行与空白
+static void strip_line(char *line) {
+  size_t len = strlen(line);
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+    line[--len] = '\0';
+}
+
+int hls_playlist_load(HlsPlaylist *pl, const char *path) {
+  int ret = hls_playlist_init(pl, path, 0);
+  if (ret < 0)
+    return ret;
+
+  FILE *file = hls_fopen(path, "rb");
+  if (!file)
+    return AVERROR(ENOENT);
+
+  char line[4096];
+  double pending_duration = -1;
+  int pending_discontinuity = 0;
+  int64_t pending_offset = -1, pending_length = 0, next_offset = 0;
+  const char *value = NULL;
+  while (fgets(line, sizeof(line), file)) {
+    strip_line(line);
+    if (!line[0])
+      continue;
+    if (av_strstart(line, "#EXT-X-VERSION:", &value)) {
+      pl->version = atoi(value);
+    } else if (av_strstart(line, "#EXT-X-TARGETDURATION:", &value)) {
+      pl->target_duration = atoi(value);
+    } else if (av_strstart(line, "#EXT-X-MEDIA-SEQUENCE:", &value)) {
+      pl->media_sequence = strtoll(value, NULL, 10);
+    } else if (av_strstart(line, "#EXT-X-PLAYLIST-TYPE:", &value)) {
+      snprintf(pl->playlist_type, sizeof(pl->playlist_type), "%s", value);
+    } else if (av_strstart(line, "#EXT-X-BYTERANGE:", &value)) {
+      // length[@offset]，省略 offset 时紧接上一个分段
+      char *at = NULL;
+      pending_length = strtoll(value, &at, 10);
+      pending_offset = at && *at == '@' ? strtoll(at + 1, NULL, 10) : next_offset;
+    } else if (av_strstart(line, "#EXTINF:", &value)) {
+      pending_duration = atof(value);
+    } else if (av_strstart(line, "#EXT-X-MAP:URI=\"", &value)) {
+      char uri[4096] = {0};
+      snprintf(uri, sizeof(uri), "%s", value);
+      char *quote = strchr(uri, '"');
+      if (quote)
+        *quote = '\0';
+      if ((ret = hls_playlist_set_map(pl, uri)) < 0)
+        break;
+    } else if (!strcmp(line, "#EXT-X-DISCONTINUITY")) {
+      pending_discontinuity = 1;
+    } else if (!strcmp(line, "#EXT-X-ENDLIST")) {
+      pl->ended = 1;
+    } else if (line[0] != '#' && pending_duration >= 0) {
+      ret = hls_playlist_add_segment_range(pl, line, pending_duration, pending_discontinuity,
+                                           pending_offset, pending_length);
+      if (ret < 0)
+        break;
+      if (pending_offset >= 0)
+        next_offset = pending_offset + pending_length;
+      pending_duration = -1;
+      pending_discontinuity = 0;
+      pending_offset = -1;
+      pending_length = 0;
+    }
+  }
+  fclose(file);
+  return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,135 @@
+#ifndef HLS_PLAYLIST_H
+#define HLS_PLAYLIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libavutil/bprint.h>
+
+/*
+ * 内存中的 HLS 媒体播放列表模型
+ *
+ * 每个分段完成时只把该分段对应的几行追加到已渲染的正文缓存中，
+ * 写盘时输出 "头部 + 正文缓存 (+ ENDLIST)" 到临时文件再原子替换，
+ * 不会重新解析或重新格式化已有条目。
+ *
+ * 低延迟模式（part_target > 0）下，带 #EXT-X-PART 的最近几个分段不进入正文缓存，
+ * 每次写盘时重新渲染；超过三个目标时长后去掉部分分段信息再并入正文缓存。
+ */
+
+typedef struct HlsPlaylistPart {
+  double duration;      // 部分分段时长（秒）
+  int64_t offset;       // 在所属分段文件中的字节偏移
+  int64_t length;       // 字节数
+  int independent;      // 1 表示以关键帧开始（INDEPENDENT=YES）
+} HlsPlaylistPart;
+
+typedef struct HlsPlaylistEntry {
+  char *uri;            // 分段 URI（相对于播放列表所在目录）
+  double duration;      // 分段时长（秒）
+  int discontinuity;    // 1 表示该分段前有 #EXT-X-DISCONTINUITY
+  char *map_uri;        // 非 NULL 表示该分段前有 #EXT-X-MAP（fMP4 初始化分段），之后的分段沿用
+  int64_t offset;       // 单文件模式下分段在文件中的起始偏移，-1 表示整个文件（无 #EXT-X-BYTERANGE）
+  int64_t length;       // 单文件模式下分段的字节数
+  HlsPlaylistPart *parts; // 低延迟模式下组成该分段的部分分段，并入正文缓存后释放
+  int nb_parts;
+} HlsPlaylistEntry;
+
+typedef struct HlsPlaylist {
+  char *path;                 // m3u8 文件路径
+  int version;                // #EXT-X-VERSION
+  int64_t media_sequence;     // #EXT-X-MEDIA-SEQUENCE
+  int target_duration;        // #EXT-X-TARGETDURATION（所有分段时长取整后的最大值）
+  char playlist_type[16];     // "EVENT" / "VOD"，为空则不输出
+  int ended;                  // 是否已包含 #EXT-X-ENDLIST
+  HlsPlaylistEntry *entries;
+  int nb_entries;
+  int capacity;
+  AVBPrint body;              // 已渲染的条目正文
+  char *pending_map;          // 下一个追加的分段前需要输出的 #EXT-X-MAP URI
+
+  // 低延迟 HLS
+  double part_target;         // #EXT-X-PART-INF:PART-TARGET，0 表示不输出部分分段
+  int nb_rendered;            // 已并入正文缓存的条目数，之后的条目每次写盘时重新渲染
+  HlsPlaylistPart *parts;     // 进行中分段已完成的部分分段
+  int nb_parts;
+  int parts_capacity;
+  char *parts_uri;            // 进行中分段的 URI
+  int parts_discontinuity;    // 进行中分段前是否有 #EXT-X-DISCONTINUITY
+  char *preload_uri;          // #EXT-X-PRELOAD-HINT 指向的下一个部分分段，NULL 表示不输出
+  int64_t preload_offset;     // 下一个部分分段在文件中的起始偏移
+} HlsPlaylist;
+
+/**
+ * 初始化一个空播放列表
+ * @return 成功返回 0，失败返回负错误码
+ */
+int hls_playlist_init(HlsPlaylist *pl, const char *path, int64_t media_sequence);
+
+/**
+ * 从磁盘加载已有播放列表（逐行解析，不整体读入内存）
+ * @return 成功返回 0；文件不存在返回 AVERROR(ENOENT)（此时 pl 为空列表）；其他错误返回负错误码
+ */
+int hls_playlist_load(HlsPlaylist *pl, const char *path);
+
+/**
+ * 追加一个已完成的分段
+ */
+int hls_playlist_add_segment(HlsPlaylist *pl, const char *uri, double duration, int discontinuity);
+
+/**
+ * 追加一个位于共享文件中的分段（输出 #EXT-X-BYTERANGE:length@offset），offset 为 -1 时等同 hls_playlist_add_segment
+ */
+int hls_playlist_add_segment_range(HlsPlaylist *pl, const char *uri, double duration, int discontinuity,
+                                   int64_t offset, int64_t length);
+
+/**
+ * 追加进行中分段的一个部分分段（#EXT-X-PART），该分段完成时随 hls_playlist_add_segment_range 一并转入条目
+ * @param uri 所属分段文件 URI，部分分段以 BYTERANGE 引用其中的 [offset, offset + length)
+ * @param discontinuity 进行中分段前是否有 #EXT-X-DISCONTINUITY（只在第一个部分分段时记录）
+ */
+int hls_playlist_add_part(HlsPlaylist *pl, const char *uri, int discontinuity, double duration,
+                          int64_t offset, int64_t length, int independent);
+
+/**
+ * 设置 #EXT-X-PRELOAD-HINT（下一个部分分段的位置），uri 为 NULL 时清除
+ */
+int hls_playlist_set_preload_hint(HlsPlaylist *pl, const char *uri, int64_t offset);
+
+/**
+ * 设置初始化分段：下一个追加的分段前输出 #EXT-X-MAP:URI="uri"
+ */
+int hls_playlist_set_map(HlsPlaylist *pl, const char *uri);
+
+/**
+ * 将播放列表写入临时文件后原子替换目标文件
+ */
+int hls_playlist_write(HlsPlaylist *pl);
+
+/**
+ * 下一个分段的媒体序号（media_sequence + 条目数）
+ */
+int64_t hls_playlist_next_sequence(const HlsPlaylist *pl);
+
+void hls_playlist_uninit(HlsPlaylist *pl);
+
+/**
+ * 以 UTF-8 路径打开文件（Windows 下转换为宽字符路径）
+ */
+FILE *hls_fopen(const char *path, const char *mode);
+
+/**
+ * 用 src 原子替换 dst
+ */
+int hls_replace_file(const char *src, const char *dst);
+
+/**
+ * 把文件截断到 size 字节
+ */
+int hls_truncate_file(const char *path, int64_t size);
+
+/**
+ * 以 UTF-8 路径创建目录（不递归），目录已存在视为成功
+ */
+int hls_mkdir(const char *path);
+
+#endif // HLS_PLAYLIST_H
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hls_session_table.h"
+#include "native_thread.h"
+
+typedef struct HlsTableSlot {
+  native_mutex_t lock;           // 会话级互斥锁，槽位存在期间永不销毁
+  volatile uint32_t generation;  // 当前代数，移除会话时递增
+  HlsSession *volatile session;  // 当前会话，空闲时为 NULL
+  uint32_t next_free;            // 空闲链表中下一个槽位（分片内序号 + 1），0 表示链表结束
+} HlsTableSlot;
+
+typedef struct HlsTableShard {
+  native_mutex_t lock;                           // 仅保护空闲链表与扩容，查找路径不使用
+  HlsTableSlot *volatile pages[HLS_TABLE_MAX_PAGES];
+  volatile uint32_t nb_pages;
+  uint32_t free_head;                            // 分片内序号 + 1，0 表示无空闲槽位
+} HlsTableShard;
+
+static HlsTableShard g_shards[HLS_TABLE_SHARDS];
+static native_mutex_t g_shards_init_lock = NATIVE_MUTEX_INITIALIZER;
+static volatile uint32_t g_shards_ready = 0;
+static volatile uint32_t g_next_shard = 0;
+
+static void ensure_shards(void) {
+  if (native_atomic_load_u32(&g_shards_ready))
+    return;
+  native_mutex_lock(&g_shards_init_lock);
+  if (!g_shards_ready) {
+    for (int i = 0; i < HLS_TABLE_SHARDS; i++) {
+      memset(&g_shards[i], 0, sizeof(HlsTableShard));
+      native_mutex_init(&g_shards[i].lock);
+    }
+    native_atomic_store_u32(&g_shards_ready, 1);
+  }
+  native_mutex_unlock(&g_shards_init_lock);
+}
+
+static inline int64_t make_handle(uint32_t generation, uint32_t shard, uint32_t local) {
+  uint32_t index = (local << HLS_TABLE_SHARD_BITS) | shard;
+  return (int64_t) (((uint64_t) generation << 32) | (uint64_t) (index + 1));
+}
+
+// 无锁解析句柄对应的槽位，句柄格式非法或槽位不存在时返回 NULL
+static HlsTableSlot *slot_of(int64_t handle, uint32_t *generation) {
+  uint32_t low = (uint32_t) ((uint64_t) handle & 0xFFFFFFFFu);
+  if (low == 0 || !native_atomic_load_u32(&g_shards_ready))
+    return NULL;
+  uint32_t index = low - 1;
+  uint32_t shard = index & (HLS_TABLE_SHARDS - 1);
+  uint32_t local = index >> HLS_TABLE_SHARD_BITS;
+  uint32_t page = local >> HLS_TABLE_PAGE_BITS;
+  if (page >= HLS_TABLE_MAX_PAGES)
+    return NULL;
+  HlsTableSlot *slots = (HlsTableSlot *) native_atomic_load_ptr((void *volatile *) &g_shards[shard].pages[page]);
+  if (!slots)
+    return NULL;
+  *generation = (uint32_t) ((uint64_t) handle >> 32);
+  return &slots[local & (HLS_TABLE_PAGE_SLOTS - 1)];
+}
+
+// 在分片锁内取出一个空闲槽位，必要时分配新页
+static int shard_take_slot(HlsTableShard *shard, uint32_t *local_out) {
+  if (shard->free_head == 0) {
+    uint32_t nb_pages = shard->nb_pages;
+    if (nb_pages >= HLS_TABLE_MAX_PAGES)
+      return -1;
+    HlsTableSlot *slots = (HlsTableSlot *) calloc(HLS_TABLE_PAGE_SLOTS, sizeof(HlsTableSlot));
+    if (!slots)
+      return -1;
+    uint32_t base = nb_pages << HLS_TABLE_PAGE_BITS;
+    for (uint32_t i = 0; i < HLS_TABLE_PAGE_SLOTS; i++) {
+      native_mutex_init(&slots[i].lock);
+      slots[i].generation = 1;
+      slots[i].next_free = (i + 1 < HLS_TABLE_PAGE_SLOTS) ? base + i + 2 : 0;
+    }
+    shard->free_head = base + 1;
+    native_atomic_store_ptr((void *volatile *) &shard->pages[nb_pages], slots);
+    native_atomic_store_u32(&shard->nb_pages, nb_pages + 1);
+  }
+  uint32_t local = shard->free_head - 1;
+  HlsTableSlot *slot = &shard->pages[local >> HLS_TABLE_PAGE_BITS][local & (HLS_TABLE_PAGE_SLOTS - 1)];
+  shard->free_head = slot->next_free;
+  slot->next_free = 0;
+  *local_out = local;
+  return 0;
+}
+
+int64_t hls_table_insert(HlsSession *session) {
+  if (!session)
+    return 0;
+  ensure_shards();
+
+  uint32_t start = native_atomic_add_u32(&g_next_shard, 1);
+  for (uint32_t attempt = 0; attempt < HLS_TABLE_SHARDS; attempt++) {
+    uint32_t shard_index = (start + attempt) & (HLS_TABLE_SHARDS - 1);
+    HlsTableShard *shard = &g_shards[shard_index];
+    uint32_t local = 0;
+
+    native_mutex_lock(&shard->lock);
+    int ret = shard_take_slot(shard, &local);
+    native_mutex_unlock(&shard->lock);
+    if (ret < 0)
+      continue;
+
+    HlsTableSlot *slot = &shard->pages[local >> HLS_TABLE_PAGE_BITS][local & (HLS_TABLE_PAGE_SLOTS - 1)];
+    native_mutex_lock(&slot->lock);
+    uint32_t generation = slot->generation;
+    native_atomic_store_ptr((void *volatile *) &slot->session, session);
+    native_mutex_unlock(&slot->lock);
+    return make_handle(generation, shard_index, local);
+  }
+  return 0;
+}
+
+HlsSession *hls_table_acquire(int64_t handle) {
+  uint32_t generation = 0;
+  HlsTableSlot *slot = slot_of(handle, &generation);
+  if (!slot)
+    return NULL;
+  // 快速路径：代数不符直接拒绝，不触碰锁
+  if (native_atomic_load_u32(&slot->generation) != generation)
+    return NULL;
+
+  native_mutex_lock(&slot->lock);
+  if (slot->generation != generation || !slot->session) {
+    native_mutex_unlock(&slot->lock);
+    return NULL;
+  }
+  return slot->session;
+}
+
+void hls_table_release(int64_t handle) {
+  uint32_t generation = 0;
+  HlsTableSlot *slot = slot_of(handle, &generation);
+  if (slot)
+    native_mutex_unlock(&slot->lock);
+}
+
+HlsSession *hls_table_remove(int64_t handle) {
+  uint32_t generation = 0;
+  HlsTableSlot *slot = slot_of(handle, &generation);
+  if (!slot)
+    return NULL;
+
+  HlsSession *session = slot->session;
+  uint32_t next_generation = generation + 1;
+  if (next_generation == 0)
+    next_generation = 1;
+  native_atomic_store_ptr((void *volatile *) &slot->session, NULL);
+  native_atomic_store_u32(&slot->generation, next_generation);
+  native_mutex_unlock(&slot->lock);
+
+  // 归还槽位到所属分片的空闲链表
+  uint32_t index = (uint32_t) ((uint64_t) handle & 0xFFFFFFFFu) - 1;
+  HlsTableShard *shard = &g_shards[index & (HLS_TABLE_SHARDS - 1)];
+  native_mutex_lock(&shard->lock);
+  slot->next_free = shard->free_head;
+  shard->free_head = (index >> HLS_TABLE_SHARD_BITS) + 1;
+  native_mutex_unlock(&shard->lock);
+
+  return session;
+}
+
+void hls_table_foreach(void (*fn)(int64_t handle, HlsSession *session, void *opaque), void *opaque) {
+  if (!native_atomic_load_u32(&g_shards_ready))
+    return;
+  for (uint32_t s = 0; s < HLS_TABLE_SHARDS; s++) {
+    HlsTableShard *shard = &g_shards[s];
+    uint32_t nb_pages = native_atomic_load_u32(&shard->nb_pages);
+    for (uint32_t p = 0; p < nb_pages; p++) {
+      HlsTableSlot *slots = (HlsTableSlot *) native_atomic_load_ptr((void *volatile *) &shard->pages[p]);
+      for (uint32_t i = 0; slots && i < HLS_TABLE_PAGE_SLOTS; i++) {
+        HlsTableSlot *slot = &slots[i];
+        if (!native_atomic_load_ptr((void *volatile *) &slot->session))
+          continue;
+        native_mutex_lock(&slot->lock);
+        if (slot->session) {
+          uint32_t local = (p << HLS_TABLE_PAGE_BITS) | i;
+          fn(make_handle(slot->generation, s, local), slot->session, opaque);
+        }
+        native_mutex_unlock(&slot->lock);
+      }
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef HLS_SESSION_TABLE_H
+#define HLS_SESSION_TABLE_H
+
+#include <stdint.h>
+#include "native_media.h"
+
+/*
+ * HLS 会话句柄表
+ *
+ * 返回给 Java 的 jlong 不再是裸指针，而是 "generation << 32 | (slot + 1)"：
+ * - slot 的低 HLS_TABLE_SHARD_BITS 位选择分片，分片之间互不竞争；
+ * - generation 在会话被移除时递增，过期或伪造的句柄会在查找阶段被拒绝；
+ * - 查找不加全局锁：先无锁比较 generation，再锁住该槽位自身的互斥锁并复核。
+ *
+ * 槽位（以及其中的互斥锁）只增不减，因此即使会话已被释放，对旧句柄加锁也是安全的。
+ */
+
+#define HLS_TABLE_SHARD_BITS 4
+#define HLS_TABLE_SHARDS (1 << HLS_TABLE_SHARD_BITS)
+#define HLS_TABLE_PAGE_BITS 8
+#define HLS_TABLE_PAGE_SLOTS (1 << HLS_TABLE_PAGE_BITS)
+#define HLS_TABLE_MAX_PAGES 64
+
+/**
+ * 注册一个会话
+ * @return 成功返回非 0 句柄，表满或内存不足返回 0
+ */
+int64_t hls_table_insert(HlsSession *session);
+
+/**
+ * 根据句柄查找会话，并持有该会话的互斥锁
+ * @return 成功返回会话指针（调用方须调用 hls_table_release），句柄无效返回 NULL
+ */
+HlsSession *hls_table_acquire(int64_t handle);
+
+/**
+ * 释放 hls_table_acquire 持有的会话锁
+ */
+void hls_table_release(int64_t handle);
+
+/**
+ * 在持有会话锁的前提下将会话移出句柄表并释放锁，之后旧句柄全部失效
+ * @return 被移除的会话，由调用方负责释放
+ */
+HlsSession *hls_table_remove(int64_t handle);
+
+/**
+ * 依次锁住每个存活会话并回调（回调期间持有该会话的锁）
+ */
+void hls_table_foreach(void (*fn)(int64_t handle, HlsSession *session, void *opaque), void *opaque);
+
+#endif // HLS_SESSION_TABLE_H
@@ -0,0 +1,390 @@
+// hls_to_mp4.c
+//
+// 把 HLS 媒体播放列表（例如 persistent HLS 会话生成的播放列表）重封装为一个 MP4 文件，不解码：
+// 分段由后台线程大块预读并首尾相接成一个输入，音频为 ADTS 封装的 AAC 时经 aac_adtstoasc 转换，
+// 输出使用 faststart 布局（按播放列表总时长估算预留 moov 空间），一次写成。
+// DISCONTINUITY 或新的 EXT-X-MAP 处开始一个新的输入，各输入按逐路时间线拼接。
+// 编码参数或 extradata 与第一段输入不同的输入无法共用输出流，整段跳过并在结果中计数。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+#include <libavutil/mathematics.h>
+#include "native_media.h"
+#include "hls_concat_reader.h"
+#include "hls_playlist.h"
+#include "mp4_layout.h"
+#include "stream_stitcher.h"
+#include "stream_transcoder.h"
+
+#define HLS_TO_MP4_CHUNK_SIZE (4 * 1024 * 1024) // 预读块大小
+#define HLS_TO_MP4_READ_AHEAD 4                 // 最多预读的块数
+
+// 播放列表中一段连续的分段（同一个初始化分段、之间没有 DISCONTINUITY）
+typedef struct HlsRun {
+  HlsConcatPiece *pieces;
+  int nb_pieces;
+} HlsRun;
+
+typedef struct HlsRemuxInput {
+  HlsConcatReader *reader;
+  AVFormatContext *fmt_ctx;
+  int in_index[2];              // 视频、音频输入流序号
+  AVBSFContext *bsf[2];         // 音频 ADTS -> ASC 转换
+} HlsRemuxInput;
+
+// 分段 URI 相对于播放列表所在目录，绝对路径与 URL 原样使用
+static char *resolve_segment_path(const char *playlist, const char *uri) {
+  int absolute = uri[0] == '/' || uri[0] == '\\' || strstr(uri, "://") ||
+                 (uri[0] && uri[1] == ':');
+  const char *slash = strrchr(playlist, '/');
+  const char *backslash = strrchr(playlist, '\\');
+  if (backslash && (!slash || backslash > slash))
+    slash = backslash;
+  size_t dir_len = absolute || !slash ? 0 : (size_t) (slash - playlist + 1);
+  char *path = (char *) malloc(dir_len + strlen(uri) + 1);
+  if (!path)
+    return NULL;
+  memcpy(path, playlist, dir_len);
+  strcpy(path + dir_len, uri);
+  return path;
+}
+
+static void free_runs(HlsRun *runs, int nb_runs) {
+  for (int i = 0; i < nb_runs; i++) {
+    for (int j = 0; j < runs[i].nb_pieces; j++)
+      free((char *) runs[i].pieces[j].path);
+    free(runs[i].pieces);
+  }
+  free(runs);
+}
+
+// 按 DISCONTINUITY 与 EXT-X-MAP 把播放列表切成若干段连续输入
+static int build_runs(const HlsPlaylist *pl, const char *playlist, HlsRun **out, int *nb_out) {
+  HlsRun *runs = (HlsRun *) calloc(pl->nb_entries, sizeof(HlsRun));
+  if (!runs)
+    return AVERROR(ENOMEM);
+  int nb_runs = 0;
+  const char *map_uri = NULL;
+  for (int i = 0; i < pl->nb_entries; i++) {
+    const HlsPlaylistEntry *entry = &pl->entries[i];
+    if (entry->map_uri)
+      map_uri = entry->map_uri;
+    if (i == 0 || entry->discontinuity || entry->map_uri) {
+      HlsRun *run = &runs[nb_runs++];
+      // 每段最多：初始化分段 + 剩余的全部分段
+      run->pieces = (HlsConcatPiece *) calloc(pl->nb_entries - i + 1, sizeof(HlsConcatPiece));
+      if (!run->pieces)
+        goto fail;
+      if (map_uri) {
+        run->pieces[0].path = resolve_segment_path(playlist, map_uri);
+        run->pieces[0].length = -1;
+        if (!run->pieces[0].path)
+          goto fail;
+        run->nb_pieces = 1;
+      }
+    }
+    HlsRun *run = &runs[nb_runs - 1];
+    HlsConcatPiece *piece = &run->pieces[run->nb_pieces];
+    piece->path = resolve_segment_path(playlist, entry->uri);
+    if (!piece->path)
+      goto fail;
+    piece->offset = entry->offset >= 0 ? entry->offset : 0;
+    piece->length = entry->offset >= 0 ? entry->length : -1;
+    run->nb_pieces++;
+  }
+  *out = runs;
+  *nb_out = nb_runs;
+  return 0;
+
+  fail:
+  free_runs(runs, nb_runs);
+  return AVERROR(ENOMEM);
+}
+
+static void close_remux_input(HlsRemuxInput *in) {
+  for (int i = 0; i < 2; i++)
+    av_bsf_free(&in->bsf[i]);
+  avformat_close_input(&in->fmt_ctx);
+  hls_concat_reader_free(&in->reader);
+}
+
+// 打开一段连续输入：音频为没有 extradata 的 AAC（ADTS 封装）时建立 aac_adtstoasc
+static int open_remux_input(HlsRemuxInput *in, const HlsRun *run) {
+  memset(in, 0, sizeof(*in));
+  int ret = hls_concat_reader_open(&in->reader, run->pieces, run->nb_pieces, HLS_TO_MP4_CHUNK_SIZE,
+                                   HLS_TO_MP4_READ_AHEAD);
+  if (ret < 0)
+    return ret;
+  in->fmt_ctx = avformat_alloc_context();
+  if (!in->fmt_ctx) {
+    close_remux_input(in);
+    return AVERROR(ENOMEM);
+  }
+  in->fmt_ctx->pb = hls_concat_reader_avio(in->reader);
+  in->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+  if ((ret = avformat_open_input(&in->fmt_ctx, NULL, NULL, NULL)) < 0 ||
+      (ret = avformat_find_stream_info(in->fmt_ctx, NULL)) < 0) {
+    close_remux_input(in);
+    return ret;
+  }
+
+  in->in_index[0] = av_find_best_stream(in->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  in->in_index[1] = av_find_best_stream(in->fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+  if (in->in_index[1] >= 0) {
+    AVStream *st = in->fmt_ctx->streams[in->in_index[1]];
+    if (st->codecpar->codec_id == AV_CODEC_ID_AAC && st->codecpar->extradata_size == 0) {
+      const AVBitStreamFilter *filter = av_bsf_get_by_name("aac_adtstoasc");
+      if (!filter)
+        ret = AVERROR_BSF_NOT_FOUND;
+      else if ((ret = av_bsf_alloc(filter, &in->bsf[1])) >= 0 &&
+               (ret = avcodec_parameters_copy(in->bsf[1]->par_in, st->codecpar)) >= 0) {
+        in->bsf[1]->time_base_in = st->time_base;
+        ret = av_bsf_init(in->bsf[1]);
+      }
+      if (ret < 0) {
+        close_remux_input(in);
+        return ret;
+      }
+    }
+  }
+  return 0;
+}
+
+// 一段输入中的流能否直接接在输出流之后：编码参数一致，且 extradata（参数集、ASC）相同
+static int run_stream_matches(const HlsRemuxInput *in, int k, const AVCodecParameters *out_par) {
+  const AVCodecParameters *par = in->bsf[k] ? in->bsf[k]->par_out : in->fmt_ctx->streams[in->in_index[k]]->codecpar;
+  if (!stream_params_match(par, out_par) || par->extradata_size != out_par->extradata_size)
+    return 0;
+  return par->extradata_size == 0 || !memcmp(par->extradata, out_par->extradata, par->extradata_size);
+}
+
+// 写入一个输入时间基的数据包：转换到输出时间基，按该路流的时间线加上偏移
+static int write_remux_packet(AVFormatContext *ofmt_ctx, StreamStitcher *stitcher, AVPacket *pkt, AVRational in_tb,
+                              int out_index) {
+  av_packet_rescale_ts(pkt, in_tb, ofmt_ctx->streams[out_index]->time_base);
+  pkt->pos = -1;
+  pkt->stream_index = out_index;
+  int ret = 0;
+  if (stream_stitcher_map(stitcher, out_index, pkt))
+    ret = av_interleaved_write_frame(ofmt_ctx, pkt);
+  av_packet_unref(pkt);
+  return ret;
+}
+
+static int write_silence_packet(void *opaque, AVPacket *pkt) {
+  return av_interleaved_write_frame((AVFormatContext *) opaque, pkt);
+}
+
+// 处理一个输入数据包（经过比特流滤镜的流先转换），数据包的引用会被消耗
+static int remux_input_packet(AVFormatContext *ofmt_ctx, StreamStitcher *stitcher, HlsRemuxInput *in,
+                              const int *out_index, AVPacket *pkt) {
+  int k = pkt->stream_index == in->in_index[0] ? 0 : pkt->stream_index == in->in_index[1] ? 1 : -1;
+  if (k < 0 || out_index[k] < 0) {
+    av_packet_unref(pkt);
+    return 0;
+  }
+  AVRational in_tb = in->fmt_ctx->streams[pkt->stream_index]->time_base;
+  if (!in->bsf[k])
+    return write_remux_packet(ofmt_ctx, stitcher, pkt, in_tb, out_index[k]);
+
+  int ret = av_bsf_send_packet(in->bsf[k], pkt);
+  av_packet_unref(pkt);
+  if (ret < 0)
+    return 0; // 无法转换的数据包跳过
+  while ((ret = av_bsf_receive_packet(in->bsf[k], pkt)) >= 0) {
+    if ((ret = write_remux_packet(ofmt_ctx, stitcher, pkt, in->bsf[k]->time_base_out, out_index[k])) < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 把一段连续输入写入输出
+static int remux_run(AVFormatContext *ofmt_ctx, StreamStitcher *stitcher, HlsRemuxInput *in,
+                     const int *out_index) {
+  int nb_out = (int) ofmt_ctx->nb_streams;
+  int in_index[STITCH_MAX_STREAMS];
+  for (int j = 0; j < nb_out; j++)
+    in_index[j] = -1;
+  for (int k = 0; k < 2; k++) {
+    if (out_index[k] >= 0)
+      in_index[out_index[k]] = in->in_index[k];
+  }
+
+  AVPacket *head[STITCH_HEAD_PACKETS];
+  int nb_head = 0;
+  int ret = stream_stitcher_begin_input(stitcher, in->fmt_ctx, in_index, head, STITCH_HEAD_PACKETS, &nb_head);
+  if (ret < 0)
+    return ret;
+  for (int j = 0; j < nb_out && ret >= 0; j++)
+    ret = stream_stitcher_pad(stitcher, j, ofmt_ctx->streams[j]->codecpar, write_silence_packet, ofmt_ctx);
+
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt && ret >= 0)
+    ret = AVERROR(ENOMEM);
+  for (int k = 0; k < nb_head; k++) {
+    if (ret >= 0)
+      ret = remux_input_packet(ofmt_ctx, stitcher, in, out_index, head[k]);
+    av_packet_free(&head[k]);
+  }
+  // 读取出错（而不是到达结尾）时返回错误，不把输出当作完整
+  int read_ret = 0;
+  while (ret >= 0 && (read_ret = av_read_frame(in->fmt_ctx, pkt)) >= 0)
+    ret = remux_input_packet(ofmt_ctx, stitcher, in, out_index, pkt);
+  if (ret >= 0 && read_ret < 0 && read_ret != AVERROR_EOF)
+    ret = read_ret;
+  av_packet_free(&pkt);
+  stream_stitcher_end_input(stitcher);
+  return ret;
+}
+
+const char *hls_to_mp4(const char *playlistPath, const char *outputPath) {
+  static char resultMsg[256];
+  HlsPlaylist pl;
+  HlsRun *runs = NULL;
+  int nb_runs = 0;
+  HlsRemuxInput in;
+  memset(&in, 0, sizeof(in));
+  AVFormatContext *ofmt_ctx = NULL;
+  AVDictionary *mux_opts = NULL;
+  int ret = 0, skipped = 0;
+
+  memset(&pl, 0, sizeof(pl));
+  if ((ret = hls_playlist_load(&pl, playlistPath)) < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to load playlist: %s", playlistPath);
+    goto end;
+  }
+  if (pl.nb_entries == 0) {
+    ret = AVERROR_INVALIDDATA;
+    snprintf(resultMsg, sizeof(resultMsg), "Playlist has no segments: %s", playlistPath);
+    goto end;
+  }
+  if ((ret = build_runs(&pl, playlistPath, &runs, &nb_runs)) < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to allocate segment list");
+    goto end;
+  }
+
+  // 第一段输入决定输出流
+  if ((ret = open_remux_input(&in, &runs[0])) < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to open first segment of %s", playlistPath);
+    goto end;
+  }
+  if ((ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, outputPath)) < 0 || !ofmt_ctx) {
+    ret = ret < 0 ? ret : AVERROR(ENOMEM);
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to create output context for %s", outputPath);
+    goto end;
+  }
+  int out_index[2] = {-1, -1};
+  const AVCodecParameters *out_par[2] = {NULL, NULL};
+  for (int k = 0; k < 2; k++) {
+    if (in.in_index[k] < 0)
+      continue;
+    const AVCodecParameters *par = in.bsf[k] ? in.bsf[k]->par_out : in.fmt_ctx->streams[in.in_index[k]]->codecpar;
+    AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
+    if (!out_stream || (ret = avcodec_parameters_copy(out_stream->codecpar, par)) < 0) {
+      ret = ret < 0 ? ret : AVERROR(ENOMEM);
+      snprintf(resultMsg, sizeof(resultMsg), "Failed to create output stream");
+      goto end;
+    }
+    out_stream->codecpar->codec_tag = 0;
+    out_index[k] = out_stream->index;
+    out_par[k] = out_stream->codecpar;
+  }
+  if (ofmt_ctx->nb_streams == 0) {
+    ret = AVERROR_STREAM_NOT_FOUND;
+    snprintf(resultMsg, sizeof(resultMsg), "No audio or video stream found in %s", playlistPath);
+    goto end;
+  }
+
+  // faststart：按播放列表总时长估算各路流的样本数；总时长或采样率未知时记为 0，由 mp4_layout_apply 改用分片布局
+  double total = 0;
+  for (int i = 0; i < pl.nb_entries; i++)
+    total += pl.entries[i].duration;
+  int64_t nb_samples[2] = {0, 0};
+  if (out_index[0] >= 0 && total > 0) {
+    AVRational rate = av_guess_frame_rate(in.fmt_ctx, in.fmt_ctx->streams[in.in_index[0]], NULL);
+    nb_samples[out_index[0]] = (int64_t) (total * (rate.num > 0 && rate.den > 0 ? av_q2d(rate) : 60)) + 1;
+  }
+  if (out_index[1] >= 0 && total > 0 && out_par[1]->sample_rate > 0) {
+    const AVCodecParameters *par = out_par[1];
+    int frame_size = par->frame_size > 0 ? par->frame_size : 1024;
+    nb_samples[out_index[1]] = (int64_t) (total * par->sample_rate / frame_size) + 1;
+  }
+
+  if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE) &&
+      (ret = avio_open(&ofmt_ctx->pb, outputPath, AVIO_FLAG_WRITE)) < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to open output file %s", outputPath);
+    goto end;
+  }
+  if ((ret = mp4_layout_apply(&mux_opts, ofmt_ctx, MP4_LAYOUT_FASTSTART, nb_samples)) < 0 ||
+      (ret = avformat_write_header(ofmt_ctx, &mux_opts)) < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to write MP4 header");
+    goto end;
+  }
+
+  StreamStitcher stitcher;
+  enum AVMediaType types[STITCH_MAX_STREAMS];
+  AVRational time_bases[STITCH_MAX_STREAMS];
+  for (unsigned int j = 0; j < ofmt_ctx->nb_streams; j++) {
+    types[j] = ofmt_ctx->streams[j]->codecpar->codec_type;
+    time_bases[j] = ofmt_ctx->streams[j]->time_base;
+  }
+  stream_stitcher_init(&stitcher, (int) ofmt_ctx->nb_streams, types, time_bases, 0);
+
+  for (int r = 0; r < nb_runs; r++) {
+    if (r > 0 && open_remux_input(&in, &runs[r]) < 0) {
+      skipped++;
+      continue;
+    }
+    // 编码参数或 extradata 与输出流不同的输入不能直接拼接（输出只有一份 stsd），整段跳过并计数
+    int compatible = 1;
+    for (int k = 0; k < 2; k++) {
+      if (out_index[k] >= 0 && in.in_index[k] >= 0 && !run_stream_matches(&in, k, out_par[k]))
+        compatible = 0;
+    }
+    if (!compatible) {
+      fprintf(stderr, "hlsToMp4: skipped run %d of %s: stream parameters differ from the output\n", r, playlistPath);
+      close_remux_input(&in);
+      skipped++;
+      continue;
+    }
+    ret = remux_run(ofmt_ctx, &stitcher, &in, out_index);
+    // 无法打开的分段文件由读取器跳过
+    skipped += hls_concat_reader_skipped(in.reader);
+    close_remux_input(&in);
+    if (ret < 0) {
+      char errbuf[128] = {0};
+      av_strerror(ret, errbuf, sizeof(errbuf));
+      snprintf(resultMsg, sizeof(resultMsg), "Failed to remux %s: %s", playlistPath, errbuf);
+      goto end;
+    }
+  }
+
+  // faststart 时 moov 在这里写回文件头预留的空间
+  if ((ret = av_write_trailer(ofmt_ctx)) < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to write MP4 trailer");
+    goto end;
+  }
+  if (skipped > 0)
+    snprintf(resultMsg, sizeof(resultMsg), "Remuxed %d segments into %s (skipped %d unreadable or incompatible part(s))",
+             pl.nb_entries, outputPath, skipped);
+  else
+    snprintf(resultMsg, sizeof(resultMsg), "Remuxed %d segments into %s", pl.nb_entries, outputPath);
+
+  end:
+  av_dict_free(&mux_opts);
+  close_remux_input(&in);
+  if (ofmt_ctx) {
+    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+      avio_closep(&ofmt_ctx->pb);
+    avformat_free_context(ofmt_ctx);
+  }
+  free_runs(runs, nb_runs);
+  hls_playlist_uninit(&pl);
+  return resultMsg;
+}
@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/avstring.h>
+#include <libavutil/dict.h>
+#include <libavutil/opt.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include "hls_writer.h"
+
+#define HLS_WRITER_IO_BUFFER_SIZE (64 * 1024)
+
+// 自定义 AVIO 回调：把复用器输出写入当前分段文件
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+static int write_segment_data(void *opaque, uint8_t *buf, int buf_size) {
+#else
+static int write_segment_data(void *opaque, const uint8_t *buf, int buf_size) {
+#endif
+  HlsWriter *w = (HlsWriter *) opaque;
+  if (!w->segment_file)
+    return AVERROR(EIO);
+  if (fwrite(buf, 1, buf_size, w->segment_file) != (size_t) buf_size)
+    return AVERROR(EIO);
+  w->bytes_written += buf_size;
+  w->file_pos += buf_size;
+  return buf_size;
+}
+
+int hls_writer_parse_options(HlsWriterOptions *opts, const char *options) {
+  memset(opts, 0, sizeof(HlsWriterOptions));
+  opts->segment_type = HLS_SEGMENT_TYPE_MPEGTS;
+  snprintf(opts->fmp4_init_filename, sizeof(opts->fmp4_init_filename), "init.mp4");
+  if (!options || !options[0])
+    return 0;
+
+  AVDictionary *dict = NULL;
+  int ret = av_dict_parse_string(&dict, options, "=", ":", 0);
+  const AVDictionaryEntry *e = NULL;
+  while (ret >= 0 && (e = av_dict_get(dict, "", e, AV_DICT_IGNORE_SUFFIX))) {
+    if (!strcmp(e->key, "hls_segment_type")) {
+      if (!strcmp(e->value, "fmp4"))
+        opts->segment_type = HLS_SEGMENT_TYPE_FMP4;
+      else if (!strcmp(e->value, "mpegts"))
+        opts->segment_type = HLS_SEGMENT_TYPE_MPEGTS;
+      else
+        ret = AVERROR(EINVAL);
+    } else if (!strcmp(e->key, "hls_fmp4_init_filename") && e->value[0]) {
+      snprintf(opts->fmp4_init_filename, sizeof(opts->fmp4_init_filename), "%s", e->value);
+    } else if (!strcmp(e->key, "hls_flags")) {
+      // 与 hls muxer 一致，多个标志用 '+' 连接
+      char flags[256] = {0};
+      snprintf(flags, sizeof(flags), "%s", e->value);
+      char *save = NULL;
+      for (char *flag = av_strtok(flags, "+", &save); flag && ret >= 0; flag = av_strtok(NULL, "+", &save)) {
+        if (!strcmp(flag, "single_file"))
+          opts->single_file = 1;
+        else
+          ret = AVERROR(EINVAL);
+      }
+    } else if (!strcmp(e->key, "hls_part_duration")) {
+      char *end = NULL;
+      opts->part_duration = strtod(e->value, &end);
+      if (end == e->value || *end || opts->part_duration < 0)
+        ret = AVERROR(EINVAL);
+    } else {
+      ret = AVERROR(EINVAL);
+    }
+  }
+  av_dict_free(&dict);
+  return ret < 0 ? ret : 0;
+}
+
+/*
+ * 打开新的媒体文件
+ * 单文件模式下若播放列表最后一个分段就在某个共享文件中，则接着该文件写，
+ * 并先截掉上次异常退出时残留的、未进入播放列表的数据
+ */
+static int open_media_file(HlsWriter *w) {
+  const HlsPlaylistEntry *last = w->playlist.nb_entries > 0 ? &w->playlist.entries[w->playlist.nb_entries - 1] : NULL;
+  if (w->opts.single_file && last && last->offset >= 0) {
+    const char *base = av_basename(w->segment_pattern);
+    snprintf(w->segment_path, sizeof(w->segment_path), "%.*s%s",
+             (int) (base - w->segment_pattern), w->segment_pattern, last->uri);
+    w->file_pos = last->offset + last->length;
+    int ret = hls_truncate_file(w->segment_path, w->file_pos);
+    if (ret < 0)
+      return ret;
+    w->segment_file = hls_fopen(w->segment_path, "ab");
+  } else {
+    // 单文件模式允许模板中不含 %d，此时直接使用模板作为文件名
+    if (av_get_frame_filename(w->segment_path, sizeof(w->segment_path), w->segment_pattern, (int) w->next_number) < 0) {
+      if (!w->opts.single_file)
+        return AVERROR(EINVAL);
+      snprintf(w->segment_path, sizeof(w->segment_path), "%s", w->segment_pattern);
+    }
+    w->file_pos = 0;
+    w->segment_file = hls_fopen(w->segment_path, "wb");
+  }
+  if (!w->segment_file)
+    return AVERROR(errno ? errno : EIO);
+  return 0;
+}
+
+static int open_segment(HlsWriter *w) {
+  if (!w->segment_file) {
+    int ret = open_media_file(w);
+    if (ret < 0)
+      return ret;
+  }
+  w->segment_offset = w->file_pos;
+  w->part_offset = w->file_pos;
+  w->segment_start = AV_NOPTS_VALUE;
+  w->segment_end = AV_NOPTS_VALUE;
+  // 每个分段都重新输出 PAT/PMT，保证分段可以独立解码
+  if (w->header_written && w->opts.segment_type == HLS_SEGMENT_TYPE_MPEGTS)
+    av_opt_set(w->mux->priv_data, "mpegts_flags", "+resend_headers", 0);
+  return 0;
+}
+
+// 重写播放列表并通知调用方
+static int publish_playlist(HlsWriter *w) {
+  int ret = hls_playlist_write(&w->playlist);
+  if (ret >= 0 && w->on_playlist)
+    w->on_playlist(w, w->opaque);
+  return ret;
+}
+
+/*
+ * 预加载提示指向下一个部分分段：单文件模式下是同一文件的当前末尾，
+ * 否则在部分分段之间是当前分段文件的末尾，在分段之间是下一个分段文件的开头
+ */
+static int update_preload_hint(HlsWriter *w, int segment_finished) {
+  if (w->opts.part_duration <= 0)
+    return 0;
+  if (!segment_finished || (w->opts.single_file && w->segment_file))
+    return hls_playlist_set_preload_hint(&w->playlist, av_basename(w->segment_path), w->file_pos);
+  char next_path[1024] = {0};
+  if (av_get_frame_filename(next_path, sizeof(next_path), w->segment_pattern, (int) w->next_number) < 0)
+    return hls_playlist_set_preload_hint(&w->playlist, NULL, 0);
+  return hls_playlist_set_preload_hint(&w->playlist, av_basename(next_path), 0);
+}
+
+// 刷出复用器中已缓存的数据：先清空交错队列，再让复用器输出尚未成包的 PES（fMP4 下为一个 moof + mdat）
+static int flush_muxer_data(HlsWriter *w) {
+  av_interleaved_write_frame(w->mux, NULL);
+  av_write_frame(w->mux, NULL);
+  avio_flush(w->avio);
+  return w->avio->error < 0 ? w->avio->error : 0;
+}
+
+// 记录 [part_offset, file_pos) 为一个部分分段（没有数据时跳过）
+static int add_part(HlsWriter *w, int64_t end_ts) {
+  if (w->file_pos <= w->part_offset || w->part_start == AV_NOPTS_VALUE)
+    return 0;
+  double duration = end_ts > w->part_start ? (end_ts - w->part_start) / (double) AV_TIME_BASE : 0;
+  int ret = hls_playlist_add_part(&w->playlist, av_basename(w->segment_path), w->pending_discontinuity, duration,
+                                  w->part_offset, w->file_pos - w->part_offset, w->part_independent);
+  w->part_offset = w->file_pos;
+  w->part_start = end_ts;
+  return ret;
+}
+
+/*
+ * 结束当前部分分段：刷出复用器使数据落盘，追加 #EXT-X-PART 并重写播放列表
+ * 部分分段是当前分段文件中的一个字节范围，不单独生成文件
+ */
+static int finish_part(HlsWriter *w, int64_t end_ts) {
+  int ret = flush_muxer_data(w);
+  if (ret >= 0 && (!w->segment_file || fflush(w->segment_file) != 0))
+    ret = AVERROR(EIO);
+  if (ret < 0)
+    return ret;
+  if ((ret = add_part(w, end_ts)) < 0 || (ret = update_preload_hint(w, 0)) < 0)
+    return ret;
+  return publish_playlist(w);
+}
+
+/*
+ * 结束当前分段：刷出复用器缓存、关闭文件、追加播放列表条目并原子重写 m3u8
+ * flush_muxer 为 0 表示调用方已经通过 av_write_trailer 刷出了数据
+ * fMP4（frag_custom）下 av_write_frame(NULL) 会把已缓存的样本输出为一个完整的 moof + mdat
+ */
+static int finish_segment(HlsWriter *w, int64_t end_ts, int flush_muxer) {
+  int ret = 0;
+  if (flush_muxer) {
+    ret = flush_muxer_data(w);
+  } else {
+    avio_flush(w->avio);
+    if (w->avio->error < 0)
+      ret = w->avio->error;
+  }
+
+  // 单文件模式下切换分段时文件保持打开，只需保证数据在更新播放列表之前落盘；
+  // 上一次 open_segment 失败时没有打开的文件
+  if (!w->segment_file) {
+    if (ret >= 0)
+      ret = AVERROR(EIO);
+  } else if (w->opts.single_file && flush_muxer) {
+    if (fflush(w->segment_file) != 0 && ret >= 0)
+      ret = AVERROR(EIO);
+  } else {
+    if (fclose(w->segment_file) != 0 && ret >= 0)
+      ret = AVERROR(EIO);
+    w->segment_file = NULL;
+  }
+
+  if (w->segment_start == AV_NOPTS_VALUE) {
+    // 空分段：不进入播放列表（共享文件中可能已有其他分段，不能删除）
+    if (!w->opts.single_file)
+      remove(w->segment_path);
+    return ret;
+  }
+  if (ret < 0)
+    return ret;
+
+  // 低延迟模式下分段的最后一部分也要作为部分分段列出
+  if (w->opts.part_duration > 0 && (ret = add_part(w, end_ts)) < 0)
+    return ret;
+
+  double duration = end_ts > w->segment_start ? (end_ts - w->segment_start) / (double) AV_TIME_BASE : 0;
+  if (w->opts.single_file)
+    ret = hls_playlist_add_segment_range(&w->playlist, av_basename(w->segment_path), duration,
+                                         w->pending_discontinuity, w->segment_offset,
+                                         w->file_pos - w->segment_offset);
+  else
+    ret = hls_playlist_add_segment(&w->playlist, av_basename(w->segment_path), duration, w->pending_discontinuity);
+  if (ret < 0)
+    return ret;
+  w->pending_discontinuity = 0;
+  w->segments_written++;
+  w->next_number++;
+  // 先让调用方落盘自己的状态（如检查点），再更新播放列表，
+  // 这样播放列表永远不会领先于调用方记录的进度
+  if (w->on_segment && (ret = w->on_segment(w, end_ts, w->opaque)) < 0)
+    return ret;
+  if ((ret = update_preload_hint(w, 1)) < 0)
+    return ret;
+  return publish_playlist(w);
+}
+
+int hls_writer_open(HlsWriter *w, const char *playlist_path, const char *segment_pattern,
+                    int64_t start_number, double segment_duration, const char *options) {
+  memset(w, 0, sizeof(HlsWriter));
+  w->segment_duration = segment_duration > 0 ? segment_duration : 2;
+  w->segment_start = AV_NOPTS_VALUE;
+  w->segment_end = AV_NOPTS_VALUE;
+  w->part_start = AV_NOPTS_VALUE;
+  w->ref_stream = -1;
+
+  int ret = hls_writer_parse_options(&w->opts, options);
+  if (ret < 0)
+    return ret;
+
+  ret = hls_playlist_load(&w->playlist, playlist_path);
+  if (ret == AVERROR(ENOENT)) {
+    w->playlist.media_sequence = start_number;
+  } else if (ret < 0) {
+    hls_playlist_uninit(&w->playlist);
+    return ret;
+  }
+  if (!w->playlist.playlist_type[0])
+    snprintf(w->playlist.playlist_type, sizeof(w->playlist.playlist_type), "EVENT");
+  if ((int) (w->segment_duration + 0.5) > w->playlist.target_duration)
+    w->playlist.target_duration = (int) (w->segment_duration + 0.5);
+  if (w->opts.part_duration >= w->segment_duration) {
+    hls_playlist_uninit(&w->playlist);
+    return AVERROR(EINVAL);
+  }
+  w->playlist.part_target = w->opts.part_duration;
+
+  // 在已有播放列表后继续：分段编号顺延，新内容与旧内容之间时间戳不连续
+  w->next_number = start_number;
+  if (w->playlist.nb_entries > 0) {
+    if (hls_playlist_next_sequence(&w->playlist) > w->next_number)
+      w->next_number = hls_playlist_next_sequence(&w->playlist);
+    w->pending_discontinuity = 1;
+  }
+
+  // EXT-X-MAP 用于非 I 帧播放列表需要版本 6 以上，fMP4 统一使用版本 7
+  if (w->opts.segment_type == HLS_SEGMENT_TYPE_FMP4 && w->playlist.version < 7)
+    w->playlist.version = 7;
+
+  w->segment_pattern = av_strdup(segment_pattern);
+  w->options = options ? av_strdup(options) : NULL;
+  if (!w->segment_pattern || (options && !w->options)) {
+    hls_writer_free(w);
+    return AVERROR(ENOMEM);
+  }
+  ret = avformat_alloc_output_context2(&w->mux, NULL,
+                                       w->opts.segment_type == HLS_SEGMENT_TYPE_FMP4 ? "mp4" : "mpegts", NULL);
+  if (ret < 0 || !w->mux) {
+    hls_writer_free(w);
+    return ret < 0 ? ret : AVERROR(ENOMEM);
+  }
+  return 0;
+}
+
+int hls_writer_add_stream(HlsWriter *w, const AVCodecParameters *par, AVRational time_base) {
+  if (w->header_written || w->mux->nb_streams >= HLS_WRITER_MAX_STREAMS)
+    return AVERROR(EINVAL);
+  // fMP4 分段只能携带 mp4 支持的编码（例如 TS 中的 DVB 字幕无法放入）
+  if (w->opts.segment_type == HLS_SEGMENT_TYPE_FMP4 &&
+      avformat_query_codec(w->mux->oformat, par->codec_id, FF_COMPLIANCE_NORMAL) != 1)
+    return AVERROR(ENOSYS);
+  AVStream *out_stream = avformat_new_stream(w->mux, NULL);
+  if (!out_stream)
+    return AVERROR(ENOMEM);
+  int ret = avcodec_parameters_copy(out_stream->codecpar, par);
+  if (ret < 0)
+    return ret;
+  out_stream->codecpar->codec_tag = 0;
+  out_stream->time_base = time_base;
+  w->in_time_base[out_stream->index] = time_base;
+
+  if (w->ref_stream < 0 ||
+      (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+       w->mux->streams[w->ref_stream]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO))
+    w->ref_stream = out_stream->index;
+  return out_stream->index;
+}
+
+/*
+ * fMP4：以 empty_moov 写出 ftyp + moov 到初始化分段文件，之后每个分段只包含 moof + mdat
+ * 续写已有播放列表时初始化分段以起始编号区分，避免覆盖旧分段仍在引用的初始化分段
+ */
+static int write_fmp4_header(HlsWriter *w) {
+  char init_name[300] = {0};
+  if (w->playlist.nb_entries > 0) {
+    const char *ext = strrchr(w->opts.fmp4_init_filename, '.');
+    int stem_len = ext ? (int) (ext - w->opts.fmp4_init_filename) : (int) strlen(w->opts.fmp4_init_filename);
+    snprintf(init_name, sizeof(init_name), "%.*s_%lld%s", stem_len, w->opts.fmp4_init_filename,
+             (long long) w->next_number, ext ? ext : "");
+  } else {
+    snprintf(init_name, sizeof(init_name), "%s", w->opts.fmp4_init_filename);
+  }
+  // 初始化分段与分段文件位于同一目录
+  const char *base = av_basename(w->segment_pattern);
+  snprintf(w->segment_path, sizeof(w->segment_path), "%.*s%s",
+           (int) (base - w->segment_pattern), w->segment_pattern, init_name);
+  w->segment_file = hls_fopen(w->segment_path, "wb");
+  if (!w->segment_file)
+    return AVERROR(errno ? errno : EIO);
+
+  AVDictionary *opts = NULL;
+  av_dict_set(&opts, "movflags", "+frag_custom+empty_moov+default_base_moof+skip_trailer", 0);
+  int ret = avformat_write_header(w->mux, &opts);
+  av_dict_free(&opts);
+  if (ret < 0)
+    return ret;
+  avio_flush(w->avio);
+  ret = w->avio->error;
+  if (fclose(w->segment_file) != 0 && ret >= 0)
+    ret = AVERROR(EIO);
+  w->segment_file = NULL;
+  if (ret < 0)
+    return ret;
+
+  if ((ret = hls_playlist_set_map(&w->playlist, init_name)) < 0)
+    return ret;
+  if ((ret = open_segment(w)) < 0)
+    return ret;
+  w->header_written = 1;
+  return 0;
+}
+
+int hls_writer_write_header(HlsWriter *w) {
+  if (w->mux->nb_streams == 0)
+    return AVERROR(EINVAL);
+
+  unsigned char *buffer = av_malloc(HLS_WRITER_IO_BUFFER_SIZE);
+  if (!buffer)
+    return AVERROR(ENOMEM);
+  w->avio = avio_alloc_context(buffer, HLS_WRITER_IO_BUFFER_SIZE, 1, w, NULL, write_segment_data, NULL);
+  if (!w->avio) {
+    av_free(buffer);
+    return AVERROR(ENOMEM);
+  }
+  w->mux->pb = w->avio;
+
+  if (w->opts.segment_type == HLS_SEGMENT_TYPE_FMP4)
+    return write_fmp4_header(w);
+
+  int ret = open_segment(w);
+  if (ret < 0)
+    return ret;
+  ret = avformat_write_header(w->mux, NULL);
+  if (ret < 0)
+    return ret;
+  w->header_written = 1;
+  return 0;
+}
+
+int hls_writer_write_packet(HlsWriter *w, AVPacket *pkt) {
+  if (!w->header_written || pkt->stream_index < 0 || pkt->stream_index >= (int) w->mux->nb_streams) {
+    av_packet_unref(pkt);
+    return AVERROR(EINVAL);
+  }
+  AVStream *out_stream = w->mux->streams[pkt->stream_index];
+  AVRational in_tb = w->in_time_base[pkt->stream_index];
+  int ret;
+
+  int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+  if (pkt->stream_index == w->ref_stream && ts != AV_NOPTS_VALUE) {
+    int64_t t = av_rescale_q(ts, in_tb, AV_TIME_BASE_Q);
+    int is_key = out_stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO || (pkt->flags & AV_PKT_FLAG_KEY);
+    int64_t pkt_duration = pkt->duration > 0 ? av_rescale_q(pkt->duration, in_tb, AV_TIME_BASE_Q) : 0;
+    if (w->segment_start == AV_NOPTS_VALUE) {
+      w->segment_start = t;
+      w->part_start = t;
+      w->part_independent = is_key;
+    } else if (is_key && t - w->segment_start >= (int64_t) (w->segment_duration * AV_TIME_BASE)) {
+      // 到达目标时长后的第一个关键帧：结束当前分段，新分段从该关键帧开始
+      if ((ret = finish_segment(w, t, 1)) < 0 || (ret = open_segment(w)) < 0) {
+        av_packet_unref(pkt);
+        return ret;
+      }
+      w->segment_start = t;
+      w->part_start = t;
+      w->part_independent = 1;
+    } else if (w->opts.part_duration > 0 && t > w->part_start &&
+               t + pkt_duration - w->part_start > (int64_t) (w->opts.part_duration * AV_TIME_BASE)) {
+      // 再写入该数据包就会超过 PART-TARGET：先结束当前部分分段
+      if ((ret = finish_part(w, t)) < 0) {
+        av_packet_unref(pkt);
+        return ret;
+      }
+      w->part_independent = is_key;
+    }
+    int64_t end = t + pkt_duration;
+    if (w->segment_end == AV_NOPTS_VALUE || end > w->segment_end)
+      w->segment_end = end;
+  }
+
+  av_packet_rescale_ts(pkt, in_tb, out_stream->time_base);
+  pkt->pos = -1;
+  return av_interleaved_write_frame(w->mux, pkt);
+}
+
+int hls_writer_close(HlsWriter *w, int end_list) {
+  int ret = 0;
+  if (w->header_written) {
+    ret = av_write_trailer(w->mux);
+    int seg_ret = finish_segment(w, w->segment_end, 0);
+    if (ret >= 0)
+      ret = seg_ret;
+  }
+  w->playlist.ended = end_list;
+  // 写入器关闭后不会再有新的部分分段
+  hls_playlist_set_preload_hint(&w->playlist, NULL, 0);
+  int pl_ret = publish_playlist(w);
+  if (ret >= 0)
+    ret = pl_ret;
+  hls_writer_free(w);
+  return ret;
+}
+
+void hls_writer_free(HlsWriter *w) {
+  if (w->segment_file) {
+    fclose(w->segment_file);
+    w->segment_file = NULL;
+  }
+  if (w->mux) {
+    w->mux->pb = NULL;
+    avformat_free_context(w->mux);
+    w->mux = NULL;
+  }
+  if (w->avio) {
+    av_freep(&w->avio->buffer);
+    avio_context_free(&w->avio);
+  }
+  av_freep(&w->segment_pattern);
+  av_freep(&w->options);
+  hls_playlist_uninit(&w->playlist);
+  w->header_written = 0;
+}
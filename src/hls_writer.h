@@ -0,0 +1,116 @@
+#ifndef HLS_WRITER_H
+#define HLS_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libavformat/avformat.h>
+#include "hls_playlist.h"
+
+/*
+ * 自管理的 HLS 分段写入器
+ *
+ * 内部只保留一个复用器（mpegts，或 fMP4 时为分片 mp4），输出经自定义 AVIOContext 写入"当前分段文件"；
+ * 在参考流（优先视频）的关键帧处达到目标时长即切换分段文件，
+ * 每完成一个分段就向内存播放列表追加一条并原子重写 m3u8。
+ * 这样既不依赖 hls muxer 的 append_list（每次写头都重新解析旧播放列表），
+ * 也保证追加的开销与播放列表已有条目数量无关。
+ */
+
+#define HLS_WRITER_MAX_STREAMS 8
+
+typedef enum HlsSegmentType {
+  HLS_SEGMENT_TYPE_MPEGTS = 0,
+  HLS_SEGMENT_TYPE_FMP4 = 1,      // fMP4/CMAF：共享初始化分段 + moof/mdat 分段
+} HlsSegmentType;
+
+/*
+ * 写入器选项，由 "key=value:key=value" 形式的字符串解析，键名与 FFmpeg hls muxer 保持一致（hls_part_duration 为扩展）：
+ *   hls_segment_type=mpegts|fmp4
+ *   hls_fmp4_init_filename=init.mp4   （位于分段文件所在目录）
+ *   hls_flags=single_file             所有分段写入同一个媒体文件，播放列表使用 #EXT-X-BYTERANGE
+ *   hls_part_duration=0.333           低延迟 HLS：按该时长（秒）输出 #EXT-X-PART 部分分段，0 表示关闭
+ */
+typedef struct HlsWriterOptions {
+  HlsSegmentType segment_type;
+  char fmp4_init_filename[256];
+  int single_file;
+  double part_duration;
+} HlsWriterOptions;
+
+typedef struct HlsWriter {
+  HlsPlaylist playlist;                            // 内存播放列表
+  HlsWriterOptions opts;                           // 解析后的选项
+  char *options;                                   // 原始选项字符串（用于检查点），可为 NULL
+  char *segment_pattern;                           // 分段文件命名模板，例如 "segment_%03d.ts"
+  double segment_duration;                         // 目标分段时长（秒）
+  int64_t next_number;                             // 下一个分段文件编号
+  AVFormatContext *mux;                            // 内部复用器（mpegts 或分片 mp4）
+  AVIOContext *avio;                               // 指向当前分段文件的自定义输出
+  AVRational in_time_base[HLS_WRITER_MAX_STREAMS]; // 调用方写入数据包所用的时间基
+  int ref_stream;                                  // 切片参考流（优先视频流）
+  int header_written;
+  FILE *segment_file;                              // 当前分段文件（单文件模式下为共享的媒体文件）
+  char segment_path[1024];                         // 当前分段文件路径
+  int64_t file_pos;                                // 当前媒体文件已写入的字节数
+  int64_t segment_offset;                          // 当前分段在媒体文件中的起始偏移
+  int64_t segment_start;                           // 当前分段起始时间（AV_TIME_BASE），无数据时为 AV_NOPTS_VALUE
+  int64_t segment_end;                             // 当前分段已写入数据的结束时间（AV_TIME_BASE）
+  int64_t part_start;                              // 当前部分分段起始时间（AV_TIME_BASE）
+  int64_t part_offset;                             // 当前部分分段在媒体文件中的起始偏移
+  int part_independent;                            // 当前部分分段是否以关键帧开始
+  int pending_discontinuity;                       // 下一个完成的分段前是否需要 #EXT-X-DISCONTINUITY
+  int64_t bytes_written;                           // 累计写入分段文件的字节数
+  int64_t segments_written;                        // 累计完成的分段数
+  // 每完成一个分段、重写播放列表之前回调（可为 NULL），segment_end 为该分段结束时间（AV_TIME_BASE）
+  int (*on_segment)(struct HlsWriter *w, int64_t segment_end, void *opaque);
+  // 每次成功重写播放列表之后回调（可为 NULL），用于唤醒等待播放列表更新的调用方
+  void (*on_playlist)(struct HlsWriter *w, void *opaque);
+  void *opaque;
+} HlsWriter;
+
+/**
+ * 解析选项字符串（NULL 或空串表示全部默认），未知的键返回 AVERROR(EINVAL)
+ */
+int hls_writer_parse_options(HlsWriterOptions *opts, const char *options);
+
+/**
+ * 打开写入器；若播放列表已存在则加载并在其后继续追加（分段编号顺延，并插入 DISCONTINUITY）
+ * @param start_number 新播放列表的起始分段编号
+ * @param options 选项字符串，见 HlsWriterOptions，可为 NULL
+ * @return 成功返回 0，失败返回负错误码
+ */
+int hls_writer_open(HlsWriter *w, const char *playlist_path, const char *segment_pattern,
+                    int64_t start_number, double segment_duration, const char *options);
+
+/**
+ * 在写头之前添加一路输出流
+ * @param time_base 之后调用 hls_writer_write_packet 时该流数据包使用的时间基
+ * @return 成功返回流序号，失败返回负错误码
+ */
+int hls_writer_add_stream(HlsWriter *w, const AVCodecParameters *par, AVRational time_base);
+
+/**
+ * 写入复用器头部并打开第一个分段文件
+ * fMP4 模式下头部（ftyp + moov）写入初始化分段文件，并在播放列表中登记 #EXT-X-MAP
+ */
+int hls_writer_write_header(HlsWriter *w);
+
+/**
+ * 写入一个数据包（时间戳使用 hls_writer_add_stream 时声明的时间基），必要时先切换分段
+ * 低延迟模式下，参考流累计达到部分分段时长时先刷出复用器并发布一个 #EXT-X-PART
+ * 数据包的引用会被消耗
+ */
+int hls_writer_write_packet(HlsWriter *w, AVPacket *pkt);
+
+/**
+ * 完成最后一个分段、写出播放列表并释放写入器
+ * @param end_list 1 表示在播放列表末尾写入 #EXT-X-ENDLIST
+ */
+int hls_writer_close(HlsWriter *w, int end_list);
+
+/**
+ * 直接释放写入器（不写 trailer、不更新播放列表）
+ */
+void hls_writer_free(HlsWriter *w);
+
+#endif // HLS_WRITER_H
@@ -1,181 +1,537 @@
 #include "com_litongjava_media_NativeMedia.h"
 #include "native_media.h"
 #include <jni.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/timestamp.h>
+#include "media_probe.h"
+#include "mp4_layout.h"
+#include "native_thread.h"
+#include "stream_stitcher.h"
+#include "stream_transcoder.h"
 
 
+// 不兼容输入在后台转码到的临时文件格式：只作中转，按原样保存数据包与参数
+#define MERGE_NORMALIZE_FORMAT "nut"
+
+typedef struct MergeNormalizeJob {
+  char *const *inputs;
+  const MediaInfo *infos;
+  const MediaInfo *target;      // 输出流模板（第一个输入的探测结果）
+  char **temp_paths;            // 每个输入的临时文件路径，兼容的输入为 NULL
+  const int *pending;           // 需要转码的输入序号（升序，保证先需要的先完成）
+  int nb_pending;
+  volatile uint32_t next;
+  int *results;
+  uint8_t *done;
+  native_mutex_t lock;
+  native_cond_t cond;
+} MergeNormalizeJob;
+
+// 输入的音视频参数与模板一致时可直接重封装（输入缺少的流不参与比较）
+static int merge_input_compatible(const MediaInfo *info, const MediaInfo *target) {
+  if (target->video_par && info->video_par && !stream_params_match(info->video_par, target->video_par))
+    return 0;
+  if (target->audio_par && info->audio_par && !stream_params_match(info->audio_par, target->audio_par))
+    return 0;
+  return 1;
+}
+
+// 写入一个时间基为 tb 的数据包
+static int write_normalized_packet(AVFormatContext *ofmt_ctx, AVPacket *pkt, int out_index, AVRational tb) {
+  pkt->stream_index = out_index;
+  pkt->pos = -1;
+  av_packet_rescale_ts(pkt, tb, ofmt_ctx->streams[out_index]->time_base);
+  return av_interleaved_write_frame(ofmt_ctx, pkt);
+}
+
+// 取出转码器已编码的数据包并写入
+static int write_normalized_output(AVFormatContext *ofmt_ctx, StreamTranscoder *transcoder, int out_index,
+                                   AVRational tb, AVPacket *pkt) {
+  int ret;
+  while ((ret = stream_transcoder_receive(transcoder, pkt)) >= 0) {
+    ret = write_normalized_packet(ofmt_ctx, pkt, out_index, tb);
+    av_packet_unref(pkt);
+    if (ret < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/*
+ * 把一个参数与模板不一致的输入转换成与模板一致的临时文件：
+ * 不匹配的流按模板参数重新编码，匹配的流直接复制；时间戳保持输入的时间线，合并时与普通输入一样处理。
+ */
+static int normalize_merge_input(const char *input, const MediaInfo *info, const MediaInfo *target,
+                                 const char *temp_path) {
+  AVFormatContext *ifmt_ctx = NULL;
+  AVFormatContext *ofmt_ctx = NULL;
+  StreamTranscoder *transcoders[2] = {NULL, NULL};
+  AVPacket *pkt = NULL;
+  int in_index[2] = {info->video_index, info->audio_index};
+  int out_index[2] = {-1, -1};
+  const AVCodecParameters *in_par[2] = {info->video_par, info->audio_par};
+  const AVCodecParameters *target_par[2] = {target->video_par, target->audio_par};
+  AVRational tb[2] = {info->video_time_base, info->audio_time_base};
+
+  int ret = media_open_input(input, &ifmt_ctx);
+  if (ret < 0)
+    return ret;
+  if ((ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, MERGE_NORMALIZE_FORMAT, temp_path)) < 0)
+    goto end;
+  for (int i = 0; i < 2; i++) {
+    if (!in_par[i] || !target_par[i])
+      continue;
+    AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
+    if (!out_stream) {
+      ret = AVERROR(ENOMEM);
+      goto end;
+    }
+    if ((ret = avcodec_parameters_copy(out_stream->codecpar, target_par[i])) < 0)
+      goto end;
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = tb[i];
+    out_index[i] = out_stream->index;
+    if (!stream_params_match(in_par[i], target_par[i])) {
+      ret = stream_transcoder_open(&transcoders[i], in_par[i], tb[i], target_par[i], tb[i],
+                                   i == 0 ? info->video_frame_rate : (AVRational) {0, 1}, 0);
+      if (ret < 0)
+        goto end;
+    }
+  }
+  if ((ret = avio_open(&ofmt_ctx->pb, temp_path, AVIO_FLAG_WRITE)) < 0)
+    goto end;
+  if ((ret = avformat_write_header(ofmt_ctx, NULL)) < 0)
+    goto end;
+
+  pkt = av_packet_alloc();
+  if (!pkt) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  while ((ret = av_read_frame(ifmt_ctx, pkt)) >= 0) {
+    int i = pkt->stream_index == in_index[0] ? 0 : pkt->stream_index == in_index[1] ? 1 : -1;
+    if (i < 0 || out_index[i] < 0) {
+      av_packet_unref(pkt);
+      continue;
+    }
+    if (transcoders[i]) {
+      ret = stream_transcoder_send(transcoders[i], pkt);
+      av_packet_unref(pkt);
+      if (ret >= 0)
+        ret = write_normalized_output(ofmt_ctx, transcoders[i], out_index[i], tb[i], pkt);
+    } else {
+      ret = write_normalized_packet(ofmt_ctx, pkt, out_index[i], tb[i]);
+      av_packet_unref(pkt);
+    }
+    if (ret < 0)
+      goto end;
+  }
+
+  // 刷出转码器
+  for (int i = 0; i < 2; i++) {
+    if (!transcoders[i])
+      continue;
+    if ((ret = stream_transcoder_send(transcoders[i], NULL)) < 0 ||
+        (ret = write_normalized_output(ofmt_ctx, transcoders[i], out_index[i], tb[i], pkt)) < 0)
+      goto end;
+  }
+  ret = av_write_trailer(ofmt_ctx);
+
+  end:
+  av_packet_free(&pkt);
+  for (int i = 0; i < 2; i++)
+    stream_transcoder_free(&transcoders[i]);
+  if (ofmt_ctx) {
+    avio_closep(&ofmt_ctx->pb);
+    avformat_free_context(ofmt_ctx);
+  }
+  avformat_close_input(&ifmt_ctx);
+  if (ret < 0)
+    remove(temp_path);
+  return ret;
+}
+
+static void *normalize_worker(void *arg) {
+  MergeNormalizeJob *job = (MergeNormalizeJob *) arg;
+  for (;;) {
+    int k = (int) native_atomic_add_u32(&job->next, 1) - 1;
+    if (k >= job->nb_pending)
+      break;
+    int i = job->pending[k];
+    int ret = normalize_merge_input(job->inputs[i], &job->infos[i], job->target, job->temp_paths[i]);
+    native_mutex_lock(&job->lock);
+    job->results[i] = ret;
+    job->done[i] = 1;
+    native_cond_broadcast(&job->cond);
+    native_mutex_unlock(&job->lock);
+  }
+  return NULL;
+}
+
+// 等待第 i 个输入转码完成，返回转码结果
+static int wait_normalized_input(MergeNormalizeJob *job, int i) {
+  native_mutex_lock(&job->lock);
+  while (!job->done[i])
+    native_cond_wait(&job->cond, &job->lock);
+  int ret = job->results[i];
+  native_mutex_unlock(&job->lock);
+  return ret;
+}
+
+static int write_merge_packet(void *opaque, AVPacket *pkt) {
+  return av_interleaved_write_frame((AVFormatContext *) opaque, pkt);
+}
+
+// 将数据包转换到输出流时间基，按该路流的时间线加上偏移后写入；与已写入数据重叠的音频包丢弃
+static int write_stitched_packet(AVFormatContext *ofmt_ctx, StreamStitcher *stitcher, AVPacket *pkt,
+                                 AVRational in_tb, int out_index) {
+  AVStream *out_stream = ofmt_ctx->streams[out_index];
+  av_packet_rescale_ts(pkt, in_tb, out_stream->time_base);
+  pkt->pos = -1;
+  pkt->stream_index = out_index;
+  int ret = 0;
+  if (stream_stitcher_map(stitcher, out_index, pkt))
+    ret = av_interleaved_write_frame(ofmt_ctx, pkt);
+  av_packet_unref(pkt);
+  return ret;
+}
+
+// 将一个输入的音视频包逐路拼接到输出时间线末尾
+static int remux_merge_input(AVFormatContext *ofmt_ctx, AVFormatContext *ifmt_ctx, int video_in, int audio_in,
+                             int video_out_index, int audio_out_index, StreamStitcher *stitcher) {
+  int nb_out = (int) ofmt_ctx->nb_streams;
+  int in_index[STITCH_MAX_STREAMS];
+  for (int j = 0; j < nb_out; j++)
+    in_index[j] = -1;
+  if (video_out_index >= 0)
+    in_index[video_out_index] = video_in;
+  if (audio_out_index >= 0)
+    in_index[audio_out_index] = audio_in;
+
+  // 预读开头的数据包以确定各路流的起始时间，再补齐上一个输入留下的音频空隙
+  AVPacket *head[STITCH_HEAD_PACKETS];
+  int nb_head = 0;
+  int ret = stream_stitcher_begin_input(stitcher, ifmt_ctx, in_index, head, STITCH_HEAD_PACKETS, &nb_head);
+  if (ret < 0)
+    return ret;
+  for (int j = 0; j < nb_out && ret >= 0; j++)
+    ret = stream_stitcher_pad(stitcher, j, ofmt_ctx->streams[j]->codecpar, write_merge_packet, ofmt_ctx);
+
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt && ret >= 0)
+    ret = AVERROR(ENOMEM);
+  for (int k = 0; k < nb_head; k++) {
+    int out_index = head[k]->stream_index == video_in ? video_out_index : audio_out_index;
+    if (ret >= 0)
+      ret = write_stitched_packet(ofmt_ctx, stitcher, head[k], ifmt_ctx->streams[head[k]->stream_index]->time_base,
+                                  out_index);
+    av_packet_free(&head[k]);
+  }
+
+  // 逐包读取处理
+  while (ret >= 0 && av_read_frame(ifmt_ctx, pkt) >= 0) {
+    int out_index = -1;
+    if (pkt->stream_index == video_in && video_out_index >= 0) {
+      out_index = video_out_index;
+    } else if (pkt->stream_index == audio_in && audio_out_index >= 0) {
+      out_index = audio_out_index;
+    } else {
+      av_packet_unref(pkt);
+      continue;
+    }
+    ret = write_stitched_packet(ofmt_ctx, stitcher, pkt, ifmt_ctx->streams[pkt->stream_index]->time_base, out_index);
+  }
+  av_packet_free(&pkt);
+  stream_stitcher_end_input(stitcher);
+  return ret;
+}
 
 /*
  * 说明：
- * 1. 根据输出文件名创建输出格式上下文，并以第一个输入文件为模板建立输出流（仅复制视频和音频流参数）。
- * 2. 为每个输入文件计算其总体时长（按 AV_TIME_BASE 统一计算，取视频和音频最大值），并使用统一的 global_offset 作为所有流包的时间补偿。
- * 3. 每个包在转换时间戳时先使用 av_rescale_q 将其 pts/dts 从输入流的 time_base 转换到输出流 time_base，再加上统一偏移量。
+ * 1. 先用线程池并行探测全部输入（时长、最佳音视频流及其参数），无法打开的文件直接跳过；
+ * 2. 根据输出文件名创建输出格式上下文，并以第一个输入文件的探测结果为模板建立输出流（仅视频和音频各一路）；
+ * 3. 编码、分辨率、像素格式或采样率、声道等与模板不一致的输入由工作线程按模板参数转码到临时文件，
+ *    只重新编码不一致的流，其余输入直接重封装；
+ * 4. 复用过程中由预读线程按顺序提前打开并探测下一个可直接重封装的输入，避免复用器在文件之间等待打开/探测；
+ * 5. 每路输出流记录自己的结束时间，每个输入整体对齐到视频的结束时间（无视频时为各流结束时间的最大值）；
+ * 6. 音频比视频短留下的空隙用缓存的静音数据包补齐，音频比视频长造成的重叠在下一个输入开头按数据包裁掉。
  *
- * 这样处理后，各输入文件无论音视频各自时长是否一致，都按同一全局时间轴排列，解决了音频播放速度快于视频的问题。
+ * 这样处理后，各输入文件无论音视频各自时长是否一致，拼接数百个片段也不会累积音视频错位，不需要重新编码。
+ *
+ * layout 为 MP4 输出布局：faststart 按探测到的样本数在文件头预留 moov 空间，fragmented 输出分片 MP4，均为单次写入。
  */
-JNIEXPORT jboolean JNICALL Java_com_litongjava_media_NativeMedia_merge
-  (JNIEnv *env, jclass clazz, jobjectArray jInputPaths, jstring jOutputPath) {
+static jboolean merge_files(JNIEnv *env, jobjectArray jInputPaths, jstring jOutputPath, Mp4Layout layout) {
   int ret = 0;
   int nb_inputs = (*env)->GetArrayLength(env, jInputPaths);
   if (nb_inputs < 1) {
     return JNI_FALSE;
   }
-  // 输出文件名（支持中文）
-  char *output_filename = jstringToChar(env, jOutputPath);
 
-  // 创建输出格式上下文
+  // 输入文件名（支持中文）需在当前线程中从 Java 取出，探测与预读线程只使用 C 字符串
+  char **input_filenames = (char **) calloc(nb_inputs, sizeof(char *));
+  char **temp_paths = (char **) calloc(nb_inputs, sizeof(char *));
+  MediaInfo *infos = (MediaInfo *) calloc(nb_inputs, sizeof(MediaInfo));
+  uint8_t *skip = (uint8_t *) calloc(nb_inputs, 1);
+  int *pending = (int *) calloc(nb_inputs, sizeof(int));
+  int *results = (int *) calloc(nb_inputs, sizeof(int));
+  uint8_t *done = (uint8_t *) calloc(nb_inputs, 1);
+  char *output_filename = jstringToChar(env, jOutputPath);
   AVFormatContext *ofmt_ctx = NULL;
-  ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, output_filename);
-  if (ret < 0 || !ofmt_ctx) {
-    free(output_filename);
-    return JNI_FALSE;
+  MediaPrefetcher *prefetcher = NULL;
+  native_thread_t *workers = NULL;
+  int nb_workers = 0;
+  MergeNormalizeJob job;
+  memset(&job, 0, sizeof(job));
+  native_mutex_init(&job.lock);
+  native_cond_init(&job.cond);
+  jboolean result = JNI_FALSE;
+  if (!input_filenames || !temp_paths || !infos || !skip || !pending || !results || !done || !output_filename)
+    goto end;
+  for (int i = 0; i < nb_inputs; i++) {
+    jstring jInput = (jstring) (*env)->GetObjectArrayElement(env, jInputPaths, i);
+    input_filenames[i] = jInput ? jstringToChar(env, jInput) : NULL;
+    if (jInput)
+      (*env)->DeleteLocalRef(env, jInput);
+    if (!input_filenames[i])
+      goto end;
   }
-  AVOutputFormat *ofmt = ofmt_ctx->oformat;
 
-  // 采用第一个输入文件作为模板构造输出流
-  char *first_input = jstringToChar(env, (*env)->GetObjectArrayElement(env, jInputPaths, 0));
-  AVFormatContext *ifmt_ctx1 = NULL;
-  if ((ret = avformat_open_input(&ifmt_ctx1, first_input, NULL, NULL)) < 0) {
-    free(first_input);
-    free(output_filename);
-    return JNI_FALSE;
-  }
-  if ((ret = avformat_find_stream_info(ifmt_ctx1, NULL)) < 0) {
-    avformat_close_input(&ifmt_ctx1);
-    free(first_input);
-    free(output_filename);
-    return JNI_FALSE;
+  if (media_probe_parallel(infos, input_filenames, nb_inputs, 0) < 0)
+    goto end;
+  // 第一个输入作为输出流模板，必须可用
+  if (infos[0].result < 0)
+    goto end;
+
+  // 分类：无法打开的文件跳过，参数不一致的输入交给转码线程，其余由预读线程打开
+  int nb_pending = 0;
+  for (int i = 0; i < nb_inputs; i++) {
+    if (infos[i].result < 0) {
+      skip[i] = 1;
+      continue;
+    }
+    if (merge_input_compatible(&infos[i], &infos[0]))
+      continue;
+    size_t size = strlen(output_filename) + 32;
+    temp_paths[i] = (char *) malloc(size);
+    if (!temp_paths[i])
+      goto end;
+    snprintf(temp_paths[i], size, "%s.part%d.%s", output_filename, i, MERGE_NORMALIZE_FORMAT);
+    pending[nb_pending++] = i;
+    skip[i] = 1;
   }
-  free(first_input);
+
+  // 创建输出格式上下文
+  ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, output_filename);
+  if (ret < 0 || !ofmt_ctx)
+    goto end;
+  AVOutputFormat *ofmt = ofmt_ctx->oformat;
 
   // 建立输出流（仅复制视频、音频流）
   int video_out_index = -1, audio_out_index = -1;
-  for (unsigned int i = 0; i < ifmt_ctx1->nb_streams; i++) {
-    AVStream *in_stream = ifmt_ctx1->streams[i];
-    if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ||
-        in_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-
-      AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
-      if (!out_stream) {
-        avformat_close_input(&ifmt_ctx1);
-        free(output_filename);
-        return JNI_FALSE;
-      }
-      ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
-      if (ret < 0) {
-        avformat_close_input(&ifmt_ctx1);
-        free(output_filename);
-        return JNI_FALSE;
-      }
-      out_stream->codecpar->codec_tag = 0;
-      if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-        video_out_index = out_stream->index;
-      else if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-        audio_out_index = out_stream->index;
-    }
+  const AVCodecParameters *template_par[2] = {infos[0].video_par, infos[0].audio_par};
+  for (int i = 0; i < 2; i++) {
+    if (!template_par[i])
+      continue;
+    AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
+    if (!out_stream)
+      goto end;
+    ret = avcodec_parameters_copy(out_stream->codecpar, template_par[i]);
+    if (ret < 0)
+      goto end;
+    out_stream->codecpar->codec_tag = 0;
+    if (i == 0)
+      video_out_index = out_stream->index;
+    else
+      audio_out_index = out_stream->index;
   }
-  avformat_close_input(&ifmt_ctx1);
 
   // 打开输出文件
   if (!(ofmt->flags & AVFMT_NOFILE)) {
-    if ((ret = avio_open(&ofmt_ctx->pb, output_filename, AVIO_FLAG_WRITE)) < 0) {
-      avformat_free_context(ofmt_ctx);
-      free(output_filename);
-      return JNI_FALSE;
-    }
-  }
-
-  // 写入输出文件头
-  ret = avformat_write_header(ofmt_ctx, NULL);
-  if (ret < 0) {
-    if (!(ofmt->flags & AVFMT_NOFILE))
-      avio_close(ofmt_ctx->pb);
-    avformat_free_context(ofmt_ctx);
-    free(output_filename);
-    return JNI_FALSE;
+    if ((ret = avio_open(&ofmt_ctx->pb, output_filename, AVIO_FLAG_WRITE)) < 0)
+      goto end;
   }
 
-  // 定义统一全局时间偏移量（单位：AV_TIME_BASE，AV_TIME_BASE_Q= {1,AV_TIME_BASE}）
-  int64_t global_offset = 0;
-
-  // 遍历每个输入文件
+  // 按布局设置复用器选项：faststart 需要各路流的样本数估算（音频按输入时长计，包含补齐的静音）；
+  // 任一输入的帧数或时长未知时该路流记为未知（0），由 mp4_layout_apply 改用分片布局
+  int64_t nb_samples[2] = {0, 0};
+  int unknown[2] = {0, 0};
+  const AVCodecParameters *audio_par = infos[0].audio_par;
+  double audio_packet_rate = audio_par && audio_par->sample_rate > 0
+                             ? audio_par->sample_rate / (double) (audio_par->frame_size > 0 ? audio_par->frame_size : 1024)
+                             : 0;
   for (int i = 0; i < nb_inputs; i++) {
-    char *input_filename = jstringToChar(env, (*env)->GetObjectArrayElement(env, jInputPaths, i));
-    AVFormatContext *ifmt_ctx = NULL;
-    if ((ret = avformat_open_input(&ifmt_ctx, input_filename, NULL, NULL)) < 0) {
-      free(input_filename);
-      continue;  // 无法打开的文件跳过
-    }
-    if ((ret = avformat_find_stream_info(ifmt_ctx, NULL)) < 0) {
-      avformat_close_input(&ifmt_ctx);
-      free(input_filename);
+    if (infos[i].result < 0)
       continue;
+    if (video_out_index >= 0 && infos[i].video_index >= 0) {
+      if (infos[i].video_frames > 0)
+        nb_samples[video_out_index] += infos[i].video_frames;
+      else
+        unknown[video_out_index] = 1;
     }
-
-    // 计算该输入文件中音视频的最大时长（统一转换到 AV_TIME_BASE 单位）
-    int64_t file_duration = 0;
-    for (unsigned int j = 0; j < ifmt_ctx->nb_streams; j++) {
-      AVStream *in_stream = ifmt_ctx->streams[j];
-      if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ||
-          in_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-        if (in_stream->duration > 0) {
-          int64_t dur = av_rescale_q(in_stream->duration, in_stream->time_base, AV_TIME_BASE_Q);
-          if (dur > file_duration)
-            file_duration = dur;
-        }
-      }
+    if (audio_out_index >= 0) {
+      if (infos[i].duration > 0 && audio_packet_rate > 0)
+        nb_samples[audio_out_index] += (int64_t) (infos[i].duration / (double) AV_TIME_BASE * audio_packet_rate) + 1;
+      else
+        unknown[audio_out_index] = 1;
     }
+  }
+  for (int j = 0; j < 2; j++) {
+    if (unknown[j])
+      nb_samples[j] = 0;
+  }
+  AVDictionary *mux_opts = NULL;
+  if ((ret = mp4_layout_apply(&mux_opts, ofmt_ctx, layout, nb_samples)) < 0) {
+    av_dict_free(&mux_opts);
+    goto end;
+  }
 
-    // 逐包读取处理
-    AVPacket pkt;
-    while (av_read_frame(ifmt_ctx, &pkt) >= 0) {
-      AVStream *in_stream = ifmt_ctx->streams[pkt.stream_index];
-      int out_index = -1;
-      if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && video_out_index >= 0) {
-        out_index = video_out_index;
-      } else if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && audio_out_index >= 0) {
-        out_index = audio_out_index;
-      } else {
-        av_packet_unref(&pkt);
-        continue;
-      }
+  // 写入输出文件头
+  ret = avformat_write_header(ofmt_ctx, &mux_opts);
+  av_dict_free(&mux_opts);
+  if (ret < 0)
+    goto end;
 
-      AVStream *out_stream = ofmt_ctx->streams[out_index];
-      // 将统一偏移量转换到输出流的 time_base 单位
-      int64_t offset = av_rescale_q(global_offset, AV_TIME_BASE_Q, out_stream->time_base);
+  // 启动转码线程（编码器自身也会多线程，线程数取处理器数量的一半）
+  job.inputs = input_filenames;
+  job.infos = infos;
+  job.target = &infos[0];
+  job.temp_paths = temp_paths;
+  job.pending = pending;
+  job.nb_pending = nb_pending;
+  job.results = results;
+  job.done = done;
+  if (nb_pending > 0) {
+    int threads = FFMIN(FFMAX(native_cpu_count() / 2, 1), nb_pending);
+    workers = (native_thread_t *) calloc(threads, sizeof(native_thread_t));
+    if (!workers)
+      goto end;
+    for (int i = 0; i < threads; i++) {
+      if (native_thread_create(&workers[i], normalize_worker, &job) < 0)
+        break;
+      nb_workers++;
+    }
+    // 无法创建线程时由当前线程先完成全部转码
+    if (nb_workers == 0)
+      normalize_worker(&job);
+  }
 
-      // 将 pts、dts 和 duration 从输入流 time_base 转换到输出流 time_base 后加上偏移量
-      pkt.pts = av_rescale_q(pkt.pts, in_stream->time_base, out_stream->time_base) + offset;
-      pkt.dts = av_rescale_q(pkt.dts, in_stream->time_base, out_stream->time_base) + offset;
-      if (pkt.duration > 0)
-        pkt.duration = av_rescale_q(pkt.duration, in_stream->time_base, out_stream->time_base);
-      pkt.pos = -1;
-      pkt.stream_index = out_index;
+  // 预读线程领先复用器一个文件
+  if ((ret = media_prefetcher_start(&prefetcher, input_filenames, skip, nb_inputs, 1)) < 0)
+    goto end;
 
-      ret = av_interleaved_write_frame(ofmt_ctx, &pkt);
-      if (ret < 0) {
-        av_packet_unref(&pkt);
+  // 逐路流的时间线（写入文件头后输出流的 time_base 才确定）
+  StreamStitcher stitcher;
+  enum AVMediaType types[STITCH_MAX_STREAMS];
+  AVRational time_bases[STITCH_MAX_STREAMS];
+  for (unsigned int j = 0; j < ofmt_ctx->nb_streams; j++) {
+    types[j] = ofmt_ctx->streams[j]->codecpar->codec_type;
+    time_bases[j] = ofmt_ctx->streams[j]->time_base;
+  }
+  stream_stitcher_init(&stitcher, (int) ofmt_ctx->nb_streams, types, time_bases, 0);
+
+  // 按输入顺序写入：可直接重封装的输入从预读线程取出，转码的输入等待对应临时文件完成
+  // 转码或打开失败的输入跳过并计数，输出仍然写完整（可播放），但结果返回失败
+  int nb_failed = 0;
+  for (int i = 0; i < nb_inputs && ret >= 0; i++) {
+    if (infos[i].result < 0)
+      continue;  // 探测阶段无法打开的文件跳过
+    AVFormatContext *ifmt_ctx = NULL;
+    int video_in = infos[i].video_index, audio_in = infos[i].audio_index;
+    int input_ret = 0;
+    if (temp_paths[i]) {
+      if ((input_ret = wait_normalized_input(&job, i)) >= 0)
+        input_ret = media_open_input(temp_paths[i], &ifmt_ctx);
+      if (input_ret >= 0) {
+        video_in = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        audio_in = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+      }
+    } else {
+      int index = 0;
+      if (!media_prefetcher_next(prefetcher, &index, &ifmt_ctx, &input_ret))
         break;
+      if (input_ret >= 0 && !ifmt_ctx)
+        input_ret = AVERROR_UNKNOWN;
+    }
+    if (input_ret < 0) {
+      char errbuf[128] = {0};
+      av_strerror(input_ret, errbuf, sizeof(errbuf));
+      fprintf(stderr, "merge: skipped input %s: %s\n", input_filenames[i], errbuf);
+      nb_failed++;
+    } else {
+      ret = remux_merge_input(ofmt_ctx, ifmt_ctx, video_in, audio_in, video_out_index, audio_out_index, &stitcher);
+      if (ret < 0) {
+        char errbuf[128] = {0};
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        fprintf(stderr, "merge: failed to write input %s: %s\n", input_filenames[i], errbuf);
       }
-      av_packet_unref(&pkt);
     }
-
     avformat_close_input(&ifmt_ctx);
-    free(input_filename);
-
-    // 当前输入文件处理完后，将全局偏移量更新为之前的 global_offset + 本文件最大时长（确保所有流时间统一）
-    global_offset += file_duration;
+    if (temp_paths[i])
+      remove(temp_paths[i]);
   }
 
-  // 写入 trailer，并关闭上下文
-  av_write_trailer(ofmt_ctx);
-  if (!(ofmt->flags & AVFMT_NOFILE))
-    avio_close(ofmt_ctx->pb);
-  avformat_free_context(ofmt_ctx);
+  // 写入 trailer（faststart 时 moov 在这里写回文件头预留的空间，预留不足会失败）
+  if (ret >= 0 && (ret = av_write_trailer(ofmt_ctx)) >= 0 && nb_failed == 0)
+    result = JNI_TRUE;
+
+  end:
+  // 提前结束时让转码线程不再领取新的输入
+  native_atomic_store_u32(&job.next, (uint32_t) nb_inputs);
+  for (int i = 0; i < nb_workers; i++)
+    native_thread_join(workers[i]);
+  free(workers);
+  native_mutex_destroy(&job.lock);
+  native_cond_destroy(&job.cond);
+  media_prefetcher_free(&prefetcher);
+  if (ofmt_ctx) {
+    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+      avio_closep(&ofmt_ctx->pb);
+    avformat_free_context(ofmt_ctx);
+  }
+  for (int i = 0; infos && i < nb_inputs; i++)
+    media_info_uninit(&infos[i]);
+  for (int i = 0; input_filenames && i < nb_inputs; i++)
+    free(input_filenames[i]);
+  for (int i = 0; temp_paths && i < nb_inputs; i++) {
+    if (temp_paths[i]) {
+      remove(temp_paths[i]);
+      free(temp_paths[i]);
+    }
+  }
+  free(input_filenames);
+  free(temp_paths);
+  free(infos);
+  free(skip);
+  free(pending);
+  free(results);
+  free(done);
   free(output_filename);
-  return JNI_TRUE;
+  return result;
+}
+
+JNIEXPORT jboolean JNICALL Java_com_litongjava_media_NativeMedia_merge
+  (JNIEnv *env, jclass clazz, jobjectArray jInputPaths, jstring jOutputPath) {
+  return merge_files(env, jInputPaths, jOutputPath, MP4_LAYOUT_DEFAULT);
+}
+
+/*
+ * 与 merge 相同，options 为 "key=value:key=value" 形式，可为 null：
+ *   layout=default|faststart|fragmented  MP4 输出布局（见 mp4_layout.h）
+ */
+JNIEXPORT jboolean JNICALL Java_com_litongjava_media_NativeMedia_mergeWithOptions
+  (JNIEnv *env, jclass clazz, jobjectArray jInputPaths, jstring jOutputPath, jstring jOptions) {
+  Mp4Layout layout = MP4_LAYOUT_DEFAULT;
+  if (jOptions) {
+    const char *options = (*env)->GetStringUTFChars(env, jOptions, NULL);
+    int ret = mp4_layout_from_options(options, &layout);
+    (*env)->ReleaseStringUTFChars(env, jOptions, options);
+    if (ret < 0)
+      return JNI_FALSE;
+  }
+  return merge_files(env, jInputPaths, jOutputPath, layout);
 }
@@ -0,0 +1,312 @@
+#include "com_litongjava_media_NativeMedia.h"
+#include <jni.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// 包含 FFmpeg 头文件
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/opt.h>
+#include "gop_reencoder.h"
+
+#define CLIP_TAIL_MARGIN (10 * AV_TIME_BASE) // 视频结束后，音频最多再多读这么久的数据
+
+/*
+ * 智能剪切：只重新编码与剪切范围部分相交的 GOP（通常是开头和结尾各一个），
+ * 完整落在范围内的 GOP 直接流拷贝，音频按时间流拷贝。
+ */
+typedef struct ClipContext {
+  AVFormatContext *ifmt_ctx;
+  AVFormatContext *ofmt_ctx;
+  int *stream_map;              // 输入流序号 -> 输出流序号，-1 表示丢弃
+  uint8_t *stream_done;         // 音频流已越过剪切终点
+  int video_index;
+  GopReencoder *reencoder;
+  int splice;                   // 1 表示重编码片段可与流拷贝的 GOP 拼接，否则整路视频重新编码
+  int64_t start_time;           // 剪切范围（AV_TIME_BASE）
+  int64_t end_time;
+  int64_t video_start;          // 剪切范围（视频流时间基）
+  int64_t video_end;
+  AVPacket **gop;               // 当前 GOP 的数据包（从关键帧开始）
+  int nb_gop;
+  int gop_capacity;
+  int copied_gops;
+  int reencoded_gops;
+} ClipContext;
+
+// 写入一个输入时间基的数据包：时间戳减去剪切起点后转换到输出时间基
+static int write_clip_packet(ClipContext *ctx, AVPacket *pkt, int in_index) {
+  AVStream *in_stream = ctx->ifmt_ctx->streams[in_index];
+  AVStream *out_stream = ctx->ofmt_ctx->streams[ctx->stream_map[in_index]];
+  int64_t offset = av_rescale_q(ctx->start_time, AV_TIME_BASE_Q, in_stream->time_base);
+  if (pkt->pts != AV_NOPTS_VALUE)
+    pkt->pts -= offset;
+  if (pkt->dts != AV_NOPTS_VALUE)
+    pkt->dts -= offset;
+  av_packet_rescale_ts(pkt, in_stream->time_base, out_stream->time_base);
+  pkt->stream_index = out_stream->index;
+  pkt->pos = -1;
+  return av_interleaved_write_frame(ctx->ofmt_ctx, pkt);
+}
+
+static int on_reencoded_packet(void *opaque, AVPacket *pkt) {
+  ClipContext *ctx = (ClipContext *) opaque;
+  return write_clip_packet(ctx, pkt, ctx->video_index);
+}
+
+static void clear_clip_gop(ClipContext *ctx) {
+  for (int i = 0; i < ctx->nb_gop; i++)
+    av_packet_free(&ctx->gop[i]);
+  ctx->nb_gop = 0;
+}
+
+static int add_clip_gop_packet(ClipContext *ctx, AVPacket *pkt) {
+  if (ctx->nb_gop >= ctx->gop_capacity) {
+    int capacity = ctx->gop_capacity ? ctx->gop_capacity * 2 : 64;
+    AVPacket **tmp = (AVPacket **) realloc(ctx->gop, capacity * sizeof(AVPacket *));
+    if (!tmp)
+      return AVERROR(ENOMEM);
+    ctx->gop = tmp;
+    ctx->gop_capacity = capacity;
+  }
+  AVPacket *copy = av_packet_alloc();
+  if (!copy)
+    return AVERROR(ENOMEM);
+  av_packet_move_ref(copy, pkt);
+  ctx->gop[ctx->nb_gop++] = copy;
+  return 0;
+}
+
+/*
+ * 处理一个完整的 GOP：next_key 为下一个关键帧的显示时间（视频流时间基），INT64_MAX 表示文件结束
+ * 与范围无交集的丢弃，完整落在范围内的流拷贝，部分相交的只重新编码范围内的帧
+ */
+static int process_clip_gop(ClipContext *ctx, int64_t next_key) {
+  if (ctx->nb_gop == 0)
+    return 0;
+  int64_t gop_start = INT64_MAX, gop_end = next_key;
+  for (int i = 0; i < ctx->nb_gop; i++) {
+    AVPacket *pkt = ctx->gop[i];
+    if (pkt->pts == AV_NOPTS_VALUE)
+      continue;
+    gop_start = FFMIN(gop_start, pkt->pts);
+    if (next_key == INT64_MAX)
+      gop_end = i == 0 ? pkt->pts + pkt->duration : FFMAX(gop_end, pkt->pts + pkt->duration);
+  }
+
+  int ret = 0;
+  if (gop_end <= ctx->video_start || gop_start >= ctx->video_end) {
+    // 与剪切范围无交集
+  } else if (ctx->splice && gop_start >= ctx->video_start && gop_end <= ctx->video_end) {
+    // 先结束前面的重编码片段，再原样写入整个 GOP
+    ret = gop_reencoder_flush(ctx->reencoder, on_reencoded_packet, ctx);
+    for (int i = 0; i < ctx->nb_gop && ret >= 0; i++)
+      ret = write_clip_packet(ctx, ctx->gop[i], ctx->video_index);
+    ctx->copied_gops++;
+  } else {
+    ret = gop_reencoder_encode(ctx->reencoder, ctx->gop, ctx->nb_gop, ctx->video_start, ctx->video_end,
+                               on_reencoded_packet, ctx);
+    ctx->reencoded_gops++;
+  }
+  clear_clip_gop(ctx);
+  return ret;
+}
+
+// 创建输出文件：视频（可拼接时沿用源参数，否则使用编码器参数）与所有音频流
+static int open_clip_output(ClipContext *ctx, const char *outputPath) {
+  AVFormatContext *ifmt_ctx = ctx->ifmt_ctx;
+  int ret = avformat_alloc_output_context2(&ctx->ofmt_ctx, NULL, NULL, outputPath);
+  if (ret < 0 || !ctx->ofmt_ctx)
+    return ret < 0 ? ret : AVERROR_UNKNOWN;
+
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    AVStream *in_stream = ifmt_ctx->streams[i];
+    ctx->stream_map[i] = -1;
+    if ((int) i != ctx->video_index && in_stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+      continue;
+    AVStream *out_stream = avformat_new_stream(ctx->ofmt_ctx, NULL);
+    if (!out_stream)
+      return AVERROR(ENOMEM);
+    if ((int) i == ctx->video_index && !ctx->splice)
+      ret = gop_reencoder_parameters(ctx->reencoder, out_stream->codecpar);
+    else
+      ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+    if (ret < 0)
+      return ret;
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = in_stream->time_base;
+    ctx->stream_map[i] = out_stream->index;
+  }
+
+  if (!(ctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+    ret = avio_open(&ctx->ofmt_ctx->pb, outputPath, AVIO_FLAG_WRITE);
+    if (ret < 0)
+      return ret;
+  }
+  AVDictionary *opts = NULL;
+  av_dict_set(&opts, "avoid_negative_ts", "make_zero", 0);
+  ret = avformat_write_header(ctx->ofmt_ctx, &opts);
+  av_dict_free(&opts);
+  return ret;
+}
+
+// 读取并剪切：视频按 GOP 处理，音频按时间直接流拷贝
+static int run_clip(ClipContext *ctx) {
+  AVFormatContext *ifmt_ctx = ctx->ifmt_ctx;
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+    return AVERROR(ENOMEM);
+  int video_done = ctx->video_index < 0;
+  int ret;
+  while ((ret = av_read_frame(ifmt_ctx, pkt)) >= 0) {
+    int idx = pkt->stream_index;
+    AVStream *in_stream = ifmt_ctx->streams[idx];
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    int64_t t = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, in_stream->time_base, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+
+    if (ctx->stream_map[idx] < 0) {
+      ret = 0;
+    } else if (idx == ctx->video_index) {
+      ret = 0;
+      if (!video_done && (pkt->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE) {
+        // 新的 GOP 开始：前一个 GOP 已完整
+        ret = process_clip_gop(ctx, ts);
+        if (ts >= ctx->video_end)
+          video_done = 1;
+      }
+      if (ret >= 0 && !video_done && (ctx->nb_gop > 0 || (pkt->flags & AV_PKT_FLAG_KEY)))
+        ret = add_clip_gop_packet(ctx, pkt);
+    } else if (t == AV_NOPTS_VALUE || (t >= ctx->start_time && t < ctx->end_time)) {
+      ret = write_clip_packet(ctx, pkt, idx);
+    } else {
+      ret = 0;
+      if (t >= ctx->end_time)
+        ctx->stream_done[idx] = 1;
+    }
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
+
+    // 视频已越过终点：所有音频流也越过终点（或已多读了足够长的时间）后结束
+    if (video_done) {
+      int all_done = t != AV_NOPTS_VALUE && t >= ctx->end_time + CLIP_TAIL_MARGIN;
+      if (!all_done) {
+        all_done = 1;
+        for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+          if ((int) i != ctx->video_index && ctx->stream_map[i] >= 0 && !ctx->stream_done[i])
+            all_done = 0;
+        }
+      }
+      if (all_done)
+        break;
+    }
+  }
+  if (ret == AVERROR_EOF)
+    ret = 0;
+  if (ret >= 0 && !video_done)
+    ret = process_clip_gop(ctx, INT64_MAX);
+  if (ret >= 0 && ctx->reencoder)
+    ret = gop_reencoder_flush(ctx->reencoder, on_reencoded_packet, ctx);
+  av_packet_free(&pkt);
+  return ret;
+}
+
+/*
+ * 帧精确剪切 [startSeconds, endSeconds)，输出容器由 outputPath 的扩展名决定
+ */
+static const char *extract_clip(const char *inputPath, const char *outputPath, double startSeconds,
+                                double endSeconds, char *resultMsg, size_t resultSize) {
+  if (startSeconds < 0 || endSeconds <= startSeconds) {
+    snprintf(resultMsg, resultSize, "Invalid clip range: %.3f - %.3f", startSeconds, endSeconds);
+    return resultMsg;
+  }
+  ClipContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.start_time = (int64_t) (startSeconds * AV_TIME_BASE);
+  ctx.end_time = (int64_t) (endSeconds * AV_TIME_BASE);
+
+  int ret = avformat_open_input(&ctx.ifmt_ctx, inputPath, NULL, NULL);
+  if (ret < 0 || (ret = avformat_find_stream_info(ctx.ifmt_ctx, NULL)) < 0)
+    goto end;
+  ctx.stream_map = (int *) calloc(ctx.ifmt_ctx->nb_streams, sizeof(int));
+  ctx.stream_done = (uint8_t *) calloc(ctx.ifmt_ctx->nb_streams, 1);
+  if (!ctx.stream_map || !ctx.stream_done) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  ctx.video_index = av_find_best_stream(ctx.ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (ctx.video_index >= 0 &&
+      (ctx.ifmt_ctx->streams[ctx.video_index]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+    ctx.video_index = -1;
+  if (ctx.video_index >= 0) {
+    AVStream *video = ctx.ifmt_ctx->streams[ctx.video_index];
+    ctx.video_start = av_rescale_q(ctx.start_time, AV_TIME_BASE_Q, video->time_base);
+    ctx.video_end = av_rescale_q(ctx.end_time, AV_TIME_BASE_Q, video->time_base);
+    // 输出格式是否需要全局头只能在创建输出上下文后得知，这里按扩展名预先判断
+    const AVOutputFormat *ofmt = av_guess_format(NULL, outputPath, NULL);
+    int global_header = ofmt && (ofmt->flags & AVFMT_GLOBALHEADER);
+    ret = gop_reencoder_open(&ctx.reencoder, video->codecpar, video->time_base,
+                             av_guess_frame_rate(ctx.ifmt_ctx, video, NULL), global_header);
+    if (ret < 0)
+      goto end;
+    ctx.splice = gop_reencoder_splice_compatible(ctx.reencoder);
+  }
+
+  if ((ret = open_clip_output(&ctx, outputPath)) < 0)
+    goto end;
+
+  // 定位到起点之前的关键帧，定位失败时从头读取
+  if (ctx.video_index >= 0)
+    av_seek_frame(ctx.ifmt_ctx, ctx.video_index, ctx.video_start, AVSEEK_FLAG_BACKWARD);
+  else
+    av_seek_frame(ctx.ifmt_ctx, -1, ctx.start_time, AVSEEK_FLAG_BACKWARD);
+
+  ret = run_clip(&ctx);
+  if (ret >= 0)
+    ret = av_write_trailer(ctx.ofmt_ctx);
+
+  end:
+  if (ret < 0) {
+    char errbuf[128] = {0};
+    av_strerror(ret, errbuf, sizeof(errbuf));
+    snprintf(resultMsg, resultSize, "Failed to extract clip: %s", errbuf);
+  } else {
+    snprintf(resultMsg, resultSize,
+             "Clip extracted successfully (%d GOP(s) copied, %d re-encoded), output saved to %s",
+             ctx.copied_gops, ctx.reencoded_gops, outputPath);
+  }
+  clear_clip_gop(&ctx);
+  free(ctx.gop);
+  gop_reencoder_free(&ctx.reencoder);
+  if (ctx.ofmt_ctx) {
+    if (!(ctx.ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+      avio_closep(&ctx.ofmt_ctx->pb);
+    avformat_free_context(ctx.ofmt_ctx);
+  }
+  if (ctx.ifmt_ctx)
+    avformat_close_input(&ctx.ifmt_ctx);
+  free(ctx.stream_map);
+  free(ctx.stream_done);
+  return resultMsg;
+}
+
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_extractClip
+  (JNIEnv *env, jclass clazz, jstring inputPathJ, jstring outputPathJ, jdouble startSeconds, jdouble endSeconds) {
+  const char *inputPath = (*env)->GetStringUTFChars(env, inputPathJ, NULL);
+  const char *outputPath = (*env)->GetStringUTFChars(env, outputPathJ, NULL);
+  char resultMsg[512] = {0};
+  if (!inputPath || !outputPath) {
+    snprintf(resultMsg, sizeof(resultMsg), "Invalid input or output path");
+  } else {
+    extract_clip(inputPath, outputPath, startSeconds, endSeconds, resultMsg, sizeof(resultMsg));
+  }
+  if (inputPath)
+    (*env)->ReleaseStringUTFChars(env, inputPathJ, inputPath);
+  if (outputPath)
+    (*env)->ReleaseStringUTFChars(env, outputPathJ, outputPath);
+  return (*env)->NewStringUTF(env, resultMsg);
+}
@@ -1,4 +1,5 @@
 #include "com_litongjava_media_NativeMedia.h"
+#include "native_media.h"
 #include <jni.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,366 +13,1213 @@
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
+#include <libavutil/bprint.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
+#include "mp4_layout.h"
+#include "native_queue.h"
+#include "native_thread.h"
+#include "gop_reencoder.h"
+#include "watermark_overlay.h"
 
-JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkToVideo
-  (JNIEnv *env, jclass clazz, jstring inputVideoPathJ, jstring outputVideoPathJ, jstring watermarkTextJ,
-   jstring fontFileJ) {
-  // 从 Java 获取文件路径、水印文本和字体文件路径
-  const char *inputPath = (*env)->GetStringUTFChars(env, inputVideoPathJ, NULL);
-  const char *outputPath = (*env)->GetStringUTFChars(env, outputVideoPathJ, NULL);
-  const char *watermarkText = (*env)->GetStringUTFChars(env, watermarkTextJ, NULL);
+#define WATERMARK_QUEUE_CAPACITY 8        // 相邻两级之间最多缓存的帧/包数量，超过后上一级等待
+#define WATERMARK_DEFAULT_PRESET "veryfast"
+#define WATERMARK_DEFAULT_FONT_SIZE 24
+#define WATERMARK_MARGIN 10               // 水印距右下角边缘的像素
 
-  const char *fontFile = NULL;
-// 检查 fontFileJ 是否为 null 或者空字符串
-  if (fontFileJ == NULL || (*env)->GetStringUTFLength(env, fontFileJ) == 0) {
-#ifdef _WIN32
-    // Windows 系统，示例路径
-    fontFile = "C\\:/Windows/Fonts/simhei.ttf";
-#elif defined(__APPLE__)
+// 流水线中传递的数据：视频帧或直接复制的数据包（二者只有一个非 NULL）
+typedef struct WatermarkItem {
+  AVFrame *frame;
+  AVPacket *pkt;
+} WatermarkItem;
 
-    fontFile = "/Library/Fonts/Arial Unicode.ttf";
-#elif defined(__linux__)
-    fontFile = "/usr/share/fonts/google-noto-cjk/NotoSansCJK-Regular.ttc";
-#else
+/*
+ * 水印流水线（每个输出一条）：读包解码（调用线程，所有输出共用） -> 滤镜线程 -> 编码写入线程，
+ * 相邻两级之间是有界队列。复制的数据包也沿流水线传递，只有编码写入线程访问输出文件
+ */
+typedef struct WatermarkPipeline {
+  AVFormatContext *ofmt_ctx;
+  int *stream_map;              // 输入流 -> 直接复制的输出流（音频、字幕），-1 表示不复制
+  AVFilterGraph *graph;         // 滤镜图，使用预渲染位图时为 NULL
+  AVFilterContext *src_ctx;
+  AVFilterContext *sink_ctx;
+  WatermarkBitmap *bitmap;      // 预渲染的水印位图，非 NULL 时直接混合到解码后的帧
+  WatermarkOverlay overlay;     // 由第一帧的尺寸、像素格式与色彩空间生成
+  int overlay_ready;
+  AVRational in_time_base;      // 解码帧的时间基
+  AVCodecContext *enc_ctx;
+  AVStream *out_stream;
+  NativeQueue *filter_queue;    // 解码后的帧与复制的数据包
+  NativeQueue *encode_queue;    // 加好水印的帧与复制的数据包
+  native_thread_t filter_thread;
+  native_thread_t encode_thread;
+  int filter_started;
+  int encode_started;
+  int filter_result;            // 失败后继续取出并丢弃剩余数据，避免上一级阻塞
+  int encode_result;
+  volatile uint32_t failed;     // 任一级失败后置 1，解码线程不再向该输出分发
+  int header_written;           // 已写入文件头，结束时需要写入结尾
+  int opened;                   // 输出已打开、流水线已启动
+} WatermarkPipeline;
 
-    fontFile = "/usr/share/fonts/default.ttf";
-#endif
-  } else {
-    fontFile = (*env)->GetStringUTFChars(env, fontFileJ, NULL);
+static void free_watermark_item(WatermarkItem *item) {
+  av_frame_free(&item->frame);
+  av_packet_free(&item->pkt);
+  free(item);
+}
+
+// 编码一帧并写入输出文件（frame 为 NULL 时刷出编码器）
+static int encode_watermark_frame(WatermarkPipeline *p, AVFrame *frame) {
+  int ret = avcodec_send_frame(p->enc_ctx, frame);
+  if (ret < 0)
+    return ret;
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+    return AVERROR(ENOMEM);
+  while ((ret = avcodec_receive_packet(p->enc_ctx, pkt)) >= 0) {
+    av_packet_rescale_ts(pkt, p->enc_ctx->time_base, p->out_stream->time_base);
+    pkt->stream_index = p->out_stream->index;
+    ret = av_interleaved_write_frame(p->ofmt_ctx, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
   }
+  av_packet_free(&pkt);
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
 
-  AVFormatContext *ifmt_ctx = NULL, *ofmt_ctx = NULL;
-  AVCodecContext *dec_ctx = NULL, *enc_ctx = NULL;
-  AVStream *in_video_stream = NULL, *out_video_stream = NULL;
-  int video_stream_index = -1;
-  int ret = 0;
+// 编码写入线程：按顺序编码帧、写入复制的数据包，输入结束后刷出编码器
+static void *watermark_encode_worker(void *arg) {
+  WatermarkPipeline *p = (WatermarkPipeline *) arg;
+  void *item = NULL;
+  while (native_queue_pop(p->encode_queue, &item)) {
+    WatermarkItem *it = (WatermarkItem *) item;
+    if (p->encode_result >= 0) {
+      if (it->frame)
+        p->encode_result = encode_watermark_frame(p, it->frame);
+      else
+        p->encode_result = av_interleaved_write_frame(p->ofmt_ctx, it->pkt);
+      if (p->encode_result < 0)
+        native_atomic_store_u32(&p->failed, 1);
+    }
+    free_watermark_item(it);
+  }
+  if (p->encode_result >= 0)
+    p->encode_result = encode_watermark_frame(p, NULL);
+  return NULL;
+}
 
-  // 以下变量用于 FFmpeg 滤镜
-  AVFilterGraph *filter_graph = NULL;
-  AVFilterContext *buffersrc_ctx = NULL, *buffersink_ctx = NULL;
-  const AVFilter *buffersrc = NULL, *buffersink = NULL;
-  AVFilterInOut *outputs = NULL, *inputs = NULL;
-  char filter_descr[512] = {0};
+// 把预渲染的水印混合到解码后的帧（只改写水印所在区域），交给编码线程
+static int blend_watermark_frame(WatermarkPipeline *p, AVFrame *frame) {
+  if (!frame)
+    return 0;
+  int ret;
+  if (frame->format != p->enc_ctx->pix_fmt)
+    return AVERROR(EINVAL);
+  if (!p->overlay_ready) {
+    if ((ret = watermark_overlay_init(&p->overlay, p->bitmap, frame, WATERMARK_MARGIN)) < 0)
+      return ret;
+    p->overlay_ready = 1;
+  }
+  // 解码器仍持有参考帧的引用，共享的缓冲区先复制一份再改写
+  if ((ret = av_frame_make_writable(frame)) < 0 || (ret = watermark_overlay_blend(&p->overlay, frame)) < 0)
+    return ret;
 
-  // 打开输入文件
-  if ((ret = avformat_open_input(&ifmt_ctx, inputPath, NULL, NULL)) < 0) {
-    goto end_fail;
+  WatermarkItem *item = (WatermarkItem *) calloc(1, sizeof(WatermarkItem));
+  if (!item || !(item->frame = av_frame_alloc())) {
+    free(item);
+    return AVERROR(ENOMEM);
   }
-  if ((ret = avformat_find_stream_info(ifmt_ctx, NULL)) < 0) {
-    goto end_fail;
+  av_frame_move_ref(item->frame, frame);
+  item->frame->pict_type = AV_PICTURE_TYPE_NONE;
+  if (item->frame->pts != AV_NOPTS_VALUE)
+    item->frame->pts = av_rescale_q(item->frame->pts, p->in_time_base, p->enc_ctx->time_base);
+  if (native_queue_push(p->encode_queue, item) < 0) {
+    free_watermark_item(item);
+    return AVERROR(EIO);
   }
+  return 0;
+}
 
-  // 寻找视频流
-  for (int i = 0; i < ifmt_ctx->nb_streams; i++) {
-    if (ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-      video_stream_index = i;
-      in_video_stream = ifmt_ctx->streams[i];
+// 把一帧送入滤镜图，取出加好水印的帧交给编码线程（frame 为 NULL 时刷出滤镜图）
+static int filter_watermark_frame(WatermarkPipeline *p, AVFrame *frame) {
+  if (p->bitmap)
+    return blend_watermark_frame(p, frame);
+  int ret = av_buffersrc_add_frame(p->src_ctx, frame);
+  if (ret < 0)
+    return ret;
+  AVRational sink_tb = av_buffersink_get_time_base(p->sink_ctx);
+  for (;;) {
+    WatermarkItem *item = (WatermarkItem *) calloc(1, sizeof(WatermarkItem));
+    if (!item || !(item->frame = av_frame_alloc())) {
+      free(item);
+      return AVERROR(ENOMEM);
+    }
+    if ((ret = av_buffersink_get_frame(p->sink_ctx, item->frame)) < 0) {
+      free_watermark_item(item);
       break;
     }
+    // 时间戳从滤镜输出时间基转换到编码器时间基
+    item->frame->pict_type = AV_PICTURE_TYPE_NONE;
+    if (item->frame->pts != AV_NOPTS_VALUE)
+      item->frame->pts = av_rescale_q(item->frame->pts, sink_tb, p->enc_ctx->time_base);
+    if (native_queue_push(p->encode_queue, item) < 0) {
+      free_watermark_item(item);
+      return AVERROR(EIO);
+    }
   }
-  if (video_stream_index < 0) {
-    ret = -1;
-    goto end_fail;
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 滤镜线程：叠加水印，复制的数据包原样转交；结束时关闭编码队列
+static void *watermark_filter_worker(void *arg) {
+  WatermarkPipeline *p = (WatermarkPipeline *) arg;
+  void *item = NULL;
+  while (native_queue_pop(p->filter_queue, &item)) {
+    WatermarkItem *it = (WatermarkItem *) item;
+    if (p->filter_result >= 0) {
+      if (it->frame) {
+        p->filter_result = filter_watermark_frame(p, it->frame);
+      } else if (native_queue_push(p->encode_queue, it) < 0) {
+        p->filter_result = AVERROR(EIO);
+      } else {
+        continue;
+      }
+      if (p->filter_result < 0)
+        native_atomic_store_u32(&p->failed, 1);
+    }
+    free_watermark_item(it);
+  }
+  if (p->filter_result >= 0)
+    p->filter_result = filter_watermark_frame(p, NULL);
+  native_queue_close(p->encode_queue);
+  return NULL;
+}
+
+static int start_watermark_pipeline(WatermarkPipeline *p) {
+  p->filter_queue = native_queue_alloc(WATERMARK_QUEUE_CAPACITY);
+  p->encode_queue = native_queue_alloc(WATERMARK_QUEUE_CAPACITY);
+  if (!p->filter_queue || !p->encode_queue)
+    return AVERROR(ENOMEM);
+  if (native_thread_create(&p->encode_thread, watermark_encode_worker, p) < 0)
+    return AVERROR(EAGAIN);
+  p->encode_started = 1;
+  if (native_thread_create(&p->filter_thread, watermark_filter_worker, p) < 0)
+    return AVERROR(EAGAIN);
+  p->filter_started = 1;
+  return 0;
+}
+
+// 关闭输入队列，等待两级线程处理完剩余数据后退出，返回流水线的结果
+static int stop_watermark_pipeline(WatermarkPipeline *p) {
+  if (p->filter_queue)
+    native_queue_close(p->filter_queue);
+  if (p->filter_started)
+    native_thread_join(p->filter_thread);
+  p->filter_started = 0;
+  // 滤镜线程未启动时由这里关闭编码队列
+  if (p->encode_queue)
+    native_queue_close(p->encode_queue);
+  if (p->encode_started)
+    native_thread_join(p->encode_thread);
+  p->encode_started = 0;
+
+  void *item = NULL;
+  NativeQueue *queues[2] = {p->filter_queue, p->encode_queue};
+  for (int i = 0; i < 2; i++) {
+    if (!queues[i])
+      continue;
+    while (native_queue_pop(queues[i], &item))
+      free_watermark_item((WatermarkItem *) item);
   }
+  native_queue_free(&p->filter_queue);
+  native_queue_free(&p->encode_queue);
+  watermark_overlay_uninit(&p->overlay);
+  p->overlay_ready = 0;
+  return p->filter_result < 0 ? p->filter_result : p->encode_result;
+}
 
-  // 打开视频解码器
-  AVCodec *dec = avcodec_find_decoder(in_video_stream->codecpar->codec_id);
-  if (!dec) {
-    ret = -1;
-    goto end_fail;
+// 把调用线程解码出的帧或复制的数据包送入流水线（取得其所有权）
+static int push_watermark_item(WatermarkPipeline *p, AVFrame *frame, AVPacket *pkt) {
+  WatermarkItem *item = (WatermarkItem *) calloc(1, sizeof(WatermarkItem));
+  if (!item) {
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return AVERROR(ENOMEM);
   }
-  dec_ctx = avcodec_alloc_context3(dec);
-  if (!dec_ctx) {
-    ret = -1;
-    goto end_fail;
+  item->frame = frame;
+  item->pkt = pkt;
+  if (native_queue_push(p->filter_queue, item) < 0) {
+    free_watermark_item(item);
+    return AVERROR(EIO);
   }
-  ret = avcodec_parameters_to_context(dec_ctx, in_video_stream->codecpar);
-  if (ret < 0) {
-    goto end_fail;
+  return 0;
+}
+
+// 输出已打开且流水线没有失败
+static int watermark_output_live(WatermarkPipeline *p) {
+  return p->opened && !native_atomic_load_u32(&p->failed);
+}
+
+// 把解码出的帧分发给仍在工作的输出（除最后一个外只增加引用计数，不拷贝像素，最后一个取得原帧）
+static int dispatch_watermark_frame(WatermarkPipeline *outputs, int nb_outputs, AVFrame *frame) {
+  int last = -1;
+  for (int i = 0; i < nb_outputs; i++) {
+    if (watermark_output_live(&outputs[i]))
+      last = i;
   }
-  if ((ret = avcodec_open2(dec_ctx, dec, NULL)) < 0) {
-    goto end_fail;
+  for (int i = 0; i <= last; i++) {
+    if (i < last && !watermark_output_live(&outputs[i]))
+      continue;
+    AVFrame *ref = i < last ? av_frame_clone(frame) : frame;
+    if (!ref) {
+      av_frame_free(&frame);
+      return AVERROR(ENOMEM);
+    }
+    int ret = push_watermark_item(&outputs[i], ref, NULL);
+    if (ret < 0) {
+      if (ref != frame)
+        av_frame_free(&frame);
+      return ret;
+    }
   }
+  if (last < 0)
+    av_frame_free(&frame);
+  return 0;
+}
 
-  // 创建输出文件上下文
-  avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, outputPath);
-  if (!ofmt_ctx) {
-    ret = -1;
-    goto end_fail;
+// 把音频、字幕数据包复制给所有输出（共享数据缓冲区），时间戳转换到各自输出流的时间基
+static int dispatch_watermark_packet(WatermarkPipeline *outputs, int nb_outputs, AVFormatContext *ifmt_ctx,
+                                     const AVPacket *packet) {
+  AVStream *in_stream = ifmt_ctx->streams[packet->stream_index];
+  for (int i = 0; i < nb_outputs; i++) {
+    WatermarkPipeline *p = &outputs[i];
+    if (!watermark_output_live(p) || p->stream_map[packet->stream_index] < 0)
+      continue;
+    AVStream *out_stream = p->ofmt_ctx->streams[p->stream_map[packet->stream_index]];
+    AVPacket *copy = av_packet_clone(packet);
+    if (!copy)
+      return AVERROR(ENOMEM);
+    av_packet_rescale_ts(copy, in_stream->time_base, out_stream->time_base);
+    copy->stream_index = out_stream->index;
+    copy->pos = -1;
+    int ret = push_watermark_item(p, NULL, copy);
+    if (ret < 0)
+      return ret;
   }
+  return 0;
+}
 
-  // 为输出文件创建一个新视频流
-  out_video_stream = avformat_new_stream(ofmt_ctx, NULL);
-  if (!out_video_stream) {
-    ret = -1;
-    goto end_fail;
+// 解码一个视频数据包（pkt 为 NULL 时刷出解码器），解码出的帧分发给所有输出
+static int decode_watermark_packet(WatermarkPipeline *outputs, int nb_outputs, AVCodecContext *dec_ctx,
+                                   const AVPacket *pkt) {
+  int ret = avcodec_send_packet(dec_ctx, pkt);
+  if (ret < 0)
+    return ret;
+  for (;;) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+      return AVERROR(ENOMEM);
+    if ((ret = avcodec_receive_frame(dec_ctx, frame)) < 0) {
+      av_frame_free(&frame);
+      break;
+    }
+    if ((ret = dispatch_watermark_frame(outputs, nb_outputs, frame)) < 0)
+      return ret;
   }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
 
-  // 使用 H.264 编码器进行编码
-  AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
-  if (!encoder) {
-    ret = -1;
-    goto end_fail;
+// 估算一路流的样本数（容器未记录时按时长与帧率/音频帧长估算），无法估算（如字幕流）时返回 0
+static int64_t estimate_stream_samples(AVFormatContext *ifmt_ctx, AVStream *st) {
+  if (st->nb_frames > 0)
+    return st->nb_frames;
+  int64_t duration = st->duration > 0 ? av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q)
+                                      : ifmt_ctx->duration;
+  if (duration <= 0)
+    return 0;
+  const AVCodecParameters *par = st->codecpar;
+  if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+    AVRational frame_rate = av_guess_frame_rate(ifmt_ctx, st, NULL);
+    return frame_rate.num > 0 && frame_rate.den > 0 ? av_rescale_q(duration, AV_TIME_BASE_Q, av_inv_q(frame_rate)) : 0;
   }
-  enc_ctx = avcodec_alloc_context3(encoder);
-  if (!enc_ctx) {
-    ret = -1;
-    goto end_fail;
+  if (par->codec_type == AVMEDIA_TYPE_AUDIO && par->sample_rate > 0)
+    return av_rescale(duration, par->sample_rate, (int64_t) AV_TIME_BASE * (par->frame_size > 0 ? par->frame_size : 1024));
+  return 0;
+}
+
+/*
+ * 创建滤镜图：buffer -> filter_descr -> buffersink，输出编码器需要的像素格式
+ */
+static int open_filter_graph(AVFilterGraph **graph, AVFilterContext **buffersrc_ctx, AVFilterContext **buffersink_ctx,
+                             const AVCodecContext *dec_ctx, AVRational time_base, enum AVPixelFormat pix_fmt,
+                             const char *filter_descr, int threads) {
+  AVFilterGraph *filter_graph = avfilter_graph_alloc();
+  if (!filter_graph)
+    return AVERROR(ENOMEM);
+  *graph = filter_graph;
+  filter_graph->nb_threads = threads;
+
+  // 获取 buffer 源和 sink 滤镜
+  const AVFilter *buffersrc = avfilter_get_by_name("buffer");
+  const AVFilter *buffersink = avfilter_get_by_name("buffersink");
+  if (!buffersrc || !buffersink)
+    return AVERROR_FILTER_NOT_FOUND;
+
+  // 构造 buffer 源的参数字符串
+  char args[512] = {0};
+  snprintf(args, sizeof(args),
+           "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+           dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt, time_base.num, time_base.den,
+           dec_ctx->sample_aspect_ratio.num, dec_ctx->sample_aspect_ratio.den);
+  int ret = avfilter_graph_create_filter(buffersrc_ctx, buffersrc, "in", args, NULL, filter_graph);
+  if (ret < 0)
+    return ret;
+  ret = avfilter_graph_create_filter(buffersink_ctx, buffersink, "out", NULL, NULL, filter_graph);
+  if (ret < 0)
+    return ret;
+
+  // 设置 buffersink 的输出像素格式，仅接受编码器需要的格式
+  enum AVPixelFormat pix_fmts[] = {pix_fmt, AV_PIX_FMT_NONE};
+  ret = av_opt_set_int_list(*buffersink_ctx, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+  if (ret < 0)
+    return ret;
+
+  // 初始化滤镜的输入输出端点
+  AVFilterInOut *outputs = avfilter_inout_alloc();
+  AVFilterInOut *inputs = avfilter_inout_alloc();
+  if (!outputs || !inputs) {
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    return AVERROR(ENOMEM);
   }
+  outputs->name = av_strdup("in");
+  outputs->filter_ctx = *buffersrc_ctx;
+  outputs->pad_idx = 0;
+  outputs->next = NULL;
+
+  inputs->name = av_strdup("out");
+  inputs->filter_ctx = *buffersink_ctx;
+  inputs->pad_idx = 0;
+  inputs->next = NULL;
+
+  // 解析并构造滤镜链（在 buffersrc 与 buffersink 之间插入水印滤镜）
+  ret = avfilter_graph_parse_ptr(filter_graph, filter_descr, &inputs, &outputs, NULL);
+  if (ret >= 0)
+    ret = avfilter_graph_config(filter_graph, NULL);
+  avfilter_inout_free(&inputs);
+  avfilter_inout_free(&outputs);
+  return ret;
+}
+
+
+/*
+ * 水印任务的设置，由 options 解析，options 为 "key=value:key=value" 形式，可为 NULL：
+ *   layout=default|faststart|fragmented  MP4 输出布局（见 mp4_layout.h）
+ *   threads=N                            解码、滤镜与编码各自使用的线程数，0（默认）表示按处理器核数自动选择
+ *   preset=NAME                          x264 编码预设，默认 veryfast
+ *   fontsize=N                           文字字号，默认 24
+ *   logo=PATH                            使用图片（如带透明通道的 PNG）作为水印，代替文字
+ */
+typedef struct WatermarkSettings {
+  Mp4Layout layout;
+  int threads;
+  const char *preset;
+  const char *logo;
+  const char *font_file;
+  int font_size;
+  AVDictionary *dict;           // 解析出的选项，preset、logo 指向其中的字符串
+} WatermarkSettings;
+
+static int parse_watermark_settings(WatermarkSettings *s, const char *options, const char *font_file) {
+  memset(s, 0, sizeof(*s));
+  s->preset = WATERMARK_DEFAULT_PRESET;
+  s->font_size = WATERMARK_DEFAULT_FONT_SIZE;
+  s->font_file = font_file;
+  int ret = mp4_layout_from_options(options, &s->layout);
+  if (ret < 0)
+    return ret;
+  if (options && (ret = av_dict_parse_string(&s->dict, options, "=", ":", 0)) < 0)
+    return ret;
+  AVDictionaryEntry *entry = av_dict_get(s->dict, "threads", NULL, 0);
+  if (entry)
+    s->threads = FFMAX(atoi(entry->value), 0);
+  if ((entry = av_dict_get(s->dict, "preset", NULL, 0)) && entry->value[0])
+    s->preset = entry->value;
+  if ((entry = av_dict_get(s->dict, "fontsize", NULL, 0)) && atoi(entry->value) > 0)
+    s->font_size = atoi(entry->value);
+  if ((entry = av_dict_get(s->dict, "logo", NULL, 0)) && entry->value[0])
+    s->logo = entry->value;
+  return 0;
+}
+
+// 未指定字体时各系统默认的中文字体
+static const char *default_font_file(void) {
+#ifdef _WIN32
+  // Windows 系统，示例路径
+  return "C\\:/Windows/Fonts/simhei.ttf";
+#elif defined(__APPLE__)
+  return "/Library/Fonts/Arial Unicode.ttf";
+#elif defined(__linux__)
+  return "/usr/share/fonts/google-noto-cjk/NotoSansCJK-Regular.ttc";
+#else
+  return "/usr/share/fonts/default.ttf";
+#endif
+}
+
+/*
+ * 打开一个输出：H.264 编码器、直接复制的音频与字幕流、水印（预渲染位图或滤镜图），写入文件头后启动流水线线程
+ * @param threads 该输出的滤镜与编码线程数，0 表示自动
+ */
+static int open_watermark_output(WatermarkPipeline *p, AVFormatContext *ifmt_ctx, AVStream *in_video_stream,
+                                 AVCodecContext *dec_ctx, const char *output_path, const char *text,
+                                 const WatermarkSettings *s, int threads) {
+  int ret;
+  // 创建输出文件上下文
+  avformat_alloc_output_context2(&p->ofmt_ctx, NULL, NULL, output_path);
+  if (!p->ofmt_ctx)
+    return AVERROR(EINVAL);
+  AVFormatContext *ofmt_ctx = p->ofmt_ctx;
+
+  // 为输出文件创建一个新视频流
+  p->out_stream = avformat_new_stream(ofmt_ctx, NULL);
+  if (!p->out_stream)
+    return AVERROR(ENOMEM);
+
+  // 使用 H.264 编码器进行编码
+  const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
+  if (!encoder)
+    return AVERROR_ENCODER_NOT_FOUND;
+  p->enc_ctx = avcodec_alloc_context3(encoder);
+  if (!p->enc_ctx)
+    return AVERROR(ENOMEM);
+  AVCodecContext *enc_ctx = p->enc_ctx;
   // 设置编码参数，根据输入视频设置输出参数（这里保持分辨率一致）
   enc_ctx->height = dec_ctx->height;
   enc_ctx->width = dec_ctx->width;
   enc_ctx->sample_aspect_ratio = dec_ctx->sample_aspect_ratio;
   // 选择 encoder 支持的像素格式（首选 encoder 的列表）
   enc_ctx->pix_fmt = encoder->pix_fmts ? encoder->pix_fmts[0] : dec_ctx->pix_fmt;
-  // 时间基设置可以采用解码器的帧率倒数，或者直接使用输入流的时间基
-  if (dec_ctx->framerate.num && dec_ctx->framerate.den)
-    enc_ctx->time_base = av_inv_q(dec_ctx->framerate);
-  else
-    enc_ctx->time_base = in_video_stream->time_base;
+  // 时间基沿用输入流的时间基：可变帧率的源换算到 1/帧率 时相邻帧会落到同一 pts；
+  // 帧率只告诉编码器用于码率控制
+  enc_ctx->time_base = in_video_stream->time_base;
+  AVRational frame_rate = av_guess_frame_rate(ifmt_ctx, in_video_stream, NULL);
+  if (frame_rate.num > 0 && frame_rate.den > 0)
+    enc_ctx->framerate = frame_rate;
   if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
     enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  enc_ctx->thread_count = threads;
 
   // 打开编码器
   AVDictionary *enc_opts = NULL;
-  av_dict_set(&enc_opts, "preset", "veryfast", 0);
-  if ((ret = avcodec_open2(enc_ctx, encoder, &enc_opts)) < 0) {
-    av_dict_free(&enc_opts);
-    goto end_fail;
-  }
+  av_dict_set(&enc_opts, "preset", s->preset, 0);
+  ret = avcodec_open2(enc_ctx, encoder, &enc_opts);
   av_dict_free(&enc_opts);
+  if (ret < 0)
+    return ret;
 
   // 将编码器参数复制到输出流
-  ret = avcodec_parameters_from_context(out_video_stream->codecpar, enc_ctx);
-  if (ret < 0) {
-    goto end_fail;
+  if ((ret = avcodec_parameters_from_context(p->out_stream->codecpar, enc_ctx)) < 0)
+    return ret;
+  p->out_stream->time_base = enc_ctx->time_base;
+
+  // 音频与字幕流直接复制（输出格式不支持的编码跳过），由 av_interleaved_write_frame 按 dts 与视频交错
+  p->stream_map = (int *) malloc(ifmt_ctx->nb_streams * sizeof(int));
+  if (!p->stream_map)
+    return AVERROR(ENOMEM);
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    AVStream *in_stream = ifmt_ctx->streams[i];
+    enum AVMediaType type = in_stream->codecpar->codec_type;
+    p->stream_map[i] = -1;
+    if ((type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_SUBTITLE) ||
+        avformat_query_codec(ofmt_ctx->oformat, in_stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL) != 1)
+      continue;
+    AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
+    if (!out_stream)
+      return AVERROR(ENOMEM);
+    if ((ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar)) < 0)
+      return ret;
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = in_stream->time_base;
+    out_stream->disposition = in_stream->disposition;
+    av_dict_copy(&out_stream->metadata, in_stream->metadata, 0);
+    p->stream_map[i] = out_stream->index;
   }
-  out_video_stream->time_base = enc_ctx->time_base;
 
   // 打开输出文件（如果需要）
   if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-    ret = avio_open(&ofmt_ctx->pb, outputPath, AVIO_FLAG_WRITE);
-    if (ret < 0) {
-      goto end_fail;
-    }
+    if ((ret = avio_open(&ofmt_ctx->pb, output_path, AVIO_FLAG_WRITE)) < 0)
+      return ret;
   }
 
-  // -----------------------------
-  //  1. 创建滤镜图（Filter Graph）
-  // -----------------------------
-  filter_graph = avfilter_graph_alloc();
-  if (!filter_graph) {
-    ret = -1;
-    goto end_fail;
+  // 静态水印优先预渲染一次，直接混合到解码后的帧；像素格式需要转换或渲染失败时退回滤镜图
+  if (watermark_overlay_supported(dec_ctx->pix_fmt) && dec_ctx->pix_fmt == enc_ctx->pix_fmt) {
+    int bitmap_ret = s->logo ? watermark_bitmap_get_image(s->logo, &p->bitmap)
+                             : watermark_bitmap_get_text(text, s->font_file, s->font_size, &p->bitmap);
+    if (bitmap_ret < 0)
+      p->bitmap = NULL;
+  }
+  if (!p->bitmap) {
+    // 注意：text 参数需要使用 UTF-8 编码（支持中文），fontfile 必须指定支持中文的字体文件
+    char filter_descr[1024] = {0};
+    if (s->logo)
+      snprintf(filter_descr, sizeof(filter_descr),
+               "movie=filename='%s'[wm];[in][wm]overlay=x=W-w-%d:y=H-h-%d[out]", s->logo, WATERMARK_MARGIN,
+               WATERMARK_MARGIN);
+    else
+      snprintf(filter_descr, sizeof(filter_descr),
+               "drawtext=fontfile='%s':text='%s':x=w-tw-%d:y=h-th-%d:fontsize=%d:fontcolor=white",
+               s->font_file, text, WATERMARK_MARGIN, WATERMARK_MARGIN, s->font_size);
+    ret = open_filter_graph(&p->graph, &p->src_ctx, &p->sink_ctx, dec_ctx, in_video_stream->time_base,
+                            enc_ctx->pix_fmt, filter_descr, threads);
+    if (ret < 0)
+      return ret;
   }
 
-  // 获取 buffer 源和 sink 滤镜
-  buffersrc = avfilter_get_by_name("buffer");
-  buffersink = avfilter_get_by_name("buffersink");
-  if (!buffersrc || !buffersink) {
-    ret = -1;
-    goto end_fail;
+  // 写入输出文件的文件头；faststart 布局按输入各路流的样本数估算预留的 moov 空间
+  int64_t *nb_samples = (int64_t *) calloc(ofmt_ctx->nb_streams, sizeof(int64_t));
+  if (!nb_samples)
+    return AVERROR(ENOMEM);
+  nb_samples[p->out_stream->index] = estimate_stream_samples(ifmt_ctx, in_video_stream);
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    if (p->stream_map[i] >= 0)
+      nb_samples[p->stream_map[i]] = estimate_stream_samples(ifmt_ctx, ifmt_ctx->streams[i]);
   }
+  AVDictionary *mux_opts = NULL;
+  if ((ret = mp4_layout_apply(&mux_opts, ofmt_ctx, s->layout, nb_samples)) >= 0)
+    ret = avformat_write_header(ofmt_ctx, &mux_opts);
+  p->header_written = ret >= 0;
+  av_dict_free(&mux_opts);
+  free(nb_samples);
+  if (ret < 0)
+    return ret;
 
-  // 构造 buffer 源的参数字符串
-  char args[512] = {0};
-  snprintf(args, sizeof(args),
-           "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-           dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt,
-           in_video_stream->time_base.num, in_video_stream->time_base.den,
-           dec_ctx->sample_aspect_ratio.num, dec_ctx->sample_aspect_ratio.den);
-  ret = avfilter_graph_create_filter(&buffersrc_ctx, buffersrc, "in", args, NULL, filter_graph);
-  if (ret < 0) {
-    goto end_fail;
+  // 启动滤镜与编码线程
+  p->in_time_base = in_video_stream->time_base;
+  return start_watermark_pipeline(p);
+}
+
+// 停止流水线并释放一个输出（输出文件的结尾由调用方写入）
+static void close_watermark_output(WatermarkPipeline *p) {
+  // 先停止流水线线程，它们仍在使用滤镜图、编码器与输出文件
+  stop_watermark_pipeline(p);
+  watermark_bitmap_unref(&p->bitmap);
+  avfilter_graph_free(&p->graph);
+  avcodec_free_context(&p->enc_ctx);
+  if (p->ofmt_ctx) {
+    if (!(p->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+      avio_closep(&p->ofmt_ctx->pb);
+    avformat_free_context(p->ofmt_ctx);
+    p->ofmt_ctx = NULL;
   }
+  free(p->stream_map);
+  p->stream_map = NULL;
+}
 
-  ret = avfilter_graph_create_filter(&buffersink_ctx, buffersink, "out", NULL, NULL, filter_graph);
-  if (ret < 0) {
-    goto end_fail;
+/*
+ * 给视频加水印并写出 nb_outputs 个文件（texts[i] 写入 output_paths[i]）
+ * 视频只解码一次，解码后的帧按引用分发给各输出的流水线，各输出的叠加与编码并行进行；音频与字幕流直接复制
+ * 单个输出失败不影响其他输出；失败的输出同样写入结尾，全部输出失败后停止解码
+ * @param results 各输出的结果（0 或负错误码）
+ * @return 全部成功返回 0，否则返回第一个负错误码
+ */
+static int watermark_files(const char *input_path, const char *const *texts, const char *const *output_paths,
+                           int nb_outputs, const WatermarkSettings *s, int *results) {
+  AVFormatContext *ifmt_ctx = NULL;
+  AVCodecContext *dec_ctx = NULL;
+  AVPacket *packet = NULL;
+  int ret = 0, started = 0;
+  for (int i = 0; i < nb_outputs; i++)
+    results[i] = 0;
+  WatermarkPipeline *outputs = (WatermarkPipeline *) calloc(nb_outputs, sizeof(WatermarkPipeline));
+  packet = av_packet_alloc();
+  if (!outputs || !packet) {
+    ret = AVERROR(ENOMEM);
+    goto end;
   }
 
-  // 设置 buffersink 的输出像素格式，仅接受编码器需要的格式
-  enum AVPixelFormat pix_fmts[] = {enc_ctx->pix_fmt, AV_PIX_FMT_NONE};
-  ret = av_opt_set_int_list(buffersink_ctx, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-  if (ret < 0) {
-    goto end_fail;
+  // 打开输入文件
+  if ((ret = avformat_open_input(&ifmt_ctx, input_path, NULL, NULL)) < 0 ||
+      (ret = avformat_find_stream_info(ifmt_ctx, NULL)) < 0)
+    goto end;
+
+  // 寻找视频流
+  int video_stream_index = -1;
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    if (ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+      video_stream_index = (int) i;
+      break;
+    }
   }
+  if (video_stream_index < 0) {
+    ret = AVERROR_STREAM_NOT_FOUND;
+    goto end;
+  }
+  AVStream *in_video_stream = ifmt_ctx->streams[video_stream_index];
 
-  // 构造 drawtext 滤镜描述字符串
-  // 注意：text 参数需要使用 UTF-8 编码（支持中文），fontfile 必须指定支持中文的字体文件
-  snprintf(filter_descr, sizeof(filter_descr),
-           "drawtext=fontfile='%s':text='%s':x=w-tw-10:y=h-th-10:fontsize=24:fontcolor=white",
-           fontFile, watermarkText);
+  // 打开视频解码器，帧级与片级多线程解码
+  const AVCodec *dec = avcodec_find_decoder(in_video_stream->codecpar->codec_id);
+  if (!dec || !(dec_ctx = avcodec_alloc_context3(dec))) {
+    ret = AVERROR_DECODER_NOT_FOUND;
+    goto end;
+  }
+  if ((ret = avcodec_parameters_to_context(dec_ctx, in_video_stream->codecpar)) < 0)
+    goto end;
+  dec_ctx->thread_count = s->threads;
+  dec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  if ((ret = avcodec_open2(dec_ctx, dec, NULL)) < 0)
+    goto end;
 
-  // 初始化滤镜的输入输出端点
-  outputs = avfilter_inout_alloc();
-  inputs = avfilter_inout_alloc();
-  if (!outputs || !inputs) {
-    ret = -1;
-    goto end_fail;
+  // 多个输出时按输出数分摊处理器核数，避免编码线程数成倍超出核数
+  int threads = s->threads;
+  if (threads == 0 && nb_outputs > 1)
+    threads = FFMAX(native_cpu_count() / nb_outputs, 1);
+  int nb_live = 0;
+  started = 1;
+  for (int i = 0; i < nb_outputs; i++) {
+    results[i] = open_watermark_output(&outputs[i], ifmt_ctx, in_video_stream, dec_ctx, output_paths[i], texts[i],
+                                       s, threads);
+    outputs[i].opened = results[i] >= 0;
+    nb_live += outputs[i].opened;
   }
 
-  outputs->name = av_strdup("in");
-  outputs->filter_ctx = buffersrc_ctx;
-  outputs->pad_idx = 0;
-  outputs->next = NULL;
+  // 调用线程只负责读包与解码：解码后的帧分发给各输出的滤镜线程，音频、字幕数据包沿流水线交给编码线程写入
+  while (nb_live > 0 && (ret = av_read_frame(ifmt_ctx, packet)) >= 0) {
+    if (packet->stream_index == video_stream_index)
+      ret = decode_watermark_packet(outputs, nb_outputs, dec_ctx, packet);
+    else
+      ret = dispatch_watermark_packet(outputs, nb_outputs, ifmt_ctx, packet);
+    av_packet_unref(packet);
+    if (ret < 0)
+      break;
+    // 所有输出都已失败时不再解码剩余的输入
+    nb_live = 0;
+    for (int i = 0; i < nb_outputs; i++)
+      nb_live += watermark_output_live(&outputs[i]);
+  }
+  if (ret == AVERROR_EOF)
+    ret = 0;
 
-  inputs->name = av_strdup("out");
-  inputs->filter_ctx = buffersink_ctx;
-  inputs->pad_idx = 0;
-  inputs->next = NULL;
+  // 刷出解码器，再等待各输出的滤镜与编码线程处理完剩余的帧并刷出编码器
+  if (ret >= 0 && nb_live > 0)
+    ret = decode_watermark_packet(outputs, nb_outputs, dec_ctx, NULL);
+  for (int i = 0; i < nb_outputs; i++) {
+    WatermarkPipeline *p = &outputs[i];
+    int pipeline_ret = stop_watermark_pipeline(p);
+    if (results[i] >= 0)
+      results[i] = ret < 0 ? ret : pipeline_ret;
+    // 每个已写入文件头的输出都写入结尾（失败的输出已写入的部分仍可播放）；
+    // faststart 时 moov 在这里写回文件头预留的空间，预留不足会失败
+    if (p->header_written) {
+      int trailer_ret = av_write_trailer(p->ofmt_ctx);
+      if (results[i] >= 0)
+        results[i] = trailer_ret;
+    }
+  }
+  for (int i = 0; ret >= 0 && i < nb_outputs; i++)
+    ret = results[i];
 
-  // 解析并构造滤镜链（在 buffersrc 与 buffersink 之间插入 drawtext 过滤器）
-  ret = avfilter_graph_parse_ptr(filter_graph, filter_descr, &inputs, &outputs, NULL);
-  if (ret < 0) {
-    goto end_fail;
+  end:
+  for (int i = 0; outputs && i < nb_outputs; i++)
+    close_watermark_output(&outputs[i]);
+  if (ret < 0 && !started) {
+    // 输入或解码器无法打开时所有输出都失败
+    for (int i = 0; i < nb_outputs; i++) {
+      if (results[i] >= 0)
+        results[i] = ret;
+    }
   }
-  ret = avfilter_graph_config(filter_graph, NULL);
+  free(outputs);
+  av_packet_free(&packet);
+  avcodec_free_context(&dec_ctx);
+  avformat_close_input(&ifmt_ctx);
+  return ret;
+}
+
+/*
+ * 给视频加文字水印：视频解码、叠加水印后重新编码，音频与字幕流直接复制
+ * 解码、滤镜、编码分别在不同线程中以流水线方式并行
+ * 解码输出的像素格式与编码器一致（8 位平面 YUV）时，水印只渲染一次并直接混合到帧中，不经过滤镜图
+ */
+static jstring add_watermark(JNIEnv *env, jstring inputVideoPathJ, jstring outputVideoPathJ, jstring watermarkTextJ,
+                             jstring fontFileJ, const char *options) {
+  // 从 Java 获取文件路径、水印文本和字体文件路径
+  const char *inputPath = (*env)->GetStringUTFChars(env, inputVideoPathJ, NULL);
+  const char *outputPath = (*env)->GetStringUTFChars(env, outputVideoPathJ, NULL);
+  const char *watermarkText = (*env)->GetStringUTFChars(env, watermarkTextJ, NULL);
+
+  // 检查 fontFileJ 是否为 null 或者空字符串
+  int customFont = fontFileJ != NULL && (*env)->GetStringUTFLength(env, fontFileJ) > 0;
+  const char *fontFile = customFont ? (*env)->GetStringUTFChars(env, fontFileJ, NULL) : default_font_file();
+
+  WatermarkSettings settings;
+  int result = 0;
+  int ret = parse_watermark_settings(&settings, options, fontFile);
+  if (ret >= 0)
+    ret = watermark_files(inputPath, &watermarkText, &outputPath, 1, &settings, &result);
+  av_dict_free(&settings.dict);
+
+  char resultMsg[256] = {0};
   if (ret < 0) {
-    goto end_fail;
+    snprintf(resultMsg, sizeof(resultMsg), "Failed to add watermark, error code: %d", ret);
+  } else {
+    snprintf(resultMsg, sizeof(resultMsg), "Watermark added successfully, output saved to %s", outputPath);
   }
+  (*env)->ReleaseStringUTFChars(env, inputVideoPathJ, inputPath);
+  (*env)->ReleaseStringUTFChars(env, outputVideoPathJ, outputPath);
+  (*env)->ReleaseStringUTFChars(env, watermarkTextJ, watermarkText);
+  if (customFont)
+    (*env)->ReleaseStringUTFChars(env, fontFileJ, fontFile);
+  return (*env)->NewStringUTF(env, resultMsg);
+}
 
-  avfilter_inout_free(&inputs);
-  avfilter_inout_free(&outputs);
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkToVideo
+  (JNIEnv *env, jclass clazz, jstring inputVideoPathJ, jstring outputVideoPathJ, jstring watermarkTextJ,
+   jstring fontFileJ) {
+  return add_watermark(env, inputVideoPathJ, outputVideoPathJ, watermarkTextJ, fontFileJ, NULL);
+}
 
-  // -----------------------------
-  // 写入输出文件的文件头
-  ret = avformat_write_header(ofmt_ctx, NULL);
-  if (ret < 0) {
-    goto end_fail;
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkToVideoWithOptions
+  (JNIEnv *env, jclass clazz, jstring inputVideoPathJ, jstring outputVideoPathJ, jstring watermarkTextJ,
+   jstring fontFileJ, jstring optionsJ) {
+  // options 允许为 null，表示默认设置
+  const char *options = optionsJ ? (*env)->GetStringUTFChars(env, optionsJ, NULL) : NULL;
+  jstring result = add_watermark(env, inputVideoPathJ, outputVideoPathJ, watermarkTextJ, fontFileJ, options);
+  if (options)
+    (*env)->ReleaseStringUTFChars(env, optionsJ, options);
+  return result;
+}
+
+/*
+ * 同一个视频按不同文字加水印并写出多个文件：texts[i] 写入 outputPaths[i]
+ * 视频只解码一次，N 个输出的代价约为一次解码加 N 次编码；fontFile、options 可为 null（同 addWatermarkToVideoWithOptions）
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarks
+  (JNIEnv *env, jclass clazz, jstring inputVideoPathJ, jobjectArray textsJ, jobjectArray outputPathsJ,
+   jstring fontFileJ, jstring optionsJ) {
+  int nb_outputs = textsJ ? (*env)->GetArrayLength(env, textsJ) : 0;
+  if (nb_outputs < 1 || !outputPathsJ || (*env)->GetArrayLength(env, outputPathsJ) != nb_outputs) {
+    return (*env)->NewStringUTF(env, "Failed to add watermarks: texts and output paths must be non-empty and of equal length");
   }
 
-  // 申请解码与滤镜使用的 AVFrame
-  AVFrame *frame = av_frame_alloc();
-  AVFrame *filt_frame = av_frame_alloc();
-  if (!frame || !filt_frame) {
-    ret = AVERROR(ENOMEM);
-    goto end_fail;
+  // 字符串需在当前线程中从 Java 取出，流水线线程只使用 C 字符串
+  char *inputPath = jstringToChar(env, inputVideoPathJ);
+  char *fontFile = fontFileJ && (*env)->GetStringUTFLength(env, fontFileJ) > 0 ? jstringToChar(env, fontFileJ) : NULL;
+  char *options = optionsJ ? jstringToChar(env, optionsJ) : NULL;
+  char **texts = (char **) calloc(nb_outputs, sizeof(char *));
+  char **outputPaths = (char **) calloc(nb_outputs, sizeof(char *));
+  int *results = (int *) calloc(nb_outputs, sizeof(int));
+  int ret = inputPath && texts && outputPaths && results ? 0 : AVERROR(ENOMEM);
+  for (int i = 0; ret >= 0 && i < nb_outputs; i++) {
+    jstring jText = (jstring) (*env)->GetObjectArrayElement(env, textsJ, i);
+    jstring jOutput = (jstring) (*env)->GetObjectArrayElement(env, outputPathsJ, i);
+    texts[i] = jText ? jstringToChar(env, jText) : NULL;
+    outputPaths[i] = jOutput ? jstringToChar(env, jOutput) : NULL;
+    if (jText)
+      (*env)->DeleteLocalRef(env, jText);
+    if (jOutput)
+      (*env)->DeleteLocalRef(env, jOutput);
+    if (!texts[i] || !outputPaths[i])
+      ret = AVERROR(EINVAL);
   }
 
-  AVPacket packet;
-  av_init_packet(&packet);
-  packet.data = NULL;
-  packet.size = 0;
+  WatermarkSettings settings;
+  memset(&settings, 0, sizeof(settings));
+  if (ret >= 0)
+    ret = parse_watermark_settings(&settings, options, fontFile ? fontFile : default_font_file());
+  int ran = ret >= 0;
+  if (ran)
+    ret = watermark_files(inputPath, (const char *const *) texts, (const char *const *) outputPaths, nb_outputs,
+                          &settings, results);
+  av_dict_free(&settings.dict);
 
-  // -----------------------------
-  // 逐帧处理：解码 -> 送入滤镜 -> 从滤镜中取出 -> 编码 -> 写入文件
-  while (av_read_frame(ifmt_ctx, &packet) >= 0) {
-    if (packet.stream_index == video_stream_index) {
-      ret = avcodec_send_packet(dec_ctx, &packet);
-      if (ret < 0) {
-        break;
-      }
-      while ((ret = avcodec_receive_frame(dec_ctx, frame)) >= 0) {
-        // 将解码后的帧送入滤镜图
-        if ((ret = av_buffersrc_add_frame(buffersrc_ctx, frame)) < 0) {
-          break;
-        }
-        // 从滤镜图中获取处理后的帧
-        while ((ret = av_buffersink_get_frame(buffersink_ctx, filt_frame)) >= 0) {
-          // 将水印后的视频帧送入编码器
-          filt_frame->pict_type = AV_PICTURE_TYPE_NONE;
-          ret = avcodec_send_frame(enc_ctx, filt_frame);
-          if (ret < 0) {
-            break;
-          }
-          AVPacket enc_pkt;
-          av_init_packet(&enc_pkt);
-          enc_pkt.data = NULL;
-          enc_pkt.size = 0;
-          while ((ret = avcodec_receive_packet(enc_ctx, &enc_pkt)) >= 0) {
-            av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, out_video_stream->time_base);
-            enc_pkt.stream_index = out_video_stream->index;
-            ret = av_interleaved_write_frame(ofmt_ctx, &enc_pkt);
-            av_packet_unref(&enc_pkt);
-            if (ret < 0) {
-              break;
-            }
-          }
-          av_frame_unref(filt_frame);
-        }
-        av_frame_unref(frame);
-      }
-    }
-    av_packet_unref(&packet);
-  }
-
-  // 刷出残留的解码和编码数据
-  avcodec_send_packet(dec_ctx, NULL);
-  while (avcodec_receive_frame(dec_ctx, frame) >= 0) {
-    av_buffersrc_add_frame(buffersrc_ctx, frame);
-    while (av_buffersink_get_frame(buffersink_ctx, filt_frame) >= 0) {
-      filt_frame->pict_type = AV_PICTURE_TYPE_NONE;
-      avcodec_send_frame(enc_ctx, filt_frame);
-      AVPacket enc_pkt;
-      av_init_packet(&enc_pkt);
-      enc_pkt.data = NULL;
-      enc_pkt.size = 0;
-      while (avcodec_receive_packet(enc_ctx, &enc_pkt) >= 0) {
-        av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, out_video_stream->time_base);
-        enc_pkt.stream_index = out_video_stream->index;
-        av_interleaved_write_frame(ofmt_ctx, &enc_pkt);
-        av_packet_unref(&enc_pkt);
-      }
-      av_frame_unref(filt_frame);
+  // 部分输出失败时逐个列出失败的输出及原因
+  AVBPrint msg;
+  av_bprint_init(&msg, 0, AV_BPRINT_SIZE_UNLIMITED);
+  if (ret >= 0) {
+    av_bprintf(&msg, "Watermarks added successfully, %d outputs written", nb_outputs);
+  } else if (!ran) {
+    av_bprintf(&msg, "Failed to add watermarks, error code: %d", ret);
+  } else {
+    int nb_failed = 0;
+    for (int i = 0; i < nb_outputs; i++)
+      nb_failed += results[i] < 0;
+    av_bprintf(&msg, "Failed to add watermarks to %d of %d outputs:", nb_failed, nb_outputs);
+    for (int i = 0; i < nb_outputs; i++) {
+      if (results[i] >= 0)
+        continue;
+      char errbuf[128] = {0};
+      av_strerror(results[i], errbuf, sizeof(errbuf));
+      av_bprintf(&msg, " %s (%s);", outputPaths[i], errbuf);
     }
-    av_frame_unref(frame);
-  }
-
-  // 刷出编码器
-  avcodec_send_frame(enc_ctx, NULL);
-  while (1) {
-    AVPacket enc_pkt;
-    av_init_packet(&enc_pkt);
-    enc_pkt.data = NULL;
-    enc_pkt.size = 0;
-    ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
-    if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN))
-      break;
+  }
+  jstring resultJ = (*env)->NewStringUTF(env, av_bprint_is_complete(&msg) ? msg.str : "Failed to add watermarks");
+  av_bprint_finalize(&msg, NULL);
+  for (int i = 0; i < nb_outputs; i++) {
+    if (texts)
+      free(texts[i]);
+    if (outputPaths)
+      free(outputPaths[i]);
+  }
+  free(texts);
+  free(outputPaths);
+  free(results);
+  free(inputPath);
+  free(fontFile);
+  free(options);
+  return resultJ;
+}
+
+/*
+ * 按时间窗口加水印：只重新编码与窗口相交的 GOP（帧在窗口内时叠加水印），其余 GOP 原样流拷贝，
+ * 音频与字幕流直接复制。重编码沿用 gop_reencoder 按源流参数编码、与流拷贝的 GOP 拼接在同一路视频流中；
+ * 源编码无法拼接时（非 H.264 或没有 libx264）整路视频重新编码，水印仍只出现在窗口内。
+ */
+typedef struct WatermarkWindowContext {
+  AVFormatContext *ifmt_ctx;
+  AVFormatContext *ofmt_ctx;
+  int *stream_map;              // 输入流序号 -> 输出流序号，-1 表示丢弃
+  int video_index;
+  GopReencoder *reencoder;
+  int splice;                   // 1 表示重编码的 GOP 可与流拷贝的 GOP 拼接
+  int64_t *windows;             // [start, end) 对（视频流时间基）
+  int nb_windows;
+  WatermarkBitmap *bitmap;
+  WatermarkOverlay overlay;     // 由第一个重编码的帧生成
+  int overlay_ready;
+  AVPacket **gop;               // 当前 GOP 的数据包（从关键帧开始）
+  int nb_gop;
+  int gop_capacity;
+  int copied_gops;
+  int reencoded_gops;
+} WatermarkWindowContext;
+
+// 写入一个输入时间基的数据包：时间戳转换到输出时间基
+static int write_window_packet(WatermarkWindowContext *ctx, AVPacket *pkt, int in_index) {
+  AVStream *in_stream = ctx->ifmt_ctx->streams[in_index];
+  AVStream *out_stream = ctx->ofmt_ctx->streams[ctx->stream_map[in_index]];
+  av_packet_rescale_ts(pkt, in_stream->time_base, out_stream->time_base);
+  pkt->stream_index = out_stream->index;
+  pkt->pos = -1;
+  return av_interleaved_write_frame(ctx->ofmt_ctx, pkt);
+}
+
+static int on_window_packet(void *opaque, AVPacket *pkt) {
+  WatermarkWindowContext *ctx = (WatermarkWindowContext *) opaque;
+  return write_window_packet(ctx, pkt, ctx->video_index);
+}
+
+// 显示时间（视频流时间基）落在某个窗口内
+static int in_watermark_window(const WatermarkWindowContext *ctx, int64_t pts) {
+  for (int i = 0; i < ctx->nb_windows; i++) {
+    if (pts >= ctx->windows[i * 2] && pts < ctx->windows[i * 2 + 1])
+      return 1;
+  }
+  return 0;
+}
+
+// 重编码前的解码帧：在窗口内时叠加水印
+static int on_window_frame(void *opaque, AVFrame *frame) {
+  WatermarkWindowContext *ctx = (WatermarkWindowContext *) opaque;
+  if (frame->pts == AV_NOPTS_VALUE || !in_watermark_window(ctx, frame->pts))
+    return 0;
+  int ret;
+  if (!ctx->overlay_ready) {
+    if ((ret = watermark_overlay_init(&ctx->overlay, ctx->bitmap, frame, WATERMARK_MARGIN)) < 0)
+      return ret;
+    ctx->overlay_ready = 1;
+  }
+  // 解码器仍持有参考帧的引用，共享的缓冲区先复制一份再改写
+  if ((ret = av_frame_make_writable(frame)) < 0)
+    return ret;
+  return watermark_overlay_blend(&ctx->overlay, frame);
+}
+
+static void clear_window_gop(WatermarkWindowContext *ctx) {
+  for (int i = 0; i < ctx->nb_gop; i++)
+    av_packet_free(&ctx->gop[i]);
+  ctx->nb_gop = 0;
+}
+
+static int add_window_gop_packet(WatermarkWindowContext *ctx, AVPacket *pkt) {
+  if (ctx->nb_gop >= ctx->gop_capacity) {
+    int capacity = ctx->gop_capacity ? ctx->gop_capacity * 2 : 64;
+    AVPacket **tmp = (AVPacket **) realloc(ctx->gop, capacity * sizeof(AVPacket *));
+    if (!tmp)
+      return AVERROR(ENOMEM);
+    ctx->gop = tmp;
+    ctx->gop_capacity = capacity;
+  }
+  AVPacket *copy = av_packet_alloc();
+  if (!copy)
+    return AVERROR(ENOMEM);
+  av_packet_move_ref(copy, pkt);
+  ctx->gop[ctx->nb_gop++] = copy;
+  return 0;
+}
+
+/*
+ * 处理一个完整的 GOP：next_key 为下一个关键帧的显示时间（视频流时间基），INT64_MAX 表示文件结束
+ * 与所有窗口都不相交的流拷贝，相交的整个 GOP 重新编码
+ */
+static int process_window_gop(WatermarkWindowContext *ctx, int64_t next_key) {
+  if (ctx->nb_gop == 0)
+    return 0;
+  int64_t gop_start = INT64_MAX, last_end = INT64_MIN;
+  for (int i = 0; i < ctx->nb_gop; i++) {
+    AVPacket *pkt = ctx->gop[i];
+    if (pkt->pts == AV_NOPTS_VALUE)
+      continue;
+    gop_start = FFMIN(gop_start, pkt->pts);
+    last_end = FFMAX(last_end, pkt->pts + FFMAX(pkt->duration, 1));
+  }
+  int64_t gop_end = next_key != INT64_MAX ? next_key : last_end;
+  int intersects = 0;
+  for (int i = 0; i < ctx->nb_windows && !intersects; i++)
+    intersects = gop_start < ctx->windows[i * 2 + 1] && gop_end > ctx->windows[i * 2];
+
+  int ret = 0;
+  if (ctx->splice && !intersects) {
+    // 先结束前面的重编码片段，再原样写入整个 GOP
+    ret = gop_reencoder_flush(ctx->reencoder, on_window_packet, ctx);
+    for (int i = 0; i < ctx->nb_gop && ret >= 0; i++)
+      ret = write_window_packet(ctx, ctx->gop[i], ctx->video_index);
+    ctx->copied_gops++;
+  } else {
+    ret = gop_reencoder_encode(ctx->reencoder, ctx->gop, ctx->nb_gop, INT64_MIN, INT64_MAX, on_window_packet, ctx);
+    ctx->reencoded_gops++;
+  }
+  clear_window_gop(ctx);
+  return ret;
+}
+
+// 创建输出文件：视频（可拼接时沿用源参数，否则使用编码器参数）与输出格式支持的音频、字幕流
+static int open_window_output(WatermarkWindowContext *ctx, const char *outputPath, Mp4Layout layout) {
+  AVFormatContext *ifmt_ctx = ctx->ifmt_ctx;
+  int ret = avformat_alloc_output_context2(&ctx->ofmt_ctx, NULL, NULL, outputPath);
+  if (ret < 0 || !ctx->ofmt_ctx)
+    return ret < 0 ? ret : AVERROR_UNKNOWN;
+
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    AVStream *in_stream = ifmt_ctx->streams[i];
+    enum AVMediaType type = in_stream->codecpar->codec_type;
+    ctx->stream_map[i] = -1;
+    if ((int) i != ctx->video_index &&
+        ((type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_SUBTITLE) ||
+         avformat_query_codec(ctx->ofmt_ctx->oformat, in_stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL) != 1))
+      continue;
+    AVStream *out_stream = avformat_new_stream(ctx->ofmt_ctx, NULL);
+    if (!out_stream)
+      return AVERROR(ENOMEM);
+    if ((int) i == ctx->video_index && !ctx->splice)
+      ret = gop_reencoder_parameters(ctx->reencoder, out_stream->codecpar);
+    else
+      ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
     if (ret < 0)
-      break;
-    av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, out_video_stream->time_base);
-    enc_pkt.stream_index = out_video_stream->index;
-    av_interleaved_write_frame(ofmt_ctx, &enc_pkt);
-    av_packet_unref(&enc_pkt);
+      return ret;
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = in_stream->time_base;
+    out_stream->disposition = in_stream->disposition;
+    av_dict_copy(&out_stream->metadata, in_stream->metadata, 0);
+    ctx->stream_map[i] = out_stream->index;
   }
 
-  av_write_trailer(ofmt_ctx);
+  if (!(ctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+    ret = avio_open(&ctx->ofmt_ctx->pb, outputPath, AVIO_FLAG_WRITE);
+    if (ret < 0)
+      return ret;
+  }
 
-  end_fail:
-  {
-    char resultMsg[256] = {0};
-    if (ret < 0) {
-      snprintf(resultMsg, sizeof(resultMsg), "Failed to add watermark, error code: %d", ret);
+  // faststart 布局按输入各路流的样本数估算预留的 moov 空间
+  int64_t *nb_samples = (int64_t *) calloc(ctx->ofmt_ctx->nb_streams, sizeof(int64_t));
+  if (!nb_samples)
+    return AVERROR(ENOMEM);
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    if (ctx->stream_map[i] >= 0)
+      nb_samples[ctx->stream_map[i]] = estimate_stream_samples(ifmt_ctx, ifmt_ctx->streams[i]);
+  }
+  AVDictionary *opts = NULL;
+  if ((ret = mp4_layout_apply(&opts, ctx->ofmt_ctx, layout, nb_samples)) >= 0)
+    ret = avformat_write_header(ctx->ofmt_ctx, &opts);
+  av_dict_free(&opts);
+  free(nb_samples);
+  return ret;
+}
+
+// 读取并写出：视频按 GOP 处理，其他流直接复制
+static int run_watermark_windows(WatermarkWindowContext *ctx) {
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+    return AVERROR(ENOMEM);
+  int ret;
+  while ((ret = av_read_frame(ctx->ifmt_ctx, pkt)) >= 0) {
+    int idx = pkt->stream_index;
+    ret = 0;
+    if (ctx->stream_map[idx] < 0) {
+      // 丢弃
+    } else if (idx == ctx->video_index) {
+      // 新的 GOP 开始：前一个 GOP 已完整；第一个关键帧之前无法解码的数据包丢弃
+      if ((pkt->flags & AV_PKT_FLAG_KEY) && pkt->pts != AV_NOPTS_VALUE)
+        ret = process_window_gop(ctx, pkt->pts);
+      if (ret >= 0 && (ctx->nb_gop > 0 || (pkt->flags & AV_PKT_FLAG_KEY)))
+        ret = add_window_gop_packet(ctx, pkt);
     } else {
-      snprintf(resultMsg, sizeof(resultMsg), "Watermark added successfully, output saved to %s", outputPath);
+      ret = write_window_packet(ctx, pkt, idx);
     }
-    // 清理释放分配的资源
-    if (filter_graph)
-      avfilter_graph_free(&filter_graph);
-    if (dec_ctx)
-      avcodec_free_context(&dec_ctx);
-    if (enc_ctx)
-      avcodec_free_context(&enc_ctx);
-    if (ifmt_ctx)
-      avformat_close_input(&ifmt_ctx);
-    if (ofmt_ctx) {
-      if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-        avio_closep(&ofmt_ctx->pb);
-      avformat_free_context(ofmt_ctx);
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
+  }
+  if (ret == AVERROR_EOF)
+    ret = 0;
+  if (ret >= 0)
+    ret = process_window_gop(ctx, INT64_MAX);
+  if (ret >= 0)
+    ret = gop_reencoder_flush(ctx->reencoder, on_window_packet, ctx);
+  av_packet_free(&pkt);
+  return ret;
+}
+
+/*
+ * windows 为 [start, end) 秒的列表（start0, end0, start1, end1, ...），负值表示距视频结尾的秒数，
+ * 超出时长的结束时间截到结尾；options 同 addWatermarkToVideoWithOptions（threads、preset 不适用于按源参数的重编码）
+ */
+static const char *add_watermark_windows(const char *inputPath, const char *outputPath, const char *text,
+                                         const double *windows, int nb_windows, const WatermarkSettings *s,
+                                         char *resultMsg, size_t resultSize) {
+  WatermarkWindowContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  int ret = avformat_open_input(&ctx.ifmt_ctx, inputPath, NULL, NULL);
+  if (ret < 0 || (ret = avformat_find_stream_info(ctx.ifmt_ctx, NULL)) < 0)
+    goto end;
+  ctx.stream_map = (int *) calloc(ctx.ifmt_ctx->nb_streams, sizeof(int));
+  ctx.windows = (int64_t *) calloc(nb_windows * 2, sizeof(int64_t));
+  if (!ctx.stream_map || !ctx.windows) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  ctx.video_index = av_find_best_stream(ctx.ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (ctx.video_index < 0) {
+    ret = ctx.video_index;
+    goto end;
+  }
+  AVStream *video = ctx.ifmt_ctx->streams[ctx.video_index];
+
+  // 窗口转换到视频流时间基（相对文件起始时间）：负值相对结尾，截到 [0, 时长]，结束在结尾处的窗口延伸到文件末尾
+  int64_t duration = ctx.ifmt_ctx->duration > 0 ? ctx.ifmt_ctx->duration : INT64_MAX / 2;
+  int64_t start_time = ctx.ifmt_ctx->start_time != AV_NOPTS_VALUE ? ctx.ifmt_ctx->start_time : 0;
+  for (int i = 0; i < nb_windows; i++) {
+    int64_t bounds[2];
+    for (int k = 0; k < 2; k++) {
+      double t = windows[i * 2 + k] * AV_TIME_BASE;
+      if (t < 0)
+        t += (double) duration;
+      bounds[k] = t <= 0 ? 0 : t >= (double) duration ? duration : (int64_t) t;
     }
-    av_frame_free(&frame);
-    av_frame_free(&filt_frame);
-    if (inputPath)
-      (*env)->ReleaseStringUTFChars(env, inputVideoPathJ, inputPath);
-    if (outputPath)
-      (*env)->ReleaseStringUTFChars(env, outputVideoPathJ, outputPath);
-    if (watermarkText)
-      (*env)->ReleaseStringUTFChars(env, watermarkTextJ, watermarkText);
-    if (fontFile)
-      (*env)->ReleaseStringUTFChars(env, fontFileJ, fontFile);
+    if (bounds[1] <= bounds[0])
+      continue;
+    ctx.windows[ctx.nb_windows * 2] = av_rescale_q(bounds[0] + start_time, AV_TIME_BASE_Q, video->time_base);
+    ctx.windows[ctx.nb_windows * 2 + 1] = bounds[1] >= duration ? INT64_MAX
+                                          : av_rescale_q(bounds[1] + start_time, AV_TIME_BASE_Q, video->time_base);
+    ctx.nb_windows++;
+  }
+
+  // 水印位图：只支持直接混合到源像素格式（8 位平面 YUV）
+  if (!watermark_overlay_supported((enum AVPixelFormat) video->codecpar->format)) {
+    ret = AVERROR(ENOSYS);
+    goto end;
+  }
+  ret = s->logo ? watermark_bitmap_get_image(s->logo, &ctx.bitmap)
+                : watermark_bitmap_get_text(text, s->font_file, s->font_size, &ctx.bitmap);
+  if (ret < 0)
+    goto end;
+
+  // 输出格式是否需要全局头只能在创建输出上下文后得知，这里按扩展名预先判断
+  const AVOutputFormat *ofmt = av_guess_format(NULL, outputPath, NULL);
+  int global_header = ofmt && (ofmt->flags & AVFMT_GLOBALHEADER);
+  ret = gop_reencoder_open(&ctx.reencoder, video->codecpar, video->time_base,
+                           av_guess_frame_rate(ctx.ifmt_ctx, video, NULL), global_header);
+  if (ret < 0)
+    goto end;
+  ctx.splice = gop_reencoder_splice_compatible(ctx.reencoder);
+  gop_reencoder_set_frame_callback(ctx.reencoder, on_window_frame, &ctx);
+
+  if ((ret = open_window_output(&ctx, outputPath, s->layout)) < 0)
+    goto end;
+  ret = run_watermark_windows(&ctx);
+  // faststart 时 moov 在这里写回文件头预留的空间，预留不足会失败
+  if (ret >= 0)
+    ret = av_write_trailer(ctx.ofmt_ctx);
+
+  end:
+  if (ret < 0) {
+    char errbuf[128] = {0};
+    av_strerror(ret, errbuf, sizeof(errbuf));
+    snprintf(resultMsg, resultSize, "Failed to add watermark: %s", errbuf);
+  } else {
+    snprintf(resultMsg, resultSize,
+             "Watermark added successfully (%d GOP(s) copied, %d re-encoded), output saved to %s",
+             ctx.copied_gops, ctx.reencoded_gops, outputPath);
+  }
+  clear_window_gop(&ctx);
+  free(ctx.gop);
+  gop_reencoder_free(&ctx.reencoder);
+  watermark_overlay_uninit(&ctx.overlay);
+  watermark_bitmap_unref(&ctx.bitmap);
+  if (ctx.ofmt_ctx) {
+    if (!(ctx.ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+      avio_closep(&ctx.ofmt_ctx->pb);
+    avformat_free_context(ctx.ofmt_ctx);
+  }
+  if (ctx.ifmt_ctx)
+    avformat_close_input(&ctx.ifmt_ctx);
+  free(ctx.stream_map);
+  free(ctx.windows);
+  return resultMsg;
+}
+
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_addWatermarkInWindows
+  (JNIEnv *env, jclass clazz, jstring inputVideoPathJ, jstring outputVideoPathJ, jstring watermarkTextJ,
+   jstring fontFileJ, jdoubleArray windowsJ, jstring optionsJ) {
+  char resultMsg[512] = {0};
+  int nb_values = windowsJ ? (*env)->GetArrayLength(env, windowsJ) : 0;
+  if (nb_values < 2 || nb_values % 2 != 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Invalid watermark windows, expected [start, end] pairs in seconds");
     return (*env)->NewStringUTF(env, resultMsg);
   }
-}
\ No newline at end of file
+
+  const char *inputPath = (*env)->GetStringUTFChars(env, inputVideoPathJ, NULL);
+  const char *outputPath = (*env)->GetStringUTFChars(env, outputVideoPathJ, NULL);
+  const char *watermarkText = (*env)->GetStringUTFChars(env, watermarkTextJ, NULL);
+  int customFont = fontFileJ != NULL && (*env)->GetStringUTFLength(env, fontFileJ) > 0;
+  const char *fontFile = customFont ? (*env)->GetStringUTFChars(env, fontFileJ, NULL) : default_font_file();
+  const char *options = optionsJ ? (*env)->GetStringUTFChars(env, optionsJ, NULL) : NULL;
+  jdouble *windows = (*env)->GetDoubleArrayElements(env, windowsJ, NULL);
+
+  WatermarkSettings settings;
+  int ret = parse_watermark_settings(&settings, options, fontFile);
+  if (!inputPath || !outputPath || !watermarkText || !windows) {
+    snprintf(resultMsg, sizeof(resultMsg), "Invalid input or output path");
+  } else if (ret < 0) {
+    snprintf(resultMsg, sizeof(resultMsg), "Invalid options: %s", options);
+  } else {
+    add_watermark_windows(inputPath, outputPath, watermarkText, windows, nb_values / 2, &settings, resultMsg,
+                          sizeof(resultMsg));
+  }
+  av_dict_free(&settings.dict);
+
+  if (windows)
+    (*env)->ReleaseDoubleArrayElements(env, windowsJ, windows, JNI_ABORT);
+  if (options)
+    (*env)->ReleaseStringUTFChars(env, optionsJ, options);
+  if (customFont)
+    (*env)->ReleaseStringUTFChars(env, fontFileJ, fontFile);
+  if (watermarkText)
+    (*env)->ReleaseStringUTFChars(env, watermarkTextJ, watermarkText);
+  if (outputPath)
+    (*env)->ReleaseStringUTFChars(env, outputVideoPathJ, outputPath);
+  if (inputPath)
+    (*env)->ReleaseStringUTFChars(env, inputVideoPathJ, inputPath);
+  return (*env)->NewStringUTF(env, resultMsg);
+}
@@ -0,0 +1,224 @@
+// media_probe.c
+#include "media_probe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+#include "native_queue.h"
+#include "native_thread.h"
+
+#define MEDIA_PROBE_MIN_THREADS 4 // 探测以 I/O 等待为主，处理器较少时也保留一定并发
+
+int media_open_input(const char *path, AVFormatContext **fmt_ctx) {
+  AVFormatContext *ctx = NULL;
+  int ret = avformat_open_input(&ctx, path, NULL, NULL);
+  if (ret < 0)
+    return ret;
+  if ((ret = avformat_find_stream_info(ctx, NULL)) < 0) {
+    avformat_close_input(&ctx);
+    return ret;
+  }
+  if (fmt_ctx)
+    *fmt_ctx = ctx;
+  else
+    avformat_close_input(&ctx);
+  return 0;
+}
+
+int media_probe_file(MediaInfo *info, const char *path) {
+  memset(info, 0, sizeof(*info));
+  info->video_index = -1;
+  info->audio_index = -1;
+  AVFormatContext *ctx = NULL;
+  int ret = media_open_input(path, &ctx);
+  if (ret < 0) {
+    info->result = ret;
+    return ret;
+  }
+
+  // 音视频流的最大时长
+  for (unsigned int i = 0; i < ctx->nb_streams; i++) {
+    AVStream *st = ctx->streams[i];
+    if ((st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO || st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) &&
+        st->duration > 0) {
+      int64_t dur = av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q);
+      if (dur > info->duration)
+        info->duration = dur;
+    }
+  }
+
+  info->video_index = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  info->audio_index = av_find_best_stream(ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+  if (info->video_index >= 0) {
+    AVStream *st = ctx->streams[info->video_index];
+    info->video_par = avcodec_parameters_alloc();
+    if (!info->video_par || (ret = avcodec_parameters_copy(info->video_par, st->codecpar)) < 0)
+      ret = ret < 0 ? ret : AVERROR(ENOMEM);
+    info->video_time_base = st->time_base;
+    info->video_frame_rate = av_guess_frame_rate(ctx, st, NULL);
+    info->video_frames = st->nb_frames;
+    if (info->video_frames <= 0 && info->video_frame_rate.num > 0 && info->video_frame_rate.den > 0)
+      info->video_frames = av_rescale_q(info->duration, AV_TIME_BASE_Q, av_inv_q(info->video_frame_rate));
+  }
+  if (ret >= 0 && info->audio_index >= 0) {
+    AVStream *st = ctx->streams[info->audio_index];
+    info->audio_par = avcodec_parameters_alloc();
+    if (!info->audio_par || (ret = avcodec_parameters_copy(info->audio_par, st->codecpar)) < 0)
+      ret = ret < 0 ? ret : AVERROR(ENOMEM);
+    info->audio_time_base = st->time_base;
+  }
+  avformat_close_input(&ctx);
+  if (ret < 0) {
+    media_info_uninit(info);
+    info->result = ret;
+  }
+  return ret;
+}
+
+void media_info_uninit(MediaInfo *info) {
+  avcodec_parameters_free(&info->video_par);
+  avcodec_parameters_free(&info->audio_par);
+}
+
+typedef struct ProbeJob {
+  MediaInfo *infos;
+  char *const *paths;
+  int nb_paths;
+  volatile uint32_t next;
+} ProbeJob;
+
+static void *probe_worker(void *arg) {
+  ProbeJob *job = (ProbeJob *) arg;
+  for (;;) {
+    int i = (int) native_atomic_add_u32(&job->next, 1) - 1;
+    if (i >= job->nb_paths)
+      break;
+    media_probe_file(&job->infos[i], job->paths[i]);
+  }
+  return NULL;
+}
+
+int media_probe_parallel(MediaInfo *infos, char *const *paths, int nb_paths, int threads) {
+  if (nb_paths <= 0)
+    return 0;
+  if (threads <= 0)
+    threads = FFMAX(native_cpu_count(), MEDIA_PROBE_MIN_THREADS);
+  if (threads > nb_paths)
+    threads = nb_paths;
+
+  ProbeJob job;
+  memset(&job, 0, sizeof(job));
+  job.infos = infos;
+  job.paths = paths;
+  job.nb_paths = nb_paths;
+
+  native_thread_t *workers = (native_thread_t *) calloc(threads, sizeof(native_thread_t));
+  if (!workers)
+    return AVERROR(ENOMEM);
+  int started = 0;
+  for (int i = 0; i < threads; i++) {
+    if (native_thread_create(&workers[i], probe_worker, &job) < 0)
+      break;
+    started++;
+  }
+  // 线程创建失败时由当前线程处理剩余的输入
+  if (started < threads)
+    probe_worker(&job);
+  for (int i = 0; i < started; i++)
+    native_thread_join(workers[i]);
+  free(workers);
+  return 0;
+}
+
+typedef struct PrefetchedInput {
+  int index;
+  int result;
+  AVFormatContext *fmt_ctx;
+} PrefetchedInput;
+
+struct MediaPrefetcher {
+  char *const *paths;
+  const uint8_t *skip;
+  int nb_paths;
+  NativeQueue *ready;           // 已打开、等待调用方取走的输入（容量即预读深度）
+  native_thread_t thread;
+  int thread_started;
+};
+
+static void free_prefetched(PrefetchedInput *item) {
+  if (item->fmt_ctx)
+    avformat_close_input(&item->fmt_ctx);
+  free(item);
+}
+
+static void *prefetch_worker(void *arg) {
+  MediaPrefetcher *pf = (MediaPrefetcher *) arg;
+  for (int i = 0; i < pf->nb_paths; i++) {
+    if (pf->skip && pf->skip[i])
+      continue;
+    PrefetchedInput *item = (PrefetchedInput *) calloc(1, sizeof(PrefetchedInput));
+    if (!item)
+      break;
+    item->index = i;
+    item->result = media_open_input(pf->paths[i], &item->fmt_ctx);
+    // 队列满时在此等待调用方取走，队列关闭（调用方提前结束）时停止
+    if (native_queue_push(pf->ready, item) < 0) {
+      free_prefetched(item);
+      break;
+    }
+  }
+  native_queue_close(pf->ready);
+  return NULL;
+}
+
+int media_prefetcher_start(MediaPrefetcher **out, char *const *paths, const uint8_t *skip, int nb_paths, int depth) {
+  MediaPrefetcher *pf = (MediaPrefetcher *) calloc(1, sizeof(MediaPrefetcher));
+  if (!pf)
+    return AVERROR(ENOMEM);
+  pf->paths = paths;
+  pf->skip = skip;
+  pf->nb_paths = nb_paths;
+  pf->ready = native_queue_alloc(depth > 0 ? depth : 1);
+  if (!pf->ready) {
+    free(pf);
+    return AVERROR(ENOMEM);
+  }
+  if (native_thread_create(&pf->thread, prefetch_worker, pf) < 0) {
+    native_queue_free(&pf->ready);
+    free(pf);
+    return AVERROR(EAGAIN);
+  }
+  pf->thread_started = 1;
+  *out = pf;
+  return 0;
+}
+
+int media_prefetcher_next(MediaPrefetcher *pf, int *index, AVFormatContext **fmt_ctx, int *result) {
+  void *item = NULL;
+  if (!native_queue_pop(pf->ready, &item))
+    return 0;
+  PrefetchedInput *input = (PrefetchedInput *) item;
+  *index = input->index;
+  *fmt_ctx = input->fmt_ctx;
+  *result = input->result;
+  free(input);
+  return 1;
+}
+
+void media_prefetcher_free(MediaPrefetcher **ppf) {
+  MediaPrefetcher *pf = *ppf;
+  if (!pf)
+    return;
+  native_queue_close(pf->ready);
+  if (pf->thread_started)
+    native_thread_join(pf->thread);
+  void *item = NULL;
+  while (native_queue_pop(pf->ready, &item))
+    free_prefetched((PrefetchedInput *) item);
+  native_queue_free(&pf->ready);
+  free(pf);
+  *ppf = NULL;
+}
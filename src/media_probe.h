@@ -0,0 +1,69 @@
+#ifndef MEDIA_PROBE_H
+#define MEDIA_PROBE_H
+
+#include <stdint.h>
+#include <libavformat/avformat.h>
+
+/*
+ * 输入探测与预读
+ *
+ * 批量处理大量输入（例如合并数百个片段）时，avformat_open_input + avformat_find_stream_info 的延迟
+ * 会让复用器在文件之间空等。media_probe_parallel 用线程池一次性探测全部输入并记录摘要；
+ * MediaPrefetcher 在后台线程中按顺序提前打开接下来的输入，复用当前文件时下一个文件已经就绪。
+ */
+
+typedef struct MediaInfo {
+  int result;                   // 打开/探测结果，负值表示失败
+  int64_t duration;             // 音视频流的最大时长（AV_TIME_BASE）
+  int video_index;              // 最佳视频流序号，-1 表示无
+  int audio_index;              // 最佳音频流序号，-1 表示无
+  AVCodecParameters *video_par; // 最佳视频流参数副本，无视频时为 NULL
+  AVCodecParameters *audio_par; // 最佳音频流参数副本，无音频时为 NULL
+  AVRational video_time_base;
+  AVRational audio_time_base;
+  AVRational video_frame_rate;
+  int64_t video_frames;         // 最佳视频流的帧数（容器未记录时按时长与帧率估算）
+} MediaInfo;
+
+/**
+ * 打开并探测一个输入
+ * @return 成功返回 0 并通过 fmt_ctx 返回已探测的上下文（fmt_ctx 为 NULL 时探测后关闭），失败返回负错误码
+ */
+int media_open_input(const char *path, AVFormatContext **fmt_ctx);
+
+/**
+ * 探测一个输入并填写摘要（info->result 同时记录结果）
+ */
+int media_probe_file(MediaInfo *info, const char *path);
+
+/**
+ * 用线程池并行探测全部输入，单个输入失败只记录在对应的 result 中
+ * @param threads 线程数，<= 0 表示按处理器数量自动选择
+ * @return 成功返回 0，无法分配资源时返回负错误码
+ */
+int media_probe_parallel(MediaInfo *infos, char *const *paths, int nb_paths, int threads);
+
+void media_info_uninit(MediaInfo *info);
+
+typedef struct MediaPrefetcher MediaPrefetcher;
+
+/**
+ * 启动预读线程：按顺序在后台打开并探测 paths 中的输入，最多领先调用方 depth 个
+ * @param skip 可为 NULL；skip[i] 非 0 的输入不打开（例如探测已失败）
+ */
+int media_prefetcher_start(MediaPrefetcher **pf, char *const *paths, const uint8_t *skip, int nb_paths, int depth);
+
+/**
+ * 按顺序取出下一个输入（阻塞直到就绪）
+ * @param index 输入序号
+ * @param fmt_ctx 已探测的上下文，由调用方关闭；打开失败时为 NULL
+ * @return 取到返回 1（*result 为打开结果），全部取完返回 0
+ */
+int media_prefetcher_next(MediaPrefetcher *pf, int *index, AVFormatContext **fmt_ctx, int *result);
+
+/**
+ * 停止预读线程并关闭尚未取走的输入
+ */
+void media_prefetcher_free(MediaPrefetcher **pf);
+
+#endif // MEDIA_PROBE_H
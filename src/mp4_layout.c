@@ -0,0 +1,81 @@
+// mp4_layout.c
+#include "mp4_layout.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MP4_MOOV_BASE_SIZE (16 * 1024)  // mvhd/udta 等固定部分
+#define MP4_MOOV_TRACK_SIZE (4 * 1024)  // 每个 trak 的固定部分（tkhd/mdhd/hdlr/stsd 等）
+
+int mp4_layout_parse(const char *name, Mp4Layout *layout) {
+  if (!name || !name[0] || !strcmp(name, "default"))
+    *layout = MP4_LAYOUT_DEFAULT;
+  else if (!strcmp(name, "faststart"))
+    *layout = MP4_LAYOUT_FASTSTART;
+  else if (!strcmp(name, "fragmented"))
+    *layout = MP4_LAYOUT_FRAGMENTED;
+  else
+    return AVERROR(EINVAL);
+  return 0;
+}
+
+int mp4_layout_from_options(const char *options, Mp4Layout *layout) {
+  *layout = MP4_LAYOUT_DEFAULT;
+  if (!options || !options[0])
+    return 0;
+  AVDictionary *dict = NULL;
+  int ret = av_dict_parse_string(&dict, options, "=", ":", 0);
+  AVDictionaryEntry *entry = ret >= 0 ? av_dict_get(dict, "layout", NULL, 0) : NULL;
+  if (entry)
+    ret = mp4_layout_parse(entry->value, layout);
+  av_dict_free(&dict);
+  return ret;
+}
+
+int64_t mp4_estimate_moov_size(const enum AVMediaType *types, const int64_t *nb_samples, int nb_streams) {
+  int64_t size = MP4_MOOV_BASE_SIZE;
+  for (int i = 0; i < nb_streams; i++) {
+    // 每个样本：stsz 4 字节，stts 8 字节（时长不规则时），交错写入时每个样本可能单独成块：stsc 12 + co64 8 字节；
+    // 视频另有 ctts 8 字节与 stss 4 字节
+    int64_t per_sample = 4 + 8 + 12 + 8;
+    if (types[i] == AVMEDIA_TYPE_VIDEO)
+      per_sample += 8 + 4;
+    size += MP4_MOOV_TRACK_SIZE + FFMAX(nb_samples[i], 0) * per_sample;
+  }
+  // 样本数只是估算，再留 1/8 余量
+  return size + size / 8;
+}
+
+// mov 复用器支持的输出格式
+static int is_mov_family(const AVOutputFormat *ofmt) {
+  static const char *const names[] = {"mp4", "mov", "ipod", "3gp", "3g2", "psp", "ismv", "f4v", NULL};
+  for (int i = 0; names[i]; i++) {
+    if (!strcmp(ofmt->name, names[i]))
+      return 1;
+  }
+  return 0;
+}
+
+int mp4_layout_apply(AVDictionary **opts, const AVFormatContext *ofmt_ctx, Mp4Layout layout,
+                     const int64_t *nb_samples) {
+  if (layout == MP4_LAYOUT_DEFAULT || !is_mov_family(ofmt_ctx->oformat))
+    return 0;
+  int nb_streams = (int) ofmt_ctx->nb_streams;
+  for (int i = 0; i < nb_streams && layout == MP4_LAYOUT_FASTSTART; i++) {
+    if (nb_samples[i] <= 0)
+      layout = MP4_LAYOUT_FRAGMENTED;  // 样本数未知，无法预留足够的 moov 空间
+  }
+  if (layout == MP4_LAYOUT_FRAGMENTED)
+    return av_dict_set(opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+
+  enum AVMediaType *types = (enum AVMediaType *) calloc(nb_streams > 0 ? nb_streams : 1, sizeof(enum AVMediaType));
+  if (!types)
+    return AVERROR(ENOMEM);
+  for (int i = 0; i < nb_streams; i++)
+    types[i] = ofmt_ctx->streams[i]->codecpar->codec_type;
+  int64_t moov_size = mp4_estimate_moov_size(types, nb_samples, nb_streams);
+  free(types);
+  if (moov_size > INT32_MAX)
+    return AVERROR(ERANGE);
+  return av_dict_set_int(opts, "moov_size", moov_size, 0);
+}
@@ -0,0 +1,50 @@
+#ifndef MP4_LAYOUT_H
+#define MP4_LAYOUT_H
+
+#include <stdint.h>
+#include <libavformat/avformat.h>
+
+/*
+ * MP4 输出布局
+ *
+ * 默认情况下 mov/mp4 复用器把 moov 写在文件末尾，播放器和缩略图程序必须先定位到文件末尾；
+ * 事后再做 faststart 又要把整个文件重写一遍。这里提供两种一次写成、可渐进播放的布局：
+ * - faststart：按输入的样本数估算 moov 大小，在文件头预留空间（moov_size），结束时把 moov 写回预留位置；
+ * - fragmented：分片 MP4，文件头写空 moov，之后每个关键帧开始一个 moof/mdat 分片。
+ */
+
+typedef enum Mp4Layout {
+  MP4_LAYOUT_DEFAULT = 0,       // moov 写在文件末尾
+  MP4_LAYOUT_FASTSTART,         // 文件头预留估算的 moov 空间
+  MP4_LAYOUT_FRAGMENTED,        // 分片 MP4
+} Mp4Layout;
+
+/**
+ * 解析布局名称："default"、"faststart"、"fragmented"（NULL 或空字符串表示默认）
+ * @return 成功返回 0，未知名称返回 AVERROR(EINVAL)
+ */
+int mp4_layout_parse(const char *name, Mp4Layout *layout);
+
+/**
+ * 从 "key=value:key=value" 形式的选项中读取 layout（可为 NULL，未指定时为默认布局）
+ * @return 成功返回 0，选项格式错误或布局名称未知时返回负错误码
+ */
+int mp4_layout_from_options(const char *options, Mp4Layout *layout);
+
+/**
+ * 估算 moov 大小（字节），按每个样本在 stts/ctts/stsz/stss/stsc/stco 中的最坏占用计算并留有余量
+ * @param types 各路流类型
+ * @param nb_samples 各路流的样本数（估算值）
+ */
+int64_t mp4_estimate_moov_size(const enum AVMediaType *types, const int64_t *nb_samples, int nb_streams);
+
+/**
+ * 按布局设置复用器选项（avformat_write_header 使用）；输出格式不是 mov/mp4 系列时不做任何设置
+ * faststart 下只要有一路流的样本数未知（<= 0），预留空间就无从估算，改用 fragmented 布局，
+ * 避免结束时 moov 超出预留空间而无法写完
+ * @param nb_samples 各路输出流的样本数估算（faststart 使用，按 ofmt_ctx 中流的顺序），未知时为 0
+ */
+int mp4_layout_apply(AVDictionary **opts, const AVFormatContext *ofmt_ctx, Mp4Layout layout,
+                     const int64_t *nb_samples);
+
+#endif // MP4_LAYOUT_H
@@ -9,10 +9,47 @@
 #include <libavutil/opt.h>
 #include <libavutil/timestamp.h>
 #include <libavutil/error.h>
+#include "native_thread.h"
 #ifdef _WIN32
 #include <stringapiset.h>
 #endif
 
+// 辅助函数：创建输出上下文、为输入的每个流创建输出流（流拷贝）、打开文件并写头
+// 每个段的时间戳从 0 开始，保证单独播放
+static int open_segment_output(AVFormatContext **ofmt_ctx, AVFormatContext *ifmt_ctx,
+                               const char *extension, const char *seg_filename) {
+  // 分配输出格式上下文
+  int ret = avformat_alloc_output_context2(ofmt_ctx, NULL, extension, seg_filename);
+  if (ret < 0 || !(*ofmt_ctx))
+    return ret < 0 ? ret : AVERROR_UNKNOWN;
+
+  // 对输入文件中的每个流都创建一个输出流（流拷贝）
+  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    AVStream *in_stream = ifmt_ctx->streams[i];
+    AVStream *out_stream = avformat_new_stream(*ofmt_ctx, NULL);
+    if (!out_stream)
+      return AVERROR_UNKNOWN;
+    ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+    if (ret < 0)
+      return ret;
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = in_stream->time_base;
+  }
+
+  // 打开输出文件（若格式需要文件操作）
+  if (!((*ofmt_ctx)->oformat->flags & AVFMT_NOFILE)) {
+    ret = avio_open(&(*ofmt_ctx)->pb, seg_filename, AVIO_FLAG_WRITE);
+    if (ret < 0)
+      return ret;
+  }
+
+  AVDictionary *opts = NULL;
+  av_dict_set(&opts, "avoid_negative_ts", "make_zero", 0);
+  ret = avformat_write_header(*ofmt_ctx, &opts);
+  av_dict_free(&opts);
+  return ret;
+}
+
 // 辅助函数：新建一个输出段
 // 参数说明：
 //   ofmt_ctx      —— 指向当前输出 AVFormatContext 的指针（若不为 NULL，则先关闭上个段）
@@ -59,187 +96,660 @@ static int open_new_segment(AVFormatContext **ofmt_ctx, AVFormatContext *ifmt_ct
 
   // 构造新段文件名：例如 "input_segment_0.mp3"
   snprintf(seg_filename, seg_filename_size, "%s_segment_%d.%s", base_name, seg_index, extension);
+  return open_segment_output(ofmt_ctx, ifmt_ctx, extension, seg_filename);
+}
 
-  // 分配输出格式上下文
-  ret = avformat_alloc_output_context2(ofmt_ctx, NULL, extension, seg_filename);
-  if (ret < 0 || !(*ofmt_ctx))
-    return ret;
 
-  // 对输入文件中的每个流都创建一个输出流（流拷贝）
-  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
-    AVStream *in_stream = ifmt_ctx->streams[i];
-    AVStream *out_stream = avformat_new_stream(*ofmt_ctx, NULL);
-    if (!out_stream)
-      return AVERROR_UNKNOWN;
-    ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
-    if (ret < 0)
-      return ret;
-    out_stream->codecpar->codec_tag = 0;
-    out_stream->time_base = in_stream->time_base;
-  }
+typedef enum SplitMode {
+  SPLIT_BY_SIZE = 0,     // 每段不超过 limit 字节（单个 GOP 超过上限时独占一段）
+  SPLIT_BY_DURATION = 1, // 每段时长达到 limit 秒后在下一个关键帧处切换
+} SplitMode;
 
-  // 打开输出文件（若格式需要文件操作）
-  if (!((*ofmt_ctx)->oformat->flags & AVFMT_NOFILE)) {
-    ret = avio_open(&(*ofmt_ctx)->pb, seg_filename, AVIO_FLAG_WRITE);
-    if (ret < 0)
-      return ret;
+// 按 GOP 缓存的数据包：从一个视频关键帧开始到下一个关键帧之前（没有视频时每个包自成一组）
+typedef struct SplitGop {
+  AVPacket **pkts;
+  int nb_pkts;
+  int capacity;
+  int64_t bytes;         // 预估写入后的字节数
+  int64_t start_time;    // 组内第一个包的时间（AV_TIME_BASE），AV_NOPTS_VALUE 表示未知
+} SplitGop;
+
+typedef struct SplitContext {
+  AVFormatContext *ifmt_ctx;
+  AVFormatContext *ofmt_ctx;
+  SplitMode mode;
+  double limit;
+  int video_index;       // 切分参考的视频流，-1 表示只按包切分
+  char extension[32];
+  char base_name[1024];
+  char seg_filename[1024];
+  int seg_index;
+  char **seg_names;
+  int seg_count;
+  int seg_capacity;
+  int64_t part_bytes;    // 当前段已写入（含预估容器开销）的字节数
+  int64_t part_start;    // 当前段起始时间（AV_TIME_BASE），AV_NOPTS_VALUE 表示尚无数据
+  SplitGop gop;
+} SplitContext;
+
+// 根据输入文件名获取基础名和扩展名（输出容器与输入相同，没有扩展名时默认 mp4）
+static void split_output_names(const char *input_file, char *extension, size_t extension_size,
+                               char *base_name, size_t base_name_size) {
+  const char *dot = strrchr(input_file, '.');
+  if (dot && strlen(dot) > 1) {
+    snprintf(extension, extension_size, "%s", dot + 1);
+  } else {
+    snprintf(extension, extension_size, "mp4"); // 默认容器
   }
+  size_t base_len = dot ? (size_t) (dot - input_file) : strlen(input_file);
+  if (base_len >= base_name_size)
+    base_len = base_name_size - 1;
+  memcpy(base_name, input_file, base_len);
+  base_name[base_len] = '\0';
+}
 
-  // 写文件头
-  ret = avformat_write_header(*ofmt_ctx, NULL);
-  return ret;
+// 预估一个数据包写入容器后的字节数（mpegts 按 188/184 计入包头，其余格式计入固定的索引开销）
+static int64_t estimate_packet_bytes(const AVFormatContext *ofmt_ctx, const AVPacket *pkt) {
+  if (!strcmp(ofmt_ctx->oformat->name, "mpegts"))
+    return (pkt->size + 14) * 188 / 184 + 1;
+  return pkt->size + 16;
 }
 
+static void clear_gop(SplitGop *gop) {
+  for (int i = 0; i < gop->nb_pkts; i++)
+    av_packet_free(&gop->pkts[i]);
+  gop->nb_pkts = 0;
+  gop->bytes = 0;
+  gop->start_time = AV_NOPTS_VALUE;
+}
 
+static int add_gop_packet(SplitContext *ctx, AVPacket *pkt) {
+  SplitGop *gop = &ctx->gop;
+  if (gop->nb_pkts >= gop->capacity) {
+    int capacity = gop->capacity ? gop->capacity * 2 : 64;
+    AVPacket **tmp = realloc(gop->pkts, capacity * sizeof(AVPacket *));
+    if (!tmp)
+      return AVERROR(ENOMEM);
+    gop->pkts = tmp;
+    gop->capacity = capacity;
+  }
+  AVPacket *copy = av_packet_alloc();
+  if (!copy)
+    return AVERROR(ENOMEM);
+  av_packet_move_ref(copy, pkt);
+  gop->pkts[gop->nb_pkts++] = copy;
+  gop->bytes += estimate_packet_bytes(ctx->ofmt_ctx, copy);
+  int64_t ts = copy->dts != AV_NOPTS_VALUE ? copy->dts : copy->pts;
+  if (gop->start_time == AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE)
+    gop->start_time = av_rescale_q(ts, ctx->ifmt_ctx->streams[copy->stream_index]->time_base, AV_TIME_BASE_Q);
+  return 0;
+}
 
-JNIEXPORT jobjectArray JNICALL
-Java_com_litongjava_media_NativeMedia_split(JNIEnv *env, jclass clazz, jstring inputPath, jlong segSize) {
-  char input_file[1024] = {0};
-#ifdef _WIN32
-  // 获取 jstring 的宽字符表示
-  const jchar *inputChars = (*env)->GetStringChars(env, inputPath, NULL);
-  if (!inputChars) {
-    return NULL;
+// 当前段加上下一个完整 GOP 是否应切换到新段
+static int should_start_new_part(const SplitContext *ctx) {
+  if (ctx->part_start == AV_NOPTS_VALUE)
+    return 0; // 当前段还没有数据，GOP 再大也只能写入当前段
+  if (ctx->mode == SPLIT_BY_SIZE)
+    return ctx->part_bytes + ctx->gop.bytes > (int64_t) ctx->limit;
+  return ctx->gop.start_time != AV_NOPTS_VALUE &&
+         ctx->gop.start_time - ctx->part_start >= (int64_t) (ctx->limit * AV_TIME_BASE);
+}
+
+// 一个 GOP 已完整：必要时先切换到新段，再整组写入，保证每段都从关键帧开始
+static int commit_gop(SplitContext *ctx) {
+  SplitGop *gop = &ctx->gop;
+  int ret = 0;
+  if (gop->nb_pkts == 0)
+    return 0;
+  if (should_start_new_part(ctx)) {
+    ret = open_new_segment(&ctx->ofmt_ctx, ctx->ifmt_ctx, ctx->extension, ctx->base_name, ctx->seg_index,
+                           ctx->seg_filename, sizeof(ctx->seg_filename), &ctx->seg_names, &ctx->seg_count,
+                           &ctx->seg_capacity);
+    if (ret < 0)
+      return ret;
+    ctx->seg_index++;
+    ctx->part_bytes = ctx->ofmt_ctx->pb ? avio_tell(ctx->ofmt_ctx->pb) : 0;
+    ctx->part_start = AV_NOPTS_VALUE;
   }
-  jsize inputLen = (*env)->GetStringLength(env, inputPath);
+  if (ctx->part_start == AV_NOPTS_VALUE)
+    ctx->part_start = gop->start_time != AV_NOPTS_VALUE ? gop->start_time : 0;
+  ctx->part_bytes += gop->bytes;
 
-  // 构造宽字符缓冲区
-  wchar_t wInput[1024] = {0};
-  if (inputLen >= 1024) inputLen = 1023;
-  for (int i = 0; i < inputLen; i++) {
-    wInput[i] = (wchar_t) inputChars[i];
+  for (int i = 0; i < gop->nb_pkts && ret >= 0; i++) {
+    AVPacket *pkt = gop->pkts[i];
+    AVStream *in_stream = ctx->ifmt_ctx->streams[pkt->stream_index];
+    AVStream *out_stream = ctx->ofmt_ctx->streams[pkt->stream_index];
+    pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base, out_stream->time_base,
+                                AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+    pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base, out_stream->time_base,
+                                AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+    pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_stream->time_base);
+    pkt->pos = -1;
+    ret = av_interleaved_write_frame(ctx->ofmt_ctx, pkt);
   }
-  wInput[inputLen] = L'\0';
-  (*env)->ReleaseStringChars(env, inputPath, inputChars);
+  clear_gop(gop);
+  return ret;
+}
 
-  // 将宽字符转换为 UTF-8 字符串
-  int utf8Len = WideCharToMultiByte(CP_UTF8, 0, wInput, -1, NULL, 0, NULL, NULL);
-  if (utf8Len <= 0 || utf8Len > 1024) {
+/*
+ * 流拷贝切分：只在视频关键帧处切换段（没有视频流时可在任意包处切换）
+ * 按大小切分时先缓存一个完整 GOP（前瞻），若写入后会超过上限则先切换段，因此每段都不超过上限且可独立解码
+ * 返回段文件名数组（调用方释放），失败返回 NULL
+ */
+static char **split_media_file(const char *input_file, SplitMode mode, double limit, int *count) {
+  SplitContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.mode = mode;
+  ctx.limit = limit;
+  ctx.part_start = AV_NOPTS_VALUE;
+  ctx.gop.start_time = AV_NOPTS_VALUE;
+  *count = 0;
+  if (limit <= 0)
     return NULL;
-  }
-  WideCharToMultiByte(CP_UTF8, 0, wInput, -1, input_file, sizeof(input_file), NULL, NULL);
-#else
-  // 非 Windows 平台直接获取 UTF-8 字符串
-    const char *tmp = (*env)->GetStringUTFChars(env, inputPath, NULL);
-    if (!tmp) return NULL;
-    strncpy(input_file, tmp, sizeof(input_file) - 1);
-    (*env)->ReleaseStringUTFChars(env, inputPath, tmp);
-#endif
 
-  // 以下保持原有逻辑不变
-  int ret = 0;
-  AVFormatContext *ifmt_ctx = NULL;
-  ret = avformat_open_input(&ifmt_ctx, input_file, NULL, NULL);
+  int ret = avformat_open_input(&ctx.ifmt_ctx, input_file, NULL, NULL);
   if (ret < 0) {
     return NULL;
   }
-  ret = avformat_find_stream_info(ifmt_ctx, NULL);
+  ret = avformat_find_stream_info(ctx.ifmt_ctx, NULL);
   if (ret < 0) {
-    avformat_close_input(&ifmt_ctx);
+    avformat_close_input(&ctx.ifmt_ctx);
     return NULL;
   }
+  ctx.video_index = av_find_best_stream(ctx.ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (ctx.video_index >= 0 &&
+      (ctx.ifmt_ctx->streams[ctx.video_index]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+    ctx.video_index = -1; // 封面图不作为切分参考
 
-  // 根据输入文件名获取基础名和扩展名
-  const char *dot = strrchr(input_file, '.');
-  char extension[32] = {0};
-  if (dot && strlen(dot) > 1) {
-    strncpy(extension, dot + 1, sizeof(extension) - 1);
-  } else {
-    strcpy(extension, "mp4"); // 默认容器
-  }
-  size_t base_len = dot ? (dot - input_file) : strlen(input_file);
-  char base_name[1024] = {0};
-  strncpy(base_name, input_file, base_len);
-  base_name[base_len] = '\0';
+  split_output_names(input_file, ctx.extension, sizeof(ctx.extension), ctx.base_name, sizeof(ctx.base_name));
 
   // 准备存储段文件名的动态数组
-  int seg_capacity = 10;
-  int seg_count = 0;
-  char **seg_names = (char **) malloc(seg_capacity * sizeof(char *));
-  if (!seg_names) {
-    avformat_close_input(&ifmt_ctx);
-    return NULL;
+  ctx.seg_capacity = 10;
+  ctx.seg_names = (char **) malloc(ctx.seg_capacity * sizeof(char *));
+  AVPacket *pkt = av_packet_alloc();
+  if (!ctx.seg_names || !pkt) {
+    ret = AVERROR(ENOMEM);
+    goto end;
   }
 
-  int seg_index = 0;
-  AVFormatContext *ofmt_ctx = NULL;
-  char seg_filename[1024] = {0};
-
   // 初始化第一个段
-  ret = open_new_segment(&ofmt_ctx, ifmt_ctx, extension, base_name, seg_index, seg_filename,
-                         sizeof(seg_filename), &seg_names, &seg_count, &seg_capacity);
-  if (ret < 0) {
-    free(seg_names);
-    avformat_close_input(&ifmt_ctx);
-    return NULL;
+  ret = open_new_segment(&ctx.ofmt_ctx, ctx.ifmt_ctx, ctx.extension, ctx.base_name, ctx.seg_index,
+                         ctx.seg_filename, sizeof(ctx.seg_filename), &ctx.seg_names, &ctx.seg_count,
+                         &ctx.seg_capacity);
+  if (ret < 0)
+    goto end;
+  ctx.seg_index++;
+  ctx.part_bytes = ctx.ofmt_ctx->pb ? avio_tell(ctx.ofmt_ctx->pb) : 0;
+
+  // 读取输入数据包，遇到新的切分点时提交上一个完整的 GOP
+  while ((ret = av_read_frame(ctx.ifmt_ctx, pkt)) >= 0) {
+    int boundary = ctx.video_index < 0 ||
+                   (pkt->stream_index == ctx.video_index && (pkt->flags & AV_PKT_FLAG_KEY));
+    if (boundary && (ret = commit_gop(&ctx)) < 0)
+      break;
+    ret = add_gop_packet(&ctx, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
   }
-  seg_index++;
+  if (ret == AVERROR_EOF)
+    ret = 0;
+  if (ret >= 0)
+    ret = commit_gop(&ctx);
 
-  AVPacket *pkt = av_packet_alloc();
-  if (!pkt) {
-    if (ofmt_ctx) {
-      av_write_trailer(ofmt_ctx);
-      if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE) && ofmt_ctx->pb)
-        avio_closep(&ofmt_ctx->pb);
-      avformat_free_context(ofmt_ctx);
+  end:
+  if (ctx.ofmt_ctx) {
+    av_write_trailer(ctx.ofmt_ctx);
+    if (!(ctx.ofmt_ctx->oformat->flags & AVFMT_NOFILE) && ctx.ofmt_ctx->pb)
+      avio_closep(&ctx.ofmt_ctx->pb);
+    char *name_copy = strdup(ctx.seg_filename);
+    if (name_copy) {
+      if (ctx.seg_count >= ctx.seg_capacity) {
+        ctx.seg_capacity *= 2;
+        ctx.seg_names = realloc(ctx.seg_names, ctx.seg_capacity * sizeof(char *));
+      }
+      ctx.seg_names[ctx.seg_count++] = name_copy;
     }
-    free(seg_names);
-    avformat_close_input(&ifmt_ctx);
+    avformat_free_context(ctx.ofmt_ctx);
+    ctx.ofmt_ctx = NULL;
+  }
+  clear_gop(&ctx.gop);
+  free(ctx.gop.pkts);
+  av_packet_free(&pkt);
+  avformat_close_input(&ctx.ifmt_ctx);
+
+  if (ret < 0 && ctx.seg_names) {
+    for (int i = 0; i < ctx.seg_count; i++)
+      free(ctx.seg_names[i]);
+    free(ctx.seg_names);
     return NULL;
   }
+  *count = ctx.seg_count;
+  return ctx.seg_names;
+}
+
+#define SPLIT_TAIL_MARGIN (10 * AV_TIME_BASE) // 视频到达段尾后，其他流最多再多读这么久的数据
+
+// 并行切分的一段：[start, end) 以参考视频流关键帧的索引时间戳划分
+typedef struct SplitPart {
+  int64_t start_ts;      // 起始关键帧时间戳（参考流时间基），AV_NOPTS_VALUE 表示从文件开头
+  int64_t end_ts;        // 下一段起始关键帧时间戳，AV_NOPTS_VALUE 表示到文件末尾
+  int64_t start_time;    // start_ts 换算到 AV_TIME_BASE，用于裁剪其他流
+  int64_t end_time;
+  char filename[1024];
+  int result;
+} SplitPart;
+
+typedef struct SplitJob {
+  const char *input_file;
+  AVFormatContext *plan_ctx; // 规划用的输入上下文，只读取其中的流参数
+  int video_index;
+  const char *extension;
+  SplitPart *parts;
+  int nb_parts;
+  volatile uint32_t next_part;
+} SplitJob;
+
+// 关键帧 k 覆盖 [key_time[k], key_time[k+1])，返回时间 t 所属的 GOP 序号
+static int find_gop(const int64_t *key_time, int nb_keys, int64_t t) {
+  int lo = 0, hi = nb_keys - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (key_time[mid] <= t)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+/*
+ * 只读取容器索引（MP4 的 stss/stsz/stco，MKV 的 Cues）规划切分点，不解复用任何数据
+ * 每个 GOP 的字节数优先按索引中各流样本大小累加；索引没有样本大小（例如 MKV 的 Cues）时按关键帧的文件偏移差估算
+ * 索引中没有参考流的关键帧时返回 AVERROR(ENOSYS)
+ */
+static int plan_split_parts(AVFormatContext *ifmt_ctx, int video_index, SplitMode mode, double limit,
+                            SplitPart **out_parts, int *out_nb_parts) {
+  AVStream *video = ifmt_ctx->streams[video_index];
+  int nb_entries = avformat_index_get_entries_count(video);
+  int64_t *key_ts = (int64_t *) malloc((nb_entries + 1) * sizeof(int64_t));
+  int64_t *key_time = (int64_t *) malloc((nb_entries + 1) * sizeof(int64_t));
+  int64_t *key_pos = (int64_t *) malloc((nb_entries + 1) * sizeof(int64_t));
+  int64_t *gop_bytes = (int64_t *) calloc(nb_entries + 1, sizeof(int64_t));
+  int *cuts = (int *) malloc((nb_entries + 1) * sizeof(int));
+  int nb_keys = 0, nb_cuts = 0, ret = 0;
+  if (!key_ts || !key_time || !key_pos || !gop_bytes || !cuts) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  for (int i = 0; i < nb_entries; i++) {
+    const AVIndexEntry *e = avformat_index_get_entry(video, i);
+    if (!(e->flags & AVINDEX_KEYFRAME) || (nb_keys > 0 && e->timestamp <= key_ts[nb_keys - 1]))
+      continue;
+    key_ts[nb_keys] = e->timestamp;
+    key_time[nb_keys] = av_rescale_q(e->timestamp, video->time_base, AV_TIME_BASE_Q);
+    key_pos[nb_keys] = e->pos;
+    nb_keys++;
+  }
+  if (nb_keys == 0) {
+    ret = AVERROR(ENOSYS);
+    goto end;
+  }
+
+  // 每个 GOP 的字节数（含同一时间段内交错的其他流）
+  int have_sizes = 0;
+  for (unsigned int s = 0; s < ifmt_ctx->nb_streams; s++) {
+    AVStream *st = ifmt_ctx->streams[s];
+    int count = avformat_index_get_entries_count(st);
+    for (int i = 0; i < count; i++) {
+      const AVIndexEntry *e = avformat_index_get_entry(st, i);
+      if (e->size <= 0)
+        continue;
+      have_sizes = 1;
+      gop_bytes[find_gop(key_time, nb_keys, av_rescale_q(e->timestamp, st->time_base, AV_TIME_BASE_Q))] += e->size;
+    }
+  }
+  if (!have_sizes) {
+    int64_t file_size = ifmt_ctx->pb ? avio_size(ifmt_ctx->pb) : -1;
+    for (int k = 0; k < nb_keys; k++) {
+      int64_t next = k + 1 < nb_keys ? key_pos[k + 1] : file_size;
+      gop_bytes[k] = next > key_pos[k] ? next - key_pos[k] : 0;
+    }
+  }
+
+  // 与顺序切分相同的前瞻规则：加入下一个 GOP 会超过上限（或已达到时长）时在其关键帧处切换
+  int start = 0;
+  int64_t bytes = 0;
+  cuts[nb_cuts++] = 0;
+  for (int k = 0; k < nb_keys; k++) {
+    int cut = mode == SPLIT_BY_SIZE ? bytes + gop_bytes[k] > (int64_t) limit
+                                    : key_time[k] - key_time[start] >= (int64_t) (limit * AV_TIME_BASE);
+    if (k > start && cut) {
+      cuts[nb_cuts++] = k;
+      start = k;
+      bytes = 0;
+    }
+    bytes += gop_bytes[k];
+  }
+
+  SplitPart *parts = (SplitPart *) calloc(nb_cuts, sizeof(SplitPart));
+  if (!parts) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  for (int i = 0; i < nb_cuts; i++) {
+    parts[i].start_ts = i == 0 ? AV_NOPTS_VALUE : key_ts[cuts[i]];
+    parts[i].start_time = i == 0 ? AV_NOPTS_VALUE : key_time[cuts[i]];
+    parts[i].end_ts = i + 1 < nb_cuts ? key_ts[cuts[i + 1]] : AV_NOPTS_VALUE;
+    parts[i].end_time = i + 1 < nb_cuts ? key_time[cuts[i + 1]] : AV_NOPTS_VALUE;
+  }
+  *out_parts = parts;
+  *out_nb_parts = nb_cuts;
+
+  end:
+  free(key_ts);
+  free(key_time);
+  free(key_pos);
+  free(gop_bytes);
+  free(cuts);
+  return ret;
+}
+
+/*
+ * 重封装一段：直接定位到起始关键帧，读到下一段的起始关键帧为止
+ * 视频按关键帧边界划分（关键帧的 pts/dts 中较大者与索引时间戳比较，兼容按 dts 或 pts 建立的索引），
+ * 其他流按时间划分到 [start_time, end_time)
+ */
+static int remux_split_part(SplitJob *job, SplitPart *part) {
+  AVFormatContext *ifmt_ctx = NULL, *ofmt_ctx = NULL;
+  AVPacket *pkt = NULL;
+  uint8_t *stream_done = NULL;
+  int ret = avformat_open_input(&ifmt_ctx, job->input_file, NULL, NULL);
+  if (ret < 0)
+    return ret;
+  if (ifmt_ctx->nb_streams != job->plan_ctx->nb_streams) {
+    ret = AVERROR_INVALIDDATA;
+    goto end;
+  }
+  if (part->start_ts != AV_NOPTS_VALUE &&
+      (ret = av_seek_frame(ifmt_ctx, job->video_index, part->start_ts, AVSEEK_FLAG_BACKWARD)) < 0)
+    goto end;
+  // 输出流参数取自规划时探测过的输入，工作线程不再重复探测
+  if ((ret = open_segment_output(&ofmt_ctx, job->plan_ctx, job->extension, part->filename)) < 0)
+    goto end;
 
-  // 读取输入数据包，并写入当前段（流拷贝）
-  while (av_read_frame(ifmt_ctx, pkt) >= 0) {
+  pkt = av_packet_alloc();
+  stream_done = (uint8_t *) calloc(ifmt_ctx->nb_streams, 1);
+  if (!pkt || !stream_done) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  int video_started = part->start_ts == AV_NOPTS_VALUE;
+  int video_done = 0;
+  while ((ret = av_read_frame(ifmt_ctx, pkt)) >= 0) {
     AVStream *in_stream = ifmt_ctx->streams[pkt->stream_index];
-    AVStream *out_stream = ofmt_ctx->streams[pkt->stream_index];
-    pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base, out_stream->time_base,
-                                AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-    pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base, out_stream->time_base,
-                                AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-    pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_stream->time_base);
-    pkt->pos = -1;
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    int64_t t = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, in_stream->time_base, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+    int keep;
+    if (pkt->stream_index == job->video_index) {
+      int64_t key_ts = FFMAX(pkt->pts, pkt->dts); // AV_NOPTS_VALUE 为最小值
+      int at_key = (pkt->flags & AV_PKT_FLAG_KEY) && key_ts != AV_NOPTS_VALUE;
+      if (!video_started && at_key && key_ts >= part->start_ts)
+        video_started = 1;
+      if (video_started && !video_done && part->end_ts != AV_NOPTS_VALUE && at_key && key_ts >= part->end_ts)
+        video_done = 1;
+      keep = video_started && !video_done;
+    } else {
+      keep = t == AV_NOPTS_VALUE || part->start_time == AV_NOPTS_VALUE || t >= part->start_time;
+      if (keep && part->end_time != AV_NOPTS_VALUE && t != AV_NOPTS_VALUE && t >= part->end_time) {
+        stream_done[pkt->stream_index] = 1;
+        keep = 0;
+      }
+    }
 
-    ret = av_interleaved_write_frame(ofmt_ctx, pkt);
+    if (keep) {
+      AVStream *out_stream = ofmt_ctx->streams[pkt->stream_index];
+      pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base, out_stream->time_base,
+                                  AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+      pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base, out_stream->time_base,
+                                  AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+      pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_stream->time_base);
+      pkt->pos = -1;
+      ret = av_interleaved_write_frame(ofmt_ctx, pkt);
+    }
+    av_packet_unref(pkt);
     if (ret < 0)
       break;
 
-    if (ofmt_ctx->pb && ofmt_ctx->pb->pos >= segSize) {
-      ret = open_new_segment(&ofmt_ctx, ifmt_ctx, extension, base_name, seg_index, seg_filename,
-                             sizeof(seg_filename), &seg_names, &seg_count, &seg_capacity);
-      if (ret < 0)
+    // 视频已到段尾：所有音频流也越过段尾（或已多读了足够长的时间）后结束
+    if (video_done) {
+      int all_done = t != AV_NOPTS_VALUE && t >= part->end_time + SPLIT_TAIL_MARGIN;
+      if (!all_done) {
+        all_done = 1;
+        for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+          if ((int) i != job->video_index && ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+              !stream_done[i])
+            all_done = 0;
+        }
+      }
+      if (all_done)
         break;
-      seg_index++;
     }
-    av_packet_unref(pkt);
   }
+  if (ret == AVERROR_EOF || ret >= 0)
+    ret = av_write_trailer(ofmt_ctx);
 
+  end:
   if (ofmt_ctx) {
-    av_write_trailer(ofmt_ctx);
     if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE) && ofmt_ctx->pb)
       avio_closep(&ofmt_ctx->pb);
-    char *name_copy = strdup(seg_filename);
-    if (name_copy) {
-      if (seg_count >= seg_capacity) {
-        seg_capacity *= 2;
-        seg_names = realloc(seg_names, seg_capacity * sizeof(char *));
-      }
-      seg_names[seg_count++] = name_copy;
-    }
     avformat_free_context(ofmt_ctx);
-    ofmt_ctx = NULL;
   }
-
+  free(stream_done);
   av_packet_free(&pkt);
   avformat_close_input(&ifmt_ctx);
+  return ret;
+}
+
+// 工作线程：依次领取尚未处理的段
+static void *split_worker(void *arg) {
+  SplitJob *job = (SplitJob *) arg;
+  for (;;) {
+    int i = (int) native_atomic_add_u32(&job->next_part, 1) - 1;
+    if (i >= job->nb_parts)
+      break;
+    job->parts[i].result = remux_split_part(job, &job->parts[i]);
+  }
+  return NULL;
+}
+
+/*
+ * 按容器索引规划切分点后并行重封装，每个工作线程直接定位到自己那一段的起始关键帧
+ * 索引中没有可用的视频关键帧（例如 MPEG-TS、纯音频）时退回到顺序切分
+ */
+static char **split_media_file_parallel(const char *input_file, SplitMode mode, double limit, int threads,
+                                        int *count) {
+  AVFormatContext *ifmt_ctx = NULL;
+  SplitPart *parts = NULL;
+  int nb_parts = 0;
+  *count = 0;
+  if (limit <= 0)
+    return NULL;
+
+  int ret = avformat_open_input(&ifmt_ctx, input_file, NULL, NULL);
+  if (ret < 0)
+    return NULL;
+  if ((ret = avformat_find_stream_info(ifmt_ctx, NULL)) < 0) {
+    avformat_close_input(&ifmt_ctx);
+    return NULL;
+  }
+  int video_index = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (video_index >= 0 && !(ifmt_ctx->streams[video_index]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+    // MKV 的 Cues 在第一次定位时才读取
+    av_seek_frame(ifmt_ctx, video_index, 0, AVSEEK_FLAG_BACKWARD);
+    ret = plan_split_parts(ifmt_ctx, video_index, mode, limit, &parts, &nb_parts);
+  } else {
+    ret = AVERROR(ENOSYS);
+  }
+  if (ret == AVERROR(ENOSYS)) {
+    avformat_close_input(&ifmt_ctx);
+    return split_media_file(input_file, mode, limit, count);
+  }
+  if (ret < 0) {
+    avformat_close_input(&ifmt_ctx);
+    return NULL;
+  }
+
+  char extension[32] = {0}, base_name[1024] = {0};
+  split_output_names(input_file, extension, sizeof(extension), base_name, sizeof(base_name));
+  for (int i = 0; i < nb_parts; i++)
+    snprintf(parts[i].filename, sizeof(parts[i].filename), "%s_segment_%d.%s", base_name, i, extension);
+
+  SplitJob job;
+  memset(&job, 0, sizeof(job));
+  job.input_file = input_file;
+  job.plan_ctx = ifmt_ctx;
+  job.video_index = video_index;
+  job.extension = extension;
+  job.parts = parts;
+  job.nb_parts = nb_parts;
+
+  if (threads <= 0)
+    threads = native_cpu_count();
+  if (threads > nb_parts)
+    threads = nb_parts;
+  native_thread_t *workers = (native_thread_t *) calloc(threads, sizeof(native_thread_t));
+  int started = 0;
+  for (int i = 0; workers && i < threads; i++) {
+    if (native_thread_create(&workers[i], split_worker, &job) < 0)
+      break;
+    started++;
+  }
+  // 线程创建失败时由当前线程处理剩余的段
+  if (started < threads)
+    split_worker(&job);
+  for (int i = 0; i < started; i++)
+    native_thread_join(workers[i]);
+  free(workers);
+  avformat_close_input(&ifmt_ctx);
+
+  char **seg_names = (char **) calloc(nb_parts, sizeof(char *));
+  ret = seg_names ? 0 : AVERROR(ENOMEM);
+  for (int i = 0; i < nb_parts && ret >= 0; i++) {
+    ret = parts[i].result;
+    if (ret >= 0 && !(seg_names[i] = strdup(parts[i].filename)))
+      ret = AVERROR(ENOMEM);
+  }
+  if (ret < 0) {
+    // 任一段失败时整体失败，删除已写出（或只写了一部分）的段文件
+    for (int i = 0; i < nb_parts; i++) {
+      remove(parts[i].filename);
+      if (seg_names)
+        free(seg_names[i]);
+    }
+    free(seg_names);
+    seg_names = NULL;
+  }
+  free(parts);
+  if (seg_names)
+    *count = nb_parts;
+  return seg_names;
+}
+
+// 将 jstring 转换为 UTF-8 路径（Windows 下经宽字符转换），失败返回 -1
+static int get_input_path(JNIEnv *env, jstring inputPath, char *input_file, size_t size) {
+#ifdef _WIN32
+  // 获取 jstring 的宽字符表示
+  const jchar *inputChars = (*env)->GetStringChars(env, inputPath, NULL);
+  if (!inputChars) {
+    return -1;
+  }
+  jsize inputLen = (*env)->GetStringLength(env, inputPath);
 
-  // 构造 Java 字符串数组返回结果
+  // 构造宽字符缓冲区
+  wchar_t wInput[1024] = {0};
+  if (inputLen >= 1024) inputLen = 1023;
+  for (int i = 0; i < inputLen; i++) {
+    wInput[i] = (wchar_t) inputChars[i];
+  }
+  wInput[inputLen] = L'\0';
+  (*env)->ReleaseStringChars(env, inputPath, inputChars);
+
+  // 将宽字符转换为 UTF-8 字符串
+  int utf8Len = WideCharToMultiByte(CP_UTF8, 0, wInput, -1, NULL, 0, NULL, NULL);
+  if (utf8Len <= 0 || utf8Len > (int) size) {
+    return -1;
+  }
+  WideCharToMultiByte(CP_UTF8, 0, wInput, -1, input_file, (int) size, NULL, NULL);
+#else
+  // 非 Windows 平台直接获取 UTF-8 字符串
+  const char *tmp = (*env)->GetStringUTFChars(env, inputPath, NULL);
+  if (!tmp) return -1;
+  strncpy(input_file, tmp, size - 1);
+  (*env)->ReleaseStringUTFChars(env, inputPath, tmp);
+#endif
+  return 0;
+}
+
+// 构造 Java 字符串数组返回结果，并释放段文件名数组
+static jobjectArray to_string_array(JNIEnv *env, char **seg_names, int seg_count) {
+  if (!seg_names)
+    return NULL;
   jclass strClass = (*env)->FindClass(env, "java/lang/String");
   jobjectArray jresult = (*env)->NewObjectArray(env, seg_count, strClass, NULL);
   for (int i = 0; i < seg_count; i++) {
-    jstring jstr = (*env)->NewStringUTF(env, seg_names[i]);
-    (*env)->SetObjectArrayElement(env, jresult, i, jstr);
+    if (jresult) {
+      jstring jstr = (*env)->NewStringUTF(env, seg_names[i]);
+      (*env)->SetObjectArrayElement(env, jresult, i, jstr);
+      (*env)->DeleteLocalRef(env, jstr);
+    }
     free(seg_names[i]);
   }
   free(seg_names);
   return jresult;
-}
\ No newline at end of file
+}
+
+/*
+ * 按大小切分：每段不超过 segSize 字节，只在视频关键帧处切换，各段无需重新编码即可单独播放
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_litongjava_media_NativeMedia_split(JNIEnv *env, jclass clazz, jstring inputPath, jlong segSize) {
+  char input_file[1024] = {0};
+  if (get_input_path(env, inputPath, input_file, sizeof(input_file)) < 0)
+    return NULL;
+  int seg_count = 0;
+  char **seg_names = split_media_file(input_file, SPLIT_BY_SIZE, (double) segSize, &seg_count);
+  return to_string_array(env, seg_names, seg_count);
+}
+
+/*
+ * 按时长切分：每段达到 segmentSeconds 秒后在下一个视频关键帧处切换
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_litongjava_media_NativeMedia_splitByDuration(JNIEnv *env, jclass clazz, jstring inputPath,
+                                                      jdouble segmentSeconds) {
+  char input_file[1024] = {0};
+  if (get_input_path(env, inputPath, input_file, sizeof(input_file)) < 0)
+    return NULL;
+  int seg_count = 0;
+  char **seg_names = split_media_file(input_file, SPLIT_BY_DURATION, segmentSeconds, &seg_count);
+  return to_string_array(env, seg_names, seg_count);
+}
+
+/*
+ * 并行切分：segSize > 0 时按大小切分，否则按 segmentSeconds 秒切分；threads <= 0 表示使用全部逻辑处理器
+ * 切分点由容器索引预先计算，各段并行重封装，结果与 split / splitByDuration 一样都从关键帧开始
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_litongjava_media_NativeMedia_splitParallel(JNIEnv *env, jclass clazz, jstring inputPath, jlong segSize,
+                                                    jdouble segmentSeconds, jint threads) {
+  char input_file[1024] = {0};
+  if (get_input_path(env, inputPath, input_file, sizeof(input_file)) < 0)
+    return NULL;
+  int seg_count = 0;
+  char **seg_names = segSize > 0
+                     ? split_media_file_parallel(input_file, SPLIT_BY_SIZE, (double) segSize, threads, &seg_count)
+                     : split_media_file_parallel(input_file, SPLIT_BY_DURATION, segmentSeconds, threads, &seg_count);
+  return to_string_array(env, seg_names, seg_count);
+}
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include "native_queue.h"
+#include "native_thread.h"
+
+struct NativeQueue {
+  native_mutex_t lock;
+  native_cond_t not_empty;
+  native_cond_t not_full;
+  void **items;
+  int capacity;
+  int head;
+  int count;
+  int closed;
+};
+
+NativeQueue *native_queue_alloc(int capacity) {
+  if (capacity < 1)
+    capacity = 1;
+  NativeQueue *queue = (NativeQueue *) calloc(1, sizeof(NativeQueue));
+  if (!queue)
+    return NULL;
+  queue->items = (void **) calloc(capacity, sizeof(void *));
+  if (!queue->items) {
+    free(queue);
+    return NULL;
+  }
+  queue->capacity = capacity;
+  native_mutex_init(&queue->lock);
+  native_cond_init(&queue->not_empty);
+  native_cond_init(&queue->not_full);
+  return queue;
+}
+
+void native_queue_free(NativeQueue **queue) {
+  if (!queue || !*queue)
+    return;
+  NativeQueue *q = *queue;
+  native_cond_destroy(&q->not_empty);
+  native_cond_destroy(&q->not_full);
+  native_mutex_destroy(&q->lock);
+  free(q->items);
+  free(q);
+  *queue = NULL;
+}
+
+int native_queue_push(NativeQueue *queue, void *item) {
+  native_mutex_lock(&queue->lock);
+  while (queue->count == queue->capacity && !queue->closed)
+    native_cond_wait(&queue->not_full, &queue->lock);
+  if (queue->closed) {
+    native_mutex_unlock(&queue->lock);
+    return -1;
+  }
+  queue->items[(queue->head + queue->count) % queue->capacity] = item;
+  queue->count++;
+  native_cond_signal(&queue->not_empty);
+  native_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+int native_queue_pop(NativeQueue *queue, void **item) {
+  native_mutex_lock(&queue->lock);
+  while (queue->count == 0 && !queue->closed)
+    native_cond_wait(&queue->not_empty, &queue->lock);
+  if (queue->count == 0) {
+    native_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  *item = queue->items[queue->head];
+  queue->items[queue->head] = NULL;
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  native_cond_signal(&queue->not_full);
+  native_mutex_unlock(&queue->lock);
+  return 1;
+}
+
+void native_queue_close(NativeQueue *queue) {
+  native_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  native_cond_broadcast(&queue->not_empty);
+  native_cond_broadcast(&queue->not_full);
+  native_mutex_unlock(&queue->lock);
+}
+
+int native_queue_size(NativeQueue *queue) {
+  native_mutex_lock(&queue->lock);
+  int count = queue->count;
+  native_mutex_unlock(&queue->lock);
+  return count;
+}
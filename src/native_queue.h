@@ -0,0 +1,45 @@
+#ifndef NATIVE_QUEUE_H
+#define NATIVE_QUEUE_H
+
+/*
+ * 有界阻塞队列（元素为 void*），用于生产者/消费者线程之间传递任务、数据包或帧。
+ * 队列满时 push 阻塞，队列空时 pop 阻塞；close 之后 push 失败，pop 取完剩余元素后返回 0。
+ */
+
+typedef struct NativeQueue NativeQueue;
+
+/**
+ * 创建队列
+ * @param capacity 最大元素个数（至少为 1）
+ * @return 成功返回队列，失败返回 NULL
+ */
+NativeQueue *native_queue_alloc(int capacity);
+
+/**
+ * 释放队列（队列中剩余的元素由调用方负责处理）
+ */
+void native_queue_free(NativeQueue **queue);
+
+/**
+ * 入队，队列满时阻塞等待
+ * @return 成功返回 0，队列已关闭返回 -1
+ */
+int native_queue_push(NativeQueue *queue, void *item);
+
+/**
+ * 出队，队列空时阻塞等待
+ * @return 取到元素返回 1，队列已关闭且为空返回 0
+ */
+int native_queue_pop(NativeQueue *queue, void **item);
+
+/**
+ * 关闭队列并唤醒所有等待者
+ */
+void native_queue_close(NativeQueue *queue);
+
+/**
+ * 当前队列中的元素个数
+ */
+int native_queue_size(NativeQueue *queue);
+
+#endif // NATIVE_QUEUE_H
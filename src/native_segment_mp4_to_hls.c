@@ -14,6 +14,7 @@
 // FFmpeg Headers
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/bprint.h>
 #include <libavutil/opt.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/channel_layout.h>
@@ -23,6 +24,17 @@
 #include <libavutil/samplefmt.h>
 #include <libavutil/timestamp.h>
 #include <time.h>
+#include "hls_checkpoint.h"
+#include "hls_session_table.h"
+#include "hls_writer.h"
+#include "native_queue.h"
+#include "native_thread.h"
+#include "silence_cache.h"
+#include "stream_stitcher.h"
+#include "stream_transcoder.h"
+
+#define HLS_APPEND_QUEUE_CAPACITY 16
+#define HLS_REAPER_MAX_INTERVAL 10 // 空闲回收线程的最长检查间隔（秒）
 
 // 内联函数：拷贝 AVChannelLayout（忽略 opaque 字段）
 inline int av_channel_layout_copy(AVChannelLayout *dst, const AVChannelLayout *src) {
@@ -32,65 +44,308 @@ inline int av_channel_layout_copy(AVChannelLayout *dst, const AVChannelLayout *s
   return 0;
 }
 
+typedef struct HlsPendingInput {
+  int64_t ticket;               // 任务票据
+  int64_t end_offset;           // 该任务完成后的全局时间偏移（AV_TIME_BASE）
+} HlsPendingInput;
+
 typedef struct HlsSession {
-  AVFormatContext *ofmt_ctx;    // HLS muxer 输出上下文
+  HlsWriter writer;             // 自管理的分段写入器（含内存播放列表）
+  int writer_opened;            // writer 是否已打开
   int segDuration;              // 分段时长（秒）
-  int nextSegmentNumber;        // 当前下一个分段编号
-  int64_t global_offset;        // 全局时间戳偏移量
-  char *ts_pattern;             // TS 分段文件命名模板（深拷贝保存）
-  int header_written;           // 标识是否已写 header
-  AVDictionary *opts;           // 保存 HLS 配置选项
+  int64_t global_offset;        // 全局时间线末尾（AV_TIME_BASE），每个任务完成后更新
+  StreamStitcher stitcher;      // 逐路流的时间线，写入文件头后初始化
+  int stitcher_ready;
   time_t created_time;          // 会话创建时间
-  int closed;         // 0 表示未释放，1 表示已释放
+  AVRational video_frame_rate;  // 首个帧率可知的视频输入的帧率，用于编码静音片段，随检查点保存
+
+  // 后台追加队列：追加请求只负责入队，打开/探测/重封装在 worker 线程中完成
+  NativeQueue *jobs;            // 待处理的 HlsAppendJob 队列（有界）
+  native_thread_t worker;       // 后台 worker 线程
+  int worker_started;           // worker 是否已启动
+  volatile uint32_t aborting;   // 1 表示丢弃剩余任务（freeHlsSession）
+  native_mutex_t enqueue_lock;  // 串行化入队并分配票据，队列满时在此锁内等待（不持有会话锁）
+  volatile uint32_t pushers;    // 正在入队或等待播放列表更新的调用方数量，释放会话前必须归零
+  volatile int64_t next_ticket; // 最近分配的任务票据（在 enqueue_lock 内分配）
+  volatile int64_t completed_ticket; // 已处理完成的最大票据
+  native_mutex_t state_lock;    // 保护 last_error
+  char last_error[256];         // 最近一次失败的描述
+  volatile int64_t failed_ticket; // 最近一次失败的任务票据，0 表示没有失败的任务
+
+  // 检查点：每完成一个分段记录一次，崩溃后通过 resumePersistentHls 恢复
+  char *checkpoint_path;        // 检查点文件路径
+  HlsPendingInput *pending;     // 已追加完成、但内容尚未全部落在已完成分段中的任务
+  int nb_pending;
+  int pending_capacity;
+  int64_t committed_ticket;     // 内容已全部落在已完成分段中的最大票据
+  int64_t committed_offset;     // committed_ticket 完成后的全局时间偏移
+  int64_t resume_from;          // 恢复时丢弃该时间点（AV_TIME_BASE）之前的数据，AV_NOPTS_VALUE 表示不丢弃
+  int resume_video_started;     // 恢复后视频是否已从关键帧重新开始
+
+  // 资源统计：由 worker 更新，其他线程原子读取
+  volatile int64_t last_activity;    // 最近一次入队或完成任务的时间（秒）
+  volatile int64_t stat_bytes;       // 已写入分段文件的字节数
+  volatile int64_t stat_segments;    // 已完成的分段数
+  volatile int64_t stat_memory;      // 会话当前持有的内存估算（字节）
+  volatile int64_t stat_global_offset; // 全局时间偏移的快照
+  volatile int64_t stat_jobs;        // 已处理的任务数
+  volatile int64_t stat_job_us;      // 处理任务累计耗时（微秒）
+
+  // 阻塞式播放列表更新（LL-HLS _HLS_msn/_HLS_part）：每次重写播放列表后由 worker 更新并广播
+  native_mutex_t publish_lock;
+  native_cond_t publish_cond;
+  int64_t published_msn;        // 已发布播放列表中进行中分段的媒体序号（之前的分段均已完成）
+  int published_parts;          // 进行中分段已发布的部分分段数
+  int publish_closed;           // 会话已结束或释放，不会再有更新
 } HlsSession;
 
-typedef struct HlsSessionNode {
-  HlsSession *session;
-  struct HlsSessionNode *next;
-} HlsSessionNode;
+typedef struct HlsAppendJob {
+  char *input_path;             // 待追加的输入文件路径，为 NULL 表示插入静音片段
+  double silence_duration;      // 静音片段时长（秒）
+  int64_t ticket;               // 任务票据，按入队顺序递增
+  int waitable;                 // 1 表示有调用方在等待结果（同步追加），由等待方释放
+  native_mutex_t lock;
+  native_cond_t cond;
+  int done;
+  char result[256];
+} HlsAppendJob;
 
-// 全局链表头指针，用于维护所有活跃的 HLS 会话
-static HlsSessionNode *g_hlsSessionHead = NULL;
+static HlsAppendJob *alloc_append_job(const char *inputFilePath, int waitable) {
+  HlsAppendJob *job = (HlsAppendJob *) calloc(1, sizeof(HlsAppendJob));
+  if (!job)
+    return NULL;
+  if (inputFilePath) {
+    job->input_path = strdup(inputFilePath);
+    if (!job->input_path) {
+      free(job);
+      return NULL;
+    }
+  }
+  job->waitable = waitable;
+  if (waitable) {
+    native_mutex_init(&job->lock);
+    native_cond_init(&job->cond);
+  }
+  return job;
+}
 
-// 添加一个会话到全局链表
-static void add_hls_session(HlsSession *session) {
-  HlsSessionNode *node = (HlsSessionNode *) malloc(sizeof(HlsSessionNode));
-  if (node) {
-    node->session = session;
-    node->next = g_hlsSessionHead;
-    g_hlsSessionHead = node;
+static void free_append_job(HlsAppendJob *job) {
+  if (job->waitable) {
+    native_cond_destroy(&job->cond);
+    native_mutex_destroy(&job->lock);
   }
+  free(job->input_path);
+  free(job);
 }
 
-// 从全局链表中删除一个会话
-static void remove_hls_session(HlsSession *session) {
-  HlsSessionNode **curr = &g_hlsSessionHead;
-  while (*curr) {
-    if ((*curr)->session == session) {
-      HlsSessionNode *tmp = *curr;
-      *curr = tmp->next;
-      free(tmp);
-      return;
-    }
-    curr = &((*curr)->next);
+// 任务完成：同步任务唤醒等待方（由等待方释放），异步任务直接释放
+static void complete_append_job(HlsAppendJob *job, const char *result) {
+  if (!job->waitable) {
+    free_append_job(job);
+    return;
   }
+  native_mutex_lock(&job->lock);
+  snprintf(job->result, sizeof(job->result), "%s", result);
+  job->done = 1;
+  native_cond_signal(&job->cond);
+  native_mutex_unlock(&job->lock);
 }
 
-// 辅助函数：查找全局列表中是否存在给定的会话
-static HlsSession *find_hls_session(HlsSession *sessionPtrValue) {
-  HlsSessionNode *curr = g_hlsSessionHead;
-  while (curr) {
-    if (curr->session == sessionPtrValue) {
-      return curr->session;
-    }
-    curr = curr->next;
+static void *hls_session_worker(void *arg);
+
+// 停止 worker：abort 为 0 时先处理完队列中剩余的任务，为 1 时丢弃剩余任务
+static void stop_hls_worker(HlsSession *session, int abort) {
+  if (!session->worker_started)
+    return;
+  if (abort)
+    native_atomic_store_u32(&session->aborting, 1);
+  native_queue_close(session->jobs);
+  native_thread_join(session->worker);
+  session->worker_started = 0;
+}
+
+// 标记会话不再发布播放列表更新，并唤醒所有等待方
+static void close_hls_publish(HlsSession *session) {
+  native_mutex_lock(&session->publish_lock);
+  session->publish_closed = 1;
+  native_cond_broadcast(&session->publish_cond);
+  native_mutex_unlock(&session->publish_lock);
+}
+
+// 释放会话及其输出上下文（调用前会话必须已从句柄表中移除）
+static void free_hls_session(HlsSession *session) {
+  stop_hls_worker(session, 1);
+  close_hls_publish(session);
+  // 队列已关闭，仍在入队的调用方会很快失败返回；等它们全部离开后才能释放队列与锁
+  while (native_atomic_load_u32(&session->pushers))
+    native_thread_yield();
+  if (session->jobs)
+    native_queue_free(&session->jobs);
+  native_mutex_destroy(&session->enqueue_lock);
+  native_mutex_destroy(&session->state_lock);
+  native_cond_destroy(&session->publish_cond);
+  native_mutex_destroy(&session->publish_lock);
+  if (session->writer_opened)
+    hls_writer_free(&session->writer);
+  free(session->pending);
+  free(session->checkpoint_path);
+  free(session);
+}
+
+static void set_session_error(HlsSession *session, const char *msg) {
+  native_mutex_lock(&session->state_lock);
+  snprintf(session->last_error, sizeof(session->last_error), "%s", msg);
+  native_mutex_unlock(&session->state_lock);
+}
+
+/*
+ * 写入检查点（仅由 worker 线程或 worker 停止后的结束流程调用）
+ * timeline_end 为已完成分段的结束时间，尚无完成分段时为 AV_NOPTS_VALUE
+ * 检查点写入失败只记录错误，不影响分段输出
+ */
+static void write_session_checkpoint(HlsSession *session, int64_t timeline_end) {
+  HlsWriter *writer = &session->writer;
+  HlsCheckpoint *ck = (HlsCheckpoint *) calloc(1, sizeof(HlsCheckpoint));
+  if (!ck)
+    return;
+  snprintf(ck->playlist, sizeof(ck->playlist), "%s", writer->playlist.path);
+  snprintf(ck->segment_pattern, sizeof(ck->segment_pattern), "%s", writer->segment_pattern);
+  snprintf(ck->options, sizeof(ck->options), "%s", writer->options ? writer->options : "");
+  ck->segment_duration = writer->segment_duration;
+  ck->next_number = writer->next_number;
+  ck->timeline_end = timeline_end;
+  ck->committed_ticket = session->committed_ticket;
+  ck->committed_offset = session->committed_offset;
+  ck->video_frame_rate = session->video_frame_rate;
+  if (writer->playlist.nb_entries > 0) {
+    const HlsPlaylistEntry *last = &writer->playlist.entries[writer->playlist.nb_entries - 1];
+    snprintf(ck->last_segment_uri, sizeof(ck->last_segment_uri), "%s", last->uri);
+    ck->last_segment_duration = last->duration;
+    ck->last_segment_offset = last->offset;
+    ck->last_segment_length = last->length;
+  } else {
+    ck->last_segment_offset = -1;
+  }
+  ck->nb_streams = (int) writer->mux->nb_streams;
+  for (int i = 0; i < ck->nb_streams; i++) {
+    // 只借用编码参数指针，不由检查点释放
+    ck->par[i] = writer->mux->streams[i]->codecpar;
+    ck->time_base[i] = writer->in_time_base[i];
+  }
+  int ret = hls_checkpoint_write(session->checkpoint_path, ck);
+  free(ck);
+  if (ret < 0) {
+    char msg[256] = {0};
+    snprintf(msg, sizeof(msg), "Failed to write checkpoint %s", session->checkpoint_path);
+    set_session_error(session, msg);
   }
-  return NULL;
 }
 
-JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHls
-  (JNIEnv *env, jclass clazz, jstring playlistUrlJ, jstring tsPatternJ, jint startNumber, jint segDuration) {
+// 分段完成回调：把内容已全部落盘的任务标记为已提交，然后写检查点
+static int on_session_segment(HlsWriter *writer, int64_t segment_end, void *opaque) {
+  HlsSession *session = (HlsSession *) opaque;
+  int committed = 0;
+  while (committed < session->nb_pending && session->pending[committed].end_offset <= segment_end) {
+    session->committed_ticket = session->pending[committed].ticket;
+    session->committed_offset = session->pending[committed].end_offset;
+    committed++;
+  }
+  if (committed > 0) {
+    session->nb_pending -= committed;
+    memmove(session->pending, session->pending + committed, session->nb_pending * sizeof(HlsPendingInput));
+  }
+  write_session_checkpoint(session, segment_end);
+  return 0;
+}
+
+// 播放列表重写回调：记录已发布的位置并唤醒 awaitHlsPlaylistUpdate 的等待方
+static void on_session_playlist(HlsWriter *writer, void *opaque) {
+  HlsSession *session = (HlsSession *) opaque;
+  native_mutex_lock(&session->publish_lock);
+  session->published_msn = hls_playlist_next_sequence(&writer->playlist);
+  session->published_parts = writer->playlist.nb_parts;
+  native_cond_broadcast(&session->publish_cond);
+  native_mutex_unlock(&session->publish_lock);
+}
+
+// 记录一个已成功完成的任务，等待其内容所在的分段完成后再提交
+static int add_pending_input(HlsSession *session, int64_t ticket) {
+  if (session->nb_pending >= session->pending_capacity) {
+    int capacity = session->pending_capacity ? session->pending_capacity * 2 : 16;
+    HlsPendingInput *pending = (HlsPendingInput *) realloc(session->pending, capacity * sizeof(HlsPendingInput));
+    if (!pending)
+      return AVERROR(ENOMEM);
+    session->pending = pending;
+    session->pending_capacity = capacity;
+  }
+  session->pending[session->nb_pending].ticket = ticket;
+  session->pending[session->nb_pending].end_offset = session->global_offset;
+  session->nb_pending++;
+  return 0;
+}
+
+// 估算会话持有的内存：IO 缓冲、播放列表正文与条目、待提交任务表以及会话本身
+static int64_t estimate_session_memory(HlsSession *session) {
+  HlsWriter *writer = &session->writer;
+  int64_t bytes = sizeof(HlsSession) + HLS_APPEND_QUEUE_CAPACITY * sizeof(void *);
+  if (writer->avio)
+    bytes += writer->avio->buffer_size;
+  bytes += writer->playlist.body.size;
+  bytes += (int64_t) writer->playlist.capacity * sizeof(HlsPlaylistEntry);
+  bytes += (int64_t) session->pending_capacity * sizeof(HlsPendingInput);
+  return bytes;
+}
+
+// 刷新资源统计（仅由 worker 线程调用）
+static void update_session_stats(HlsSession *session) {
+  native_atomic_store_i64(&session->stat_bytes, session->writer.bytes_written);
+  native_atomic_store_i64(&session->stat_segments, session->writer.segments_written);
+  native_atomic_store_i64(&session->stat_memory, estimate_session_memory(session));
+  native_atomic_store_i64(&session->stat_global_offset, session->global_offset);
+  native_atomic_store_i64(&session->last_activity, (int64_t) time(NULL));
+}
+
+// 默认检查点路径：<playlist>.checkpoint
+static char *default_checkpoint_path(const char *playlistUrl) {
+  size_t size = strlen(playlistUrl) + sizeof(".checkpoint");
+  char *path = (char *) malloc(size);
+  if (path)
+    snprintf(path, size, "%s.checkpoint", playlistUrl);
+  return path;
+}
+
+// 启动 worker 并注册到句柄表，失败时释放会话并返回 0
+static int64_t start_hls_session(HlsSession *session) {
+  session->writer_opened = 1;
+  session->writer.on_segment = on_session_segment;
+  session->writer.on_playlist = on_session_playlist;
+  session->writer.opaque = session;
+  session->published_msn = hls_playlist_next_sequence(&session->writer.playlist);
+  // 持久会话总是可以继续追加
+  session->writer.playlist.ended = 0;
+
+  // 启动后台追加 worker
+  session->jobs = native_queue_alloc(HLS_APPEND_QUEUE_CAPACITY);
+  if (!session->jobs || native_thread_create(&session->worker, hls_session_worker, session) < 0) {
+    free_hls_session(session);
+    return 0;
+  }
+  session->worker_started = 1;
+  session->last_activity = (int64_t) time(NULL);
+  session->stat_memory = estimate_session_memory(session);
 
+  // 注册到句柄表，返回给 Java 的是句柄而不是裸指针
+  int64_t handle = hls_table_insert(session);
+  if (!handle) {
+    free_hls_session(session);
+    return 0;
+  }
+  return handle;
+}
+
+// 创建会话（options 可为 NULL），失败返回 0
+static int64_t init_hls_session(JNIEnv *env, jstring playlistUrlJ, jstring tsPatternJ, jint startNumber,
+                                jint segDuration, const char *options) {
   const char *playlistUrl = (*env)->GetStringUTFChars(env, playlistUrlJ, NULL);
   const char *tsPattern = (*env)->GetStringUTFChars(env, tsPatternJ, NULL);
 
@@ -102,68 +357,134 @@ JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHls
   }
   memset(session, 0, sizeof(HlsSession));
   session->segDuration = segDuration;
-  session->nextSegmentNumber = startNumber;
   session->global_offset = 0;
-  session->header_written = 0; // header 尚未写入
-  session->ts_pattern = strdup(tsPattern);
-  if (!session->ts_pattern) {
-    free(session);
-    (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
-    (*env)->ReleaseStringUTFChars(env, tsPatternJ, tsPattern);
-    return 0;
-  }
+  session->resume_from = AV_NOPTS_VALUE;
   // 记录会话创建时间
   session->created_time = time(NULL);
+  native_mutex_init(&session->state_lock);
+  native_mutex_init(&session->enqueue_lock);
+  native_mutex_init(&session->publish_lock);
+  native_cond_init(&session->publish_cond);
+  session->checkpoint_path = default_checkpoint_path(playlistUrl);
 
-  // 创建输出上下文，指定 muxer 为 "hls"，目标为 playlistUrl
-  AVFormatContext *ofmt_ctx = NULL;
-  int ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, "hls", playlistUrl);
-  if (ret < 0 || !ofmt_ctx) {
-    free(session->ts_pattern);
-    free(session);
-    (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
-    (*env)->ReleaseStringUTFChars(env, tsPatternJ, tsPattern);
+  // 打开分段写入器：已存在的播放列表会被加载一次，之后只在内存中追加
+  int ret = session->checkpoint_path ? hls_writer_open(&session->writer, playlistUrl, tsPattern, startNumber,
+                                                       segDuration, options)
+                                     : AVERROR(ENOMEM);
+  (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
+  (*env)->ReleaseStringUTFChars(env, tsPatternJ, tsPattern);
+  if (ret < 0) {
+    free_hls_session(session);
     return 0;
   }
 
-  // 构造 HLS 选项字典，并保存到 session->opts
-  AVDictionary *opts = NULL;
-  char seg_time_str[16] = {0};
-  snprintf(seg_time_str, sizeof(seg_time_str), "%d", segDuration);
-  av_dict_set(&opts, "hls_time", seg_time_str, 0);
-  // 使用用户指定的 tsPattern，例如 "segment_video_%03d.ts"
-  av_dict_set(&opts, "hls_segment_filename", tsPattern, 0);
-  av_dict_set(&opts, "hls_flags", "append_list", 0);
-  av_dict_set(&opts, "hls_list_size", "0", 0);
-  av_dict_set(&opts, "hls_playlist_type", "event", 0);
-  char start_num_str[16] = {0};
-  snprintf(start_num_str, sizeof(start_num_str), "%d", startNumber);
-  av_dict_set(&opts, "start_number", start_num_str, 0);
-  session->opts = opts;
-
-  // 如果输出格式要求打开文件，则调用 avio_open
-  if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-    ret = avio_open(&ofmt_ctx->pb, playlistUrl, AVIO_FLAG_WRITE);
-    if (ret < 0) {
-      av_dict_free(&opts);
-      avformat_free_context(ofmt_ctx);
-      free(session->ts_pattern);
-      free(session);
-      (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
-      (*env)->ReleaseStringUTFChars(env, tsPatternJ, tsPattern);
-      return 0;
-    }
-  }
+  return start_hls_session(session);
+}
 
-  session->ofmt_ctx = ofmt_ctx;
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHls
+  (JNIEnv *env, jclass clazz, jstring playlistUrlJ, jstring tsPatternJ, jint startNumber, jint segDuration) {
+  return (jlong) init_hls_session(env, playlistUrlJ, tsPatternJ, startNumber, segDuration, NULL);
+}
 
-  (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
-  (*env)->ReleaseStringUTFChars(env, tsPatternJ, tsPattern);
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    initPersistentHlsWithOptions
+ * Signature: (Ljava/lang/String;Ljava/lang/String;IILjava/lang/String;)J
+ *
+ * 与 initPersistentHls 相同，options 为 "key=value:key=value" 形式的分段选项，例如
+ * "hls_segment_type=fmp4" 输出 fMP4/CMAF 分段（共享初始化分段，播放列表版本 7），
+ * "hls_flags=single_file" 将所有分段追加到同一个媒体文件并以 #EXT-X-BYTERANGE 引用，
+ * "hls_part_duration=0.333" 开启低延迟 HLS（#EXT-X-PART / PRELOAD-HINT，配合 awaitHlsPlaylistUpdate 实现阻塞式重载）。
+ * 选项无效时返回 0。
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHlsWithOptions
+  (JNIEnv *env, jclass clazz, jstring playlistUrlJ, jstring tsPatternJ, jint startNumber, jint segDuration,
+   jstring optionsJ) {
+  const char *options = optionsJ ? (*env)->GetStringUTFChars(env, optionsJ, NULL) : NULL;
+  int64_t handle = init_hls_session(env, playlistUrlJ, tsPatternJ, startNumber, segDuration, options);
+  if (options)
+    (*env)->ReleaseStringUTFChars(env, optionsJ, options);
+  return (jlong) handle;
+}
 
-  // 加入全局会话列表
-  add_hls_session(session);
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    resumePersistentHls
+ * Signature: (Ljava/lang/String;)J
+ *
+ * 根据检查点（默认为 <playlist>.checkpoint）和已有播放列表恢复持久 HLS 会话：
+ * 1. 播放列表保留到最后一个已完成分段，未完成的分段文件会被重新写入；
+ * 2. 复用器按检查点中的编码参数重建，时间戳从已完成分段的结束时间处继续；
+ * 3. getCompletedHlsTicket 返回检查点中已提交的任务数 N，调用方需从第 N+1 个输入开始按原顺序重新追加，
+ *    落在已完成分段中的数据会被自动丢弃，因此重启最多只需重做一个分段。
+ * 失败返回 0。
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_resumePersistentHls
+  (JNIEnv *env, jclass clazz, jstring checkpointPathJ) {
+  const char *checkpointPath = (*env)->GetStringUTFChars(env, checkpointPathJ, NULL);
+  if (!checkpointPath) {
+    return 0;
+  }
+  HlsCheckpoint *ck = (HlsCheckpoint *) calloc(1, sizeof(HlsCheckpoint));
+  HlsSession *session = (HlsSession *) calloc(1, sizeof(HlsSession));
+  int ret = ck && session ? hls_checkpoint_read(checkpointPath, ck) : AVERROR(ENOMEM);
+  if (ret < 0) {
+    (*env)->ReleaseStringUTFChars(env, checkpointPathJ, checkpointPath);
+    free(ck);
+    free(session);
+    return 0;
+  }
+  session->checkpoint_path = strdup(checkpointPath);
+  (*env)->ReleaseStringUTFChars(env, checkpointPathJ, checkpointPath);
+
+  session->segDuration = (int) (ck->segment_duration + 0.5);
+  session->created_time = time(NULL);
+  native_mutex_init(&session->state_lock);
+  native_mutex_init(&session->enqueue_lock);
+  native_mutex_init(&session->publish_lock);
+  native_cond_init(&session->publish_cond);
+  session->global_offset = ck->committed_offset;
+  session->committed_offset = ck->committed_offset;
+  session->committed_ticket = ck->committed_ticket;
+  session->next_ticket = ck->committed_ticket;
+  session->completed_ticket = ck->committed_ticket;
+  session->resume_from = ck->timeline_end;
+  session->video_frame_rate = ck->video_frame_rate;
 
-  return (jlong) session;
+  HlsWriter *writer = &session->writer;
+  ret = session->checkpoint_path ? hls_writer_open(writer, ck->playlist, ck->segment_pattern, ck->next_number,
+                                                   ck->segment_duration, ck->options[0] ? ck->options : NULL)
+                                 : AVERROR(ENOMEM);
+  if (ret >= 0) {
+    session->writer_opened = 1;
+    // 检查点先于播放列表写盘：若崩溃发生在两者之间，补上播放列表中缺失的最后一个分段
+    int64_t next_sequence = hls_playlist_next_sequence(&writer->playlist);
+    if (next_sequence == ck->next_number - 1 && ck->last_segment_uri[0]) {
+      ret = hls_playlist_add_segment_range(&writer->playlist, ck->last_segment_uri, ck->last_segment_duration, 0,
+                                           ck->last_segment_offset, ck->last_segment_length);
+      if (ret >= 0)
+        ret = hls_playlist_write(&writer->playlist);
+    } else if (writer->playlist.nb_entries > 0 && next_sequence != ck->next_number) {
+      ret = AVERROR_INVALIDDATA;
+    }
+  }
+  if (ret >= 0) {
+    // 时间戳与已完成分段连续，不需要 DISCONTINUITY
+    writer->next_number = ck->next_number;
+    writer->pending_discontinuity = 0;
+    for (int i = 0; i < ck->nb_streams && ret >= 0; i++)
+      ret = hls_writer_add_stream(writer, ck->par[i], ck->time_base[i]);
+  }
+  if (ret >= 0)
+    ret = hls_writer_write_header(writer);
+  hls_checkpoint_uninit(ck);
+  free(ck);
+  if (ret < 0) {
+    free_hls_session(session);
+    return 0;
+  }
+
+  return (jlong) start_hls_session(session);
 }
 
 /*
@@ -172,57 +493,42 @@ JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_initPersistentHls
  * Signature: (JLjava/lang/String;)Ljava/lang/String;
  *
  * 实现说明：
- * 1. 根据传入的会话指针，取出 HLS 会话结构体；
- * 2. 调用 av_write_trailer 写入 trailer（如生成 EXT‑X‑ENDLIST 标签），关闭输出流；
- * 3. 释放输出上下文以及会话中分配的资源（例如 TS 模板字符串和会话结构体）；
- * 4. 返回结束操作的状态信息。
+ * 1. 根据传入的会话句柄从句柄表中取出并移除 HLS 会话，此后旧句柄全部失效；
+ * 2. 等待后台 worker 处理完队列中剩余的追加任务；
+ * 3. 写入 trailer，完成最后一个分段并在播放列表中写入 EXT‑X‑ENDLIST 标签；
+ * 4. 释放写入器以及会话中分配的资源；
+ * 5. 返回结束操作的状态信息。
  */
 JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_finishPersistentHls
   (JNIEnv *env, jclass clazz, jlong sessionPtr, jstring playlistUrlJ) {
 
-  // 将 sessionPtr 转换为 HlsSession 指针
-  HlsSession *sessionInput = (HlsSession *) (uintptr_t) sessionPtr;
-  // 通过全局列表查找该会话是否还存活
-  HlsSession *session = find_hls_session(sessionInput);
+  // 取得会话锁后从句柄表移除，之后其他线程无法再找到或向其入队
+  HlsSession *session = hls_table_acquire(sessionPtr);
   if (!session) {
     return (*env)->NewStringUTF(env, "Session already freed");
   }
+  hls_table_remove(sessionPtr);
 
-  // 如果已经关闭，则直接返回
-  if (session->closed) {
-    return (*env)->NewStringUTF(env, "Session already freed");
-  }
+  // 处理完所有已入队的追加任务后再结束会话
+  stop_hls_worker(session, 0);
 
   // 从 Java 字符串中获取播放列表路径（用于返回消息）
   const char *playlistUrl = (*env)->GetStringUTFChars(env, playlistUrlJ, NULL);
 
-  // 写入 trailer，结束会话
-  int ret = av_write_trailer(session->ofmt_ctx);
+  // 写入 trailer、完成最后一个分段并在播放列表末尾写入 EXT-X-ENDLIST
+  int ret = hls_writer_close(&session->writer, 1);
+  close_hls_publish(session);
+  session->writer_opened = 0;
+  // 会话已正常结束，检查点不再需要
+  if (ret >= 0)
+    remove(session->checkpoint_path);
+  // 无论 trailer 是否成功，都释放资源以避免泄漏
+  free_hls_session(session);
   if (ret < 0) {
     (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
-    // 如果写 trailer 出错，也应关闭资源以避免泄漏
-    if (!(session->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-      avio_closep(&session->ofmt_ctx->pb);
-    avformat_free_context(session->ofmt_ctx);
-    free(session->ts_pattern);
-    // 从全局列表中删除该会话
-    remove_hls_session(session);
     return (*env)->NewStringUTF(env, "Failed to write trailer");
   }
 
-  // 关闭输出文件（如果必要），并释放输出上下文
-  if (!(session->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-    avio_closep(&session->ofmt_ctx->pb);
-  avformat_free_context(session->ofmt_ctx);
-
-  // 从全局列表中删除该会话
-  remove_hls_session(session);
-  // 标记会话状态为已关闭，以防重复释放
-  session->closed = 1;
-  // 释放会话中分配的资源
-  free(session->ts_pattern);
-  free(session);
-
   // 构造返回消息
   char resultMsg[256] = {0};
   snprintf(resultMsg, sizeof(resultMsg),
@@ -232,191 +538,763 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_finishPersistent
   return (*env)->NewStringUTF(env, resultMsg);
 }
 
+/*
+ * 恢复后重新追加的数据：丢弃已经落在已完成分段中的数据包，视频从下一个关键帧开始
+ * pkt 的时间戳已加上全局偏移（时间基为 tb）
+ */
+static int drop_for_resume(HlsSession *session, enum AVMediaType type, const AVPacket *pkt, AVRational tb) {
+  if (session->resume_from == AV_NOPTS_VALUE)
+    return 0;
+  int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+  int64_t t = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, tb, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+  if (type == AVMEDIA_TYPE_VIDEO && !session->resume_video_started) {
+    int drop = !(pkt->flags & AV_PKT_FLAG_KEY) || t == AV_NOPTS_VALUE || t < session->resume_from;
+    session->resume_video_started = !drop;
+    return drop;
+  }
+  return t != AV_NOPTS_VALUE && t < session->resume_from;
+}
 
-JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_appendVideoSegmentToHls
-  (JNIEnv *env, jclass clazz, jlong sessionPtr, jstring inputFilePathJ) {
-  HlsSession *session = (HlsSession *) sessionPtr;
-  if (!session || !session->ofmt_ctx) {
-    return (*env)->NewStringUTF(env, "Invalid HLS session pointer");
+// 按输出流初始化逐路时间线（恢复的会话从已提交的时间偏移开始）
+static void ensure_session_stitcher(HlsSession *session) {
+  if (session->stitcher_ready)
+    return;
+  HlsWriter *writer = &session->writer;
+  enum AVMediaType types[HLS_WRITER_MAX_STREAMS];
+  int nb_streams = (int) writer->mux->nb_streams;
+  for (int i = 0; i < nb_streams; i++)
+    types[i] = writer->mux->streams[i]->codecpar->codec_type;
+  stream_stitcher_init(&session->stitcher, nb_streams, types, writer->in_time_base, session->global_offset);
+  session->stitcher_ready = 1;
+}
+
+// 写入一个时间戳已是最终值的数据包，数据包的引用会被消耗
+static int write_session_output(void *opaque, AVPacket *pkt) {
+  HlsSession *session = (HlsSession *) opaque;
+  HlsWriter *writer = &session->writer;
+  int out_index = pkt->stream_index;
+  if (drop_for_resume(session, writer->mux->streams[out_index]->codecpar->codec_type, pkt,
+                      writer->in_time_base[out_index])) {
+    av_packet_unref(pkt);
+    return 0;
   }
+  int ret = hls_writer_write_packet(writer, pkt);
+  av_packet_unref(pkt);
+  return ret;
+}
 
-  const char *inputFilePath = (*env)->GetStringUTFChars(env, inputFilePathJ, NULL);
-  if (!inputFilePath) {
-    return (*env)->NewStringUTF(env, "Failed to get input file path");
+/*
+ * 写入一个已转换到输出时间基（尚未加偏移）的数据包，数据包的引用会被消耗
+ * 偏移按该路流的时间线计算，与已写入数据重叠的音频包丢弃
+ */
+static int write_session_packet(HlsSession *session, AVPacket *pkt, int out_index) {
+  pkt->pos = -1;
+  pkt->stream_index = out_index;
+  if (!stream_stitcher_map(&session->stitcher, out_index, pkt)) {
+    av_packet_unref(pkt);
+    return 0;
   }
+  return write_session_output(session, pkt);
+}
+
+// 补齐各音频流在上一个任务结束与当前任务开始之间的空隙
+static int pad_session_gaps(HlsSession *session) {
+  HlsWriter *writer = &session->writer;
+  int ret = 0;
+  for (unsigned int j = 0; j < writer->mux->nb_streams && ret >= 0; j++)
+    ret = stream_stitcher_pad(&session->stitcher, (int) j, writer->mux->streams[j]->codecpar,
+                              write_session_output, session);
+  return ret;
+}
+
+// 取出转码器中已编码的数据包写入会话
+static int write_transcoded_packets(HlsSession *session, StreamTranscoder *transcoder, int out_index) {
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+    return AVERROR(ENOMEM);
+  int ret;
+  while ((ret = stream_transcoder_receive(transcoder, pkt)) >= 0) {
+    if ((ret = write_session_packet(session, pkt, out_index)) < 0)
+      break;
+  }
+  av_packet_free(&pkt);
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 处理输入文件的一个数据包：转码的流送入转码器，其余流转换到输出时间基后写入，数据包的引用会被消耗
+static int append_session_packet(HlsSession *session, AVFormatContext *ifmt_ctx, const int *in_index,
+                                 StreamTranscoder **transcoders, int nb_out, AVPacket *pkt) {
+  int out_index = -1;
+  for (int j = 0; j < nb_out; j++) {
+    if (in_index[j] == pkt->stream_index) {
+      out_index = j;
+      break;
+    }
+  }
+  if (out_index < 0) {
+    av_packet_unref(pkt);
+    return 0;
+  }
+  AVStream *in_stream = ifmt_ctx->streams[pkt->stream_index];
+
+  if (transcoders[out_index]) {
+    int ret = stream_transcoder_send(transcoders[out_index], pkt);
+    av_packet_unref(pkt);
+    return ret < 0 ? ret : write_transcoded_packets(session, transcoders[out_index], out_index);
+  }
+
+  AVRational out_tb = session->writer.in_time_base[out_index];
+  pkt->pts = av_rescale_q(pkt->pts, in_stream->time_base, out_tb);
+  pkt->dts = av_rescale_q(pkt->dts, in_stream->time_base, out_tb);
+  if (pkt->duration > 0)
+    pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_tb);
+  return write_session_packet(session, pkt, out_index);
+}
+
+/*
+ * 将一个输入文件重封装追加到会话中（仅由 worker 线程调用）
+ * 与会话输出参数一致的流直接重封装，不一致的流（分辨率、profile、采样率等）转码为会话参数
+ * 结果描述写入 msg，成功返回 0，失败返回负错误码
+ */
+static int hls_session_append_file(HlsSession *session, const char *inputFilePath, char *msg, size_t msg_size) {
+  HlsWriter *writer = &session->writer;
 
   AVFormatContext *ifmt_ctx = NULL;
   int ret = avformat_open_input(&ifmt_ctx, inputFilePath, NULL, NULL);
   if (ret < 0) {
     char errbuf[128] = {0};
     av_strerror(ret, errbuf, sizeof(errbuf));
-    (*env)->ReleaseStringUTFChars(env, inputFilePathJ, inputFilePath);
-    char msg[256] = {0};
-    snprintf(msg, sizeof(msg), "Failed to open input file: %s", errbuf);
-    return (*env)->NewStringUTF(env, msg);
+    snprintf(msg, msg_size, "Failed to open input file: %s", errbuf);
+    return ret;
   }
 
   ret = avformat_find_stream_info(ifmt_ctx, NULL);
   if (ret < 0) {
     avformat_close_input(&ifmt_ctx);
-    (*env)->ReleaseStringUTFChars(env, inputFilePathJ, inputFilePath);
-    return (*env)->NewStringUTF(env, "Failed to retrieve stream info from input file");
-  }
-
-  // 如果 persistent HLS 会话中还没有输出流，则首次追加：
-  if (session->ofmt_ctx->nb_streams == 0) {
-    for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
-      AVStream *in_stream = ifmt_ctx->streams[i];
-      if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ||
-          in_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-        AVStream *out_stream = avformat_new_stream(session->ofmt_ctx, NULL);
-        if (!out_stream) continue;
-        ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
-        if (ret < 0) continue;
-        out_stream->codecpar->codec_tag = 0;
-        out_stream->time_base = in_stream->time_base;
+    snprintf(msg, msg_size, "Failed to retrieve stream info from input file");
+    return ret;
+  }
+
+  // 每种类型只取一路最佳输入流（视频、音频各一路）
+  int best[2] = {
+    av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0),
+    av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0),
+  };
+
+  // 会话帧率取自第一个帧率可知的视频输入（恢复的会话从检查点取得）
+  if (best[0] >= 0 && session->video_frame_rate.num <= 0) {
+    AVRational rate = av_guess_frame_rate(ifmt_ctx, ifmt_ctx->streams[best[0]], NULL);
+    if (rate.num > 0 && rate.den > 0)
+      session->video_frame_rate = rate;
+  }
+
+  // 如果 persistent HLS 会话中还没有输出流，则首次追加：输出流参数取自该输入
+  if (!writer->header_written) {
+    for (int i = 0; i < 2; i++) {
+      if (best[i] < 0)
+        continue;
+      AVStream *in_stream = ifmt_ctx->streams[best[i]];
+      ret = hls_writer_add_stream(writer, in_stream->codecpar, in_stream->time_base);
+      if (ret < 0) {
+        char errbuf[128] = {0};
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        snprintf(msg, msg_size, "Failed to add %s stream to HLS output: %s",
+                 av_get_media_type_string(in_stream->codecpar->codec_type), errbuf);
+        avformat_close_input(&ifmt_ctx);
+        return ret;
       }
     }
-    // 使用保存的 opts 调用 avformat_write_header
-    ret = avformat_write_header(session->ofmt_ctx, &session->opts);
+    ret = hls_writer_write_header(writer);
     if (ret < 0) {
       avformat_close_input(&ifmt_ctx);
-      (*env)->ReleaseStringUTFChars(env, inputFilePathJ, inputFilePath);
-      return (*env)->NewStringUTF(env, "Failed to write header on first segment append");
-    }
-    session->header_written = 1;
-    // 释放 opts 后不再需要
-    av_dict_free(&session->opts);
-  }
-
-  // 计算输入文件音视频流的最大时长（单位转换为 AV_TIME_BASE）
-  int64_t file_duration = 0;
-  for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
-    AVStream *in_stream = ifmt_ctx->streams[i];
-    if (in_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ||
-        in_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-      if (in_stream->duration > 0) {
-        int64_t dur = av_rescale_q(in_stream->duration, in_stream->time_base, AV_TIME_BASE_Q);
-        if (dur > file_duration)
-          file_duration = dur;
-      }
+      snprintf(msg, msg_size, "Failed to write header on first segment append");
+      return ret;
     }
+    // 首个检查点：此时还没有完成的分段，恢复时从头开始
+    write_session_checkpoint(session, AV_NOPTS_VALUE);
   }
 
-  AVPacket pkt;
-  while (av_read_frame(ifmt_ctx, &pkt) >= 0) {
-    AVStream *in_stream = ifmt_ctx->streams[pkt.stream_index];
-    if (in_stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
-        in_stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
-      av_packet_unref(&pkt);
+  // 为每个输出流找到同类型的输入流；编码参数与会话不一致的流转码为会话参数，其余直接重封装
+  int in_index[HLS_WRITER_MAX_STREAMS];
+  StreamTranscoder *transcoders[HLS_WRITER_MAX_STREAMS] = {0};
+  int nb_out = (int) writer->mux->nb_streams;
+  int nb_transcoded = 0;
+  for (int j = 0; j < nb_out && ret >= 0; j++) {
+    const AVCodecParameters *target = writer->mux->streams[j]->codecpar;
+    in_index[j] = target->codec_type == AVMEDIA_TYPE_VIDEO ? best[0]
+                : target->codec_type == AVMEDIA_TYPE_AUDIO ? best[1] : -1;
+    if (in_index[j] < 0)
       continue;
+    AVStream *in_stream = ifmt_ctx->streams[in_index[j]];
+    if (stream_params_match(in_stream->codecpar, target))
+      continue;
+    AVRational frame_rate = av_guess_frame_rate(ifmt_ctx, in_stream, NULL);
+    AVRational session_rate = session->video_frame_rate.num > 0 ? session->video_frame_rate : frame_rate;
+    int gop_size = session_rate.num > 0 && session_rate.den > 0
+                   ? (int) (session->segDuration * av_q2d(session_rate) + 0.5) : 0;
+    ret = stream_transcoder_open(&transcoders[j], in_stream->codecpar, in_stream->time_base, target,
+                                 writer->in_time_base[j], frame_rate, gop_size);
+    if (ret < 0) {
+      char errbuf[128] = {0};
+      av_strerror(ret, errbuf, sizeof(errbuf));
+      snprintf(msg, msg_size, "Failed to open transcoder for mismatched %s stream: %s",
+               av_get_media_type_string(target->codec_type), errbuf);
     }
+    nb_transcoded++;
+  }
+  if (ret < 0) {
+    for (int j = 0; j < nb_out; j++)
+      stream_transcoder_free(&transcoders[j]);
+    avformat_close_input(&ifmt_ctx);
+    return ret;
+  }
 
-    // 按流类型匹配：假设只有一个视频流和一个音频流
-    int out_index = -1;
-    for (unsigned int j = 0; j < session->ofmt_ctx->nb_streams; j++) {
-      AVStream *out_stream = session->ofmt_ctx->streams[j];
-      if (out_stream->codecpar->codec_type == in_stream->codecpar->codec_type) {
-        out_index = j;
-        break;
-      }
+  // 预读开头的数据包以确定各路流的起始时间，补齐上一个任务留下的音频空隙后按读取顺序写入
+  ensure_session_stitcher(session);
+  AVPacket *head[STITCH_HEAD_PACKETS];
+  int nb_head = 0;
+  ret = stream_stitcher_begin_input(&session->stitcher, ifmt_ctx, in_index, head, STITCH_HEAD_PACKETS, &nb_head);
+  if (ret >= 0)
+    ret = pad_session_gaps(session);
+
+  AVPacket pkt;
+  for (int k = 0; k < nb_head; k++) {
+    if (ret >= 0) {
+      av_packet_move_ref(&pkt, head[k]);
+      ret = append_session_packet(session, ifmt_ctx, in_index, transcoders, nb_out, &pkt);
     }
-    if (out_index < 0) {
-      av_packet_unref(&pkt);
+    av_packet_free(&head[k]);
+  }
+  while (ret >= 0 && av_read_frame(ifmt_ctx, &pkt) >= 0)
+    ret = append_session_packet(session, ifmt_ctx, in_index, transcoders, nb_out, &pkt);
+
+  // 刷出各转码器中剩余的数据
+  for (int j = 0; j < nb_out; j++) {
+    if (!transcoders[j])
       continue;
+    if (ret >= 0)
+      ret = stream_transcoder_send(transcoders[j], NULL);
+    if (ret >= 0)
+      ret = write_transcoded_packets(session, transcoders[j], j);
+    stream_transcoder_free(&transcoders[j]);
+  }
+
+  // 时间线末尾推进到本文件视频（无视频时为各流）的结束时间，下一个文件从这里衔接
+  session->global_offset = stream_stitcher_end_input(&session->stitcher);
+
+  avformat_close_input(&ifmt_ctx);
+
+  if (ret < 0) {
+    snprintf(msg, msg_size, "Failed to write packet while appending %s", inputFilePath);
+    return ret;
+  }
+  if (nb_transcoded > 0)
+    snprintf(msg, msg_size, "Appended video segment successfully (transcoded %d mismatched stream(s)), "
+                            "updated global offset to %lld", nb_transcoded, (long long) session->global_offset);
+  else
+    snprintf(msg, msg_size,
+             "Appended video segment successfully, updated global offset to %lld", (long long) session->global_offset);
+  return 0;
+}
+
+/*
+ * 在当前时间线末尾插入一段静音音频 + 黑帧视频（仅由 worker 线程调用）
+ * 片段按输出流编码参数与时长量化值缓存，重复插入只重打时间戳，不再编码
+ */
+static int hls_session_append_silence(HlsSession *session, double duration, char *msg, size_t msg_size) {
+  HlsWriter *writer = &session->writer;
+  if (!writer->header_written) {
+    snprintf(msg, msg_size, "Cannot insert silent segment before the first video segment is appended");
+    return AVERROR(EINVAL);
+  }
+
+  SilenceStreamSpec specs[HLS_WRITER_MAX_STREAMS];
+  int nb_streams = (int) writer->mux->nb_streams;
+  for (int i = 0; i < nb_streams; i++) {
+    specs[i].par = writer->mux->streams[i]->codecpar;
+    specs[i].time_base = writer->in_time_base[i];
+    specs[i].frame_rate = session->video_frame_rate;
+  }
+  SilenceClip *clip = NULL;
+  int ret = silence_cache_get(specs, nb_streams, duration, &clip);
+  if (ret < 0) {
+    char errbuf[128] = {0};
+    av_strerror(ret, errbuf, sizeof(errbuf));
+    snprintf(msg, msg_size, "Failed to prepare silent segment: %s", errbuf);
+    return ret;
+  }
+
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt) {
+    silence_clip_unref(&clip);
+    snprintf(msg, msg_size, "Failed to allocate packet");
+    return AVERROR(ENOMEM);
+  }
+  // 片段的各路流都从 0 开始，与文件一样对齐到时间线末尾
+  ensure_session_stitcher(session);
+  int64_t first_ts[HLS_WRITER_MAX_STREAMS] = {0};
+  stream_stitcher_begin(&session->stitcher, first_ts, first_ts);
+  ret = pad_session_gaps(session);
+  for (int i = 0; i < clip->nb_packets && ret >= 0; i++) {
+    if ((ret = av_packet_ref(pkt, clip->packets[i])) < 0)
+      break;
+    ret = write_session_packet(session, pkt, pkt->stream_index);
+  }
+  av_packet_free(&pkt);
+
+  session->global_offset = stream_stitcher_end_input(&session->stitcher);
+  double inserted = clip->duration / (double) AV_TIME_BASE;
+  silence_clip_unref(&clip);
+
+  if (ret < 0) {
+    snprintf(msg, msg_size, "Failed to write packet while inserting silent segment");
+    return ret;
+  }
+  snprintf(msg, msg_size, "Inserted silent segment of %.1f seconds, updated global offset to %lld",
+           inserted, (long long) session->global_offset);
+  return 0;
+}
+
+// 后台 worker：按入队顺序逐个处理追加任务，直到队列关闭且清空
+static void *hls_session_worker(void *arg) {
+  HlsSession *session = (HlsSession *) arg;
+  void *item = NULL;
+  while (native_queue_pop(session->jobs, &item)) {
+    HlsAppendJob *job = (HlsAppendJob *) item;
+    char msg[256] = {0};
+    int ret;
+    int64_t start_us = native_time_us();
+    if (native_atomic_load_u32(&session->aborting)) {
+      ret = AVERROR_EXIT;
+      snprintf(msg, sizeof(msg), "Session freed before segment was appended");
+    } else if (job->input_path) {
+      ret = hls_session_append_file(session, job->input_path, msg, sizeof(msg));
+    } else {
+      ret = hls_session_append_silence(session, job->silence_duration, msg, sizeof(msg));
     }
-    AVStream *out_stream = session->ofmt_ctx->streams[out_index];
-
-    // 将 pkt 时间戳转换后加上全局偏移
-    int64_t offset = av_rescale_q(session->global_offset, AV_TIME_BASE_Q, out_stream->time_base);
-    pkt.pts = av_rescale_q(pkt.pts, in_stream->time_base, out_stream->time_base) + offset;
-    pkt.dts = av_rescale_q(pkt.dts, in_stream->time_base, out_stream->time_base) + offset;
-    if (pkt.duration > 0)
-      pkt.duration = av_rescale_q(pkt.duration, in_stream->time_base, out_stream->time_base);
-    pkt.pos = -1;
-    pkt.stream_index = out_index;
-
-    ret = av_interleaved_write_frame(session->ofmt_ctx, &pkt);
+    // 只有成功的任务进入待提交表；失败的任务（包括 AVERROR_EXIT 丢弃的任务）单独记录票据
+    if (ret >= 0 && (ret = add_pending_input(session, job->ticket)) < 0)
+      snprintf(msg, sizeof(msg), "Failed to record appended segment for checkpoint");
     if (ret < 0) {
-      av_packet_unref(&pkt);
-      break;
+      set_session_error(session, msg);
+      native_atomic_store_i64(&session->failed_ticket, job->ticket);
     }
-    av_packet_unref(&pkt);
+    native_atomic_add_i64(&session->stat_job_us, native_time_us() - start_us);
+    native_atomic_add_i64(&session->stat_jobs, 1);
+    update_session_stats(session);
+    native_atomic_store_i64(&session->completed_ticket, job->ticket);
+    complete_append_job(job, msg);
+  }
+  return NULL;
+}
+
+/*
+ * 向会话入队（队列满时阻塞，形成背压），成功返回任务票据，会话无效返回 -2，会话正在关闭返回 -1
+ * 会话锁只在登记入队者时短暂持有，等待队列空位时不持有，
+ * 因此背压不会阻塞 listHlsSession、空闲回收等需要会话锁的操作
+ */
+static int64_t submit_append_job(jlong sessionPtr, HlsAppendJob *job) {
+  HlsSession *session = hls_table_acquire(sessionPtr);
+  if (!session)
+    return -2;
+  native_atomic_add_u32(&session->pushers, 1);
+  hls_table_release(sessionPtr);
+
+  native_mutex_lock(&session->enqueue_lock);
+  int64_t ticket = native_atomic_load_i64(&session->next_ticket) + 1;
+  job->ticket = ticket;
+  native_atomic_store_i64(&session->next_ticket, ticket);
+  if (native_queue_push(session->jobs, job) < 0) {
+    native_atomic_store_i64(&session->next_ticket, ticket - 1);
+    ticket = -1;
+  } else {
+    native_atomic_store_i64(&session->last_activity, (int64_t) time(NULL));
   }
+  native_mutex_unlock(&session->enqueue_lock);
 
-  // 累计更新全局时间偏移，确保下一个分段在时间上衔接
-  session->global_offset += file_duration;
+  // 之后不能再访问 session：计数归零后会话可能被释放
+  native_atomic_add_u32(&session->pushers, (uint32_t) -1);
+  return ticket;
+}
 
-  avformat_close_input(&ifmt_ctx);
+// 入队一个可等待的任务并等待其完成，返回结果描述（job 由本函数释放）
+static jstring run_sync_job(JNIEnv *env, jlong sessionPtr, HlsAppendJob *job) {
+  int64_t ticket = submit_append_job(sessionPtr, job);
+  if (ticket < 0) {
+    free_append_job(job);
+    return (*env)->NewStringUTF(env, ticket == -2 ? "Invalid HLS session pointer" : "HLS session is closing");
+  }
+
+  // 不持有会话锁等待，期间其他线程仍可向同一会话入队
+  native_mutex_lock(&job->lock);
+  while (!job->done)
+    native_cond_wait(&job->cond, &job->lock);
+  native_mutex_unlock(&job->lock);
+
+  jstring result = (*env)->NewStringUTF(env, job->result);
+  free_append_job(job);
+  return result;
+}
+
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_appendVideoSegmentToHls
+  (JNIEnv *env, jclass clazz, jlong sessionPtr, jstring inputFilePathJ) {
+  const char *inputFilePath = (*env)->GetStringUTFChars(env, inputFilePathJ, NULL);
+  if (!inputFilePath) {
+    return (*env)->NewStringUTF(env, "Failed to get input file path");
+  }
+  HlsAppendJob *job = alloc_append_job(inputFilePath, 1);
   (*env)->ReleaseStringUTFChars(env, inputFilePathJ, inputFilePath);
+  if (!job) {
+    return (*env)->NewStringUTF(env, "Failed to allocate append job");
+  }
 
-  char resultMsg[256] = {0};
-  snprintf(resultMsg, sizeof(resultMsg),
-           "Appended video segment successfully, updated global offset to %lld", session->global_offset);
-  return (*env)->NewStringUTF(env, resultMsg);
+  // 同步追加也走会话队列，保证与异步追加的先后顺序一致
+  return run_sync_job(env, sessionPtr, job);
+}
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    insertSilentSegment
+ * Signature: (JD)Ljava/lang/String;
+ *
+ * 在会话当前时间线末尾插入 duration 秒（按 100ms 量化）的静音音频 + 黑帧视频，
+ * 与追加请求共用同一个队列，因此顺序与调用顺序一致。
+ * 编码参数取自会话的输出流，必须在第一次追加之后调用。
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_insertSilentSegment
+  (JNIEnv *env, jclass clazz, jlong sessionPtr, jdouble duration) {
+  if (!(duration > 0)) {
+    return (*env)->NewStringUTF(env, "Silent segment duration must be positive");
+  }
+  HlsAppendJob *job = alloc_append_job(NULL, 1);
+  if (!job) {
+    return (*env)->NewStringUTF(env, "Failed to allocate append job");
+  }
+  job->silence_duration = duration;
+  return run_sync_job(env, sessionPtr, job);
 }
 
+/*
+ * 异步追加：入队后立即返回任务票据（>0），失败返回 -1。
+ * 任务在会话的后台线程中按顺序完成，可通过 getCompletedHlsTicket 查询进度、getFailedHlsTicket 查询失败的任务，
+ * finishPersistentHls 会先处理完所有已入队的任务。
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_appendVideoSegmentToHlsAsync
+  (JNIEnv *env, jclass clazz, jlong sessionPtr, jstring inputFilePathJ) {
+  const char *inputFilePath = (*env)->GetStringUTFChars(env, inputFilePathJ, NULL);
+  if (!inputFilePath) {
+    return -1;
+  }
+  HlsAppendJob *job = alloc_append_job(inputFilePath, 0);
+  (*env)->ReleaseStringUTFChars(env, inputFilePathJ, inputFilePath);
+  if (!job) {
+    return -1;
+  }
+
+  int64_t ticket = submit_append_job(sessionPtr, job);
+  if (ticket < 0) {
+    free_append_job(job);
+    return -1;
+  }
+  return (jlong) ticket;
+}
 
-JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_listHlsSession
-  (JNIEnv *env, jclass clazz) {
-  // 构造 JSON 数组字符串，格式示例：
-  // [ {"sessionPtr":123456, "createdTime": "2025-04-12 09:30:00", "globalOffset": 1000}, {...} ]
-  char buffer[4096] = {0};
-  strcat(buffer, "[");
-
-  HlsSessionNode *curr = g_hlsSessionHead;
-  int first = 1;
-  char timeStr[64] = {0};
-  while (curr) {
-    if (!first) {
-      strcat(buffer, ",");
-    } else {
-      first = 0;
+/*
+ * 查询会话中已处理完成的最大任务票据，会话无效返回 -1
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_getCompletedHlsTicket
+  (JNIEnv *env, jclass clazz, jlong sessionPtr) {
+  HlsSession *session = hls_table_acquire(sessionPtr);
+  if (!session) {
+    return -1;
+  }
+  int64_t completed = native_atomic_load_i64(&session->completed_ticket);
+  hls_table_release(sessionPtr);
+  return (jlong) completed;
+}
+
+/*
+ * 查询会话中最近一次失败的任务票据，没有失败的任务返回 0，会话无效返回 -1
+ * 失败原因见 listHlsSession 中的 lastError
+ */
+JNIEXPORT jlong JNICALL Java_com_litongjava_media_NativeMedia_getFailedHlsTicket
+  (JNIEnv *env, jclass clazz, jlong sessionPtr) {
+  HlsSession *session = hls_table_acquire(sessionPtr);
+  if (!session) {
+    return -1;
+  }
+  int64_t failed = native_atomic_load_i64(&session->failed_ticket);
+  hls_table_release(sessionPtr);
+  return (jlong) failed;
+}
+
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    awaitHlsPlaylistUpdate
+ * Signature: (JJII)I
+ *
+ * LL-HLS 阻塞式播放列表重载：HTTP 层收到带 _HLS_msn=M（以及可选 _HLS_part=P）的请求时调用，
+ * 阻塞到播放列表包含媒体序号 M 的分段（part >= 0 时为该分段的第 P 个部分分段）后再返回播放列表。
+ * part 为 -1 表示请求中没有 _HLS_part；timeoutMs < 0 表示一直等待。
+ * 返回 1 表示已可用，0 表示超时，-1 表示会话无效或已结束而条件仍未满足。
+ * 等待期间不持有会话锁，不影响追加与其他查询。
+ */
+JNIEXPORT jint JNICALL Java_com_litongjava_media_NativeMedia_awaitHlsPlaylistUpdate
+  (JNIEnv *env, jclass clazz, jlong sessionPtr, jlong msn, jint part, jint timeoutMs) {
+  HlsSession *session = hls_table_acquire(sessionPtr);
+  if (!session) {
+    return -1;
+  }
+  // 与入队方共用计数：计数归零之前会话不会被释放或回收
+  native_atomic_add_u32(&session->pushers, 1);
+  hls_table_release(sessionPtr);
+
+  int64_t deadline = timeoutMs >= 0 ? native_time_us() + (int64_t) timeoutMs * 1000 : -1;
+  int result = 0;
+  native_mutex_lock(&session->publish_lock);
+  for (;;) {
+    // 媒体序号 M 的分段已完成，或正在进行且已发布了第 P 个部分分段
+    if (session->published_msn > msn || (part >= 0 && session->published_msn == msn && session->published_parts > part)) {
+      result = 1;
+      break;
+    }
+    if (session->publish_closed) {
+      result = -1;
+      break;
     }
-    // 格式化创建时间为字符串
-    struct tm *tm_info = localtime(&(curr->session->created_time));
-    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", tm_info);
-    char item[256] = {0};
-    snprintf(item, sizeof(item),
-             "{\"sessionPtr\":%llu,\"createdTime\":\"%s\",\"globalOffset\":%lld}",
-             (unsigned long long) (uintptr_t) curr->session, timeStr, curr->session->global_offset);
-    strcat(buffer, item);
-    curr = curr->next;
+    int64_t remaining_ms = deadline < 0 ? -1 : (deadline - native_time_us()) / 1000;
+    if (deadline >= 0 && remaining_ms <= 0)
+      break;
+    native_cond_timedwait_ms(&session->publish_cond, &session->publish_lock, remaining_ms);
+  }
+  native_mutex_unlock(&session->publish_lock);
+
+  // 之后不能再访问 session
+  native_atomic_add_u32(&session->pushers, (uint32_t) -1);
+  return result;
+}
+
+// 格式化本地时间
+static void format_local_time(time_t t, char *buf, size_t size) {
+  struct tm tm_info;
+#ifdef _WIN32
+  localtime_s(&tm_info, &t);
+#else
+  localtime_r(&t, &tm_info);
+#endif
+  strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm_info);
+}
+
+// 输出带引号的 JSON 字符串
+static void bprint_json_string(AVBPrint *bp, const char *str) {
+  av_bprint_chars(bp, '"', 1);
+  for (const unsigned char *p = (const unsigned char *) str; p && *p; p++) {
+    if (*p == '"' || *p == '\\')
+      av_bprintf(bp, "\\%c", *p);
+    else if (*p < 0x20)
+      av_bprintf(bp, "\\u%04x", *p);
+    else
+      av_bprint_chars(bp, (char) *p, 1);
   }
-  strcat(buffer, "]");
-  return (*env)->NewStringUTF(env, buffer);
+  av_bprint_chars(bp, '"', 1);
+}
+
+/*
+ * 输出一个会话的统计快照（回调期间持有会话锁，只读取原子快照与 last_error，不等待 worker）
+ */
+static void append_session_json(int64_t handle, HlsSession *session, void *opaque) {
+  AVBPrint *bp = (AVBPrint *) opaque;
+  char created[64] = {0}, activity[64] = {0};
+  int64_t last_activity = native_atomic_load_i64(&session->last_activity);
+  format_local_time(session->created_time, created, sizeof(created));
+  format_local_time((time_t) last_activity, activity, sizeof(activity));
+
+  int64_t jobs = native_atomic_load_i64(&session->stat_jobs);
+  int64_t job_us = native_atomic_load_i64(&session->stat_job_us);
+  int64_t next_ticket = native_atomic_load_i64(&session->next_ticket);
+  int64_t completed = native_atomic_load_i64(&session->completed_ticket);
+  char last_error[256] = {0};
+  native_mutex_lock(&session->state_lock);
+  snprintf(last_error, sizeof(last_error), "%s", session->last_error);
+  native_mutex_unlock(&session->state_lock);
+
+  if (bp->len > 1)
+    av_bprint_chars(bp, ',', 1);
+  av_bprintf(bp, "{\"sessionPtr\":%lld,\"createdTime\":\"%s\",\"globalOffset\":%lld,\"playlist\":",
+             (long long) handle, created, (long long) native_atomic_load_i64(&session->stat_global_offset));
+  bprint_json_string(bp, session->writer.playlist.path);
+  av_bprintf(bp, ",\"segments\":%lld,\"bytes\":%lld,\"appends\":%lld,\"avgMuxMs\":%.3f",
+             (long long) native_atomic_load_i64(&session->stat_segments),
+             (long long) native_atomic_load_i64(&session->stat_bytes),
+             (long long) jobs, jobs > 0 ? job_us / 1000.0 / jobs : 0.0);
+  av_bprintf(bp, ",\"queueDepth\":%lld,\"completedTicket\":%lld,\"lastActivity\":\"%s\",\"idleSeconds\":%lld",
+             (long long) (next_ticket - completed), (long long) completed, activity,
+             (long long) (time(NULL) - last_activity));
+  av_bprintf(bp, ",\"memoryBytes\":%lld,\"failedTicket\":%lld,\"lastError\":",
+             (long long) native_atomic_load_i64(&session->stat_memory),
+             (long long) native_atomic_load_i64(&session->failed_ticket));
+  bprint_json_string(bp, last_error);
+  av_bprint_chars(bp, '}', 1);
+}
+
+/*
+ * 返回所有会话统计信息的 JSON 数组（长度不受限制），格式示例：
+ * [{"sessionPtr":4294967297,"createdTime":"2025-04-12 09:30:00","globalOffset":1000,"playlist":"...",
+ *   "segments":12,"bytes":1048576,"appends":6,"avgMuxMs":3.512,"queueDepth":0,"completedTicket":6,
+ *   "lastActivity":"2025-04-12 09:31:00","idleSeconds":3,"memoryBytes":70000,"failedTicket":0,"lastError":""}, ...]
+ * 每个会话只在读取快照的瞬间持有其会话锁，可以被监控接口频繁轮询而不阻塞追加。
+ */
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_listHlsSession
+  (JNIEnv *env, jclass clazz) {
+  AVBPrint bp;
+  av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+  av_bprint_chars(&bp, '[', 1);
+  hls_table_foreach(append_session_json, &bp);
+  av_bprint_chars(&bp, ']', 1);
+
+  jstring result = av_bprint_is_complete(&bp) ? (*env)->NewStringUTF(env, bp.str) : (*env)->NewStringUTF(env, "[]");
+  av_bprint_finalize(&bp, NULL);
+  return result;
 }
 
 /* 新增：直接释放 HLS 会话，不需要传递播放列表路径 */
 JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_freeHlsSession
   (JNIEnv *env, jclass clazz, jlong sessionPtr) {
-  // 将 sessionPtr 转换为 HlsSession 指针
-  HlsSession *sessionInput = (HlsSession *) (uintptr_t) sessionPtr;
-  // 通过全局列表查找该会话是否还存活
-  HlsSession *session = find_hls_session(sessionInput);
-  
+  // 通过句柄表查找该会话是否还存活（过期句柄会被代数校验拒绝）
+  HlsSession *session = hls_table_acquire(sessionPtr);
   if (!session) {
     return (*env)->NewStringUTF(env, "Invalid session pointer");
   }
 
-  // 如果已经关闭了，直接返回
-  if (session->closed) {
-    return (*env)->NewStringUTF(env, "Session already freed");
+  // 从句柄表中删除该会话，然后关闭输出文件并释放会话资源
+  hls_table_remove(sessionPtr);
+  free_hls_session(session);
+
+  return (*env)->NewStringUTF(env, "HLS session freed successfully");
+}
+
+
+/*
+ * 空闲会话回收
+ *
+ * Java 端在调用 finishPersistentHls / freeHlsSession 之前崩溃时，会话会一直占用复用器、
+ * 文件句柄与缓冲区。设置空闲超时后，后台线程定期回收超过超时时间没有任何追加、且队列已清空的会话：
+ * 写入 trailer 并完成最后一个分段，播放列表保持未结束状态，检查点保留，
+ * 因此被回收的会话仍可通过 resumePersistentHls 恢复。
+ */
+
+static native_mutex_t g_reaper_control = NATIVE_MUTEX_INITIALIZER; // 串行化回收线程的启动与停止
+static native_thread_t g_reaper_thread;  // 受 g_reaper_control 保护
+static int g_reaper_started = 0;         // 受 g_reaper_control 保护
+static native_mutex_t g_reaper_lock = NATIVE_MUTEX_INITIALIZER;
+static native_cond_t g_reaper_cond = NATIVE_COND_INITIALIZER;
+static int64_t g_idle_timeout = 0; // 秒，0 表示不回收（受 g_reaper_lock 保护）
+static int g_reaper_stop = 0;      // 1 表示回收线程应退出（受 g_reaper_lock 保护）
+
+typedef struct HlsIdleScan {
+  int64_t now;
+  int64_t timeout;
+  int64_t *handles;
+  int nb_handles;
+  int capacity;
+} HlsIdleScan;
+
+// 调用方持有会话锁：队列为空且超过超时时间没有活动
+static int hls_session_is_idle(HlsSession *session, int64_t now, int64_t timeout) {
+  return native_atomic_load_u32(&session->pushers) == 0 &&
+         native_atomic_load_i64(&session->completed_ticket) == native_atomic_load_i64(&session->next_ticket) &&
+         now - native_atomic_load_i64(&session->last_activity) >= timeout;
+}
+
+static void collect_idle_session(int64_t handle, HlsSession *session, void *opaque) {
+  HlsIdleScan *scan = (HlsIdleScan *) opaque;
+  if (!hls_session_is_idle(session, scan->now, scan->timeout))
+    return;
+  if (scan->nb_handles >= scan->capacity) {
+    int capacity = scan->capacity ? scan->capacity * 2 : 16;
+    int64_t *handles = (int64_t *) realloc(scan->handles, capacity * sizeof(int64_t));
+    if (!handles)
+      return;
+    scan->handles = handles;
+    scan->capacity = capacity;
   }
-  // 如果输出上下文存在且打开了输出文件，则关闭输出文件
-  if (session->ofmt_ctx) {
-    if (!(session->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-      avio_closep(&session->ofmt_ctx->pb);
-    avformat_free_context(session->ofmt_ctx);
+  scan->handles[scan->nb_handles++] = handle;
+}
+
+static void reap_idle_sessions(int64_t timeout) {
+  HlsIdleScan scan = {(int64_t) time(NULL), timeout, NULL, 0, 0};
+  // 遍历时只收集句柄，回收在遍历结束后逐个进行，避免在 foreach 回调中移除槽位
+  hls_table_foreach(collect_idle_session, &scan);
+
+  for (int i = 0; i < scan.nb_handles; i++) {
+    HlsSession *session = hls_table_acquire(scan.handles[i]);
+    if (!session)
+      continue;
+    // 收集之后可能又有新的追加，重新确认
+    if (!hls_session_is_idle(session, (int64_t) time(NULL), timeout)) {
+      hls_table_release(scan.handles[i]);
+      continue;
+    }
+    hls_table_remove(scan.handles[i]);
+
+    stop_hls_worker(session, 0);
+    hls_writer_close(&session->writer, 0);
+    session->writer_opened = 0;
+    free_hls_session(session);
   }
+  free(scan.handles);
+}
 
-  // 从全局会话列表中删除该会话
-  remove_hls_session(session);
+static void *hls_reaper_thread(void *arg) {
+  (void) arg;
+  native_mutex_lock(&g_reaper_lock);
+  while (!g_reaper_stop) {
+    int64_t timeout = g_idle_timeout;
+    if (timeout <= 0) {
+      native_cond_wait(&g_reaper_cond, &g_reaper_lock);
+      continue;
+    }
+    int64_t interval = timeout < HLS_REAPER_MAX_INTERVAL ? timeout : HLS_REAPER_MAX_INTERVAL;
+    native_cond_timedwait_ms(&g_reaper_cond, &g_reaper_lock, interval * 1000);
+    timeout = g_idle_timeout;
+    if (g_reaper_stop || timeout <= 0)
+      continue;
+    native_mutex_unlock(&g_reaper_lock);
+    reap_idle_sessions(timeout);
+    native_mutex_lock(&g_reaper_lock);
+  }
+  native_mutex_unlock(&g_reaper_lock);
+  return NULL;
+}
 
-  // 释放会话结构体中分配的资源
-  if (session->ts_pattern)
-    free(session->ts_pattern);
-  free(session);
+/*
+ * Class:     com_litongjava_media_NativeMedia
+ * Method:    setHlsSessionIdleTimeout
+ * Signature: (I)V
+ *
+ * 设置持久 HLS 会话的空闲超时（秒），0 或负数表示不回收。
+ * 设置正数时启动后台回收线程，设置为 0 时停止并等待回收线程退出（正在进行的回收会先完成）。
+ */
+JNIEXPORT void JNICALL Java_com_litongjava_media_NativeMedia_setHlsSessionIdleTimeout
+  (JNIEnv *env, jclass clazz, jint seconds) {
+  native_mutex_lock(&g_reaper_control);
+  native_mutex_lock(&g_reaper_lock);
+  g_idle_timeout = seconds > 0 ? seconds : 0;
+  int stop = g_idle_timeout == 0 && g_reaper_started;
+  if (stop) {
+    g_reaper_stop = 1;
+  } else if (g_idle_timeout > 0 && !g_reaper_started) {
+    g_reaper_stop = 0;
+    if (native_thread_create(&g_reaper_thread, hls_reaper_thread, NULL) == 0)
+      g_reaper_started = 1;
+  }
+  native_cond_broadcast(&g_reaper_cond);
+  native_mutex_unlock(&g_reaper_lock);
 
-  return (*env)->NewStringUTF(env, "HLS session freed successfully");
-}
\ No newline at end of file
+  // 回收线程退出前需要 g_reaper_lock，因此在释放之后再 join
+  if (stop) {
+    native_thread_join(g_reaper_thread);
+    g_reaper_started = 0;
+  }
+  native_mutex_unlock(&g_reaper_control);
+}
@@ -0,0 +1,205 @@
+#ifndef NATIVE_THREAD_H
+#define NATIVE_THREAD_H
+
+/*
+ * 跨平台线程原语的最小封装：互斥锁、条件变量、线程与原子操作。
+ * Windows 使用 SRWLOCK / CONDITION_VARIABLE / _beginthreadex，其余平台使用 pthread，
+ * 原子操作统一走 GCC/Clang 的 __atomic 内建函数或 Windows 的 Interlocked 系列。
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <process.h>
+
+typedef SRWLOCK native_mutex_t;
+typedef CONDITION_VARIABLE native_cond_t;
+typedef HANDLE native_thread_t;
+
+#define NATIVE_MUTEX_INITIALIZER SRWLOCK_INIT
+#define NATIVE_COND_INITIALIZER CONDITION_VARIABLE_INIT
+
+static inline void native_mutex_init(native_mutex_t *m) { InitializeSRWLock(m); }
+static inline void native_mutex_destroy(native_mutex_t *m) { (void) m; }
+static inline void native_mutex_lock(native_mutex_t *m) { AcquireSRWLockExclusive(m); }
+static inline void native_mutex_unlock(native_mutex_t *m) { ReleaseSRWLockExclusive(m); }
+
+static inline void native_cond_init(native_cond_t *c) { InitializeConditionVariable(c); }
+static inline void native_cond_destroy(native_cond_t *c) { (void) c; }
+static inline void native_cond_wait(native_cond_t *c, native_mutex_t *m) {
+  SleepConditionVariableSRW(c, m, INFINITE, 0);
+}
+// 返回 0 表示被唤醒，非 0 表示超时
+static inline int native_cond_timedwait_ms(native_cond_t *c, native_mutex_t *m, int64_t ms) {
+  return SleepConditionVariableSRW(c, m, ms < 0 ? INFINITE : (DWORD) ms, 0) ? 0 : 1;
+}
+static inline void native_cond_signal(native_cond_t *c) { WakeConditionVariable(c); }
+static inline void native_cond_broadcast(native_cond_t *c) { WakeAllConditionVariable(c); }
+
+typedef struct NativeThreadStart {
+  void *(*fn)(void *);
+  void *arg;
+} NativeThreadStart;
+
+// 只在 native_thread_create 中取地址，声明为 inline 避免未创建线程的翻译单元出现未使用函数警告
+static inline unsigned __stdcall native_thread_trampoline(void *p) {
+  NativeThreadStart start = *(NativeThreadStart *) p;
+  free(p);
+  start.fn(start.arg);
+  return 0;
+}
+
+static inline int native_thread_create(native_thread_t *t, void *(*fn)(void *), void *arg) {
+  NativeThreadStart *start = (NativeThreadStart *) malloc(sizeof(NativeThreadStart));
+  if (!start) return -1;
+  start->fn = fn;
+  start->arg = arg;
+  *t = (HANDLE) _beginthreadex(NULL, 0, native_thread_trampoline, start, 0, NULL);
+  if (!*t) {
+    free(start);
+    return -1;
+  }
+  return 0;
+}
+
+static inline void native_thread_join(native_thread_t t) {
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+static inline void native_thread_yield(void) { SwitchToThread(); }
+
+// 可用的逻辑处理器数量（至少为 1）
+static inline int native_cpu_count(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+}
+
+// 单调时钟（微秒），只用于计算时间间隔
+static inline int64_t native_time_us(void) {
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (int64_t) (now.QuadPart / freq.QuadPart * 1000000 + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+}
+
+static inline uint32_t native_atomic_load_u32(volatile uint32_t *p) {
+  return (uint32_t) InterlockedCompareExchange((volatile LONG *) p, 0, 0);
+}
+static inline void native_atomic_store_u32(volatile uint32_t *p, uint32_t v) {
+  InterlockedExchange((volatile LONG *) p, (LONG) v);
+}
+static inline uint32_t native_atomic_add_u32(volatile uint32_t *p, uint32_t v) {
+  return (uint32_t) InterlockedExchangeAdd((volatile LONG *) p, (LONG) v) + v;
+}
+static inline int64_t native_atomic_load_i64(volatile int64_t *p) {
+  return InterlockedCompareExchange64((volatile LONG64 *) p, 0, 0);
+}
+static inline void native_atomic_store_i64(volatile int64_t *p, int64_t v) {
+  InterlockedExchange64((volatile LONG64 *) p, v);
+}
+static inline int64_t native_atomic_add_i64(volatile int64_t *p, int64_t v) {
+  return InterlockedExchangeAdd64((volatile LONG64 *) p, v) + v;
+}
+static inline void *native_atomic_load_ptr(void *volatile *p) {
+  return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+static inline void native_atomic_store_ptr(void *volatile *p, void *v) {
+  InterlockedExchangePointer(p, v);
+}
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t native_mutex_t;
+typedef pthread_cond_t native_cond_t;
+typedef pthread_t native_thread_t;
+
+#define NATIVE_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define NATIVE_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+
+static inline void native_mutex_init(native_mutex_t *m) { pthread_mutex_init(m, NULL); }
+static inline void native_mutex_destroy(native_mutex_t *m) { pthread_mutex_destroy(m); }
+static inline void native_mutex_lock(native_mutex_t *m) { pthread_mutex_lock(m); }
+static inline void native_mutex_unlock(native_mutex_t *m) { pthread_mutex_unlock(m); }
+
+static inline void native_cond_init(native_cond_t *c) { pthread_cond_init(c, NULL); }
+static inline void native_cond_destroy(native_cond_t *c) { pthread_cond_destroy(c); }
+static inline void native_cond_wait(native_cond_t *c, native_mutex_t *m) { pthread_cond_wait(c, m); }
+// 返回 0 表示被唤醒，非 0 表示超时
+static inline int native_cond_timedwait_ms(native_cond_t *c, native_mutex_t *m, int64_t ms) {
+  if (ms < 0) {
+    pthread_cond_wait(c, m);
+    return 0;
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (long) (ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec += 1;
+    ts.tv_nsec -= 1000000000L;
+  }
+  return pthread_cond_timedwait(c, m, &ts) == ETIMEDOUT;
+}
+static inline void native_cond_signal(native_cond_t *c) { pthread_cond_signal(c); }
+static inline void native_cond_broadcast(native_cond_t *c) { pthread_cond_broadcast(c); }
+
+static inline int native_thread_create(native_thread_t *t, void *(*fn)(void *), void *arg) {
+  return pthread_create(t, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+static inline void native_thread_join(native_thread_t t) { pthread_join(t, NULL); }
+
+static inline void native_thread_yield(void) { sched_yield(); }
+
+// 可用的逻辑处理器数量（至少为 1）
+static inline int native_cpu_count(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int) n : 1;
+}
+
+// 单调时钟（微秒），只用于计算时间间隔
+static inline int64_t native_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline uint32_t native_atomic_load_u32(volatile uint32_t *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void native_atomic_store_u32(volatile uint32_t *p, uint32_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static inline uint32_t native_atomic_add_u32(volatile uint32_t *p, uint32_t v) {
+  return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+}
+static inline int64_t native_atomic_load_i64(volatile int64_t *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void native_atomic_store_i64(volatile int64_t *p, int64_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static inline int64_t native_atomic_add_i64(volatile int64_t *p, int64_t v) {
+  return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+}
+static inline void *native_atomic_load_ptr(void *volatile *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void native_atomic_store_ptr(void *volatile *p, void *v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+#endif
+
+#endif // NATIVE_THREAD_H
@@ -30,3 +30,70 @@ JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_splitVideoToHLS(
   // 将结果转换为 jstring 返回给 Java
   return (*env)->NewStringUTF(env, result);
 }
+
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_splitVideoToHLSWithOptions(
+  JNIEnv *env, jclass clazz,
+  jstring playlistUrlJ,
+  jstring inputMp4PathJ,
+  jstring tsPatternJ,
+  jint segmentDuration,
+  jstring optionsJ) {
+
+  const char *playlistUrl = (*env)->GetStringUTFChars(env, playlistUrlJ, NULL);
+  const char *inputMp4Path = (*env)->GetStringUTFChars(env, inputMp4PathJ, NULL);
+  const char *tsPattern = (*env)->GetStringUTFChars(env, tsPatternJ, NULL);
+  // options 允许为 null，表示使用默认的 MPEG-TS 分段
+  const char *options = optionsJ ? (*env)->GetStringUTFChars(env, optionsJ, NULL) : NULL;
+
+  const char *result = split_video_to_hls_with_options(playlistUrl, inputMp4Path, tsPattern, segmentDuration, options);
+
+  (*env)->ReleaseStringUTFChars(env, playlistUrlJ, playlistUrl);
+  (*env)->ReleaseStringUTFChars(env, inputMp4PathJ, inputMp4Path);
+  (*env)->ReleaseStringUTFChars(env, tsPatternJ, tsPattern);
+  if (options)
+    (*env)->ReleaseStringUTFChars(env, optionsJ, options);
+
+  return (*env)->NewStringUTF(env, result);
+}
+
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_buildHlsLadder(
+  JNIEnv *env, jclass clazz,
+  jstring inputPathJ,
+  jstring outputDirJ,
+  jstring renditionsJ,
+  jint segmentDuration,
+  jstring optionsJ) {
+
+  const char *inputPath = (*env)->GetStringUTFChars(env, inputPathJ, NULL);
+  const char *outputDir = (*env)->GetStringUTFChars(env, outputDirJ, NULL);
+  // renditions 与 options 允许为 null，分别表示默认档位与默认的 MPEG-TS 分段
+  const char *renditions = renditionsJ ? (*env)->GetStringUTFChars(env, renditionsJ, NULL) : NULL;
+  const char *options = optionsJ ? (*env)->GetStringUTFChars(env, optionsJ, NULL) : NULL;
+
+  const char *result = build_hls_ladder(inputPath, outputDir, renditions, segmentDuration, options);
+
+  (*env)->ReleaseStringUTFChars(env, inputPathJ, inputPath);
+  (*env)->ReleaseStringUTFChars(env, outputDirJ, outputDir);
+  if (renditions)
+    (*env)->ReleaseStringUTFChars(env, renditionsJ, renditions);
+  if (options)
+    (*env)->ReleaseStringUTFChars(env, optionsJ, options);
+
+  return (*env)->NewStringUTF(env, result);
+}
+
+JNIEXPORT jstring JNICALL Java_com_litongjava_media_NativeMedia_hlsToMp4(
+  JNIEnv *env, jclass clazz,
+  jstring playlistPathJ,
+  jstring outputPathJ) {
+
+  const char *playlistPath = (*env)->GetStringUTFChars(env, playlistPathJ, NULL);
+  const char *outputPath = (*env)->GetStringUTFChars(env, outputPathJ, NULL);
+
+  const char *result = hls_to_mp4(playlistPath, outputPath);
+
+  (*env)->ReleaseStringUTFChars(env, playlistPathJ, playlistPath);
+  (*env)->ReleaseStringUTFChars(env, outputPathJ, outputPath);
+
+  return (*env)->NewStringUTF(env, result);
+}
@@ -9,6 +9,7 @@
 #include <libavutil/avutil.h>
 #include <libavutil/opt.h>
 #include "native_media.h"
+#include "hls_writer.h"
 
 #ifdef _WIN32
 
@@ -36,45 +37,29 @@ static void print_error(const char *msg, int errnum) {
  */
 const char *split_video_to_hls(const char *playlistUrl, const char *inputMp4Path,
                                const char *tsPattern, int segmentDuration) {
+  return split_video_to_hls_with_options(playlistUrl, inputMp4Path, tsPattern, segmentDuration, NULL);
+}
+
+const char *split_video_to_hls_with_options(const char *playlistUrl, const char *inputMp4Path,
+                                            const char *tsPattern, int segmentDuration, const char *options) {
   int ret = 0;
   AVFormatContext *ifmt_ctx = NULL;
-  AVFormatContext *ofmt_ctx = NULL;
-  AVDictionary *opts = NULL;
+  HlsWriter writer;
+  int writer_opened = 0;
   int *stream_mapping = NULL;
   int stream_mapping_size = 0;
   AVPacket pkt;
 
-  // 检查播放列表文件是否已经含有 "#EXT-X-ENDLIST"
-  {
-    FILE *checkFile = NULL;
-#ifdef _WIN32
-    int size_needed = MultiByteToWideChar(CP_UTF8, 0, playlistUrl, -1, NULL, 0);
-    wchar_t *wPlaylistUrl = (wchar_t *) malloc(size_needed * sizeof(wchar_t));
-    if (wPlaylistUrl) {
-      MultiByteToWideChar(CP_UTF8, 0, playlistUrl, -1, wPlaylistUrl, size_needed);
-      checkFile = _wfopen(wPlaylistUrl, L"r");
-      free(wPlaylistUrl);
-    }
-#else
-    checkFile = fopen(playlistUrl, "r");
-#endif
-    if (checkFile) {
-      fseek(checkFile, 0, SEEK_END);
-      long size = ftell(checkFile);
-      fseek(checkFile, 0, SEEK_SET);
-      char *content = (char *) malloc(size + 1);
-      if (content) {
-        fread(content, 1, size, checkFile);
-        content[size] = '\0';
-        if (strstr(content, "#EXT-X-ENDLIST") != NULL) {
-          fclose(checkFile);
-          free(content);
-          return "Playlist already contains #EXT-X-ENDLIST, cannot append";
-        }
-        free(content);
-      }
-      fclose(checkFile);
-    }
+  // 加载已有播放列表（逐行解析到内存模型），若已含 "#EXT-X-ENDLIST" 则不能再追加
+  ret = hls_writer_open(&writer, playlistUrl, tsPattern, 0, segmentDuration, options);
+  if (ret < 0) {
+    print_error("Unable to open HLS writer", ret);
+    return "HLS segmentation failed";
+  }
+  writer_opened = 1;
+  if (writer.playlist.ended) {
+    hls_writer_free(&writer);
+    return "Playlist already contains #EXT-X-ENDLIST, cannot append";
   }
 
   // 打开输入 MP4 文件并获取流信息
@@ -87,25 +72,6 @@ const char *split_video_to_hls(const char *playlistUrl, const char *inputMp4Path
     goto end;
   }
 
-  // 分配输出上下文，使用 "hls" Muxer，输出目标为 playlistUrl
-  ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, "hls", playlistUrl);
-  if (ret < 0 || !ofmt_ctx) {
-    print_error("Unable to allocate output context", ret);
-    goto end;
-  }
-
-  // 设置 HLS 选项：分段时长、起始编号、分段文件命名模板、追加模式、不限制列表长度、事件类型
-  {
-    char seg_time_str[16] = {0};
-    snprintf(seg_time_str, sizeof(seg_time_str), "%d", segmentDuration);
-    av_dict_set(&opts, "hls_time", seg_time_str, 0);
-
-    av_dict_set(&opts, "hls_segment_filename", tsPattern, 0);
-    av_dict_set(&opts, "hls_flags", "append_list", 0);
-    av_dict_set(&opts, "hls_list_size", "0", 0);
-    av_dict_set(&opts, "hls_playlist_type", "event", 0);
-  }
-
   // 为每个有效输入流（视频、音频、字幕）创建对应的输出流
   stream_mapping_size = ifmt_ctx->nb_streams;
   stream_mapping = av_malloc_array(stream_mapping_size, sizeof(int));
@@ -113,7 +79,7 @@ const char *split_video_to_hls(const char *playlistUrl, const char *inputMp4Path
     ret = AVERROR(ENOMEM);
     goto end;
   }
-  for (int i = 0, j = 0; i < ifmt_ctx->nb_streams; i++) {
+  for (int i = 0; i < ifmt_ctx->nb_streams; i++) {
     AVStream *in_stream = ifmt_ctx->streams[i];
     AVCodecParameters *in_codecpar = in_stream->codecpar;
     if (in_codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
@@ -122,66 +88,36 @@ const char *split_video_to_hls(const char *playlistUrl, const char *inputMp4Path
       stream_mapping[i] = -1;
       continue;
     }
-    stream_mapping[i] = j++;
-    AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
-    if (!out_stream) {
-      ret = AVERROR_UNKNOWN;
-      goto end;
+    ret = hls_writer_add_stream(&writer, in_codecpar, in_stream->time_base);
+    if (ret == AVERROR(ENOSYS) && in_codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE) {
+      // 当前分段格式无法携带该字幕编码，跳过
+      stream_mapping[i] = -1;
+      continue;
     }
-    ret = avcodec_parameters_copy(out_stream->codecpar, in_codecpar);
     if (ret < 0) {
       print_error("Failed to copy codec parameters", ret);
       goto end;
     }
-    out_stream->codecpar->codec_tag = 0;
-    out_stream->time_base = in_stream->time_base;
+    stream_mapping[i] = ret;
   }
 
-  // 打开输出文件（如果 Muxer 要求打开文件）
-  if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-#ifdef _WIN32
-    int size_needed = MultiByteToWideChar(CP_UTF8, 0, playlistUrl, -1, NULL, 0);
-    wchar_t *wPlaylistUrl = (wchar_t *) malloc(size_needed * sizeof(wchar_t));
-    if (wPlaylistUrl) {
-      MultiByteToWideChar(CP_UTF8, 0, playlistUrl, -1, wPlaylistUrl, size_needed);
-      ret = avio_open(&ofmt_ctx->pb, wPlaylistUrl, AVIO_FLAG_WRITE);
-      free(wPlaylistUrl);
-    }
-#else
-    ret = avio_open(&ofmt_ctx->pb, playlistUrl, AVIO_FLAG_WRITE);
-#endif
-    if (ret < 0) {
-      print_error("Unable to open output file", ret);
-      goto end;
-    }
-  }
-
-  // 写入 Muxer 文件头，启动生成 TS 分段及播放列表更新
-  ret = avformat_write_header(ofmt_ctx, &opts);
+  // 写入复用器头部并打开第一个分段
+  ret = hls_writer_write_header(&writer);
   if (ret < 0) {
     print_error("Failed to write header", ret);
     goto end;
   }
 
-  // 读取输入数据包，将时间戳转换后写入输出
+  // 读取输入数据包，分段写入器按声明的时间基（即输入流时间基）处理时间戳与切片
   while (av_read_frame(ifmt_ctx, &pkt) >= 0) {
     if (pkt.stream_index >= ifmt_ctx->nb_streams ||
         stream_mapping[pkt.stream_index] < 0) {
       av_packet_unref(&pkt);
       continue;
     }
-    AVStream *in_stream = ifmt_ctx->streams[pkt.stream_index];
-    AVStream *out_stream = ofmt_ctx->streams[stream_mapping[pkt.stream_index]];
-
-    pkt.pts = av_rescale_q_rnd(pkt.pts, in_stream->time_base, out_stream->time_base,
-                               AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-    pkt.dts = av_rescale_q_rnd(pkt.dts, in_stream->time_base, out_stream->time_base,
-                               AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-    pkt.duration = av_rescale_q(pkt.duration, in_stream->time_base, out_stream->time_base);
-    pkt.pos = -1;
     pkt.stream_index = stream_mapping[pkt.stream_index];
 
-    ret = av_interleaved_write_frame(ofmt_ctx, &pkt);
+    ret = hls_writer_write_packet(&writer, &pkt);
     if (ret < 0) {
       print_error("Failed to write packet", ret);
       break;
@@ -189,20 +125,21 @@ const char *split_video_to_hls(const char *playlistUrl, const char *inputMp4Path
     av_packet_unref(&pkt);
   }
 
-  // 结束时调用 trailer（本例中依然调用 trailer 以更新播放列表，如果需要避免写入 #EXT-X-ENDLIST 可注释）
-  av_write_trailer(ofmt_ctx);
+  // 结束时完成最后一个分段并写入 #EXT-X-ENDLIST（与 hls muxer 的 trailer 行为一致）
+  {
+    int close_ret = hls_writer_close(&writer, 1);
+    writer_opened = 0;
+    if (ret >= 0)
+      ret = close_ret;
+  }
 
   end:
   if (stream_mapping)
     av_freep(&stream_mapping);
   if (ifmt_ctx)
     avformat_close_input(&ifmt_ctx);
-  if (ofmt_ctx) {
-    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-      avio_closep(&ofmt_ctx->pb);
-    avformat_free_context(ofmt_ctx);
-  }
-  av_dict_free(&opts);
+  if (writer_opened)
+    hls_writer_free(&writer);
 
   if (ret < 0) {
     return "HLS segmentation failed";
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/bprint.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+#include <libavutil/samplefmt.h>
+#include "h264_bitstream.h"
+#include "native_thread.h"
+#include "silence_cache.h"
+
+#define SILENCE_CACHE_MAX_ENTRIES 32
+
+typedef struct SilenceCacheEntry {
+  SilenceClip clip;                 // 必须是第一个成员，SilenceClip* 与 SilenceCacheEntry* 可互相转换
+  char *key;
+  int refcount;                     // 缓存本身持有一个引用
+  struct SilenceCacheEntry *next;
+} SilenceCacheEntry;
+
+typedef struct TimedPacket {
+  AVPacket *pkt;
+  int64_t t;                        // dts（AV_TIME_BASE），用于交错排序
+} TimedPacket;
+
+static native_mutex_t cache_lock = NATIVE_MUTEX_INITIALIZER;
+static SilenceCacheEntry *cache_head = NULL; // 最近使用的在前
+static int cache_size = 0;
+
+static void free_entry(SilenceCacheEntry *entry) {
+  for (int i = 0; i < entry->clip.nb_packets; i++)
+    av_packet_free(&entry->clip.packets[i]);
+  av_freep(&entry->clip.packets);
+  av_freep(&entry->key);
+  av_free(entry);
+}
+
+static int append_packet(SilenceCacheEntry *entry, AVPacket *pkt) {
+  AVPacket **packets = av_realloc_array(entry->clip.packets, entry->clip.nb_packets + 1, sizeof(AVPacket *));
+  if (!packets)
+    return AVERROR(ENOMEM);
+  entry->clip.packets = packets;
+  AVPacket *copy = av_packet_alloc();
+  if (!copy)
+    return AVERROR(ENOMEM);
+  av_packet_move_ref(copy, pkt);
+  packets[entry->clip.nb_packets++] = copy;
+  return 0;
+}
+
+/*
+ * 目标流的 NAL 封装：extradata 为 avcC/hvcC（长度前缀格式）时返回长度字段的字节数，Annex B 返回 0。
+ * H.264 同时返回插入片段使用的 SPS/PPS id（与源不同，片段内的参数集不会覆盖源参数集）
+ */
+static int probe_target_bitstream(const AVCodecParameters *par, int *sps_id) {
+  int length_size = 0;
+  *sps_id = 0;
+  if (par->codec_id == AV_CODEC_ID_H264)
+    *sps_id = h264_probe_extradata(par, &length_size);
+  else if (par->codec_id == AV_CODEC_ID_HEVC && par->extradata && par->extradata_size >= 23 && par->extradata[0] == 1)
+    length_size = (par->extradata[21] & 3) + 1;
+  return length_size;
+}
+
+// 送入一帧（frame 为 NULL 表示冲刷），取出全部可用数据包存入片段
+// nal_length_size 非 0 时把编码器输出的 Annex B 码流转换为长度前缀格式，与目标流的 extradata 保持一致
+static int encode_frame(AVCodecContext *enc, const AVFrame *frame, const SilenceStreamSpec *spec,
+                        int stream_index, int nal_length_size, SilenceCacheEntry *entry) {
+  int ret = avcodec_send_frame(enc, frame);
+  if (ret < 0)
+    return ret;
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+    return AVERROR(ENOMEM);
+  while ((ret = avcodec_receive_packet(enc, pkt)) >= 0) {
+    // 丢弃编码器预热产生的负时间戳数据包，保证片段严格落在 [0, duration) 内
+    if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < 0) {
+      av_packet_unref(pkt);
+      continue;
+    }
+    av_packet_rescale_ts(pkt, enc->time_base, spec->time_base);
+    if (pkt->dts == AV_NOPTS_VALUE)
+      pkt->dts = pkt->pts;
+    pkt->stream_index = stream_index;
+    pkt->pos = -1;
+    if (nal_length_size > 0 && (ret = h264_annexb_to_length_prefixed(pkt, nal_length_size)) < 0)
+      break;
+    if ((ret = append_packet(entry, pkt)) < 0)
+      break;
+  }
+  av_packet_free(&pkt);
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static enum AVPixelFormat pick_pix_fmt(const AVCodec *codec, int wanted) {
+  if (!codec->pix_fmts)
+    return (enum AVPixelFormat) wanted;
+  for (const enum AVPixelFormat *p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+    if (*p == wanted)
+      return *p;
+  }
+  return codec->pix_fmts[0];
+}
+
+static enum AVSampleFormat pick_sample_fmt(const AVCodec *codec, int wanted) {
+  if (!codec->sample_fmts)
+    return (enum AVSampleFormat) wanted;
+  for (const enum AVSampleFormat *p = codec->sample_fmts; *p != AV_SAMPLE_FMT_NONE; p++) {
+    if (*p == wanted)
+      return *p;
+  }
+  return codec->sample_fmts[0];
+}
+
+// 编码黑帧视频：所有帧内容相同，只有首帧为关键帧，不使用 B 帧
+static int encode_black_video(const SilenceStreamSpec *spec, int stream_index, int64_t duration,
+                              SilenceCacheEntry *entry) {
+  const AVCodecParameters *par = spec->par;
+  const AVCodec *codec = avcodec_find_encoder(par->codec_id);
+  if (!codec)
+    return AVERROR_ENCODER_NOT_FOUND;
+  AVCodecContext *enc = avcodec_alloc_context3(codec);
+  AVFrame *frame = av_frame_alloc();
+  int ret = enc && frame ? 0 : AVERROR(ENOMEM);
+  if (ret < 0)
+    goto end;
+
+  AVRational frame_rate = spec->frame_rate.num > 0 && spec->frame_rate.den > 0 ? spec->frame_rate : (AVRational) {25, 1};
+  int64_t nb_frames = av_rescale_q(duration, AV_TIME_BASE_Q, av_inv_q(frame_rate));
+  if (nb_frames < 1)
+    nb_frames = 1;
+
+  enc->width = par->width;
+  enc->height = par->height;
+  enc->pix_fmt = pick_pix_fmt(codec, par->format);
+  enc->sample_aspect_ratio = par->sample_aspect_ratio;
+  enc->color_range = par->color_range;
+  enc->time_base = av_inv_q(frame_rate);
+  enc->framerate = frame_rate;
+  enc->gop_size = (int) nb_frames;
+  enc->max_b_frames = 0;
+  if (par->profile != FF_PROFILE_UNKNOWN)
+    enc->profile = par->profile;
+  // 参数集放在码流内（不设置 GLOBAL_HEADER），插入的片段可以独立解码；
+  // 片段的编码工具（如 CAVLC/CABAC）与源不同，x264 使用与源不同的 SPS/PPS id，之后的源帧仍引用源参数集
+  int sps_id = 0;
+  int nal_length_size = probe_target_bitstream(par, &sps_id);
+  AVDictionary *opts = NULL;
+  av_dict_set(&opts, "preset", "ultrafast", 0);
+  av_dict_set(&opts, "tune", "stillimage", 0);
+  if (!strcmp(codec->name, "libx264")) {
+    char params[64] = {0};
+    snprintf(params, sizeof(params), "sps-id=%d:bframes=0", sps_id);
+    av_dict_set(&opts, "x264-params", params, 0);
+  }
+  ret = avcodec_open2(enc, codec, &opts);
+  av_dict_free(&opts);
+  if (ret < 0)
+    goto end;
+
+  frame->format = enc->pix_fmt;
+  frame->width = enc->width;
+  frame->height = enc->height;
+  if ((ret = av_frame_get_buffer(frame, 0)) < 0)
+    goto end;
+  ptrdiff_t linesize[4] = {0};
+  for (int i = 0; i < 4; i++)
+    linesize[i] = frame->linesize[i];
+  ret = av_image_fill_black(frame->data, linesize, enc->pix_fmt,
+                            par->color_range == AVCOL_RANGE_JPEG ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG,
+                            enc->width, enc->height);
+  if (ret < 0)
+    goto end;
+
+  for (int64_t i = 0; i < nb_frames && ret >= 0; i++) {
+    frame->pts = i;
+    ret = encode_frame(enc, frame, spec, stream_index, nal_length_size, entry);
+  }
+  if (ret >= 0)
+    ret = encode_frame(enc, NULL, spec, stream_index, nal_length_size, entry);
+
+  end:
+  av_frame_free(&frame);
+  avcodec_free_context(&enc);
+  return ret;
+}
+
+// 编码静音音频：最后一帧按剩余样本数截短
+static int encode_silent_audio(const SilenceStreamSpec *spec, int stream_index, int64_t duration,
+                               SilenceCacheEntry *entry) {
+  const AVCodecParameters *par = spec->par;
+  const AVCodec *codec = avcodec_find_encoder(par->codec_id);
+  if (!codec)
+    return AVERROR_ENCODER_NOT_FOUND;
+  if (par->sample_rate <= 0)
+    return AVERROR(EINVAL);
+  AVCodecContext *enc = avcodec_alloc_context3(codec);
+  AVFrame *frame = av_frame_alloc();
+  int ret = enc && frame ? 0 : AVERROR(ENOMEM);
+  if (ret < 0)
+    goto end;
+
+  enc->sample_fmt = pick_sample_fmt(codec, par->format);
+  enc->sample_rate = par->sample_rate;
+  if (par->ch_layout.nb_channels > 0)
+    ret = av_channel_layout_copy(&enc->ch_layout, &par->ch_layout);
+  else
+    av_channel_layout_default(&enc->ch_layout, 2);
+  if (ret < 0)
+    goto end;
+  enc->time_base = (AVRational) {1, par->sample_rate};
+  enc->bit_rate = par->bit_rate > 0 ? par->bit_rate : 128000;
+  if (par->profile != FF_PROFILE_UNKNOWN)
+    enc->profile = par->profile;
+
+  if ((ret = avcodec_open2(enc, codec, NULL)) < 0)
+    goto end;
+
+  int frame_size = enc->frame_size > 0 ? enc->frame_size : 1024;
+  frame->format = enc->sample_fmt;
+  frame->sample_rate = enc->sample_rate;
+  frame->nb_samples = frame_size;
+  if ((ret = av_channel_layout_copy(&frame->ch_layout, &enc->ch_layout)) < 0 ||
+      (ret = av_frame_get_buffer(frame, 0)) < 0)
+    goto end;
+  av_samples_set_silence(frame->extended_data, 0, frame_size, enc->ch_layout.nb_channels, enc->sample_fmt);
+
+  int64_t total = av_rescale(duration, par->sample_rate, AV_TIME_BASE);
+  for (int64_t sent = 0; sent < total && ret >= 0; sent += frame->nb_samples) {
+    frame->nb_samples = (int) FFMIN((int64_t) frame_size, total - sent);
+    frame->pts = sent;
+    ret = encode_frame(enc, frame, spec, stream_index, 0, entry);
+  }
+  if (ret >= 0)
+    ret = encode_frame(enc, NULL, spec, stream_index, 0, entry);
+
+  end:
+  av_frame_free(&frame);
+  avcodec_free_context(&enc);
+  return ret;
+}
+
+static int compare_timed_packet(const void *a, const void *b) {
+  const TimedPacket *pa = (const TimedPacket *) a, *pb = (const TimedPacket *) b;
+  if (pa->t != pb->t)
+    return pa->t < pb->t ? -1 : 1;
+  return pa->pkt->stream_index - pb->pkt->stream_index;
+}
+
+// 按 dts 把各路流的数据包交错排列，便于调用方顺序写入
+static int interleave_packets(SilenceCacheEntry *entry, const SilenceStreamSpec *specs) {
+  int n = entry->clip.nb_packets;
+  if (n <= 1)
+    return 0;
+  TimedPacket *timed = av_malloc_array(n, sizeof(TimedPacket));
+  if (!timed)
+    return AVERROR(ENOMEM);
+  for (int i = 0; i < n; i++) {
+    AVPacket *pkt = entry->clip.packets[i];
+    timed[i].pkt = pkt;
+    timed[i].t = av_rescale_q(pkt->dts, specs[pkt->stream_index].time_base, AV_TIME_BASE_Q);
+  }
+  qsort(timed, n, sizeof(TimedPacket), compare_timed_packet);
+  for (int i = 0; i < n; i++)
+    entry->clip.packets[i] = timed[i].pkt;
+  av_free(timed);
+  return 0;
+}
+
+static char *build_key(const SilenceStreamSpec *specs, int nb_streams, int64_t quanta) {
+  AVBPrint bp;
+  av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+  for (int i = 0; i < nb_streams; i++) {
+    const AVCodecParameters *par = specs[i].par;
+    int sps_id = 0;
+    int length_size = probe_target_bitstream(par, &sps_id);
+    av_bprintf(&bp, "%d:%d:%d:%dx%d:%d:%d:%d:%d:%d:%d/%d:%d/%d;",
+               (int) par->codec_type, (int) par->codec_id, par->format, par->width, par->height,
+               par->sample_rate, par->ch_layout.nb_channels, par->profile, length_size, sps_id,
+               specs[i].time_base.num, specs[i].time_base.den, specs[i].frame_rate.num, specs[i].frame_rate.den);
+  }
+  av_bprintf(&bp, "%lld", (long long) quanta);
+  char *key = NULL;
+  if (av_bprint_finalize(&bp, &key) < 0)
+    return NULL;
+  return key;
+}
+
+// 在缓存中查找，命中时移到表头并增加引用（调用方需持有 cache_lock）
+static SilenceCacheEntry *lookup_locked(const char *key) {
+  SilenceCacheEntry *prev = NULL;
+  for (SilenceCacheEntry *e = cache_head; e; prev = e, e = e->next) {
+    if (strcmp(e->key, key) != 0)
+      continue;
+    if (prev) {
+      prev->next = e->next;
+      e->next = cache_head;
+      cache_head = e;
+    }
+    e->refcount++;
+    return e;
+  }
+  return NULL;
+}
+
+// 放入缓存表头，超出容量时淘汰最久未使用的条目（调用方需持有 cache_lock）
+static void insert_locked(SilenceCacheEntry *entry) {
+  entry->next = cache_head;
+  cache_head = entry;
+  if (++cache_size <= SILENCE_CACHE_MAX_ENTRIES)
+    return;
+  SilenceCacheEntry *prev = cache_head;
+  while (prev->next && prev->next->next)
+    prev = prev->next;
+  SilenceCacheEntry *victim = prev->next;
+  prev->next = NULL;
+  cache_size--;
+  if (--victim->refcount == 0)
+    free_entry(victim);
+}
+
+int silence_cache_get(const SilenceStreamSpec *specs, int nb_streams, double duration, SilenceClip **clip) {
+  *clip = NULL;
+  if (nb_streams <= 0 || nb_streams > SILENCE_MAX_STREAMS || !(duration > 0))
+    return AVERROR(EINVAL);
+  int64_t quanta = llround(duration * AV_TIME_BASE / SILENCE_DURATION_QUANTUM);
+  if (quanta < 1)
+    quanta = 1;
+
+  char *key = build_key(specs, nb_streams, quanta);
+  if (!key)
+    return AVERROR(ENOMEM);
+
+  native_mutex_lock(&cache_lock);
+  SilenceCacheEntry *entry = lookup_locked(key);
+  native_mutex_unlock(&cache_lock);
+  if (entry) {
+    av_free(key);
+    *clip = &entry->clip;
+    return 0;
+  }
+
+  // 未命中：在锁外编码，避免阻塞其他会话的插入
+  entry = av_mallocz(sizeof(SilenceCacheEntry));
+  if (!entry) {
+    av_free(key);
+    return AVERROR(ENOMEM);
+  }
+  entry->key = key;
+  entry->clip.duration = quanta * SILENCE_DURATION_QUANTUM;
+  int ret = 0;
+  for (int i = 0; i < nb_streams && ret >= 0; i++) {
+    enum AVMediaType type = specs[i].par->codec_type;
+    if (type == AVMEDIA_TYPE_VIDEO)
+      ret = encode_black_video(&specs[i], i, entry->clip.duration, entry);
+    else if (type == AVMEDIA_TYPE_AUDIO)
+      ret = encode_silent_audio(&specs[i], i, entry->clip.duration, entry);
+  }
+  if (ret >= 0)
+    ret = interleave_packets(entry, specs);
+  if (ret < 0) {
+    free_entry(entry);
+    return ret;
+  }
+
+  native_mutex_lock(&cache_lock);
+  // 其他线程可能已编码了相同的片段，优先使用已缓存的
+  SilenceCacheEntry *existing = lookup_locked(key);
+  if (existing) {
+    native_mutex_unlock(&cache_lock);
+    free_entry(entry);
+    *clip = &existing->clip;
+    return 0;
+  }
+  entry->refcount = 2; // 缓存 + 调用方
+  insert_locked(entry);
+  native_mutex_unlock(&cache_lock);
+  *clip = &entry->clip;
+  return 0;
+}
+
+void silence_clip_unref(SilenceClip **clip) {
+  if (!clip || !*clip)
+    return;
+  SilenceCacheEntry *entry = (SilenceCacheEntry *) *clip;
+  *clip = NULL;
+  native_mutex_lock(&cache_lock);
+  int remaining = --entry->refcount;
+  native_mutex_unlock(&cache_lock);
+  if (remaining == 0)
+    free_entry(entry);
+}
+
+void silence_cache_clear(void) {
+  native_mutex_lock(&cache_lock);
+  SilenceCacheEntry *e = cache_head;
+  cache_head = NULL;
+  cache_size = 0;
+  while (e) {
+    SilenceCacheEntry *next = e->next;
+    if (--e->refcount == 0)
+      free_entry(e);
+    e = next;
+  }
+  native_mutex_unlock(&cache_lock);
+}
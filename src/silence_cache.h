@@ -0,0 +1,47 @@
+#ifndef SILENCE_CACHE_H
+#define SILENCE_CACHE_H
+
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+/*
+ * 预编码静音片段缓存
+ *
+ * 按 (各路流编码参数, 时长量化值) 编码一次静音音频 + 黑帧视频并缓存编码后的数据包，
+ * 之后相同参数的插入只需重打时间戳后重新封装，不再调用编码器。
+ */
+
+#define SILENCE_MAX_STREAMS 8
+#define SILENCE_DURATION_QUANTUM (AV_TIME_BASE / 10) // 时长按 100ms 量化
+
+typedef struct SilenceStreamSpec {
+  const AVCodecParameters *par; // 目标流的编码参数（仅支持音频/视频）
+  AVRational time_base;         // 数据包时间戳使用的时间基
+  AVRational frame_rate;        // 视频帧率，未知时填 {0, 1}（默认 25fps）
+} SilenceStreamSpec;
+
+typedef struct SilenceClip {
+  AVPacket **packets;           // 按 dts 交错排列，stream_index 对应 SilenceStreamSpec 下标，时间戳从 0 开始
+  int nb_packets;
+  int64_t duration;             // 片段时长（AV_TIME_BASE）
+} SilenceClip;
+
+/**
+ * 取得匹配的静音片段（未命中时编码并放入缓存）
+ * @param duration 期望时长（秒），按 100ms 量化，至少为一个量化单位
+ * @param clip 成功时返回片段引用，用完需调用 silence_clip_unref
+ * @return 成功返回 0，失败返回负错误码（例如没有可用的编码器）
+ */
+int silence_cache_get(const SilenceStreamSpec *specs, int nb_streams, double duration, SilenceClip **clip);
+
+/**
+ * 释放 silence_cache_get 返回的片段引用
+ */
+void silence_clip_unref(SilenceClip **clip);
+
+/**
+ * 清空缓存（已被引用的片段在最后一个引用释放时才真正释放）
+ */
+void silence_cache_clear(void);
+
+#endif // SILENCE_CACHE_H
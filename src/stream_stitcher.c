@@ -0,0 +1,188 @@
+// stream_stitcher.c
+#include "stream_stitcher.h"
+
+#include <string.h>
+
+#include <libavutil/mathematics.h>
+#include "silence_cache.h"
+
+void stream_stitcher_init(StreamStitcher *s, int nb_streams, const enum AVMediaType *types,
+                          const AVRational *time_base, int64_t timeline_end) {
+  memset(s, 0, sizeof(*s));
+  s->nb_streams = FFMIN(nb_streams, STITCH_MAX_STREAMS);
+  for (int i = 0; i < s->nb_streams; i++) {
+    s->type[i] = types[i];
+    s->time_base[i] = time_base[i];
+    s->end[i] = AV_NOPTS_VALUE;
+    s->last_dts[i] = AV_NOPTS_VALUE;
+    s->trim_before[i] = AV_NOPTS_VALUE;
+    s->gap_end[i] = AV_NOPTS_VALUE;
+  }
+  s->timeline_end = timeline_end;
+}
+
+void stream_stitcher_begin(StreamStitcher *s, const int64_t *first_pts, const int64_t *first_dts) {
+  // 输入的起始时间：各路流第一个数据包显示时间的最小值
+  int64_t start = INT64_MAX;
+  for (int i = 0; i < s->nb_streams; i++) {
+    if (first_pts[i] != AV_NOPTS_VALUE)
+      start = FFMIN(start, av_rescale_q(first_pts[i], s->time_base[i], AV_TIME_BASE_Q));
+  }
+  if (start == INT64_MAX)
+    start = 0;
+  int64_t offset = s->timeline_end - start;
+
+  // 视频 dts 必须严格递增：B 帧造成的起始 dts 早于上一个输入的最后 dts 时，整体后移
+  for (int i = 0; i < s->nb_streams; i++) {
+    if (s->type[i] != AVMEDIA_TYPE_VIDEO || first_dts[i] == AV_NOPTS_VALUE || s->last_dts[i] == AV_NOPTS_VALUE)
+      continue;
+    int64_t mapped = first_dts[i] + av_rescale_q(offset, AV_TIME_BASE_Q, s->time_base[i]);
+    if (mapped <= s->last_dts[i])
+      offset += av_rescale_q_rnd(s->last_dts[i] + 1 - mapped, s->time_base[i], AV_TIME_BASE_Q, AV_ROUND_UP);
+  }
+
+  for (int i = 0; i < s->nb_streams; i++) {
+    s->offset[i] = av_rescale_q(offset, AV_TIME_BASE_Q, s->time_base[i]);
+    s->trim_before[i] = s->type[i] == AVMEDIA_TYPE_AUDIO ? s->end[i] : AV_NOPTS_VALUE;
+    s->gap_end[i] = first_pts[i] != AV_NOPTS_VALUE ? first_pts[i] + s->offset[i] : AV_NOPTS_VALUE;
+  }
+}
+
+int stream_stitcher_begin_input(StreamStitcher *s, AVFormatContext *ifmt_ctx, const int *in_index,
+                                AVPacket **head, int max_head, int *nb_head) {
+  int64_t first_pts[STITCH_MAX_STREAMS], first_dts[STITCH_MAX_STREAMS];
+  int missing = 0;
+  for (int i = 0; i < s->nb_streams; i++) {
+    first_pts[i] = AV_NOPTS_VALUE;
+    first_dts[i] = AV_NOPTS_VALUE;
+    missing += in_index[i] >= 0;
+  }
+
+  *nb_head = 0;
+  while (missing > 0 && *nb_head < max_head) {
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt)
+      return AVERROR(ENOMEM);
+    if (av_read_frame(ifmt_ctx, pkt) < 0) {
+      av_packet_free(&pkt);
+      break;
+    }
+    int i = 0;
+    while (i < s->nb_streams && in_index[i] != pkt->stream_index)
+      i++;
+    if (i == s->nb_streams) {
+      av_packet_free(&pkt);
+      continue;
+    }
+    head[(*nb_head)++] = pkt;
+    if (first_pts[i] == AV_NOPTS_VALUE && first_dts[i] == AV_NOPTS_VALUE) {
+      AVRational in_tb = ifmt_ctx->streams[pkt->stream_index]->time_base;
+      int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+      int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+      if (pts != AV_NOPTS_VALUE) {
+        first_pts[i] = av_rescale_q(pts, in_tb, s->time_base[i]);
+        first_dts[i] = av_rescale_q(dts, in_tb, s->time_base[i]);
+        missing--;
+      }
+    }
+  }
+  stream_stitcher_begin(s, first_pts, first_dts);
+  return 0;
+}
+
+int stream_stitcher_pad(StreamStitcher *s, int i, const AVCodecParameters *par, StitchPacketCallback cb,
+                        void *opaque) {
+  if (s->type[i] != AVMEDIA_TYPE_AUDIO || s->end[i] == AV_NOPTS_VALUE || s->gap_end[i] == AV_NOPTS_VALUE ||
+      s->gap_end[i] <= s->end[i])
+    return 0;
+  int64_t gap_start = s->end[i];
+  int64_t gap_end = s->gap_end[i];
+  // 空隙不足一帧时不补
+  int64_t frame = par->frame_size > 0 && par->sample_rate > 0
+                  ? av_rescale_q(par->frame_size, (AVRational) {1, par->sample_rate}, s->time_base[i]) : 0;
+  if (frame > 0 && gap_end - gap_start < frame)
+    return 0;
+
+  // 多取半个量化单位，保证缓存的片段覆盖整个空隙
+  SilenceStreamSpec spec = {par, s->time_base[i], {0, 1}};
+  double seconds = av_q2d(s->time_base[i]) * (double) (gap_end - gap_start) +
+                   SILENCE_DURATION_QUANTUM / (2.0 * AV_TIME_BASE);
+  SilenceClip *clip = NULL;
+  int ret = silence_cache_get(&spec, 1, seconds, &clip);
+  if (ret < 0)
+    return ret;
+
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt) {
+    silence_clip_unref(&clip);
+    return AVERROR(ENOMEM);
+  }
+  int written = 0;
+  for (int k = 0; k < clip->nb_packets; k++) {
+    const AVPacket *src = clip->packets[k];
+    int64_t duration = src->duration > 0 ? src->duration : frame;
+    if (gap_start + src->pts + duration > gap_end)
+      break;
+    if ((ret = av_packet_ref(pkt, src)) < 0)
+      break;
+    pkt->pts += gap_start;
+    pkt->dts += gap_start;
+    pkt->duration = duration;
+    pkt->stream_index = i;
+    s->last_dts[i] = pkt->dts;
+    s->end[i] = pkt->pts + duration;
+    ret = cb(opaque, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
+    written++;
+  }
+  av_packet_free(&pkt);
+  silence_clip_unref(&clip);
+  // 补齐后新输入的音频不再与之重叠
+  s->trim_before[i] = s->end[i];
+  return ret < 0 ? ret : written;
+}
+
+int stream_stitcher_map(StreamStitcher *s, int i, AVPacket *pkt) {
+  if (pkt->pts != AV_NOPTS_VALUE)
+    pkt->pts += s->offset[i];
+  if (pkt->dts != AV_NOPTS_VALUE)
+    pkt->dts += s->offset[i];
+
+  if (s->type[i] == AVMEDIA_TYPE_AUDIO) {
+    // 重叠超过半个数据包的音频包整包丢弃
+    int64_t half = pkt->duration > 0 ? pkt->duration / 2 : 0;
+    if (s->trim_before[i] != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE && pkt->pts + half < s->trim_before[i])
+      return 0;
+    if (s->last_dts[i] != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE && pkt->dts <= s->last_dts[i])
+      return 0;
+  }
+
+  if (pkt->dts != AV_NOPTS_VALUE)
+    s->last_dts[i] = pkt->dts;
+  int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+  if (ts != AV_NOPTS_VALUE) {
+    int64_t end = ts + FFMAX(pkt->duration, 0);
+    if (s->end[i] == AV_NOPTS_VALUE || end > s->end[i])
+      s->end[i] = end;
+  }
+  return 1;
+}
+
+int64_t stream_stitcher_end_input(StreamStitcher *s) {
+  int64_t video_end = AV_NOPTS_VALUE, max_end = AV_NOPTS_VALUE;
+  for (int i = 0; i < s->nb_streams; i++) {
+    if (s->end[i] == AV_NOPTS_VALUE)
+      continue;
+    int64_t end = av_rescale_q(s->end[i], s->time_base[i], AV_TIME_BASE_Q);
+    if (s->type[i] == AVMEDIA_TYPE_VIDEO && (video_end == AV_NOPTS_VALUE || end > video_end))
+      video_end = end;
+    if (max_end == AV_NOPTS_VALUE || end > max_end)
+      max_end = end;
+  }
+  int64_t end = video_end != AV_NOPTS_VALUE ? video_end : max_end;
+  if (end != AV_NOPTS_VALUE && end > s->timeline_end)
+    s->timeline_end = end;
+  return s->timeline_end;
+}
@@ -0,0 +1,77 @@
+#ifndef STREAM_STITCHER_H
+#define STREAM_STITCHER_H
+
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+/*
+ * 逐路流时间线拼接
+ *
+ * 顺序拼接多个输入时，每路输出流记录自己已写入数据的结束时间与最后的 dts。
+ * 新输入整体（保持输入内部的音视频相对位置）对齐到时间线末尾：有视频时为视频结束时间，否则为各流结束时间的最大值。
+ * 音频比视频短留下的空隙用缓存的静音数据包补齐，音频比视频长造成的重叠在新输入开头按数据包裁掉，
+ * 大量片段只重封装拼接时音视频不会逐渐错位。
+ */
+
+#define STITCH_MAX_STREAMS 8
+#define STITCH_HEAD_PACKETS 64 // 为确定各路流的起始时间戳，输入开头最多预读的数据包数
+
+typedef struct StreamStitcher {
+  int nb_streams;
+  enum AVMediaType type[STITCH_MAX_STREAMS];
+  AVRational time_base[STITCH_MAX_STREAMS];     // 输出数据包的时间基
+  int64_t end[STITCH_MAX_STREAMS];              // 已写入数据包的最大显示结束时间，AV_NOPTS_VALUE 表示尚无
+  int64_t last_dts[STITCH_MAX_STREAMS];         // 已写入的最后一个 dts，AV_NOPTS_VALUE 表示尚无
+  int64_t offset[STITCH_MAX_STREAMS];           // 当前输入的时间偏移
+  int64_t trim_before[STITCH_MAX_STREAMS];      // 当前输入中显示时间早于该值的音频包被裁掉
+  int64_t gap_end[STITCH_MAX_STREAMS];          // 当前输入该路流的起始时间（偏移后），用于补齐空隙
+  int64_t timeline_end;                         // 时间线末尾（AV_TIME_BASE）
+} StreamStitcher;
+
+// 输出数据包回调，回调结束后数据包会被释放引用
+typedef int (*StitchPacketCallback)(void *opaque, AVPacket *pkt);
+
+/**
+ * @param types 各路输出流的类型
+ * @param time_base 各路输出数据包的时间基
+ * @param timeline_end 初始时间线末尾（AV_TIME_BASE），例如恢复会话时已提交的时间偏移
+ */
+void stream_stitcher_init(StreamStitcher *s, int nb_streams, const enum AVMediaType *types,
+                          const AVRational *time_base, int64_t timeline_end);
+
+/**
+ * 开始一个新输入：各路流第一个数据包的 pts/dts 已转换到输出时间基，输入中没有的流填 AV_NOPTS_VALUE
+ */
+void stream_stitcher_begin(StreamStitcher *s, const int64_t *first_pts, const int64_t *first_dts);
+
+/**
+ * 预读输入开头的数据包直到每路映射的流都已出现（最多 max_head 个），据此调用 stream_stitcher_begin
+ * @param in_index 每路输出流对应的输入流序号，-1 表示无
+ * @param head 预读到的数据包（仅包含映射的流，按读取顺序），由调用方按顺序处理并释放
+ * @return 成功返回 0，失败返回负错误码
+ */
+int stream_stitcher_begin_input(StreamStitcher *s, AVFormatContext *ifmt_ctx, const int *in_index,
+                                AVPacket **head, int max_head, int *nb_head);
+
+/**
+ * 用缓存的静音数据包补齐音频流 i 在上一个输入结束与当前输入开始之间的空隙（只写入完整落在空隙内的数据包）
+ * 写出的数据包 stream_index 为 i，时间戳已是最终时间戳
+ * @param par 音频流的编码参数，非音频流直接返回 0
+ * @return 写入的数据包数，失败返回负错误码
+ */
+int stream_stitcher_pad(StreamStitcher *s, int i, const AVCodecParameters *par, StitchPacketCallback cb,
+                        void *opaque);
+
+/**
+ * 为输出流 i 的数据包（输出时间基、尚未加偏移）加上当前输入的偏移
+ * @return 1 表示写入，0 表示数据包与已写入的数据重叠，应丢弃
+ */
+int stream_stitcher_map(StreamStitcher *s, int i, AVPacket *pkt);
+
+/**
+ * 结束当前输入，返回更新后的时间线末尾（AV_TIME_BASE）
+ */
+int64_t stream_stitcher_end_input(StreamStitcher *s);
+
+#endif // STREAM_STITCHER_H
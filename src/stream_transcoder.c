@@ -0,0 +1,361 @@
+// stream_transcoder.c
+#include "stream_transcoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include "h264_bitstream.h"
+
+struct StreamTranscoder {
+  enum AVMediaType type;
+  AVCodecContext *dec;
+  AVCodecContext *enc;
+  AVFilterGraph *graph;         // 在解码出第一帧后按实际帧参数创建
+  AVFilterContext *src_ctx;
+  AVFilterContext *sink_ctx;
+  AVRational in_time_base;
+  AVRational out_time_base;
+  int nal_length_size;          // 目标为 avcC 封装时输出数据包的长度字节数，0 表示保持 Annex B
+  AVFrame *frame;
+  AVFrame *filt_frame;
+  AVPacket **pkts;              // 已编码、等待取出的数据包（FIFO）
+  int pkt_head;
+  int nb_pkts;
+  int pkt_capacity;
+  int flushed;                  // 已刷出全部数据
+};
+
+// 比较双方都已知的整数参数
+static int known_equal(int a, int b, int unknown) {
+  return a == unknown || b == unknown || a == b;
+}
+
+int stream_params_match(const AVCodecParameters *in, const AVCodecParameters *target) {
+  if (in->codec_type != target->codec_type || in->codec_id != target->codec_id)
+    return 0;
+  if (!known_equal(in->profile, target->profile, FF_PROFILE_UNKNOWN))
+    return 0;
+  if (in->codec_type == AVMEDIA_TYPE_VIDEO)
+    return in->width == target->width && in->height == target->height && known_equal(in->format, target->format, -1);
+  if (in->codec_type == AVMEDIA_TYPE_AUDIO)
+    return in->sample_rate == target->sample_rate && in->ch_layout.nb_channels == target->ch_layout.nb_channels &&
+           known_equal(in->format, target->format, -1);
+  return 1;
+}
+
+// 编码后的数据包放入 FIFO
+static int push_packet(StreamTranscoder *st, AVPacket *pkt) {
+  if (st->pkt_head > 0 && st->pkt_head == st->nb_pkts) {
+    st->pkt_head = 0;
+    st->nb_pkts = 0;
+  }
+  if (st->nb_pkts == st->pkt_capacity) {
+    int capacity = st->pkt_capacity ? st->pkt_capacity * 2 : 16;
+    AVPacket **pkts = (AVPacket **) realloc(st->pkts, capacity * sizeof(AVPacket *));
+    if (!pkts)
+      return AVERROR(ENOMEM);
+    st->pkts = pkts;
+    st->pkt_capacity = capacity;
+  }
+  AVPacket *copy = av_packet_alloc();
+  if (!copy)
+    return AVERROR(ENOMEM);
+  av_packet_move_ref(copy, pkt);
+  st->pkts[st->nb_pkts++] = copy;
+  return 0;
+}
+
+// 编码一帧并收集输出（frame 为 NULL 时刷出编码器）
+static int encode_frame(StreamTranscoder *st, AVFrame *frame) {
+  int ret = avcodec_send_frame(st->enc, frame);
+  if (ret < 0)
+    return ret;
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+    return AVERROR(ENOMEM);
+  while ((ret = avcodec_receive_packet(st->enc, pkt)) >= 0) {
+    av_packet_rescale_ts(pkt, st->enc->time_base, st->out_time_base);
+    if (st->nal_length_size && (ret = h264_annexb_to_length_prefixed(pkt, st->nal_length_size)) < 0) {
+      av_packet_unref(pkt);
+      break;
+    }
+    ret = push_packet(st, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
+  }
+  av_packet_free(&pkt);
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 取出滤镜输出的所有帧并编码
+static int drain_filter(StreamTranscoder *st) {
+  int ret;
+  AVRational sink_tb = av_buffersink_get_time_base(st->sink_ctx);
+  while ((ret = av_buffersink_get_frame(st->sink_ctx, st->filt_frame)) >= 0) {
+    AVFrame *f = st->filt_frame;
+    if (f->pts != AV_NOPTS_VALUE)
+      f->pts = av_rescale_q(f->pts, sink_tb, st->enc->time_base);
+    if (st->type == AVMEDIA_TYPE_VIDEO)
+      f->pict_type = AV_PICTURE_TYPE_NONE;
+    ret = encode_frame(st, f);
+    av_frame_unref(f);
+    if (ret < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 按第一帧的实际参数创建滤镜图，输出与编码器参数一致的帧
+static int open_filter_graph(StreamTranscoder *st, const AVFrame *frame) {
+  const AVCodecContext *enc = st->enc;
+  AVFilterInOut *outputs = NULL, *inputs = NULL;
+  char args[512] = {0}, filter_descr[512] = {0};
+  int ret;
+
+  st->graph = avfilter_graph_alloc();
+  if (!st->graph)
+    return AVERROR(ENOMEM);
+
+  if (st->type == AVMEDIA_TYPE_VIDEO) {
+    AVRational sar = frame->sample_aspect_ratio.num > 0 ? frame->sample_aspect_ratio : (AVRational) {1, 1};
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+             frame->width, frame->height, frame->format, st->in_time_base.num, st->in_time_base.den, sar.num, sar.den);
+    ret = avfilter_graph_create_filter(&st->src_ctx, avfilter_get_by_name("buffer"), "in", args, NULL, st->graph);
+    if (ret < 0)
+      return ret;
+    ret = avfilter_graph_create_filter(&st->sink_ctx, avfilter_get_by_name("buffersink"), "out", NULL, NULL, st->graph);
+    if (ret < 0)
+      return ret;
+    snprintf(filter_descr, sizeof(filter_descr), "scale=%d:%d,format=%s,setsar=%d/%d", enc->width, enc->height,
+             av_get_pix_fmt_name(enc->pix_fmt), enc->sample_aspect_ratio.num > 0 ? enc->sample_aspect_ratio.num : 1,
+             enc->sample_aspect_ratio.num > 0 ? enc->sample_aspect_ratio.den : 1);
+  } else {
+    char in_layout[64] = {0}, out_layout[64] = {0};
+    av_channel_layout_describe(&frame->ch_layout, in_layout, sizeof(in_layout));
+    av_channel_layout_describe(&enc->ch_layout, out_layout, sizeof(out_layout));
+    snprintf(args, sizeof(args), "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%s",
+             st->in_time_base.num, st->in_time_base.den, frame->sample_rate,
+             av_get_sample_fmt_name((enum AVSampleFormat) frame->format), in_layout);
+    ret = avfilter_graph_create_filter(&st->src_ctx, avfilter_get_by_name("abuffer"), "in", args, NULL, st->graph);
+    if (ret < 0)
+      return ret;
+    ret = avfilter_graph_create_filter(&st->sink_ctx, avfilter_get_by_name("abuffersink"), "out", NULL, NULL, st->graph);
+    if (ret < 0)
+      return ret;
+    snprintf(filter_descr, sizeof(filter_descr), "aresample=%d,aformat=sample_fmts=%s:channel_layouts=%s",
+             enc->sample_rate, av_get_sample_fmt_name(enc->sample_fmt), out_layout);
+  }
+
+  outputs = avfilter_inout_alloc();
+  inputs = avfilter_inout_alloc();
+  if (!outputs || !inputs) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  outputs->name = av_strdup("in");
+  outputs->filter_ctx = st->src_ctx;
+  outputs->pad_idx = 0;
+  outputs->next = NULL;
+  inputs->name = av_strdup("out");
+  inputs->filter_ctx = st->sink_ctx;
+  inputs->pad_idx = 0;
+  inputs->next = NULL;
+
+  ret = avfilter_graph_parse_ptr(st->graph, filter_descr, &inputs, &outputs, NULL);
+  if (ret >= 0)
+    ret = avfilter_graph_config(st->graph, NULL);
+  // 固定帧长的音频编码器（如 AAC）要求每帧样本数等于 frame_size
+  if (ret >= 0 && st->type == AVMEDIA_TYPE_AUDIO && enc->frame_size > 0 &&
+      !(enc->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+    av_buffersink_set_frame_size(st->sink_ctx, enc->frame_size);
+
+  end:
+  avfilter_inout_free(&inputs);
+  avfilter_inout_free(&outputs);
+  return ret;
+}
+
+// 取出解码器输出的所有帧送入滤镜
+static int drain_decoder(StreamTranscoder *st) {
+  int ret;
+  while ((ret = avcodec_receive_frame(st->dec, st->frame)) >= 0) {
+    st->frame->pts = st->frame->best_effort_timestamp;
+    if (!st->graph && (ret = open_filter_graph(st, st->frame)) < 0) {
+      av_frame_unref(st->frame);
+      return ret;
+    }
+    ret = av_buffersrc_add_frame(st->src_ctx, st->frame);
+    av_frame_unref(st->frame);
+    if (ret < 0 || (ret = drain_filter(st)) < 0)
+      return ret;
+  }
+  return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int open_encoder(StreamTranscoder *st, const AVCodecParameters *target, AVRational frame_rate, int gop_size) {
+  const AVCodec *codec = NULL;
+  int splice = 0;
+  if (target->codec_id == AV_CODEC_ID_H264 && (codec = avcodec_find_encoder_by_name("libx264")))
+    splice = 1;
+  else
+    codec = avcodec_find_encoder(target->codec_id);
+  if (!codec)
+    return AVERROR_ENCODER_NOT_FOUND;
+  // 目标的参数集在 extradata 中（avcC/hvcC）时，其他编码器在码流内输出的同 id 参数集会覆盖它，
+  // 拼接点之后流拷贝的帧将按错误的参数集解码，这种情况不能转码拼接
+  if (st->type == AVMEDIA_TYPE_VIDEO && !splice && target->extradata && target->extradata_size > 0 &&
+      target->extradata[0] == 1)
+    return AVERROR(ENOSYS);
+  st->enc = avcodec_alloc_context3(codec);
+  if (!st->enc)
+    return AVERROR(ENOMEM);
+  AVCodecContext *enc = st->enc;
+  int ret;
+
+  if (target->bit_rate > 0)
+    enc->bit_rate = target->bit_rate;
+  if (target->profile != FF_PROFILE_UNKNOWN)
+    enc->profile = target->profile;
+  if (target->level != FF_LEVEL_UNKNOWN)
+    enc->level = target->level;
+
+  if (st->type == AVMEDIA_TYPE_VIDEO) {
+    enc->width = target->width;
+    enc->height = target->height;
+    enc->pix_fmt = target->format >= 0 ? (enum AVPixelFormat) target->format
+                                       : codec->pix_fmts ? codec->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+    enc->sample_aspect_ratio = target->sample_aspect_ratio;
+    enc->time_base = st->out_time_base;
+    if (frame_rate.num > 0 && frame_rate.den > 0)
+      enc->framerate = frame_rate;
+    if (gop_size > 0)
+      enc->gop_size = gop_size;
+    // 不使用全局头：参数集随每个关键帧输出，拼接处的解码器可以直接切换到新的参数集
+  } else {
+    enc->sample_rate = target->sample_rate;
+    enc->sample_fmt = target->format >= 0 ? (enum AVSampleFormat) target->format
+                                          : codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    if (target->ch_layout.nb_channels > 0)
+      ret = av_channel_layout_copy(&enc->ch_layout, &target->ch_layout);
+    else
+      ret = av_channel_layout_copy(&enc->ch_layout, &(AVChannelLayout) AV_CHANNEL_LAYOUT_STEREO);
+    if (ret < 0)
+      return ret;
+    enc->time_base = (AVRational) {1, enc->sample_rate};
+  }
+
+  AVDictionary *opts = NULL;
+  if (splice) {
+    // 参数集使用与目标不同的 id，拼接后不会覆盖流拷贝部分依赖的参数集；
+    // 不用 B 帧，输出的 dts 不会早于拼接点；按目标的 NAL 封装输出
+    int sps_id = h264_probe_extradata(target, &st->nal_length_size);
+    char params[64] = {0};
+    snprintf(params, sizeof(params), "sps-id=%d:bframes=0", sps_id);
+    av_dict_set(&opts, "x264-params", params, 0);
+    enc->max_b_frames = 0;
+  }
+  ret = avcodec_open2(enc, codec, &opts);
+  av_dict_free(&opts);
+  return ret;
+}
+
+int stream_transcoder_open(StreamTranscoder **out, const AVCodecParameters *in_par, AVRational in_time_base,
+                           const AVCodecParameters *target, AVRational out_time_base,
+                           AVRational frame_rate, int gop_size) {
+  *out = NULL;
+  if (in_par->codec_type != target->codec_type ||
+      (target->codec_type != AVMEDIA_TYPE_VIDEO && target->codec_type != AVMEDIA_TYPE_AUDIO))
+    return AVERROR(EINVAL);
+
+  StreamTranscoder *st = (StreamTranscoder *) calloc(1, sizeof(StreamTranscoder));
+  if (!st)
+    return AVERROR(ENOMEM);
+  st->type = target->codec_type;
+  st->in_time_base = in_time_base;
+  st->out_time_base = out_time_base;
+
+  int ret;
+  const AVCodec *dec_codec = avcodec_find_decoder(in_par->codec_id);
+  if (!dec_codec) {
+    ret = AVERROR_DECODER_NOT_FOUND;
+    goto fail;
+  }
+  st->dec = avcodec_alloc_context3(dec_codec);
+  st->frame = av_frame_alloc();
+  st->filt_frame = av_frame_alloc();
+  if (!st->dec || !st->frame || !st->filt_frame) {
+    ret = AVERROR(ENOMEM);
+    goto fail;
+  }
+  if ((ret = avcodec_parameters_to_context(st->dec, in_par)) < 0)
+    goto fail;
+  st->dec->pkt_timebase = in_time_base;
+  st->dec->thread_count = 0;
+  if ((ret = avcodec_open2(st->dec, dec_codec, NULL)) < 0)
+    goto fail;
+  if ((ret = open_encoder(st, target, frame_rate, gop_size)) < 0)
+    goto fail;
+
+  *out = st;
+  return 0;
+
+  fail:
+  stream_transcoder_free(&st);
+  return ret;
+}
+
+int stream_transcoder_send(StreamTranscoder *st, const AVPacket *pkt) {
+  if (st->flushed)
+    return AVERROR_EOF;
+  int ret = avcodec_send_packet(st->dec, pkt);
+  if (ret < 0 && pkt)
+    return 0; // 损坏的数据包跳过
+  if ((ret = drain_decoder(st)) < 0 || pkt)
+    return ret;
+
+  // 输入结束：依次刷出滤镜与编码器
+  if (st->graph) {
+    if ((ret = av_buffersrc_add_frame(st->src_ctx, NULL)) < 0 || (ret = drain_filter(st)) < 0)
+      return ret;
+  }
+  if ((ret = encode_frame(st, NULL)) < 0)
+    return ret;
+  st->flushed = 1;
+  return 0;
+}
+
+int stream_transcoder_receive(StreamTranscoder *st, AVPacket *pkt) {
+  if (st->pkt_head < st->nb_pkts) {
+    AVPacket *head = st->pkts[st->pkt_head++];
+    av_packet_move_ref(pkt, head);
+    av_packet_free(&head);
+    return 0;
+  }
+  return st->flushed ? AVERROR_EOF : AVERROR(EAGAIN);
+}
+
+void stream_transcoder_free(StreamTranscoder **pst) {
+  StreamTranscoder *st = *pst;
+  if (!st)
+    return;
+  for (int i = st->pkt_head; i < st->nb_pkts; i++)
+    av_packet_free(&st->pkts[i]);
+  free(st->pkts);
+  avfilter_graph_free(&st->graph);
+  avcodec_free_context(&st->dec);
+  avcodec_free_context(&st->enc);
+  av_frame_free(&st->frame);
+  av_frame_free(&st->filt_frame);
+  free(st);
+  *pst = NULL;
+}
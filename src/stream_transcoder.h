@@ -0,0 +1,54 @@
+#ifndef STREAM_TRANSCODER_H
+#define STREAM_TRANSCODER_H
+
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+/*
+ * 单路流转码器：解码 -> 滤镜（缩放/像素格式 或 重采样/采样格式/声道布局/帧长）-> 按目标编码参数重新编码
+ *
+ * 用于向已确定输出参数的复用器追加参数不一致的输入：只有不匹配的流经过转码，其余流照常重封装。
+ * 目标为 H.264 时使用 libx264，参数集使用与目标不同的 id 并随关键帧输出，不使用 B 帧，
+ * 数据包按目标 extradata 的 NAL 封装（Annex B 或 avcC 长度前缀）输出，可与流拷贝的数据写入同一路输出流。
+ * 其他视频编码器无法指定参数集 id，目标参数集在 extradata 中（avcC/hvcC）时拒绝转码。
+ */
+
+typedef struct StreamTranscoder StreamTranscoder;
+
+/**
+ * 判断输入流能否不经转码直接写入目标流
+ * 视频比较编码、分辨率、像素格式与 profile；音频比较编码、采样率、声道数、采样格式与 profile
+ * （任一方未知的 profile/格式不参与比较）
+ * @return 1 表示兼容，0 表示需要转码
+ */
+int stream_params_match(const AVCodecParameters *in, const AVCodecParameters *target);
+
+/**
+ * 创建转码器
+ * @param in_par 输入流编码参数
+ * @param in_time_base 送入的数据包所用时间基
+ * @param target 目标流编码参数（编码、分辨率/像素格式、采样率/声道/采样格式、profile、level、码率）
+ * @param out_time_base 输出数据包所用时间基
+ * @param frame_rate 视频帧率（用于编码器码控），未知时填 {0, 1}
+ * @param gop_size 视频关键帧间隔（帧），0 表示使用编码器默认值
+ * @return 成功返回 0，失败返回负错误码（例如没有可用的解码器/编码器；无法与目标参数集拼接时返回 AVERROR(ENOSYS)）
+ */
+int stream_transcoder_open(StreamTranscoder **st, const AVCodecParameters *in_par, AVRational in_time_base,
+                           const AVCodecParameters *target, AVRational out_time_base,
+                           AVRational frame_rate, int gop_size);
+
+/**
+ * 送入一个输入数据包，pkt 为 NULL 表示输入结束（刷出解码器、滤镜与编码器）
+ * 无法解码的数据包会被跳过
+ */
+int stream_transcoder_send(StreamTranscoder *st, const AVPacket *pkt);
+
+/**
+ * 取出一个编码后的数据包（时间戳使用 out_time_base，与输入时间线一致）
+ * @return 0 表示取到数据包，AVERROR(EAGAIN) 表示需要送入更多数据，AVERROR_EOF 表示已全部刷出
+ */
+int stream_transcoder_receive(StreamTranscoder *st, AVPacket *pkt);
+
+void stream_transcoder_free(StreamTranscoder **st);
+
+#endif // STREAM_TRANSCODER_H
@@ -0,0 +1,556 @@
+// watermark_overlay.c
+#include "watermark_overlay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+#include "native_thread.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WATERMARK_HAVE_SSE2 1
+#else
+#define WATERMARK_HAVE_SSE2 0
+#endif
+
+#define WATERMARK_CACHE_MAX_ENTRIES 16
+#define WATERMARK_MAX_CANVAS 8192   // 渲染文字时画布的最大宽度
+
+typedef struct WatermarkCacheEntry {
+  WatermarkBitmap bitmap;           // 必须是第一个成员，WatermarkBitmap* 与 WatermarkCacheEntry* 可互相转换
+  char *key;
+  int refcount;                     // 缓存本身持有一个引用
+  struct WatermarkCacheEntry *next;
+} WatermarkCacheEntry;
+
+static native_mutex_t cache_lock = NATIVE_MUTEX_INITIALIZER;
+static WatermarkCacheEntry *cache_head = NULL; // 最近使用的在前
+static int cache_size = 0;
+
+static void free_entry(WatermarkCacheEntry *entry) {
+  av_freep(&entry->bitmap.rgba);
+  av_freep(&entry->key);
+  av_free(entry);
+}
+
+// 在缓存中查找，命中时移到表头并增加引用（调用方需持有 cache_lock）
+static WatermarkCacheEntry *lookup_locked(const char *key) {
+  WatermarkCacheEntry *prev = NULL;
+  for (WatermarkCacheEntry *e = cache_head; e; prev = e, e = e->next) {
+    if (strcmp(e->key, key) != 0)
+      continue;
+    if (prev) {
+      prev->next = e->next;
+      e->next = cache_head;
+      cache_head = e;
+    }
+    e->refcount++;
+    return e;
+  }
+  return NULL;
+}
+
+// 放入缓存表头，超出容量时淘汰最久未使用的条目（调用方需持有 cache_lock）
+static void insert_locked(WatermarkCacheEntry *entry) {
+  entry->next = cache_head;
+  cache_head = entry;
+  if (++cache_size <= WATERMARK_CACHE_MAX_ENTRIES)
+    return;
+  WatermarkCacheEntry *prev = cache_head;
+  while (prev->next && prev->next->next)
+    prev = prev->next;
+  WatermarkCacheEntry *victim = prev->next;
+  prev->next = NULL;
+  cache_size--;
+  if (--victim->refcount == 0)
+    free_entry(victim);
+}
+
+/*
+ * 从 RGBA 帧中取出 alpha 非零的最小矩形保存为位图
+ * premultiply 为 1 时按 alpha 预乘颜色（解码出的图片是非预乘的，drawtext 在透明画布上的结果已是预乘的）
+ */
+static int store_bitmap(WatermarkCacheEntry *entry, const AVFrame *frame, int premultiply) {
+  int left = frame->width, right = -1, top = frame->height, bottom = -1;
+  for (int y = 0; y < frame->height; y++) {
+    const uint8_t *row = frame->data[0] + (ptrdiff_t) y * frame->linesize[0];
+    for (int x = 0; x < frame->width; x++) {
+      if (!row[x * 4 + 3])
+        continue;
+      left = FFMIN(left, x);
+      right = FFMAX(right, x);
+      top = FFMIN(top, y);
+      bottom = FFMAX(bottom, y);
+    }
+  }
+  // 全透明时得到空位图，混合时什么也不做
+  if (right < 0)
+    return 0;
+
+  WatermarkBitmap *bmp = &entry->bitmap;
+  bmp->width = right - left + 1;
+  bmp->height = bottom - top + 1;
+  bmp->rgba = av_malloc((size_t) bmp->width * bmp->height * 4);
+  if (!bmp->rgba)
+    return AVERROR(ENOMEM);
+  for (int y = 0; y < bmp->height; y++) {
+    const uint8_t *src = frame->data[0] + (ptrdiff_t) (top + y) * frame->linesize[0] + left * 4;
+    uint8_t *dst = bmp->rgba + (size_t) y * bmp->width * 4;
+    memcpy(dst, src, (size_t) bmp->width * 4);
+    if (!premultiply)
+      continue;
+    for (int x = 0; x < bmp->width; x++) {
+      unsigned a = dst[x * 4 + 3];
+      for (int c = 0; c < 3; c++)
+        dst[x * 4 + c] = (uint8_t) ((dst[x * 4 + c] * a + 127) / 255);
+    }
+  }
+  return 0;
+}
+
+// 配置滤镜图并从 buffersink 取出一帧
+static int pull_frame(AVFilterGraph *graph, AVFilterContext *sink, AVFilterContext *src, AVFrame *input,
+                      AVFrame *output) {
+  int ret = avfilter_graph_config(graph, NULL);
+  if (ret < 0)
+    return ret;
+  if (src) {
+    if ((ret = av_buffersrc_add_frame(src, input)) < 0 || (ret = av_buffersrc_add_frame(src, NULL)) < 0)
+      return ret;
+  }
+  return av_buffersink_get_frame(sink, output);
+}
+
+// 创建 format=rgba -> buffersink 并把 last 接到 format 上
+static int append_rgba_sink(AVFilterGraph *graph, AVFilterContext *last, AVFilterContext **sink) {
+  AVFilterContext *format = NULL;
+  int ret = avfilter_graph_create_filter(&format, avfilter_get_by_name("format"), "rgba", "pix_fmts=rgba", NULL,
+                                         graph);
+  if (ret < 0)
+    return ret;
+  if ((ret = avfilter_graph_create_filter(sink, avfilter_get_by_name("buffersink"), "sink", NULL, NULL, graph)) < 0)
+    return ret;
+  if ((ret = avfilter_link(last, 0, format, 0)) < 0)
+    return ret;
+  return avfilter_link(format, 0, *sink, 0);
+}
+
+// UTF-8 字符数，用于估算画布宽度
+static int utf8_length(const char *s) {
+  int n = 0;
+  for (; *s; s++) {
+    if (((unsigned char) *s & 0xC0) != 0x80)
+      n++;
+  }
+  return n;
+}
+
+/*
+ * 在透明画布上用 drawtext 渲染一次文字：color(透明) -> format=rgba -> drawtext -> buffersink
+ * drawtext 的参数直接通过 AVOption 设置，文字与字体路径不需要按滤镜描述语法转义
+ */
+static int render_text(WatermarkCacheEntry *entry, const char *text, const char *font_file, int font_size) {
+  int canvas_w = FFMIN((utf8_length(text) + 2) * font_size, WATERMARK_MAX_CANVAS);
+  int canvas_h = font_size * 5 / 2;
+  char args[128], value[32];
+  AVFilterGraph *graph = avfilter_graph_alloc();
+  AVFrame *frame = av_frame_alloc();
+  AVFilterContext *canvas = NULL, *format = NULL, *drawtext = NULL, *sink = NULL;
+  const AVFilter *drawtext_filter = avfilter_get_by_name("drawtext");
+  int ret = 0;
+  if (!graph || !frame) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  if (!drawtext_filter) {
+    ret = AVERROR_FILTER_NOT_FOUND;
+    goto end;
+  }
+  graph->nb_threads = 1;
+
+  snprintf(args, sizeof(args), "c=black@0:s=%dx%d:r=1:d=1", canvas_w, canvas_h);
+  if ((ret = avfilter_graph_create_filter(&canvas, avfilter_get_by_name("color"), "canvas", args, NULL, graph)) < 0)
+    goto end;
+  if ((ret = avfilter_graph_create_filter(&format, avfilter_get_by_name("format"), "canvas_rgba", "pix_fmts=rgba",
+                                          NULL, graph)) < 0)
+    goto end;
+  drawtext = avfilter_graph_alloc_filter(graph, drawtext_filter, "text");
+  if (!drawtext) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  snprintf(value, sizeof(value), "%d", font_size);
+  if ((ret = av_opt_set(drawtext, "fontfile", font_file, 0)) < 0 ||
+      (ret = av_opt_set(drawtext, "text", text, 0)) < 0 ||
+      (ret = av_opt_set(drawtext, "fontsize", value, 0)) < 0 ||
+      (ret = av_opt_set(drawtext, "fontcolor", "white", 0)) < 0)
+    goto end;
+  snprintf(value, sizeof(value), "%d", font_size / 2);
+  if ((ret = av_opt_set(drawtext, "x", value, 0)) < 0 || (ret = av_opt_set(drawtext, "y", value, 0)) < 0)
+    goto end;
+  if ((ret = avfilter_init_str(drawtext, NULL)) < 0)
+    goto end;
+  if ((ret = avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"), "sink", NULL, NULL,
+                                          graph)) < 0)
+    goto end;
+  if ((ret = avfilter_link(canvas, 0, format, 0)) < 0 || (ret = avfilter_link(format, 0, drawtext, 0)) < 0 ||
+      (ret = avfilter_link(drawtext, 0, sink, 0)) < 0)
+    goto end;
+  if ((ret = pull_frame(graph, sink, NULL, NULL, frame)) < 0)
+    goto end;
+  ret = store_bitmap(entry, frame, 0);
+
+  end:
+  av_frame_free(&frame);
+  avfilter_graph_free(&graph);
+  return ret;
+}
+
+// 解码图片的第一帧
+static int decode_image(const char *path, AVFrame *frame) {
+  AVFormatContext *fmt_ctx = NULL;
+  AVCodecContext *dec_ctx = NULL;
+  AVPacket *pkt = av_packet_alloc();
+  int ret = pkt ? 0 : AVERROR(ENOMEM);
+  if (ret < 0)
+    goto end;
+  if ((ret = avformat_open_input(&fmt_ctx, path, NULL, NULL)) < 0 ||
+      (ret = avformat_find_stream_info(fmt_ctx, NULL)) < 0)
+    goto end;
+  int index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (index < 0) {
+    ret = index;
+    goto end;
+  }
+  const AVCodec *dec = avcodec_find_decoder(fmt_ctx->streams[index]->codecpar->codec_id);
+  if (!dec || !(dec_ctx = avcodec_alloc_context3(dec))) {
+    ret = AVERROR_DECODER_NOT_FOUND;
+    goto end;
+  }
+  if ((ret = avcodec_parameters_to_context(dec_ctx, fmt_ctx->streams[index]->codecpar)) < 0 ||
+      (ret = avcodec_open2(dec_ctx, dec, NULL)) < 0)
+    goto end;
+
+  int draining = 0;
+  for (;;) {
+    ret = avcodec_receive_frame(dec_ctx, frame);
+    if (ret != AVERROR(EAGAIN) || draining)
+      break;
+    ret = av_read_frame(fmt_ctx, pkt);
+    if (ret < 0) {
+      draining = 1;
+      ret = avcodec_send_packet(dec_ctx, NULL);
+    } else if (pkt->stream_index == index) {
+      ret = avcodec_send_packet(dec_ctx, pkt);
+    }
+    av_packet_unref(pkt);
+    if (ret < 0)
+      break;
+  }
+
+  end:
+  av_packet_free(&pkt);
+  avcodec_free_context(&dec_ctx);
+  avformat_close_input(&fmt_ctx);
+  return ret;
+}
+
+// 解码图片并转换为 RGBA：buffer -> format=rgba -> buffersink
+static int render_image(WatermarkCacheEntry *entry, const char *path) {
+  AVFrame *image = av_frame_alloc();
+  AVFrame *frame = av_frame_alloc();
+  AVFilterGraph *graph = avfilter_graph_alloc();
+  AVFilterContext *src = NULL, *sink = NULL;
+  char args[256];
+  int ret = 0;
+  if (!image || !frame || !graph) {
+    ret = AVERROR(ENOMEM);
+    goto end;
+  }
+  if ((ret = decode_image(path, image)) < 0)
+    goto end;
+  graph->nb_threads = 1;
+
+  snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1", image->width,
+           image->height, image->format);
+  if ((ret = avfilter_graph_create_filter(&src, avfilter_get_by_name("buffer"), "in", args, NULL, graph)) < 0 ||
+      (ret = append_rgba_sink(graph, src, &sink)) < 0)
+    goto end;
+  if ((ret = pull_frame(graph, sink, src, image, frame)) < 0)
+    goto end;
+  ret = store_bitmap(entry, frame, 1);
+
+  end:
+  av_frame_free(&image);
+  av_frame_free(&frame);
+  avfilter_graph_free(&graph);
+  return ret;
+}
+
+// 查找缓存，未命中时渲染并放入缓存（text 为 NULL 表示图标）
+static int get_bitmap(char *key, const char *text, const char *font_file, int font_size, const char *path,
+                      WatermarkBitmap **bitmap) {
+  native_mutex_lock(&cache_lock);
+  WatermarkCacheEntry *entry = lookup_locked(key);
+  native_mutex_unlock(&cache_lock);
+  if (entry) {
+    av_free(key);
+    *bitmap = &entry->bitmap;
+    return 0;
+  }
+
+  // 未命中：在锁外渲染，避免阻塞其他任务
+  entry = av_mallocz(sizeof(WatermarkCacheEntry));
+  if (!entry) {
+    av_free(key);
+    return AVERROR(ENOMEM);
+  }
+  entry->key = key;
+  int ret = text ? render_text(entry, text, font_file, font_size) : render_image(entry, path);
+  if (ret < 0) {
+    free_entry(entry);
+    return ret;
+  }
+
+  native_mutex_lock(&cache_lock);
+  // 其他线程可能已渲染了相同的水印，优先使用已缓存的
+  WatermarkCacheEntry *existing = lookup_locked(key);
+  if (existing) {
+    native_mutex_unlock(&cache_lock);
+    free_entry(entry);
+    *bitmap = &existing->bitmap;
+    return 0;
+  }
+  entry->refcount = 2; // 缓存 + 调用方
+  insert_locked(entry);
+  native_mutex_unlock(&cache_lock);
+  *bitmap = &entry->bitmap;
+  return 0;
+}
+
+int watermark_bitmap_get_text(const char *text, const char *font_file, int font_size, WatermarkBitmap **bitmap) {
+  *bitmap = NULL;
+  if (!text || !font_file || font_size <= 0)
+    return AVERROR(EINVAL);
+  char *key = av_asprintf("text\n%s\n%s\n%d", font_file, text, font_size);
+  if (!key)
+    return AVERROR(ENOMEM);
+  return get_bitmap(key, text, font_file, font_size, NULL, bitmap);
+}
+
+int watermark_bitmap_get_image(const char *path, WatermarkBitmap **bitmap) {
+  *bitmap = NULL;
+  if (!path || !path[0])
+    return AVERROR(EINVAL);
+  char *key = av_asprintf("image\n%s", path);
+  if (!key)
+    return AVERROR(ENOMEM);
+  return get_bitmap(key, NULL, NULL, 0, path, bitmap);
+}
+
+void watermark_bitmap_unref(WatermarkBitmap **bitmap) {
+  if (!bitmap || !*bitmap)
+    return;
+  WatermarkCacheEntry *entry = (WatermarkCacheEntry *) *bitmap;
+  *bitmap = NULL;
+  native_mutex_lock(&cache_lock);
+  int remaining = --entry->refcount;
+  native_mutex_unlock(&cache_lock);
+  if (remaining == 0)
+    free_entry(entry);
+}
+
+void watermark_bitmap_cache_clear(void) {
+  native_mutex_lock(&cache_lock);
+  WatermarkCacheEntry *e = cache_head;
+  cache_head = NULL;
+  cache_size = 0;
+  while (e) {
+    WatermarkCacheEntry *next = e->next;
+    if (--e->refcount == 0)
+      free_entry(e);
+    e = next;
+  }
+  native_mutex_unlock(&cache_lock);
+}
+
+// 支持的像素格式及其色度下采样，返回 0 表示不支持
+static int chroma_shift(enum AVPixelFormat format, int *shift_w, int *shift_h) {
+  switch (format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+      *shift_w = 1;
+      *shift_h = 1;
+      return 1;
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_YUVJ422P:
+      *shift_w = 1;
+      *shift_h = 0;
+      return 1;
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+      *shift_w = 0;
+      *shift_h = 0;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+int watermark_overlay_supported(enum AVPixelFormat format) {
+  int shift_w, shift_h;
+  return chroma_shift(format, &shift_w, &shift_h);
+}
+
+static uint8_t clip_u8(double v) {
+  return v <= 0 ? 0 : v >= 255 ? 255 : (uint8_t) (v + 0.5);
+}
+
+int watermark_overlay_init(WatermarkOverlay *overlay, const WatermarkBitmap *bitmap, const AVFrame *frame,
+                           int margin) {
+  memset(overlay, 0, sizeof(*overlay));
+  enum AVPixelFormat format = (enum AVPixelFormat) frame->format;
+  if (!chroma_shift(format, &overlay->chroma_shift_w, &overlay->chroma_shift_h))
+    return AVERROR(ENOSYS);
+  overlay->format = format;
+  overlay->frame_width = frame->width;
+  overlay->frame_height = frame->height;
+
+  // 右下角，左上角按色度采样对齐，超出帧的部分裁掉
+  int align_w = 1 << overlay->chroma_shift_w, align_h = 1 << overlay->chroma_shift_h;
+  int x = FFMAX(frame->width - bitmap->width - margin, 0) & ~(align_w - 1);
+  int y = FFMAX(frame->height - bitmap->height - margin, 0) & ~(align_h - 1);
+  overlay->x = x;
+  overlay->y = y;
+  overlay->width = FFMIN(bitmap->width, frame->width - x);
+  overlay->height = FFMIN(bitmap->height, frame->height - y);
+  if (overlay->width <= 0 || overlay->height <= 0) {
+    overlay->width = 0;
+    overlay->height = 0;
+    return 0;
+  }
+
+  // BT.709 / BT.601 系数，限定范围或全范围
+  int bt709 = frame->colorspace == AVCOL_SPC_BT709;
+  double kr = bt709 ? 0.2126 : 0.299, kb = bt709 ? 0.0722 : 0.114, kg = 1.0 - kr - kb;
+  int full = frame->color_range == AVCOL_RANGE_JPEG || format == AV_PIX_FMT_YUVJ420P ||
+             format == AV_PIX_FMT_YUVJ422P || format == AV_PIX_FMT_YUVJ444P;
+  double y_scale = full ? 1.0 : 219.0 / 255.0, y_offset = full ? 0 : 16;
+  double c_scale = full ? 1.0 : 224.0 / 255.0;
+
+  int w = overlay->width, h = overlay->height;
+  int cw = (w + align_w - 1) >> overlay->chroma_shift_w, ch = (h + align_h - 1) >> overlay->chroma_shift_h;
+  overlay->linesize[0] = w;
+  overlay->linesize[1] = cw;
+  overlay->planes[0] = av_malloc((size_t) w * h);
+  overlay->alpha[0] = av_malloc((size_t) w * h);
+  overlay->planes[1] = av_malloc((size_t) cw * ch);
+  overlay->planes[2] = av_malloc((size_t) cw * ch);
+  overlay->alpha[1] = av_malloc((size_t) cw * ch);
+  // 色度按块累加后取平均
+  double *acc = av_mallocz((size_t) cw * ch * 3 * sizeof(double));
+  if (!overlay->planes[0] || !overlay->alpha[0] || !overlay->planes[1] || !overlay->planes[2] ||
+      !overlay->alpha[1] || !acc) {
+    av_free(acc);
+    watermark_overlay_uninit(overlay);
+    return AVERROR(ENOMEM);
+  }
+
+  // 颜色已按 alpha 预乘，偏移量同样按 alpha 预乘：p = a * Y，混合时 dst = dst * (1 - a) + p
+  for (int j = 0; j < h; j++) {
+    const uint8_t *src = bitmap->rgba + (size_t) j * bitmap->width * 4;
+    for (int i = 0; i < w; i++) {
+      double r = src[i * 4], g = src[i * 4 + 1], b = src[i * 4 + 2], a = src[i * 4 + 3];
+      double luma = kr * r + kg * g + kb * b;
+      overlay->planes[0][j * w + i] = clip_u8(y_offset * a / 255.0 + y_scale * luma);
+      overlay->alpha[0][j * w + i] = (uint8_t) a;
+      double *c = acc + ((size_t) (j >> overlay->chroma_shift_h) * cw + (i >> overlay->chroma_shift_w)) * 3;
+      c[0] += 128.0 * a / 255.0 + c_scale * (b - luma) / (2.0 * (1.0 - kb));
+      c[1] += 128.0 * a / 255.0 + c_scale * (r - luma) / (2.0 * (1.0 - kr));
+      c[2] += a;
+    }
+  }
+  double block = (double) (align_w * align_h);
+  for (int k = 0; k < cw * ch; k++) {
+    overlay->planes[1][k] = clip_u8(acc[k * 3] / block);
+    overlay->planes[2][k] = clip_u8(acc[k * 3 + 1] / block);
+    overlay->alpha[1][k] = clip_u8(acc[k * 3 + 2] / block);
+  }
+  av_free(acc);
+  return 0;
+}
+
+// dst = dst * (255 - a) / 255 + src，src 为预乘后的值
+static void blend_row(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int w) {
+  int i = 0;
+#if WATERMARK_HAVE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i v255 = _mm_set1_epi16(255);
+  const __m128i v128 = _mm_set1_epi16(128);
+  for (; i + 16 <= w; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (alpha + i));
+    // 文字之间大部分是透明的，整块透明时跳过
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+      continue;
+    __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+    __m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                                               _mm_sub_epi16(v255, _mm_unpacklo_epi8(a, zero))), v128);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                                               _mm_sub_epi16(v255, _mm_unpackhi_epi8(a, zero))), v128);
+    // x / 255 ≈ (x + (x >> 8)) >> 8（x 已加 128 取整），x 最大 65153，不会溢出 16 位无符号
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    _mm_storeu_si128((__m128i *) (dst + i), _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+  }
+#endif
+  for (; i < w; i++) {
+    if (!alpha[i])
+      continue;
+    unsigned t = dst[i] * (255u - alpha[i]) + 128;
+    unsigned v = ((t + (t >> 8)) >> 8) + src[i];
+    dst[i] = (uint8_t) (v > 255 ? 255 : v);
+  }
+}
+
+static void blend_plane(uint8_t *dst, int dst_linesize, const uint8_t *src, const uint8_t *alpha, int src_linesize,
+                        int w, int h) {
+  for (int j = 0; j < h; j++)
+    blend_row(dst + (ptrdiff_t) j * dst_linesize, src + (size_t) j * src_linesize,
+              alpha + (size_t) j * src_linesize, w);
+}
+
+int watermark_overlay_blend(const WatermarkOverlay *overlay, AVFrame *frame) {
+  if (frame->format != overlay->format || frame->width != overlay->frame_width ||
+      frame->height != overlay->frame_height)
+    return AVERROR(EINVAL);
+  if (overlay->width <= 0 || overlay->height <= 0)
+    return 0;
+  int sw = overlay->chroma_shift_w, sh = overlay->chroma_shift_h;
+  int cw = overlay->linesize[1];
+  // 色度平面的高度不超过帧的色度高度
+  int ch = FFMIN((overlay->height + (1 << sh) - 1) >> sh, ((frame->height + (1 << sh) - 1) >> sh) - (overlay->y >> sh));
+
+  blend_plane(frame->data[0] + (ptrdiff_t) overlay->y * frame->linesize[0] + overlay->x, frame->linesize[0],
+              overlay->planes[0], overlay->alpha[0], overlay->linesize[0], overlay->width, overlay->height);
+  for (int p = 1; p < 3; p++) {
+    uint8_t *dst = frame->data[p] + (ptrdiff_t) (overlay->y >> sh) * frame->linesize[p] + (overlay->x >> sw);
+    blend_plane(dst, frame->linesize[p], overlay->planes[p], overlay->alpha[1], cw, cw, ch);
+  }
+  return 0;
+}
+
+void watermark_overlay_uninit(WatermarkOverlay *overlay) {
+  for (int i = 0; i < 3; i++)
+    av_freep(&overlay->planes[i]);
+  for (int i = 0; i < 2; i++)
+    av_freep(&overlay->alpha[i]);
+}
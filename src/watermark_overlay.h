@@ -0,0 +1,76 @@
+#ifndef WATERMARK_OVERLAY_H
+#define WATERMARK_OVERLAY_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+/*
+ * 预渲染水印叠加
+ *
+ * 静态水印（文字或 PNG 图标）只渲染一次为预乘 alpha 的 RGBA 位图，按 (文字, 字体, 字号) 或图标路径缓存。
+ * 每个任务再按视频的像素格式与色彩空间转换一次为预乘的 YUVA 平面，之后每帧只在水印所在区域
+ * 直接混合到解码后的 YUV 平面（SSE2 可用时每次处理 16 个像素），不再经过 libavfilter。
+ */
+
+typedef struct WatermarkBitmap {
+  int width;
+  int height;
+  uint8_t *rgba;                // 预乘 alpha 的 RGBA，行宽 width * 4
+} WatermarkBitmap;
+
+typedef struct WatermarkOverlay {
+  enum AVPixelFormat format;    // 目标帧的像素格式
+  int frame_width;
+  int frame_height;
+  int x, y;                     // 水印左上角在帧中的位置（按色度采样对齐）
+  int width, height;            // 实际混合的区域（超出帧的部分已裁掉）
+  int chroma_shift_w, chroma_shift_h;
+  uint8_t *planes[3];           // 预乘的 Y、U、V
+  uint8_t *alpha[2];            // 亮度分辨率与色度分辨率的 alpha
+  int linesize[2];              // 亮度与色度平面的行宽
+} WatermarkOverlay;
+
+/**
+ * 取得文字水印位图（未命中时用 drawtext 渲染一次并放入缓存）
+ * @param bitmap 成功时返回位图引用，用完需调用 watermark_bitmap_unref
+ * @return 成功返回 0，失败返回负错误码（例如没有 drawtext 滤镜或字体文件不可用）
+ */
+int watermark_bitmap_get_text(const char *text, const char *font_file, int font_size, WatermarkBitmap **bitmap);
+
+/**
+ * 取得图标水印位图（PNG 等图片，取第一帧，未命中时解码一次并放入缓存）
+ */
+int watermark_bitmap_get_image(const char *path, WatermarkBitmap **bitmap);
+
+/**
+ * 释放 watermark_bitmap_get_* 返回的位图引用
+ */
+void watermark_bitmap_unref(WatermarkBitmap **bitmap);
+
+/**
+ * 清空缓存（已被引用的位图在最后一个引用释放时才真正释放）
+ */
+void watermark_bitmap_cache_clear(void);
+
+/**
+ * 是否支持直接混合到该像素格式的帧（8 位平面 YUV 4:2:0 / 4:2:2 / 4:4:4）
+ */
+int watermark_overlay_supported(enum AVPixelFormat format);
+
+/**
+ * 按帧的尺寸、像素格式与色彩空间准备叠加数据，水印放在右下角、距边缘 margin 像素
+ * @param frame 用于取得尺寸、像素格式、色彩空间与范围的参考帧
+ * @return 成功返回 0，像素格式不支持返回 AVERROR(ENOSYS)
+ */
+int watermark_overlay_init(WatermarkOverlay *overlay, const WatermarkBitmap *bitmap, const AVFrame *frame, int margin);
+
+/**
+ * 把水印混合到帧中（帧必须可写，尺寸与像素格式与初始化时一致）
+ * @return 成功返回 0，帧不匹配返回 AVERROR(EINVAL)
+ */
+int watermark_overlay_blend(const WatermarkOverlay *overlay, AVFrame *frame);
+
+void watermark_overlay_uninit(WatermarkOverlay *overlay);
+
+#endif // WATERMARK_OVERLAY_H